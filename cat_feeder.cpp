@@ -1,9 +1,19 @@
 #include <Arduino.h>
 #include "cat_feeder.h"
+#include "lwip/sockets.h"
+#include "freertos/semphr.h"
+#include <sys/time.h>
+
+// mbedtls 3.x hides struct members behind MBEDTLS_PRIVATE(); 2.x has no such macro.
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
 
 // Single owning definitions:
 uint32_t lastPollMs   = 0;
 long     lastUpdateId = -1;
+uint32_t lastReactionLatencyMs = 0;
+int32_t  lastCaptureAgeMs = 0;
 
 // Also define PHOTO_CAPTION here (since it's only declared extern in the header)
 const char* PHOTO_CAPTION = "ESP32-CAM snapshot 📸";
@@ -22,448 +32,3745 @@ void flashBlink(int times, int on_ms, int off_ms) {
   }
 }
 
-bool ensureWiFi() {
-  if (WiFi.status() == WL_CONNECTED) return true;
-  Serial.println("[WiFi] Reconnecting...");
+// ------------ RTC-retained state (survives deep sleep, lost on power-off) ------------
+
+#define RTC_STATE_MAGIC    0xCA7FEED5UL
+#define RTC_STATE_VERSION  11
+
+struct RtcState {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  // Wi-Fi fast-reconnect cache
+  uint8_t  bssid[6];
+  uint8_t  channel;
+  uint8_t  has_ip;
+  uint32_t ip, gateway, subnet, dns;
+  uint32_t wakes_since_dhcp;
+  uint32_t dhcp_at_s;          // rtcClockS() when the cached lease was obtained
+  // Telegram
+  int32_t  last_update_id;
+  // Counters
+  uint32_t wake_count;
+  uint32_t fast_ok;
+  uint32_t fast_fail;
+  uint32_t last_fast_ms;
+  uint32_t last_full_ms;
+  // Adaptive capture: learned uplink and JPEG size vs. the ladder's estimates
+  uint32_t uplink_bps;
+  int8_t   uplink_rssi;
+  uint8_t  capture_rung;
+  uint16_t jpeg_scale_pct;
+  // PIR verifier: background luma block means and how many wakes it rejected
+  uint8_t  motion_bg_valid;
+  uint8_t  motion_bg_static;   // wakes in a row whose frames agreed but differed from the background
+  uint8_t  motion_bg[MOTION_GRID_W * MOTION_GRID_H];
+  uint32_t pir_rejected;
+  // Tracing aggregates across wakes
+  struct {
+    uint32_t count;
+    uint32_t sum;
+    uint32_t max;
+    uint16_t hist[TRACE_HIST_BUCKETS];
+  } trace[TR_KIND_COUNT];
+  uint32_t heap_low_water;
+  uint32_t psram_low_water;
+  // Awake-window energy estimate
+  uint32_t last_awake_ms;
+  uint32_t last_charge_uah;
+  uint32_t total_charge_uah;
+  // Timelapse mode (timer wakes)
+  uint8_t  timelapse_on;
+  // Progressive snap: last preview number, so a button from an earlier wake never matches
+  uint32_t preview_seq;
+  // Serialized mbedtls session for TLS resumption on the next wake
+  uint16_t tls_session_len;
+  uint8_t  tls_session[TLS_SESSION_BLOB_MAX];
+  uint32_t crc;  // over everything above
+};
+
+RTC_DATA_ATTR static RtcState s_rtc;
+static bool     s_rtcValid = false;
+static bool     s_fastConnect = false;
+static uint32_t s_wifiStartMs = 0;
+static uint32_t s_wifiConnectMs = 0;  // how long this wake's association + IP took
+static bool     s_fastVerified = false; // a TLS connect went through on the cached lease
+static portMUX_TYPE s_wifiMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t rtcStateCrc() {
+  return esp_rom_crc32_le(0, (const uint8_t*)&s_rtc, offsetof(RtcState, crc));
+}
+
+bool rtcStateRestore() {
+  s_rtcValid = s_rtc.magic == RTC_STATE_MAGIC && s_rtc.version == RTC_STATE_VERSION &&
+               s_rtc.size == sizeof(RtcState) && s_rtc.crc == rtcStateCrc();
+  if (!s_rtcValid) {
+    // Power-on, firmware change or corruption: start from a clean block.
+    memset(&s_rtc, 0, sizeof(s_rtc));
+    s_rtc.magic = RTC_STATE_MAGIC;
+    s_rtc.version = RTC_STATE_VERSION;
+    s_rtc.size = sizeof(RtcState);
+    s_rtc.last_update_id = -1;
+    s_rtc.timelapse_on = TIMELAPSE_ENABLED;
+  }
+  s_rtc.wake_count++;
+  if (s_rtc.last_update_id > lastUpdateId) lastUpdateId = s_rtc.last_update_id;
+  Serial.printf("[RTC] State %s, wake #%lu, lastUpdateId %ld\n", s_rtcValid ? "restored" : "reset",
+                (unsigned long)s_rtc.wake_count, lastUpdateId);
+  return s_rtcValid;
+}
+
+void rtcStateSave() {
+  s_rtc.last_update_id = (int32_t)lastUpdateId;
+  s_rtc.crc = rtcStateCrc();
+}
+
+uint32_t rtcWakeCount() {
+  return s_rtc.wake_count;
+}
+
+// System time runs from the RTC timer, which keeps counting through deep sleep.
+static uint32_t rtcClockS() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (uint32_t)tv.tv_sec;
+}
+
+// Remember where we associated and which lease we got, for the next wake.
+static void rememberWiFi() {
+  const uint8_t* bssid = WiFi.BSSID();
+  if (bssid) memcpy(s_rtc.bssid, bssid, sizeof(s_rtc.bssid));
+  s_rtc.channel = (uint8_t)WiFi.channel();
+  if (!s_fastConnect) {
+    s_rtc.ip = WiFi.localIP();
+    s_rtc.gateway = WiFi.gatewayIP();
+    s_rtc.subnet = WiFi.subnetMask();
+    s_rtc.dns = WiFi.dnsIP();
+    s_rtc.has_ip = s_rtc.ip != 0;
+    s_rtc.wakes_since_dhcp = 0;
+    s_rtc.dhcp_at_s = rtcClockS();
+  }
+}
+
+static bool canFastConnect() {
+  return s_rtcValid && s_rtc.channel != 0 && s_rtc.has_ip &&
+         s_rtc.wakes_since_dhcp < WIFI_DHCP_REFRESH_WAKES &&
+         rtcClockS() - s_rtc.dhcp_at_s < WIFI_LEASE_REUSE_S;
+}
+
+static void beginFullConnect() {
+  s_fastConnect = false;
+  WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // DHCP
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+}
+
+void startWiFi() {
+  WiFi.persistent(false); // the RTC block is our cache; skip NVS writes
   WiFi.disconnect();
   WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  uint8_t tries = 0;
-  while (WiFi.status() != WL_CONNECTED && tries < 40) {
-    delay(250);
-    Serial.print('.');
-    tries++;
+  s_wifiStartMs = millis();
+  if (canFastConnect()) {
+    // Channel-locked association to the known AP, reusing the previous lease (no scan, no DHCP).
+    s_fastConnect = true;
+    s_rtc.wakes_since_dhcp++;
+    WiFi.config(IPAddress(s_rtc.ip), IPAddress(s_rtc.gateway), IPAddress(s_rtc.subnet),
+                IPAddress(s_rtc.dns));
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD, s_rtc.channel, s_rtc.bssid);
+  } else {
+    beginFullConnect();
+  }
+}
+
+bool waitWiFi(uint32_t timeout_ms) {
+  uint32_t start = millis();
+  uint32_t assoc_ms = 0;
+  while (WiFi.status() != WL_CONNECTED && millis() - start < timeout_ms) {
+    wifi_ap_record_t ap;
+    if (!assoc_ms && esp_wifi_sta_get_ap_info(&ap) == ESP_OK) assoc_ms = millis();
+    if (s_fastConnect && millis() - s_wifiStartMs > WIFI_FAST_TIMEOUT_MS) {
+      // AP moved channel or lease is gone: drop the cache and do it the slow way.
+      Serial.println("[WiFi] Cached reconnect failed, falling back to scan + DHCP");
+      s_rtc.fast_fail++;
+      s_rtc.has_ip = 0;
+      WiFi.disconnect();
+      beginFullConnect();
+    }
+    delay(10);
   }
-  Serial.println();
   if (WiFi.status() == WL_CONNECTED) {
+    const uint32_t took = millis() - s_wifiStartMs;
+    s_wifiConnectMs = took;
+    if (s_fastConnect) {
+      s_rtc.fast_ok++;
+      s_rtc.last_fast_ms = took;
+    } else {
+      s_rtc.last_full_ms = took;
+    }
+    rememberWiFi();
+    if (!assoc_ms) assoc_ms = millis(); // associated and got the IP within one poll
+    traceValue(TR_WIFI_ASSOC, assoc_ms - s_wifiStartMs);
+    traceSpan(TR_DHCP, assoc_ms);
     Serial.print("[WiFi] Connected. IP: ");
     Serial.println(WiFi.localIP());
     Serial.println("RSSI:");
     Serial.println(WiFi.RSSI());
+    Serial.printf("[WiFi] %s reconnect in %lu ms (last cached: %lu ms, last full: %lu ms)\n",
+                  s_fastConnect ? "Cached" : "Full", (unsigned long)took,
+                  (unsigned long)s_rtc.last_fast_ms, (unsigned long)s_rtc.last_full_ms);
     return true;
   }
   Serial.println("[WiFi] Failed to connect.");
   return false;
 }
 
-void sendPirAlertButtons() {
-  telegramSendMessageWithButtons("🚨 Motion detected. What should I do?");
+bool wifiDropCachedLease() {
+  // Only the first failure on the cached lease redoes DHCP; both sessions may report it.
+  portENTER_CRITICAL(&s_wifiMux);
+  const bool mine = s_fastConnect && !s_fastVerified;
+  if (mine) s_fastVerified = true;
+  portEXIT_CRITICAL(&s_wifiMux);
+  if (!mine) return false;
+  Serial.println("[WiFi] No route on the cached lease, redoing DHCP");
+  s_rtc.fast_fail++;
+  s_rtc.has_ip = 0;
+  WiFi.disconnect();
+  beginFullConnect();
+  return waitWiFi(10000);
 }
 
-bool telegramSendMessageWithButtons(const String& text) {
-  WiFiClientSecure client;
-  client.setInsecure();
-
-  String host = "api.telegram.org";
-  String base = "/bot" + String(BOT_TOKEN) + "/sendMessage";
-  // Inline keyboard with two buttons that send callback data
-  String replyMarkup =
-      "{\"inline_keyboard\":[["
-      "{\"text\":\"\\uD83D\\uDCF8 /snap\",\"callback_data\":\"cf:snap\"},"
-      "{\"text\":\"\\u274E /ignore\",\"callback_data\":\"cf:ignore\"}"
-      "]]}";
+void wifiCachedLeaseWorks() {
+  s_fastVerified = true;
+}
 
+bool ensureWiFi() {
+  if (WiFi.status() == WL_CONNECTED) return true;
+  Serial.println("[WiFi] Reconnecting...");
+  startWiFi();
+  return waitWiFi(10000);
+}
 
-  // Build GET with URL-encoded text and reply_markup
-  String url = base +
-               "?chat_id=" + String(CHAT_ID) +
-               "&text=" + urlencode(text) +
-               "&reply_markup=" + urlencode(replyMarkup);
+// ------------ boot timeline ------------
 
-  if (!client.connect(host.c_str(), 443)) return false;
+struct BootMark {
+  const char* phase;
+  uint32_t    t_ms;
+};
+static BootMark s_bootMarks[BOOT_MAX_MARKS];
+static uint8_t  s_bootMarkCount = 0;
 
-  String req =
-      "GET " + url + " HTTP/1.1\r\n" +
-      "Host: " + host + "\r\n" +
-      "User-Agent: ESP32-CAM\r\n" +
-      "Connection: close\r\n\r\n";
-  client.print(req);
+void bootMark(const char* phase) {
+  if (s_bootMarkCount < BOOT_MAX_MARKS) {
+    s_bootMarks[s_bootMarkCount++] = { phase, millis() };
+  }
+}
 
-  uint32_t start = millis();
-  while (client.connected() && millis() - start < 6000) {
-    while (client.available()) { client.read(); start = millis(); }
+void logBootTimeline() {
+  uint32_t prev = 0;
+  Serial.println("[BOOT] Timeline (ms since reset, +phase):");
+  for (uint8_t i = 0; i < s_bootMarkCount; ++i) {
+    Serial.printf("[BOOT]   %6lu  +%5lu  %s\n", (unsigned long)s_bootMarks[i].t_ms,
+                  (unsigned long)(s_bootMarks[i].t_ms - prev), s_bootMarks[i].phase);
+    prev = s_bootMarks[i].t_ms;
   }
-  client.stop();
-  return true;
 }
 
-// Build and send multipart/form-data to Telegram sendPhoto
-bool telegramSendPhoto(const uint8_t* jpg_buf, size_t jpg_len, const char* caption) {
-  WiFiClientSecure client;
-  client.setInsecure(); // quick test: skip CA validation
+// ------------ tracing ------------
 
-  String host = "api.telegram.org";
-  String url  = "/bot" + String(BOT_TOKEN) + "/sendPhoto";
+struct TraceEntry {
+  uint32_t  t_ms;
+  uint32_t  value;
+  TraceKind kind;
+};
 
-  String boundary = "----ESP32CamFormBoundary";
-  String head =
-    "--" + boundary + "\r\n"
-    "Content-Disposition: form-data; name=\"chat_id\"\r\n\r\n" +
-    String(CHAT_ID) + "\r\n" +
-    "--" + boundary + "\r\n"
-    "Content-Disposition: form-data; name=\"caption\"\r\n\r\n" +
-    String(caption ? caption : "") + "\r\n" +
-    "--" + boundary + "\r\n"
-    "Content-Disposition: form-data; name=\"photo\"; filename=\"snap.jpg\"\r\n"
-    "Content-Type: image/jpeg\r\n\r\n";
+static const char* const kTraceNames[TR_KIND_COUNT] = {
+  "wake", "wifi", "dhcp", "tls", "capture", "resp", "jpeg", "uplink", "image"
+};
+static const char* const kTraceUnits[TR_KIND_COUNT] = {
+  "ms", "ms", "ms", "ms", "ms", "ms", "B", "B/s", "ms"
+};
 
-  String tail = "\r\n--" + boundary + "--\r\n";
-  size_t contentLength = head.length() + jpg_len + tail.length();
+static TraceEntry   s_traceRing[TRACE_RING_SIZE];
+static uint16_t     s_traceCount = 0;  // total recorded this wake; ring index = count % size
+static portMUX_TYPE s_traceMux = portMUX_INITIALIZER_UNLOCKED;
 
-  Serial.printf("[TG] Connecting to %s...\n", host.c_str());
-  if (!client.connect(host.c_str(), 443)) {
-    Serial.println("[TG] Connection failed");
-    return false;
+static inline uint8_t traceBucket(uint32_t v) {
+  const uint8_t b = v ? (uint8_t)(32 - __builtin_clz(v)) : 0;
+  return b < TRACE_HIST_BUCKETS ? b : TRACE_HIST_BUCKETS - 1;
+}
+
+void traceValue(TraceKind kind, uint32_t value) {
+  const uint32_t now = millis();
+  const uint8_t bucket = traceBucket(value);
+  portENTER_CRITICAL(&s_traceMux);
+  TraceEntry& e = s_traceRing[s_traceCount % TRACE_RING_SIZE];
+  e.t_ms = now;
+  e.value = value;
+  e.kind = kind;
+  s_traceCount++;
+  auto& agg = s_rtc.trace[kind];
+  agg.count++;
+  agg.sum += value;
+  if (value > agg.max) agg.max = value;
+  if (agg.hist[bucket] != 0xFFFF) agg.hist[bucket]++;
+  portEXIT_CRITICAL(&s_traceMux);
+}
+
+void traceEndWake() {
+  traceValue(TR_WAKE, millis());
+  const uint32_t heap_low = ESP.getMinFreeHeap();
+  const uint32_t psram_low = psramFound() ? ESP.getMinFreePsram() : 0;
+  if (!s_rtc.heap_low_water || heap_low < s_rtc.heap_low_water) s_rtc.heap_low_water = heap_low;
+  if (psram_low && (!s_rtc.psram_low_water || psram_low < s_rtc.psram_low_water)) {
+    s_rtc.psram_low_water = psram_low;
   }
+  Serial.printf("[TRACE] Low water this wake: heap %lu B, PSRAM %lu B\n",
+                (unsigned long)heap_low, (unsigned long)psram_low);
+}
 
-  String req =
-      "POST " + url + " HTTP/1.1\r\n" +
-      "Host: " + host + "\r\n" +
-      "User-Agent: ESP32-CAM\r\n" +
-      "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n" +
-      "Content-Length: " + String(contentLength) + "\r\n" +
-      "Connection: close\r\n\r\n";
+void logTraceRing() {
+  const uint16_t n = s_traceCount < TRACE_RING_SIZE ? s_traceCount : TRACE_RING_SIZE;
+  Serial.printf("[TRACE] %u spans this wake (last %u):\n", (unsigned)s_traceCount, (unsigned)n);
+  for (uint16_t i = s_traceCount - n; i != s_traceCount; ++i) {
+    const TraceEntry& e = s_traceRing[i % TRACE_RING_SIZE];
+    Serial.printf("[TRACE]   %6lu  %-8s %lu %s\n", (unsigned long)e.t_ms, kTraceNames[e.kind],
+                  (unsigned long)e.value, kTraceUnits[e.kind]);
+  }
+}
 
-  client.print(req);
-  client.print(head);
+// Upper bound of the bucket holding the q-th percentile.
+static uint32_t traceQuantile(const uint16_t* hist, uint32_t count, uint8_t q) {
+  uint32_t need = (count * q + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < TRACE_HIST_BUCKETS; ++b) {
+    seen += hist[b];
+    if (seen >= need) return b ? (1UL << b) - 1 : 0;
+  }
+  return UINT32_MAX;
+}
 
-  size_t written = 0;
-  while (written < jpg_len) {
-    size_t chunk = client.write(jpg_buf + written, jpg_len - written);
-    if (chunk == 0) {
-      Serial.println("[TG] Write stalled");
-      client.stop();
-      return false;
-    }
-    written += chunk;
+size_t traceFormatSummary(char* out, size_t cap) {
+  size_t n = 0;
+  out[0] = '\0';
+  for (uint8_t k = 0; k < TR_KIND_COUNT && n < cap; ++k) {
+    const auto& agg = s_rtc.trace[k];
+    if (!agg.count) continue;
+    n += snprintf(out + n, cap - n, "%s n%lu avg%lu p50<%lu p90<%lu max%lu%s\n", kTraceNames[k],
+                  (unsigned long)agg.count, (unsigned long)(agg.sum / agg.count),
+                  (unsigned long)traceQuantile(agg.hist, agg.count, 50),
+                  (unsigned long)traceQuantile(agg.hist, agg.count, 90),
+                  (unsigned long)agg.max, kTraceUnits[k]);
+  }
+  if (n < cap) {
+    n += snprintf(out + n, cap - n, "low water: heap %lu B, PSRAM %lu B",
+                  (unsigned long)s_rtc.heap_low_water, (unsigned long)s_rtc.psram_low_water);
   }
+  return n < cap ? n : cap - 1;
+}
 
-  client.print(tail);
+void sendPirAlertButtons() {
+  telegramSendMessageWithButtons("🚨 Motion detected. What should I do?");
+}
 
-  Serial.println("[TG] Request sent, waiting for response...");
-  uint32_t start = millis();
-  while (client.connected() && millis() - start < 8000) {
-    while (client.available()) {
-      String line = client.readStringUntil('\n');
-      Serial.print(line); // prints headers + JSON
-      start = millis();
-    }
+// ------------ TLS client with session resumption ------------
+
+// Last negotiated session, shared by every TlsClient (all talk to the same server).
+static mbedtls_ssl_session s_tlsSession;
+static bool                s_tlsHaveSession = false;
+static SemaphoreHandle_t   s_tlsSessionLock = nullptr;
+
+void tlsSessionCacheRestore() {
+  if (!s_tlsSessionLock) {
+    mbedtls_ssl_session_init(&s_tlsSession);
+    s_tlsSessionLock = xSemaphoreCreateMutex();
   }
-  client.stop();
-  return true;
+  if (s_rtcValid && s_rtc.tls_session_len > 0 &&
+      mbedtls_ssl_session_load(&s_tlsSession, s_rtc.tls_session, s_rtc.tls_session_len) == 0) {
+    s_tlsHaveSession = true;
+    Serial.printf("[TLS] Cached session restored (%u bytes)\n", (unsigned)s_rtc.tls_session_len);
+  }
+}
+
+void tlsSessionCacheSave() {
+  s_rtc.tls_session_len = 0;
+  if (!s_tlsSessionLock || xSemaphoreTake(s_tlsSessionLock, portMAX_DELAY) != pdTRUE) return;
+  size_t len = 0;
+  if (s_tlsHaveSession &&
+      mbedtls_ssl_session_save(&s_tlsSession, s_rtc.tls_session, sizeof(s_rtc.tls_session),
+                               &len) == 0) {
+    s_rtc.tls_session_len = (uint16_t)len;
+  } else if (s_tlsHaveSession) {
+    Serial.println("[TLS] Session does not fit the RTC block, not kept");
+  }
+  xSemaphoreGive(s_tlsSessionLock);
 }
 
-bool telegramSendMessage(const String& text) {
-  WiFiClientSecure client;
-  client.setInsecure();
+// Offer the cached session; remembers its master secret to detect a resumption.
+static bool tlsSessionOffer(mbedtls_ssl_context* ssl, uint8_t* master) {
+  bool offered = false;
+  if (!s_tlsSessionLock || xSemaphoreTake(s_tlsSessionLock, portMAX_DELAY) != pdTRUE) return false;
+  if (s_tlsHaveSession && mbedtls_ssl_set_session(ssl, &s_tlsSession) == 0) {
+    memcpy(master, s_tlsSession.MBEDTLS_PRIVATE(master), 48);
+    offered = true;
+  }
+  xSemaphoreGive(s_tlsSessionLock);
+  return offered;
+}
 
-  String host = "api.telegram.org";
-  String url  = "/bot" + String(BOT_TOKEN) + "/sendMessage"
-                "?chat_id=" + String(CHAT_ID) +
-                "&text=" + urlencode(text);
+// Keep the session just negotiated (a resumed one may carry a renewed ticket).
+// Takes ownership of `fresh`.
+static void tlsSessionStore(mbedtls_ssl_session* fresh) {
+  if (!s_tlsSessionLock || xSemaphoreTake(s_tlsSessionLock, portMAX_DELAY) != pdTRUE) {
+    mbedtls_ssl_session_free(fresh);
+    return;
+  }
+  mbedtls_ssl_session_free(&s_tlsSession);
+  s_tlsSession = *fresh;
+  s_tlsHaveSession = true;
+  xSemaphoreGive(s_tlsSessionLock);
+}
 
-  Serial.printf("[TG] Connecting for sendMessage...\n");
-  if (!client.connect(host.c_str(), 443)) {
-    Serial.println("[TG] Connection failed");
-    return false;
+static void tlsSessionForget() {
+  if (!s_tlsSessionLock || xSemaphoreTake(s_tlsSessionLock, portMAX_DELAY) != pdTRUE) return;
+  s_tlsHaveSession = false;
+  xSemaphoreGive(s_tlsSessionLock);
+}
+
+TlsClient::~TlsClient() {
+  stop();
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+  stop();
+  if (!rng_ready_) {
+    mbedtls_entropy_init(&entropy_);
+    mbedtls_ctr_drbg_init(&drbg_);
+    if (mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_, nullptr, 0) != 0) return 0;
+    rng_ready_ = true;
   }
 
-  String req =
-      "GET " + url + " HTTP/1.1\r\n" +
-      "Host: " + host + "\r\n" +
-      "User-Agent: ESP32-CAM\r\n" +
-      "Connection: close\r\n\r\n";
-  client.print(req);
+  const uint32_t t0 = millis();
+  mbedtls_net_init(&net_);
+  mbedtls_ssl_init(&ssl_);
+  mbedtls_ssl_config_init(&conf_);
+  open_ = true; // from here on stop() releases everything
 
-  uint32_t start = millis();
-  while (client.connected() && millis() - start < 6000) {
-    while (client.available()) {
-      String line = client.readStringUntil('\n');
-      // Optional: Serial.print(line);
-      start = millis();
+  char port_str[6];
+  snprintf(port_str, sizeof(port_str), "%u", (unsigned)port);
+  if (mbedtls_net_connect(&net_, host, port_str, MBEDTLS_NET_PROTO_TCP) != 0) {
+    stop();
+    return 0;
+  }
+  int one = 1;
+  setsockopt(net_.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  if (mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                  MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+    stop();
+    return 0;
+  }
+  mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_NONE); // same trust model as setInsecure()
+  mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+  if (mbedtls_ssl_setup(&ssl_, &conf_) != 0 || mbedtls_ssl_set_hostname(&ssl_, host) != 0) {
+    stop();
+    return 0;
+  }
+
+  uint8_t offered_master[48];
+  const bool offered = tlsSessionOffer(&ssl_, offered_master);
+
+  mbedtls_net_set_nonblock(&net_);
+  mbedtls_ssl_set_bio(&ssl_, &net_, mbedtls_net_send, mbedtls_net_recv, nullptr);
+  int ret;
+  while ((ret = mbedtls_ssl_handshake(&ssl_)) != 0) {
+    if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+        millis() - t0 > TLS_HANDSHAKE_TIMEOUT_MS) {
+      Serial.printf("[TLS] Handshake failed: -0x%04x\n", (unsigned)-ret);
+      stop();
+      // A stale ticket must not break the next attempt.
+      if (offered) tlsSessionForget();
+      return 0;
     }
+    delay(1);
   }
-  client.stop();
-  return true;
+  handshake_ms_ = millis() - t0;
+
+  // An abbreviated handshake reuses the cached master secret; a full one derives a new one.
+  mbedtls_ssl_session fresh;
+  mbedtls_ssl_session_init(&fresh);
+  if (mbedtls_ssl_get_session(&ssl_, &fresh) == 0) {
+    resumed_ = offered && memcmp(fresh.MBEDTLS_PRIVATE(master), offered_master, 48) == 0;
+    tlsSessionStore(&fresh);
+  } else {
+    resumed_ = false;
+    mbedtls_ssl_session_free(&fresh);
+  }
+  return 1;
+}
+
+size_t TlsClient::write(uint8_t b) {
+  return write(&b, 1);
 }
 
-// Very small urlencode helper (enough for basic text)
-String urlencode(const String& s) {
-  const char *hex = "0123456789ABCDEF";
-  String out;
-  for (size_t i = 0; i < s.length(); i++) {
-    char c = s[i];
-    if (('a' <= c && c <= 'z') ||
-        ('A' <= c && c <= 'Z') ||
-        ('0' <= c && c <= '9') ||
-        c == '-' || c == '_' || c == '.' || c == '~') {
-      out += c;
-    } else if (c == ' ') {
-      out += "%20";
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+  if (!open_) return 0;
+  size_t done = 0;
+  uint32_t start = millis();
+  while (done < size && millis() - start < TLS_IO_TIMEOUT_MS) {
+    int ret = mbedtls_ssl_write(&ssl_, buf + done, size - done);
+    if (ret > 0) {
+      done += ret;
+      start = millis();
+    } else if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) {
+      delay(1);
     } else {
-      out += '%';
-      out += hex[(c >> 4) & 0xF];
-      out += hex[c & 0xF];
+      stop();
+      break;
     }
   }
-  return out;
+  return done;
 }
 
-bool initCamera() {
-  camera_config_t config;
-  config.ledc_channel = LEDC_CHANNEL_0;
-  config.ledc_timer   = LEDC_TIMER_0;
-  config.pin_d0       = Y2_GPIO_NUM;
-  config.pin_d1       = Y3_GPIO_NUM;
-  config.pin_d2       = Y4_GPIO_NUM;
-  config.pin_d3       = Y5_GPIO_NUM;
-  config.pin_d4       = Y6_GPIO_NUM;
-  config.pin_d5       = Y7_GPIO_NUM;
-  config.pin_d6       = Y8_GPIO_NUM;
-  config.pin_d7       = Y9_GPIO_NUM;
-  config.pin_xclk     = XCLK_GPIO_NUM;
-  config.pin_pclk     = PCLK_GPIO_NUM;
-  config.pin_vsync    = VSYNC_GPIO_NUM;
-  config.pin_href     = HREF_GPIO_NUM;
-  config.pin_sccb_sda = SIOD_GPIO_NUM;
-  config.pin_sccb_scl = SIOC_GPIO_NUM;
-  config.pin_pwdn     = PWDN_GPIO_NUM;
-  config.pin_reset    = RESET_GPIO_NUM;
-  config.xclk_freq_hz = 20000000;
-  config.pixel_format = PIXFORMAT_JPEG;
-
-  if (psramFound()) {
-    config.frame_size = FRAMESIZE_VGA; // 640x480
-    config.jpeg_quality = 30;          // 10=better, 63=smaller
-    config.fb_count = 1;
-    Serial.println("PSRAM found.");
-  } else {
-    config.frame_size = FRAMESIZE_QVGA;
-    config.jpeg_quality = 30;
-    config.fb_count = 1;
+int TlsClient::available() {
+  if (!open_) return 0;
+  // Zero-length read: decrypts the next record if one has arrived, never blocks.
+  int ret = mbedtls_ssl_read(&ssl_, nullptr, 0);
+  if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    stop(); // close_notify, EOF or error
+    return 0;
   }
+  return (int)mbedtls_ssl_get_bytes_avail(&ssl_);
+}
 
-  esp_err_t err = esp_camera_init(&config);
-  if (err != ESP_OK) {
-    Serial.printf("[CAM] Init failed 0x%x\n", err);
-    return false;
-  }
+int TlsClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+  if (!open_) return -1;
+  int ret = mbedtls_ssl_read(&ssl_, buf, size);
+  if (ret > 0) return ret;
+  if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) return -1;
+  stop(); // 0 = EOF, or an error
+  return -1;
+}
+
+int TlsClient::peek() {
+  return -1; // not needed by the Telegram code
+}
+
+void TlsClient::stop() {
+  if (!open_) return;
+  mbedtls_ssl_close_notify(&ssl_);
+  mbedtls_net_free(&net_);
+  mbedtls_ssl_free(&ssl_);
+  mbedtls_ssl_config_free(&conf_);
+  open_ = false;
+}
+
+bool TlsClient::waitReadable(uint32_t timeout_ms) {
+  if (!open_) return false;
+  if (mbedtls_ssl_get_bytes_avail(&ssl_) > 0) return true;
+  fd_set rfds;
+  FD_ZERO(&rfds);
+  FD_SET(net_.fd, &rfds);
+  struct timeval tv = { (time_t)(timeout_ms / 1000), (suseconds_t)((timeout_ms % 1000) * 1000) };
+  return select(net_.fd + 1, &rfds, nullptr, nullptr, &tv) > 0;
+}
 
-  sensor_t* s = esp_camera_sensor_get();
-  if (s) {
-    s->set_framesize(s, FRAMESIZE_SVGA);
-    s->set_quality(s, 20);
+uint8_t TlsClient::connected() {
+  if (!open_) return 0;
+  if (mbedtls_ssl_get_bytes_avail(&ssl_) > 0) return 1;
+  // Peek at the socket: 0 means the server closed its side.
+  uint8_t c;
+  int r = recv(net_.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    stop();
+    return 0;
   }
-  return true;
+  return 1;
 }
 
-// NOTE: no default args here — defaults live in cat_feeder.h
-bool takeAndSendPhoto(const char* caption, uint32_t fresh_wait_ms) {
-  Serial.println("[CAM] Capturing (fresh /snap)...");
+// ------------ Telegram keep-alive session ------------
 
-  // 0) Flush whatever the driver currently has ready
-  camera_fb_t* fb = esp_camera_fb_get();
-  uint64_t t0_ms = 0;
-  if (fb) {
-    // Record timestamp of the flushed frame (if available)
-    t0_ms = (uint64_t)fb->timestamp.tv_sec * 1000ULL + (fb->timestamp.tv_usec / 1000ULL);
-    esp_camera_fb_return(fb);
+TelegramSession tgSession;
+TelegramSession tgUploadSession;
+
+// ------------ request building (fixed buffers, no heap) ------------
+
+// Bit set for RFC 3986 unreserved characters: A-Z a-z 0-9 - _ . ~
+static const uint8_t kUrlUnreserved[32] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0xFF, 0x03, 0xFE, 0xFF, 0xFF, 0x87, 0xFE, 0xFF, 0xFF, 0x47,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+static const char kHexDigits[] = "0123456789ABCDEF";
+
+static inline bool isUnreserved(uint8_t c) {
+  return kUrlUnreserved[c >> 3] & (1 << (c & 7));
+}
+
+size_t urlEncodedLength(const char* s) {
+  size_t n = 0;
+  for (; *s; ++s) n += isUnreserved((uint8_t)*s) ? 1 : 3;
+  return n;
+}
+
+void ReqBuf::clear() {
+  len_ = 0;
+  overflow_ = false;
+  if (cap_) buf_[0] = '\0';
+}
+
+ReqBuf& ReqBuf::add(const char* s, size_t n) {
+  if (overflow_ || len_ + n >= cap_) {
+    overflow_ = true;
+    return *this;
   }
+  memcpy(buf_ + len_, s, n);
+  len_ += n;
+  buf_[len_] = '\0';
+  return *this;
+}
+
+ReqBuf& ReqBuf::add(const char* s) {
+  return add(s, strlen(s));
+}
 
-  // Give the sensor/driver a moment to produce the *next* frame
-  delay(fresh_wait_ms);
+ReqBuf& ReqBuf::addUInt(unsigned long v) {
+  char tmp[12];
+  size_t n = 0;
+  do { tmp[sizeof(tmp) - 1 - n++] = (char)('0' + v % 10); v /= 10; } while (v);
+  return add(tmp + sizeof(tmp) - n, n);
+}
 
-  // 1) Grab what should now be a *fresh* frame
-  fb = esp_camera_fb_get();
-  if (!fb) {
-    Serial.println("[CAM] Capture failed (no fresh frame)");
-    return false;
+ReqBuf& ReqBuf::addInt(long v) {
+  if (v < 0) {
+    add("-", 1);
+    return addUInt(0UL - (unsigned long)v);
   }
+  return addUInt((unsigned long)v);
+}
 
-  // Optional: ensure it's newer than the flushed one; if not, try once more quickly
-  uint64_t t1_ms = (uint64_t)fb->timestamp.tv_sec * 1000ULL + (fb->timestamp.tv_usec / 1000ULL);
-  if (t1_ms <= t0_ms && t0_ms != 0) {
-    // Same-or-older frame edge case—return and try one more time
-    esp_camera_fb_return(fb);
-    delay(30);
-    fb = esp_camera_fb_get();
-    if (!fb) {
-      Serial.println("[CAM] Capture failed on retry");
-      return false;
+ReqBuf& ReqBuf::addUrlEncoded(const char* s) {
+  // Reserve the exact size up front so the loop below never has to check bounds.
+  const size_t n = urlEncodedLength(s);
+  if (overflow_ || len_ + n >= cap_) {
+    overflow_ = true;
+    return *this;
+  }
+  char* out = buf_ + len_;
+  for (; *s; ++s) {
+    const uint8_t c = (uint8_t)*s;
+    if (isUnreserved(c)) {
+      *out++ = (char)c;
+    } else {
+      *out++ = '%';
+      *out++ = kHexDigits[c >> 4];
+      *out++ = kHexDigits[c & 0xF];
     }
-    t1_ms = (uint64_t)fb->timestamp.tv_sec * 1000ULL + (fb->timestamp.tv_usec / 1000ULL);
   }
+  len_ += n;
+  buf_[len_] = '\0';
+  return *this;
+}
 
-  Serial.printf("[CAM] Fresh frame: %u bytes (t=%llu ms)\n", fb->len, (unsigned long long)t1_ms);
+// Request line up to the query string: "<METHOD> /bot<token>/<api_method>".
+static void beginApiRequest(ReqBuf& req, const char* method, const char* api_method) {
+  req.add(method).add(" /bot" BOT_TOKEN "/").add(api_method);
+}
 
-  bool ok = telegramSendPhoto(fb->buf, fb->len, caption);
+// Common request head for every Bot API call; the connection is kept open.
+static void finishHead(ReqBuf& req, size_t content_length = 0, const char* content_type = nullptr) {
+  req.add(" HTTP/1.1\r\n"
+          "Host: " TELEGRAM_HOST "\r\n"
+          "User-Agent: ESP32-CAM\r\n");
+  if (content_type) {
+    req.add("Content-Type: ").add(content_type).add("\r\n"
+            "Content-Length: ").addUInt(content_length).add("\r\n");
+  }
+  req.add("Connection: keep-alive\r\n\r\n");
+}
 
-  // Always return the buffer after use
-  esp_camera_fb_return(fb);
+#define TG_BOUNDARY "----ESP32CamFormBoundary"
+static const char kMultipartTail[] = "\r\n--" TG_BOUNDARY "--\r\n";
 
-  if (ok) {
-    Serial.println("[TG] Photo sent.");
+static void addFormField(ReqBuf& body, const char* name, const char* value) {
+  body.add("--" TG_BOUNDARY "\r\n"
+           "Content-Disposition: form-data; name=\"").add(name).add("\"\r\n\r\n")
+      .add(value).add("\r\n");
+}
+
+bool TelegramSession::connect() {
+  if (client_.connected()) {
+    reused_ = true;
+    return true;
+  }
+  stop();
+  if (!client_.connect(TELEGRAM_HOST, TELEGRAM_PORT)) {
+    Serial.println("[TG] Connection failed");
+    // A reused lease that is no longer ours associates fine but routes nowhere.
+    if (!wifiDropCachedLease() || !client_.connect(TELEGRAM_HOST, TELEGRAM_PORT)) return false;
+  }
+  wifiCachedLeaseWorks();
+  handshakes_++;
+  reused_ = false;
+  const uint32_t took = client_.lastHandshakeMs();
+  traceValue(TR_TLS_HANDSHAKE, took);
+  if (client_.lastHandshakeResumed()) {
+    resumed_handshakes_++;
+    resumed_ms_ += took;
   } else {
-    Serial.println("[TG] Send failed.");
+    full_ms_ += took;
   }
-  return ok;
+  Serial.printf("[TG] TLS handshake #%lu (%s) took %lu ms\n", (unsigned long)handshakes_,
+                client_.lastHandshakeResumed() ? "resumed" : "full", (unsigned long)took);
+  return true;
 }
 
-// Naive parser helpers (no ArduinoJson)
-static long extractMaxUpdateId(const String& body) {
-  // Find all occurrences of "update_id":<num> and return the maximum
-  long maxId = lastUpdateId;
-  int idx = 0;
-  const String key = "\"update_id\":";
-  while (true) {
-    idx = body.indexOf(key, idx);
-    if (idx < 0) break;
-    idx += key.length();
-    // skip spaces
-    while (idx < (int)body.length() && (body[idx] == ' ')) idx++;
-    // read number
-    long val = 0;
-    bool any = false;
-    while (idx < (int)body.length() && isDigit(body[idx])) {
-      any = true;
-      val = val * 10 + (body[idx] - '0');
-      idx++;
-    }
-    if (any && val > maxId) maxId = val;
-  }
-  return maxId;
+void TelegramSession::stop() {
+  client_.stop();
+  rx_pos_ = rx_len_ = 0;
+}
+
+bool TelegramSession::connected() {
+  return client_.connected();
 }
 
-// Matches real text commands ("/snap" or "/ignore") in a message to THIS chat
-static bool bodyHasTextCommandForMe(const String& body, const String& cmd) {
-  String cidPat = String("\"chat\"") + ":{\"id\":" + String(CHAT_ID);
-  String txtPat = String("\"text\":\"") + cmd + "\"";
-  int from = 0;
+void TelegramSession::setDeadline(uint32_t deadline_ms) {
+  deadline_ms_ = deadline_ms;
+  has_deadline_ = true;
+}
+
+void TelegramSession::clearDeadline() {
+  has_deadline_ = false;
+}
+
+bool TelegramSession::cancelled() const {
+  return has_deadline_ && (int32_t)(deadline_ms_ - millis()) <= 0;
+}
+
+// Refill the receive buffer. Returns the bytes buffered, 0 on timeout, close or cancel.
+size_t TelegramSession::fill(uint32_t timeout_ms) {
+  if (rx_pos_ < rx_len_) return rx_len_ - rx_pos_;
+  const uint32_t start = millis();
   while (true) {
-    int pos = body.indexOf(txtPat, from);
-    if (pos < 0) break;
-    int windowStart = max(0, pos - 600);
-    int windowEnd   = min((int)body.length(), pos + 600);
-    String win = body.substring(windowStart, windowEnd);
-    if (win.indexOf("\"message\"") >= 0 && win.indexOf(cidPat) >= 0) {
-      return true;
+    int n = client_.read((uint8_t*)rx_, sizeof(rx_));
+    if (n > 0) {
+      rx_pos_ = 0;
+      rx_len_ = (uint16_t)n;
+      return (size_t)n;
     }
-    from = pos + txtPat.length();
+    if (!client_.connected() || cancelled()) return 0;
+    const uint32_t waited = millis() - start;
+    if (waited >= timeout_ms) return 0;
+    // Sliced so a deadline (end of the awake window) is noticed promptly.
+    client_.waitReadable(min<uint32_t>(timeout_ms - waited, 100));
   }
-  return false;
 }
 
-// Matches inline button presses via callback_query.data ("snap" or "ignore") for THIS chat
-static bool bodyHasCallbackForMe(const String& body, const String& dataWanted) {
-  String dataPat = String("\"data\":\"") + dataWanted + "\"";
-  String cidPat  = String("\"chat\"") + ":{\"id\":" + String(CHAT_ID);
-  int from = 0;
-  while (true) {
-    int pos = body.indexOf(dataPat, from);
-    if (pos < 0) break;
-    int windowStart = max(0, pos - 800);
-    int windowEnd   = min((int)body.length(), pos + 800);
-    String win = body.substring(windowStart, windowEnd);
-    if (win.indexOf("\"callback_query\"") >= 0 && win.indexOf(cidPat) >= 0) {
+// Read one header line (without CR/LF); longer lines are truncated to `cap`.
+bool TelegramSession::readLine(char* line, size_t cap, uint32_t timeout_ms) {
+  size_t n = 0;
+  while (fill(timeout_ms)) {
+    const char* p = rx_ + rx_pos_;
+    const size_t avail = rx_len_ - rx_pos_;
+    const char* nl = (const char*)memchr(p, '\n', avail);
+    const size_t take = nl ? (size_t)(nl - p) : avail;
+    const size_t copy = min(take, cap - 1 - n);
+    memcpy(line + n, p, copy);
+    n += copy;
+    rx_pos_ += take + (nl ? 1 : 0);
+    if (nl) {
+      if (n > 0 && line[n - 1] == '\r') n--;
+      line[n] = '\0';
       return true;
     }
-    from = pos + dataPat.length();
   }
   return false;
 }
 
+// Hand exactly `len` body bytes to the sink; len < 0 reads until the server closes.
+bool TelegramSession::readBody(long len, BodySink sink, void* sink_ctx, uint32_t timeout_ms) {
+  while (len != 0) {
+    const size_t avail = fill(timeout_ms);
+    if (avail == 0) return len < 0 && !client_.connected();
+    const size_t take = (len < 0 || (long)avail < len) ? avail : (size_t)len;
+    if (sink) sink(rx_ + rx_pos_, take, sink_ctx);
+    rx_pos_ += take;
+    if (len > 0) len -= (long)take;
+  }
+  return true;
+}
 
-// Poll Telegram (getUpdates with offset=lastUpdateId+1)
-void pollTelegram() {
-  if (!ensureWiFi()) return;
+struct EnvelopeTee {
+  TelegramSession::BodySink sink;
+  void*                     sink_ctx;
+  TgResultParser*           envelope;
+};
 
-  WiFiClientSecure client;
-  client.setInsecure();
+// Body bytes go to the caller's sink and to the envelope parser in the same pass.
+static void envelopeTeeSink(const char* data, size_t len, void* ctx) {
+  EnvelopeTee* tee = (EnvelopeTee*)ctx;
+  tee->envelope->feed(data, len);
+  if (tee->sink) tee->sink(data, len, tee->sink_ctx);
+}
 
-  String host = "api.telegram.org";
-  String url  = "/bot" + String(BOT_TOKEN) + "/getUpdates?timeout=0";
-  if (lastUpdateId >= 0) {
-    url += "&offset=" + String(lastUpdateId + 1);
-  }
+// Consume exactly one HTTP response so the next request can reuse the connection.
+// Returns true when the response was complete; result_ says whether the call succeeded.
+bool TelegramSession::readResponse(BodySink sink, void* sink_ctx, uint32_t timeout_ms,
+                                   bool* got_any, uint32_t sent_ms) {
+  char line[128];
+  result_ = TgResult();
+  result_.sent_ms = sent_ms;
+  if (!readLine(line, sizeof(line), timeout_ms)) return false;
+  result_.answer_ms = millis();
+  *got_any = true;
+  // Long-polls (the only requests with a deadline) wait on purpose.
+  if (!has_deadline_) traceSpan(TR_RESPONSE_WAIT, sent_ms);
+  // "HTTP/1.1 200 OK"
+  const char* sp = strchr(line, ' ');
+  result_.http_status = sp ? atoi(sp + 1) : 0;
 
-  Serial.println("[TG] getUpdates...");
-  if (!client.connect(host.c_str(), 443)) {
-    Serial.println("[TG] getUpdates connect failed");
-    return;
+  long content_length = -1;
+  bool chunked = false;
+  bool keep_alive = true;
+  while (true) {
+    if (!readLine(line, sizeof(line), timeout_ms)) return false;
+    if (line[0] == '\0') break; // end of headers
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      content_length = atol(line + 15);
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line + 18, "chunked")) {
+      chunked = true;
+    } else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line + 11, "close")) {
+      keep_alive = false;
+    } else if (strncasecmp(line, "Retry-After:", 12) == 0) {
+      result_.retry_after_s = strtoul(line + 12, nullptr, 10);
+    }
   }
+  // Without framing the body ends when the server closes the socket.
+  if (!chunked && content_length < 0) keep_alive = false;
 
-  String req =
-      "GET " + url + " HTTP/1.1\r\n" +
-      "Host: " + host + "\r\n" +
-      "User-Agent: ESP32-CAM\r\n" +
-      "Connection: close\r\n\r\n";
-  client.print(req);
-
-  // Read the full HTTP response body into a String (naively)
-  String response;
-  uint32_t start = millis();
-  while (client.connected() && millis() - start < 6000) {
-    while (client.available()) {
-      char c = client.read();
-      response += c;
-      start = millis();
+  TgResultParser envelope(&result_);
+  EnvelopeTee tee = { sink, sink_ctx, &envelope };
+  bool complete = false;
+  if (chunked) {
+    while (readLine(line, sizeof(line), timeout_ms)) {
+      const long size = strtol(line, nullptr, 16); // chunk extensions after ';' are ignored
+      if (size <= 0) {
+        // Last chunk; the optional trailer section ends with an empty line.
+        bool got_line;
+        while ((got_line = readLine(line, sizeof(line), timeout_ms)) && line[0] != '\0') {}
+        complete = got_line;
+        break;
+      }
+      if (!readBody(size, envelopeTeeSink, &tee, timeout_ms)) break;
+      if (!readLine(line, sizeof(line), timeout_ms)) break; // CRLF after the chunk data
     }
+  } else {
+    complete = readBody(content_length, envelopeTeeSink, &tee, timeout_ms);
   }
-  client.stop();
 
-  // Separate headers from body
-  int bodyIdx = response.indexOf("\r\n\r\n");
-  if (bodyIdx < 0) {
-    Serial.println("[TG] Bad HTTP response");
-    return;
-  }
-  String body = response.substring(bodyIdx + 4);
+  if (!keep_alive || !complete) stop();
+  result_.ok = complete && result_.ok &&
+               result_.http_status >= 200 && result_.http_status < 300;
+  return complete;
+}
 
-  // Update lastUpdateId
-  long newMax = extractMaxUpdateId(body);
-  if (newMax > lastUpdateId) {
-    lastUpdateId = newMax;
-    Serial.printf("[TG] lastUpdateId -> %ld\n", lastUpdateId);
+// A 429 holds every request, from the loop and the uploader task alike.
+static portMUX_TYPE s_rateMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t     s_holdUntilMs = 0;
+static bool         s_holding = false;
+static uint8_t      s_backoffS = 0;
+
+void tgNoteRateLimit(uint32_t retry_after_s) {
+  portENTER_CRITICAL(&s_rateMux);
+  uint32_t wait_s = retry_after_s;
+  if (wait_s == 0) {
+    s_backoffS = s_backoffS ? (uint8_t)min<uint32_t>(s_backoffS * 2u, TG_BACKOFF_MAX_S) : 1;
+    wait_s = s_backoffS;
   }
+  s_holdUntilMs = millis() + wait_s * 1000UL;
+  s_holding = true;
+  outboxStats.rate_limited++;
+  portEXIT_CRITICAL(&s_rateMux);
+  Serial.printf("[TG] Rate limited, holding requests for %lu s\n", (unsigned long)wait_s);
+}
 
-  // Decide action based on callback data OR real text commands
-  const bool do_snap   = bodyHasCallbackForMe(body, "cf:snap")   || bodyHasTextCommandForMe(body, "/snap");
-  const bool do_ignore = bodyHasCallbackForMe(body, "cf:ignore") || bodyHasTextCommandForMe(body, "/ignore");
+static void tgNoteAccepted() {
+  portENTER_CRITICAL(&s_rateMux);
+  s_backoffS = 0;
+  portEXIT_CRITICAL(&s_rateMux);
+}
 
-  if (do_snap) {
-    telegramSendMessage("📸 On it! Capturing...");
-    takeAndSendPhoto(PHOTO_CAPTION, 120);
-  } else if (do_ignore) {
-    telegramSendMessage("✅ Ignored. No action taken.");
-    // (Optional) end awake window early:
-    // enterDeepSleep();
+uint32_t tgRateLimitRemainingMs() {
+  portENTER_CRITICAL(&s_rateMux);
+  uint32_t left = 0;
+  if (s_holding) {
+    const int32_t d = (int32_t)(s_holdUntilMs - millis());
+    if (d > 0) {
+      left = (uint32_t)d;
+    } else {
+      s_holding = false;
+    }
   }
+  portEXIT_CRITICAL(&s_rateMux);
+  return left;
+}
 
+bool TelegramSession::request(const ReqBuf& head, BodyWriter write_body, void* write_ctx,
+                              BodySink sink, void* sink_ctx, uint32_t timeout_ms) {
+  result_ = TgResult();
+  if (head.overflow()) {
+    Serial.println("[TG] Request too large for its buffer");
+    return false;
+  }
+  // One retry: a reused connection may have been closed by the server while idle.
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (!connect()) return false;
+    requests_++;
+    bool got_any = false;
+    bool sent = client_.write((const uint8_t*)head.c_str(), head.length()) == head.length();
+    if (sent && write_body) sent = write_body(client_, write_ctx);
+    const uint32_t t_sent = millis();
+    if (sent && readResponse(sink, sink_ctx, timeout_ms, &got_any, t_sent)) {
+      if (result_.http_status == 429) {
+        tgNoteRateLimit(result_.retry_after_s);
+      } else if (result_.ok) {
+        tgNoteAccepted();
+      }
+      if (!result_.ok) {
+        Serial.printf("[TG] HTTP %d, error %d: %s\n", result_.http_status, result_.error_code,
+                      result_.description[0] ? result_.description : "(no description)");
+      }
+      return result_.ok;
+    }
+    stop();
+    if (!reused_ || got_any || cancelled()) break;
+    Serial.println("[TG] Kept-alive connection dropped, reconnecting");
+  }
+  return false;
 }
 
-static void configurePirRtcInput() {
-  pinMode(PIR_PIN, INPUT);
-  rtc_gpio_deinit((gpio_num_t)PIR_PIN);
-  rtc_gpio_init((gpio_num_t)PIR_PIN);
-  rtc_gpio_set_direction((gpio_num_t)PIR_PIN, RTC_GPIO_MODE_INPUT_ONLY);
-  rtc_gpio_pullup_dis((gpio_num_t)PIR_PIN);
-  rtc_gpio_pulldown_en((gpio_num_t)PIR_PIN);  // idle LOW
+float TelegramSession::reuseRatio() const {
+  if (requests_ == 0) return 0.0f;
+  return (float)(requests_ - handshakes_) / (float)requests_;
 }
 
-void logWakeCause() {
-  esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
-  switch (cause) {
-    case ESP_SLEEP_WAKEUP_EXT1: Serial.println("[BOOT] Wake: EXT1 (PIR)"); break;
-    case ESP_SLEEP_WAKEUP_EXT0: Serial.println("[BOOT] Wake: EXT0"); break;
-    case ESP_SLEEP_WAKEUP_TIMER: Serial.println("[BOOT] Wake: TIMER"); break;
-    case ESP_SLEEP_WAKEUP_UNDEFINED: Serial.println("[BOOT] Power-on reset"); break;
-    default: Serial.printf("[BOOT] Wake cause: %d\n", (int)cause); break;
-  }
+void TelegramSession::logStats() const {
+  const uint32_t full = handshakes_ - resumed_handshakes_;
+  Serial.printf("[TG] %lu requests over %lu handshakes (reuse %.0f%%)\n",
+                (unsigned long)requests_, (unsigned long)handshakes_, reuseRatio() * 100.0f);
+  Serial.printf("[TG] Handshakes: %lu resumed (avg %lu ms), %lu full (avg %lu ms)\n",
+                (unsigned long)resumed_handshakes_,
+                (unsigned long)(resumed_handshakes_ ? resumed_ms_ / resumed_handshakes_ : 0),
+                (unsigned long)full, (unsigned long)(full ? full_ms_ / full : 0));
 }
 
-void enterDeepSleep() {
-  configurePirRtcInput();
+// Inline keyboard with two buttons that send callback data
+static const char kPirButtonsMarkup[] =
+    "{\"inline_keyboard\":[["
+    "{\"text\":\"\\uD83D\\uDCF8 /snap\",\"callback_data\":\"cf:snap\"},"
+    "{\"text\":\"\\u274E /ignore\",\"callback_data\":\"cf:ignore\"}"
+    "]]}";
+
+bool telegramSendMessageWithButtons(const char* text) {
+  // Build GET with URL-encoded text and reply_markup
+  char buf[TG_REQ_BUF_SIZE];
+  ReqBuf req(buf, sizeof(buf));
+  beginApiRequest(req, "GET", "sendMessage");
+  req.add("?chat_id=" CHAT_ID "&text=").addUrlEncoded(text)
+     .add("&reply_markup=").addUrlEncoded(kPirButtonsMarkup);
+  finishHead(req);
+
+  return tgSession.request(req);
+}
+
+struct PhotoUpload {
+  const ReqBuf* part_head;
+  const uint8_t* jpg_buf;
+  size_t jpg_len;
+};
+
+// The socket takes what fits; keep going until everything is out. Returns the bytes
+// written, short only if the connection stalled.
+static size_t clientWriteAll(Client& client, const uint8_t* data, size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    size_t chunk = client.write(data + written, len - written);
+    if (chunk == 0) break;
+    written += chunk;
+  }
+  return written;
+}
+
+static bool writePhotoBody(Client& client, void* ctx) {
+  const PhotoUpload* up = (const PhotoUpload*)ctx;
+  client.write((const uint8_t*)up->part_head->c_str(), up->part_head->length());
+
+  const uint32_t t0 = millis();
+  const size_t written = clientWriteAll(client, up->jpg_buf, up->jpg_len);
+  recordUploadThroughput(written, millis() - t0);
+  if (written < up->jpg_len) {
+    Serial.println("[TG] Write stalled");
+    return false;
+  }
+
+  client.write((const uint8_t*)kMultipartTail, sizeof(kMultipartTail) - 1);
+  return true;
+}
+
+static void feedScannerSink(const char* data, size_t len, void* ctx) {
+  ((TgJsonScanner*)ctx)->feed(data, len);
+}
+
+static const char* const kExtraChatIds[] = { EXTRA_CHAT_IDS nullptr };
+static const uint8_t kExtraChats = sizeof(kExtraChatIds) / sizeof(kExtraChatIds[0]) - 1;
+
+FanoutStats fanoutStats;
+static RecipientStats s_recipients[kExtraChats + 1];
+static portMUX_TYPE   s_fanoutMux = portMUX_INITIALIZER_UNLOCKED;
+
+uint8_t extraChatCount() {
+  return kExtraChats;
+}
+
+const RecipientStats& recipientStats(uint8_t i) {
+  return s_recipients[i <= kExtraChats ? i : 0];
+}
+
+// Photos are sent from the loop and the uploader task, so counters take the lock.
+static void countDelivery(uint8_t recipient, bool ok) {
+  portENTER_CRITICAL(&s_fanoutMux);
+  if (ok) {
+    s_recipients[recipient].ok++;
+  } else {
+    s_recipients[recipient].failed++;
+  }
+  portEXIT_CRITICAL(&s_fanoutMux);
+}
+
+// Multipart upload of the JPEG itself to one chat. Returns the bytes written in *sent_bytes.
+static bool uploadPhoto(const char* chat_id, const uint8_t* jpg_buf, size_t jpg_len,
+                        const char* caption, TelegramSession& session,
+                        char* file_id, size_t file_id_cap, size_t* sent_bytes,
+                        const char* reply_markup = nullptr) {
+  char part_buf[TG_REQ_BUF_SIZE];
+  ReqBuf part(part_buf, sizeof(part_buf));
+  addFormField(part, "chat_id", chat_id);
+  addFormField(part, "caption", caption ? caption : "");
+  if (reply_markup) addFormField(part, "reply_markup", reply_markup);
+  part.add("--" TG_BOUNDARY "\r\n"
+           "Content-Disposition: form-data; name=\"photo\"; filename=\"snap.jpg\"\r\n"
+           "Content-Type: image/jpeg\r\n\r\n");
+
+  const size_t contentLength = part.length() + jpg_len + sizeof(kMultipartTail) - 1;
+
+  char head_buf[256];
+  ReqBuf req(head_buf, sizeof(head_buf));
+  beginApiRequest(req, "POST", "sendPhoto");
+  finishHead(req, contentLength, "multipart/form-data; boundary=" TG_BOUNDARY);
+
+  if (part.overflow()) {
+    Serial.println("[TG] Caption too long");
+    return false;
+  }
+  PhotoUpload up = { &part, jpg_buf, jpg_len };
+  file_id[0] = '\0';
+  TgFileIdParser parser(file_id, file_id_cap);
+  *sent_bytes = req.length() + contentLength;
+  Serial.printf("[TG] Uploading %u bytes to %s...\n", (unsigned)jpg_len, TELEGRAM_HOST);
+  return session.request(req, writePhotoBody, &up, feedScannerSink, &parser, 8000);
+}
+
+// Re-send an already uploaded photo by its file_id: a few hundred bytes instead of the JPEG.
+static bool forwardPhoto(const char* chat_id, const char* file_id, const char* caption,
+                         TelegramSession& session, size_t* sent_bytes) {
+  char buf[TG_REQ_BUF_SIZE];
+  ReqBuf req(buf, sizeof(buf));
+  beginApiRequest(req, "GET", "sendPhoto");
+  req.add("?chat_id=").addUrlEncoded(chat_id)
+     .add("&photo=").addUrlEncoded(file_id)
+     .add("&caption=").addUrlEncoded(caption ? caption : "");
+  finishHead(req);
+  *sent_bytes = req.length();
+  return session.request(req);
+}
+
+bool telegramSendPhoto(const uint8_t* jpg_buf, size_t jpg_len, const char* caption,
+                       TelegramSession& session, const char* reply_markup) {
+  char file_id[TG_FILE_ID_MAX];
+  size_t upload_bytes = 0;
+  const bool ok = uploadPhoto(CHAT_ID, jpg_buf, jpg_len, caption, session,
+                              file_id, sizeof(file_id), &upload_bytes, reply_markup);
+  countDelivery(0, ok);
+  if (kExtraChats == 0) return ok;
+
+  // A file_id that filled the scanner's value buffer may be cut short: do not trust it.
+  const bool have_id = ok && file_id[0] && strlen(file_id) < sizeof(file_id) - 1;
+  uint32_t forward_bytes = 0;
+  uint8_t forwarded = 0;
+  for (uint8_t i = 0; i < kExtraChats; ++i) {
+    size_t bytes = 0;
+    bool sent;
+    if (have_id) {
+      sent = forwardPhoto(kExtraChatIds[i], file_id, caption, session, &bytes);
+      if (sent) {
+        forward_bytes += bytes;
+        forwarded++;
+      }
+    } else {
+      char unused[TG_FILE_ID_MAX];
+      sent = uploadPhoto(kExtraChatIds[i], jpg_buf, jpg_len, caption, session,
+                         unused, sizeof(unused), &bytes);
+    }
+    countDelivery(i + 1, sent);
+    if (!sent) Serial.printf("[TG] Photo to extra chat %u failed\n", (unsigned)(i + 1));
+  }
+
+  if (have_id) {
+    portENTER_CRITICAL(&s_fanoutMux);
+    fanoutStats.uploads++;
+    fanoutStats.forwards += forwarded;
+    fanoutStats.upload_bytes += upload_bytes;
+    fanoutStats.forward_bytes += forward_bytes;
+    fanoutStats.bytes_saved += forwarded * upload_bytes - forward_bytes;
+    portEXIT_CRITICAL(&s_fanoutMux);
+    Serial.printf("[TG] Sent to %u/%u extra chats by file_id: %lu B instead of %lu B\n",
+                  (unsigned)forwarded, (unsigned)kExtraChats, (unsigned long)forward_bytes,
+                  (unsigned long)(forwarded * upload_bytes));
+  }
+  return ok;
+}
+
+static bool sendMessageNow(const char* text) {
+  char buf[TG_REQ_BUF_SIZE];
+  ReqBuf req(buf, sizeof(buf));
+  beginApiRequest(req, "GET", "sendMessage");
+  req.add("?chat_id=" CHAT_ID "&text=").addUrlEncoded(text);
+  finishHead(req);
+
+  Serial.printf("[TG] sendMessage...\n");
+  return tgSession.request(req);
+}
+
+bool telegramSendMessage(const char* text) {
+  // Asking again during a hold only extends it: let the text wait in the outbox.
+  if (tgRateLimitRemainingMs() > 0) return tgNotify(text);
+  return sendMessageNow(text);
+}
+
+// ------------ outbound message queue ------------
+
+OutboxStats outboxStats;
+static char     s_outbox[TG_OUTBOX_TEXT_MAX];
+static size_t   s_outboxLen = 0;
+static uint8_t  s_outboxCount = 0;   // notices in s_outbox
+
+bool tgNotify(const char* text) {
+  const size_t n = strlen(text);
+  outboxStats.notices++;
+  if (s_outboxLen && s_outboxLen + 1 + n >= sizeof(s_outbox)) tgOutboxService();
+  if (s_outboxLen + (s_outboxLen ? 1 : 0) + n >= sizeof(s_outbox)) {
+    outboxStats.dropped++;
+    Serial.printf("[TG] Outbox full, notice dropped: %s\n", text);
+    return false;
+  }
+  if (s_outboxLen) s_outbox[s_outboxLen++] = '\n';
+  memcpy(s_outbox + s_outboxLen, text, n + 1);
+  s_outboxLen += n;
+  s_outboxCount++;
+  return true;
+}
+
+const char* tgOutboxMergeCaption(const char* caption, char* out, size_t cap) {
+  if (s_outboxLen == 0) return caption;
+  const size_t cap_len = caption ? strlen(caption) : 0;
+  const size_t limit = cap < PHOTO_CAPTION_MAX ? cap : PHOTO_CAPTION_MAX;
+  if (s_outboxLen + (cap_len ? 1 : 0) + cap_len >= limit) return caption;
+  memcpy(out, s_outbox, s_outboxLen);
+  size_t n = s_outboxLen;
+  if (cap_len) {
+    out[n++] = '\n';
+    memcpy(out + n, caption, cap_len);
+    n += cap_len;
+  }
+  out[n] = '\0';
+  outboxStats.merged += s_outboxCount;
+  s_outboxLen = 0;
+  s_outboxCount = 0;
+  return out;
+}
+
+void tgOutboxService() {
+  if (s_outboxLen == 0 || tgRateLimitRemainingMs() > 0 || WiFi.status() != WL_CONNECTED) return;
+  outboxStats.messages++;
+  if (!sendMessageNow(s_outbox) && tgSession.lastResult().http_status != 429) {
+    // Not a rate limit: the text itself or the link is the problem, do not retry forever.
+    Serial.println("[TG] Queued notices could not be sent");
+    outboxStats.dropped += s_outboxCount;
+  } else if (!tgSession.lastResult().ok) {
+    return; // held by the 429, try again later
+  }
+  s_outboxLen = 0;
+  s_outboxCount = 0;
+}
+
+bool tgOutboxFlush(uint32_t timeout_ms) {
+  const uint32_t start = millis();
+  while (s_outboxLen > 0) {
+    const uint32_t hold = tgRateLimitRemainingMs();
+    if (hold > 0) {
+      if (millis() - start + hold > timeout_ms) {
+        Serial.printf("[TG] Rate-limit hold outlasts the flush; %u notice(s) dropped\n",
+                      (unsigned)s_outboxCount);
+        outboxStats.dropped += s_outboxCount;
+        s_outboxLen = 0;
+        s_outboxCount = 0;
+        return false;
+      }
+      delay(hold);
+    }
+    tgOutboxService();
+    if (s_outboxLen > 0 && tgRateLimitRemainingMs() == 0) return false; // link is down
+  }
+  Serial.printf("[TG] Outbox: %lu notices, %lu in captions, %lu message(s), %lu dropped, %lu 429s\n",
+                (unsigned long)outboxStats.notices, (unsigned long)outboxStats.merged,
+                (unsigned long)outboxStats.messages, (unsigned long)outboxStats.dropped,
+                (unsigned long)outboxStats.rate_limited);
+  return true;
+}
+
+// ------------ adaptive framesize / quality ------------
+
+struct CaptureRung {
+  framesize_t size;
+  uint8_t     quality;
+  uint32_t    expected_bytes;  // typical OV2640 JPEG size for an indoor scene
+  const char* name;
+};
+
+// Best first. Never above the init framesize: frame buffers are sized for it.
+static const CaptureRung kCaptureLadder[] = {
+  { FRAMESIZE_SVGA, 20, 40000, "SVGA q20" },
+  { FRAMESIZE_SVGA, 28, 28000, "SVGA q28" },
+  { FRAMESIZE_VGA,  25, 20000, "VGA q25"  },
+  { FRAMESIZE_VGA,  32, 14000, "VGA q32"  },
+  { FRAMESIZE_CIF,  32,  9000, "CIF q32"  },
+  { FRAMESIZE_QVGA, 35,  6000, "QVGA q35" },
+};
+static const uint8_t kCaptureRungs = sizeof(kCaptureLadder) / sizeof(kCaptureLadder[0]);
+
+static framesize_t s_maxFramesize = FRAMESIZE_SVGA;
+static int8_t      s_appliedRung = -1;
+static volatile bool s_clipRecording = false;  // a clip on the upload task has the sensor
+
+// Throughput guess when nothing has been measured yet.
+static uint32_t uplinkPriorBps(int8_t rssi) {
+  if (rssi >= -60) return 150000;
+  if (rssi >= -70) return 60000;
+  if (rssi >= -80) return 20000;
+  return 8000;
+}
+
+static uint32_t estimateUplinkBps(int8_t rssi_now) {
+  if (s_rtc.uplink_bps == 0 || rssi_now == 0) {
+    return s_rtc.uplink_bps ? s_rtc.uplink_bps : uplinkPriorBps(rssi_now);
+  }
+  // Roughly halve the learned rate for every 6 dB the link got worse since it was measured.
+  uint32_t bps = s_rtc.uplink_bps;
+  for (int drop = s_rtc.uplink_rssi - rssi_now; drop >= 6 && bps > 1000; drop -= 6) bps /= 2;
+  return bps;
+}
+
+void recordUploadThroughput(size_t bytes, uint32_t ms) {
+  // Small writes only fill the socket buffer and say nothing about the link.
+  if (bytes < 8192 || ms < 20) return;
+  const uint32_t bps = (uint32_t)((uint64_t)bytes * 1000 / ms);
+  traceValue(TR_UPLINK_BPS, bps);
+  s_rtc.uplink_bps = s_rtc.uplink_bps ? (s_rtc.uplink_bps * 3 + bps) / 4 : bps;
+  s_rtc.uplink_rssi = (int8_t)WiFi.RSSI();
+  Serial.printf("[ADAPT] Upload %u B in %lu ms = %lu B/s (learned %lu B/s @ %d dBm)\n",
+                (unsigned)bytes, (unsigned long)ms, (unsigned long)bps,
+                (unsigned long)s_rtc.uplink_bps, (int)s_rtc.uplink_rssi);
+}
+
+void noteCapturedSize(size_t bytes) {
+  traceValue(TR_JPEG_BYTES, bytes);
+  if (s_appliedRung < 0) return;
+  // Scene complexity: how far real JPEGs are from the ladder's estimates (EWMA, percent).
+  const uint32_t pct = (uint32_t)((uint64_t)bytes * 100 / kCaptureLadder[s_appliedRung].expected_bytes);
+  const uint32_t prev = s_rtc.jpeg_scale_pct ? s_rtc.jpeg_scale_pct : 100;
+  s_rtc.jpeg_scale_pct = (uint16_t)min<uint32_t>((prev * 3 + pct) / 4, 1000);
+}
+
+void applyAdaptiveCapture() {
+  const int8_t rssi = (int8_t)WiFi.RSSI();
+  const uint32_t bps = estimateUplinkBps(rssi);
+  const uint32_t scale = s_rtc.jpeg_scale_pct ? s_rtc.jpeg_scale_pct : 100;
+
+  uint8_t pick = kCaptureRungs - 1;
+  uint32_t predicted_ms = 0;
+  for (uint8_t i = 0; i < kCaptureRungs; ++i) {
+    if (kCaptureLadder[i].size > s_maxFramesize) continue;
+    const uint32_t bytes = kCaptureLadder[i].expected_bytes * scale / 100;
+    predicted_ms = (uint32_t)((uint64_t)bytes * 1000 / bps);
+    pick = i;
+    if (predicted_ms <= UPLOAD_BUDGET_MS) break;
+  }
+
+  Serial.printf("[ADAPT] rssi=%d dBm uplink~%lu B/s scale=%lu%% -> %s (~%lu ms)\n", (int)rssi,
+                (unsigned long)bps, (unsigned long)scale, kCaptureLadder[pick].name,
+                (unsigned long)predicted_ms);
+  if (pick == s_appliedRung) return;
+  // A clip on the upload task owns the sensor settings until its recording ends; this
+  // capture goes out at the current rung and the next one adapts.
+  if (s_clipRecording) {
+    Serial.println("[ADAPT] Clip recording, keeping the current rung");
+    return;
+  }
+  s_rtc.capture_rung = pick;
+
+  sensor_t* sensor = esp_camera_sensor_get();
+  if (!sensor) return;
+  const bool resize = s_appliedRung < 0 || kCaptureLadder[s_appliedRung].size != kCaptureLadder[pick].size;
+  if (resize) sensor->set_framesize(sensor, kCaptureLadder[pick].size);
+  sensor->set_quality(sensor, kCaptureLadder[pick].quality);
+  s_appliedRung = pick;
+  // The frame in flight was started with the old settings; let it pass.
+  if (resize) warmUpCamera(1);
+}
+
+bool initCamera() {
+  camera_config_t config;
+  config.ledc_channel = LEDC_CHANNEL_0;
+  config.ledc_timer   = LEDC_TIMER_0;
+  config.pin_d0       = Y2_GPIO_NUM;
+  config.pin_d1       = Y3_GPIO_NUM;
+  config.pin_d2       = Y4_GPIO_NUM;
+  config.pin_d3       = Y5_GPIO_NUM;
+  config.pin_d4       = Y6_GPIO_NUM;
+  config.pin_d5       = Y7_GPIO_NUM;
+  config.pin_d6       = Y8_GPIO_NUM;
+  config.pin_d7       = Y9_GPIO_NUM;
+  config.pin_xclk     = XCLK_GPIO_NUM;
+  config.pin_pclk     = PCLK_GPIO_NUM;
+  config.pin_vsync    = VSYNC_GPIO_NUM;
+  config.pin_href     = HREF_GPIO_NUM;
+  config.pin_sccb_sda = SIOD_GPIO_NUM;
+  config.pin_sccb_scl = SIOC_GPIO_NUM;
+  config.pin_pwdn     = PWDN_GPIO_NUM;
+  config.pin_reset    = RESET_GPIO_NUM;
+  config.xclk_freq_hz = 20000000;
+  config.pixel_format = PIXFORMAT_JPEG;
+
+  // Final framesize/quality go straight into the config: frame buffers are sized for
+  // it and no sensor reconfiguration is needed after init.
+  if (psramFound()) {
+    config.frame_size = FRAMESIZE_SVGA; // 800x600, top rung of the adaptive ladder
+    config.jpeg_quality = 20;           // 10=better, 63=smaller
+    // Ring of frame buffers in PSRAM; the driver's DMA task keeps overwriting the
+    // oldest one, so the next fb_get() always hands out the freshest frame.
+    config.fb_count = CAM_FB_COUNT;
+    config.fb_location = CAMERA_FB_IN_PSRAM;
+    config.grab_mode = CAMERA_GRAB_LATEST;
+    Serial.println("PSRAM found.");
+  } else {
+    config.frame_size = FRAMESIZE_QVGA; // larger JPEGs do not fit a DRAM frame buffer
+    config.jpeg_quality = 20;
+    config.fb_count = 1;
+    config.fb_location = CAMERA_FB_IN_DRAM;
+    config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
+  }
+
+  s_maxFramesize = config.frame_size;
+  s_appliedRung = -1;
+
+  esp_err_t err = esp_camera_init(&config);
+  if (err != ESP_OK) {
+    Serial.printf("[CAM] Init failed 0x%x\n", err);
+    return false;
+  }
+  return true;
+}
+
+void warmUpCamera(uint8_t frames) {
+  // Let auto-exposure / white balance settle on frames nobody will see.
+  for (uint8_t i = 0; i < frames; ++i) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) return;
+    esp_camera_fb_return(fb);
+  }
+}
+
+// ------------ microSD frame journal ------------
+
+FrameJournal::FrameJournal(fs::FS& fs, const char* base) : fs_(fs), base_(base) {}
+
+void FrameJournal::path(char* out, size_t cap, const char* ext) const {
+  snprintf(out, cap, "%s.%s", base_, ext);
+}
+
+static uint32_t journalRecordCrc(const JournalRecord& rec, const char* caption, const uint8_t* data) {
+  uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)&rec, offsetof(JournalRecord, crc));
+  crc = esp_rom_crc32_le(crc, (const uint8_t*)caption, rec.caption_len);
+  return esp_rom_crc32_le(crc, data, rec.data_len);
+}
+
+bool FrameJournal::readIndexEntry(uint32_t i, IndexEntry* e) {
+  char idx_path[32];
+  path(idx_path, sizeof(idx_path), "idx");
+  File idx = fs_.open(idx_path, FILE_READ);
+  if (!idx) return false;
+  const bool ok = idx.seek(i * sizeof(IndexEntry)) &&
+                  idx.read((uint8_t*)e, sizeof(*e)) == sizeof(*e);
+  idx.close();
+  return ok;
+}
+
+bool FrameJournal::saveCursor() {
+  char pos_path[32];
+  path(pos_path, sizeof(pos_path), "pos");
+  File pos = fs_.open(pos_path, FILE_WRITE);
+  if (!pos) return false;
+  // Stored with its complement: a torn write reads back as "nothing drained".
+  const uint32_t cur[2] = { drained_, ~drained_ };
+  const bool ok = pos.write((const uint8_t*)cur, sizeof(cur)) == sizeof(cur);
+  pos.close();
+  return ok;
+}
+
+bool FrameJournal::open() {
+  char dat_path[32], idx_path[32], pos_path[32];
+  path(dat_path, sizeof(dat_path), "dat");
+  path(idx_path, sizeof(idx_path), "idx");
+  path(pos_path, sizeof(pos_path), "pos");
+  entries_ = drained_ = 0;
+  if (!fs_.exists(idx_path)) return true; // empty journal
+
+  File idx = fs_.open(idx_path, FILE_READ);
+  if (!idx) return false;
+  const size_t idx_size = idx.size();
+  idx.close();
+  size_t dat_size = 0;
+  if (fs_.exists(dat_path)) {
+    File dat = fs_.open(dat_path, FILE_READ);
+    if (dat) {
+      dat_size = dat.size();
+      dat.close();
+    }
+  }
+
+  // Never trust an index entry that points past the data actually on the card.
+  entries_ = idx_size / sizeof(IndexEntry);
+  IndexEntry last = { 0, 0 };
+  while (entries_ > 0) {
+    if (readIndexEntry(entries_ - 1, &last) && (uint64_t)last.offset + last.length <= dat_size) break;
+    entries_--;
+    last = { 0, 0 };
+  }
+
+  if (entries_ * sizeof(IndexEntry) != idx_size) {
+    // Torn index append: keep the complete entries so later appends stay aligned.
+    char tmp_path[32];
+    path(tmp_path, sizeof(tmp_path), "tmp");
+    File src = fs_.open(idx_path, FILE_READ);
+    File dst = fs_.open(tmp_path, FILE_WRITE);
+    bool ok = src && dst;
+    uint8_t buf[128];
+    for (size_t left = entries_ * sizeof(IndexEntry); ok && left > 0;) {
+      const size_t n = left < sizeof(buf) ? left : sizeof(buf);
+      ok = src.read(buf, n) == n && dst.write(buf, n) == n;
+      left -= n;
+    }
+    if (src) src.close();
+    if (dst) dst.close();
+    if (!ok || !fs_.remove(idx_path) || !fs_.rename(tmp_path, idx_path)) return false;
+    Serial.printf("[JOURNAL] Repaired index: %u -> %lu entries\n",
+                  (unsigned)(idx_size / sizeof(IndexEntry)), (unsigned long)entries_);
+  }
+
+  // A record appended after the last index entry was cut off by a reset; it is skipped.
+  const uint64_t end = (uint64_t)last.offset + last.length;
+  if (dat_size > end) {
+    Serial.printf("[JOURNAL] Ignoring %lu bytes of an unfinished record\n",
+                  (unsigned long)(dat_size - end));
+  }
+
+  File pos = fs_.open(pos_path, FILE_READ);
+  uint32_t cur[2];
+  if (pos && pos.read((uint8_t*)cur, sizeof(cur)) == sizeof(cur) && cur[1] == ~cur[0] &&
+      cur[0] <= entries_) {
+    drained_ = cur[0];
+  }
+  if (pos) pos.close();
+  if (pending() == 0 && entries_ > 0) {
+    drained_ = entries_ - 1;
+    return advance(); // everything was sent: start over with empty files
+  }
+  return true;
+}
+
+// Length of `s` cut to at most `max` bytes without splitting a UTF-8 character; Telegram
+// answers 400 to a caption with a broken sequence.
+static size_t utf8Prefix(const char* s, size_t max) {
+  size_t n = strnlen(s, max);
+  if (s[n] == '\0') return n;
+  while (n > 0 && ((uint8_t)s[n] & 0xC0) == 0x80) n--;
+  return n;
+}
+
+bool FrameJournal::append(uint8_t kind, uint32_t wake, const char* caption,
+                          const uint8_t* data, size_t len) {
+  if (len > JOURNAL_MAX_RECORD) return false;
+  char dat_path[32], idx_path[32];
+  path(dat_path, sizeof(dat_path), "dat");
+  path(idx_path, sizeof(idx_path), "idx");
+
+  JournalRecord rec = {};
+  rec.magic = JOURNAL_MAGIC;
+  rec.seq = entries_;
+  rec.wake = wake;
+  rec.uptime_ms = millis();
+  rec.caption_len = (uint16_t)utf8Prefix(caption ? caption : "", PHOTO_CAPTION_MAX - 1);
+  rec.kind = kind;
+  rec.data_len = (uint32_t)len;
+  rec.crc = journalRecordCrc(rec, caption ? caption : "", data);
+
+  File dat = fs_.open(dat_path, FILE_APPEND, true);
+  if (!dat) return false;
+  const uint32_t offset = (uint32_t)dat.size();
+  bool ok = dat.write((const uint8_t*)&rec, sizeof(rec)) == sizeof(rec) &&
+            dat.write((const uint8_t*)(caption ? caption : ""), rec.caption_len) == rec.caption_len &&
+            dat.write(data, len) == len;
+  dat.flush();
+  dat.close();
+  if (!ok) return false;
+
+  // The index entry is the commit point: written only once the record is on the card.
+  const IndexEntry e = { offset, (uint32_t)(sizeof(rec) + rec.caption_len + len) };
+  File idx = fs_.open(idx_path, FILE_APPEND, true);
+  if (!idx) return false;
+  ok = idx.write((const uint8_t*)&e, sizeof(e)) == sizeof(e);
+  idx.close();
+  if (ok) entries_++;
+  return ok;
+}
+
+// Read and sanity-check the header and caption of the record at `e` (cap_buf: PHOTO_CAPTION_MAX).
+bool FrameJournal::readHeader(File& dat, const IndexEntry& e, JournalRecord* rec, char* cap_buf) {
+  const bool ok = dat.seek(e.offset) && dat.read((uint8_t*)rec, sizeof(*rec)) == sizeof(*rec) &&
+                  rec->magic == JOURNAL_MAGIC && rec->caption_len < PHOTO_CAPTION_MAX &&
+                  rec->data_len <= JOURNAL_MAX_RECORD &&
+                  sizeof(*rec) + rec->caption_len + rec->data_len == e.length &&
+                  dat.read((uint8_t*)cap_buf, rec->caption_len) == rec->caption_len;
+  cap_buf[ok ? rec->caption_len : 0] = '\0';
+  return ok;
+}
+
+bool FrameJournal::read(uint32_t k, JournalRecord* rec, char* caption, size_t caption_cap, uint8_t** data) {
+  *data = nullptr;
+  IndexEntry e;
+  if (k >= pending() || !readIndexEntry(drained_ + k, &e)) return false;
+  char dat_path[32];
+  path(dat_path, sizeof(dat_path), "dat");
+  File dat = fs_.open(dat_path, FILE_READ);
+  if (!dat) return false;
+
+  char cap_buf[PHOTO_CAPTION_MAX];
+  bool ok = readHeader(dat, e, rec, cap_buf);
+  if (ok) {
+    *data = (uint8_t*)(psramFound() ? ps_malloc(rec->data_len) : malloc(rec->data_len));
+    ok = *data && dat.read(*data, rec->data_len) == rec->data_len &&
+         journalRecordCrc(*rec, cap_buf, *data) == rec->crc;
+  }
+  dat.close();
+  if (!ok) {
+    free(*data);
+    *data = nullptr;
+    return false;
+  }
+  strlcpy(caption, cap_buf, caption_cap);
+  return true;
+}
+
+bool FrameJournal::advance() {
+  if (pending() == 0) return false;
+  drained_++;
+  if (drained_ < entries_) return saveCursor();
+  char p[32];
+  static const char* const kExts[] = { "dat", "idx", "pos" };
+  for (const char* ext : kExts) {
+    path(p, sizeof(p), ext);
+    if (fs_.exists(p)) fs_.remove(p);
+  }
+  entries_ = drained_ = 0;
+  return true;
+}
+
+static FrameJournal      s_journal(SD_MMC, JOURNAL_BASE_PATH);
+static FrameJournal      s_timelapse(SD_MMC, TIMELAPSE_BASE_PATH);
+static SemaphoreHandle_t s_journalLock = nullptr;
+static bool              s_sdMounted = false;
+static bool              s_sdFailed = false;     // no card this wake: do not keep retrying
+static volatile bool     s_journalBusy = false;
+static volatile bool     s_journalDrain = true;
+
+void journalBegin() {
+  if (!s_journalLock) s_journalLock = xSemaphoreCreateMutex();
+}
+
+// Caller holds s_journalLock.
+static bool journalMountLocked() {
+  if (s_sdMounted) return true;
+  if (s_sdFailed || feederBusy()) return false;
+  const uint32_t t0 = millis();
+  // 1-bit mode (CLK 14, CMD 15, D0 2) leaves GPIO4 (flash LED), 12 and 13 (PIR) alone.
+  if (!SD_MMC.begin("/sdcard", true)) {
+    s_sdFailed = true;
+    Serial.println("[JOURNAL] No microSD card");
+    return false;
+  }
+  s_sdMounted = true;
+  if (!s_journal.open()) Serial.println("[JOURNAL] Could not read the journal index");
+  if (!s_timelapse.open()) Serial.println("[JOURNAL] Could not read the timelapse index");
+  Serial.printf("[JOURNAL] Card mounted in %lu ms, %lu frame(s) pending\n",
+                (unsigned long)(millis() - t0), (unsigned long)s_journal.pending());
+  return true;
+}
+
+bool journalFrame(const uint8_t* jpg, size_t len, const char* caption) {
+  if (!s_journalLock) return false;
+  xSemaphoreTake(s_journalLock, portMAX_DELAY);
+  const bool ok = journalMountLocked() &&
+                  s_journal.append(JOURNAL_KIND_PHOTO, rtcWakeCount(), caption, jpg, len);
+  const uint32_t pending = s_journal.pending();
+  xSemaphoreGive(s_journalLock);
+  Serial.printf("[JOURNAL] %s %u bytes (%lu pending)\n", ok ? "Saved" : "Could not save",
+                (unsigned)len, (unsigned long)pending);
+  return ok;
+}
+
+bool journalCapture(const char* caption) {
+  camera_fb_t* fb = grabFreshFrame(esp_timer_get_time());
+  if (!fb) return false;
+  const bool ok = journalFrame(fb->buf, fb->len, caption);
+  esp_camera_fb_return(fb);
+  return ok;
+}
+
+bool tgFailureIsTransient(const TgResult& r) {
+  return r.http_status == 0 || r.http_status == 429 || r.http_status >= 500;
+}
+
+bool journalDrainOne(TelegramSession& session) {
+  if (!s_journalLock) return false;
+  // Busy goes up before the enable check so drainPhotoPipeline() never misses a drain.
+  s_journalBusy = true;
+  if (!s_journalDrain) {
+    s_journalBusy = false;
+    return false;
+  }
+  JournalRecord rec;
+  char caption[PHOTO_CAPTION_MAX];
+  uint8_t* data = nullptr;
+  xSemaphoreTake(s_journalLock, portMAX_DELAY);
+  const bool have = journalMountLocked() && s_journal.pending() > 0;
+  const bool readable = have && s_journal.readNext(&rec, caption, sizeof(caption), &data);
+  if (have && !readable) {
+    s_journal.advance();
+    Serial.println("[JOURNAL] Skipped a corrupt record");
+  }
+  xSemaphoreGive(s_journalLock);
+  if (!readable) {
+    s_journalBusy = false;
+    return have;
+  }
+
+  // Room for the marker, a caption of the full PHOTO_CAPTION_MAX - 1 bytes and the wake number.
+  char full[PHOTO_CAPTION_MAX + 32];
+  snprintf(full, sizeof(full), "⏪ %s (wake #%lu)", caption, (unsigned long)rec.wake);
+  const bool sent = telegramSendPhoto(data, rec.data_len, full, session);
+  free(data);
+  // Telegram rejecting the frame outright will not change on a retry.
+  const bool consumed = sent || !tgFailureIsTransient(session.lastResult());
+  if (consumed) {
+    xSemaphoreTake(s_journalLock, portMAX_DELAY);
+    // If the feeder took the card meanwhile the frame is sent again later (at-least-once).
+    if (s_sdMounted) s_journal.advance();
+    xSemaphoreGive(s_journalLock);
+  }
+  Serial.printf("[JOURNAL] Backlog frame seq %lu %s\n", (unsigned long)rec.seq,
+                sent ? "sent" : (consumed ? "rejected, dropped" : "failed, kept"));
+  s_journalBusy = false;
+  return consumed;
+}
+
+void journalSetDrainEnabled(bool enabled) {
+  s_journalDrain = enabled;
+}
+
+bool journalDrainEnabled() {
+  return s_journalDrain;
+}
+
+bool journalBusy() {
+  return s_journalBusy;
+}
+
+uint32_t journalPending() {
+  if (!s_journalLock) return 0;
+  xSemaphoreTake(s_journalLock, portMAX_DELAY);
+  const uint32_t n = s_sdMounted ? s_journal.pending() : 0;
+  xSemaphoreGive(s_journalLock);
+  return n;
+}
+
+void journalSuspend() {
+  if (!s_journalLock) return;
+  xSemaphoreTake(s_journalLock, portMAX_DELAY);
+  if (s_sdMounted) {
+    SD_MMC.end();
+    s_sdMounted = false;
+  }
+  xSemaphoreGive(s_journalLock);
+}
+
+// ------------ timelapse ------------
+
+static_assert(TIMELAPSE_BATCH >= 2 && TIMELAPSE_BATCH <= 10, "sendMediaGroup takes 2..10 items");
+
+bool timelapseEnabled() {
+  return s_rtc.timelapse_on != 0;
+}
+
+void timelapseSetEnabled(bool enabled) {
+  s_rtc.timelapse_on = enabled ? 1 : 0;
+}
+
+int timelapseCapture() {
+  if (!s_journalLock) return -1;
+  camera_fb_t* fb = grabFreshFrame(esp_timer_get_time());
+  if (!fb) return -1;
+  xSemaphoreTake(s_journalLock, portMAX_DELAY);
+  const bool mounted = journalMountLocked();
+  const bool full = mounted && s_timelapse.pending() >= TIMELAPSE_MAX_PENDING;
+  const bool ok = mounted && !full &&
+                  s_timelapse.append(JOURNAL_KIND_PHOTO, rtcWakeCount(), "", fb->buf, fb->len);
+  // A full backlog still reports what is waiting, so this wake tries to upload it.
+  const int waiting = ok || full ? (int)s_timelapse.pending() : -1;
+  xSemaphoreGive(s_journalLock);
+  Serial.printf("[TL] Frame %u bytes %s (%d waiting)\n", (unsigned)fb->len,
+                ok ? "stored" : (full ? "not stored, backlog full" : "not stored"), waiting);
+  esp_camera_fb_return(fb);
+  return waiting;
+}
+
+struct AlbumItem {
+  uint8_t* data;
+  uint32_t len;
+};
+
+struct AlbumUpload {
+  const ReqBuf*    fields;
+  const AlbumItem* items;
+  uint8_t          count;
+};
+
+static size_t albumPartHead(char* out, size_t cap, uint8_t i) {
+  return snprintf(out, cap,
+                  "--" TG_BOUNDARY "\r\n"
+                  "Content-Disposition: form-data; name=\"p%u\"; filename=\"p%u.jpg\"\r\n"
+                  "Content-Type: image/jpeg\r\n\r\n", (unsigned)i, (unsigned)i);
+}
+
+static bool writeAlbumBody(Client& client, void* ctx) {
+  const AlbumUpload* up = (const AlbumUpload*)ctx;
+  client.write((const uint8_t*)up->fields->c_str(), up->fields->length());
+  size_t written = 0;
+  const uint32_t t0 = millis();
+  for (uint8_t i = 0; i < up->count; ++i) {
+    char head[160];
+    const size_t head_len = albumPartHead(head, sizeof(head), i);
+    if (client.write((const uint8_t*)head, head_len) != head_len ||
+        clientWriteAll(client, up->items[i].data, up->items[i].len) != up->items[i].len ||
+        client.write((const uint8_t*)"\r\n", 2) != 2) {
+      Serial.println("[TL] Album write stalled");
+      return false;
+    }
+    written += up->items[i].len;
+  }
+  recordUploadThroughput(written, millis() - t0);
+  client.write((const uint8_t*)kMultipartTail, sizeof(kMultipartTail) - 1);
+  return true;
+}
+
+static bool sendAlbum(TelegramSession& session, const AlbumItem* items, uint8_t count) {
+  size_t content_length = sizeof(kMultipartTail) - 1;
+  for (uint8_t i = 0; i < count; ++i) {
+    char head[160];
+    content_length += albumPartHead(head, sizeof(head), i) + items[i].len + 2;
+  }
+
+  char media_buf[TG_REQ_BUF_SIZE];
+  ReqBuf media(media_buf, sizeof(media_buf));
+  media.add("[");
+  for (uint8_t i = 0; i < count; ++i) {
+    media.add(i ? ",{" : "{").add("\"type\":\"photo\",\"media\":\"attach://p").addUInt(i).add("\"");
+    if (i == 0) {
+      media.add(",\"caption\":\"\xE2\x8F\xB1 Timelapse, ").addUInt(count)
+           .add(" frames every ").addUInt(TIMELAPSE_INTERVAL_S / 60).add(" min\"");
+    }
+    media.add("}");
+  }
+  media.add("]");
+
+  char fields_buf[TG_REQ_BUF_SIZE + 256];
+  ReqBuf fields(fields_buf, sizeof(fields_buf));
+  addFormField(fields, "chat_id", CHAT_ID);
+  addFormField(fields, "media", media.c_str());
+  if (media.overflow() || fields.overflow()) return false;
+  content_length += fields.length();
+
+  char head_buf[256];
+  ReqBuf req(head_buf, sizeof(head_buf));
+  beginApiRequest(req, "POST", "sendMediaGroup");
+  finishHead(req, content_length, "multipart/form-data; boundary=" TG_BOUNDARY);
+
+  AlbumUpload up = { &fields, items, count };
+  Serial.printf("[TL] Uploading album of %u frames (%u bytes)...\n", (unsigned)count,
+                (unsigned)content_length);
+  return session.request(req, writeAlbumBody, &up, nullptr, nullptr, 15000);
+}
+
+// Caller holds s_journalLock. Reads the oldest frames (up to 10, within
+// TIMELAPSE_ALBUM_BYTES) into memory. An unreadable oldest record is dropped; one further
+// in ends the album there and is dropped when the next album starts at it.
+static uint8_t timelapseLoadLocked(AlbumItem* items, uint32_t* skipped) {
+  uint8_t n = 0;
+  size_t bytes = 0;
+  while (n < 10 && n < s_timelapse.pending()) {
+    JournalRecord rec;
+    char caption[PHOTO_CAPTION_MAX];
+    uint8_t* data = nullptr;
+    if (!s_timelapse.read(n, &rec, caption, sizeof(caption), &data)) {
+      if (n > 0) break;
+      s_timelapse.advance();
+      (*skipped)++;
+      Serial.println("[TL] Skipped a corrupt frame");
+      continue;
+    }
+    if (n > 0 && bytes + rec.data_len > TIMELAPSE_ALBUM_BYTES) {
+      free(data);
+      break;
+    }
+    items[n++] = { data, rec.data_len };
+    bytes += rec.data_len;
+  }
+  return n;
+}
+
+// Sends loaded frames as one album (a single frame as a plain photo). If Telegram rejects
+// the album for good, the frames go one by one so only the bad one is lost. *done counts
+// the frames finished with, sent or dropped; false once a transient failure stops it.
+static bool timelapseSend(TelegramSession& session, const AlbumItem* items, uint8_t n,
+                          uint8_t* done, uint32_t* dropped) {
+  *done = 0;
+  if (n >= 2) {
+    if (sendAlbum(session, items, n)) {
+      *done = n;
+      return true;
+    }
+    if (tgFailureIsTransient(session.lastResult())) return false;
+    Serial.printf("[TL] Album rejected (HTTP %d), sending its frames one by one\n",
+                  session.lastResult().http_status);
+  }
+  for (uint8_t i = 0; i < n; ++i) {
+    if (!telegramSendPhoto(items[i].data, items[i].len, "\xE2\x8F\xB1 Timelapse", session)) {
+      if (tgFailureIsTransient(session.lastResult())) return false;
+      (*dropped)++;
+      Serial.println("[TL] Frame rejected, dropped");
+    }
+    (*done)++;
+  }
+  return true;
+}
+
+bool timelapseUpload(TelegramSession& session) {
+  if (!s_journalLock || !ensureWiFi()) return false;
+  const uint32_t t0 = millis();
+  uint32_t frames = 0;
+  uint32_t albums = 0;
+  uint32_t dropped = 0;
+  bool ok = true;
+  while (ok) {
+    AlbumItem items[10];
+    xSemaphoreTake(s_journalLock, portMAX_DELAY);
+    const bool mounted = journalMountLocked();
+    const uint8_t n = mounted ? timelapseLoadLocked(items, &dropped) : 0;
+    xSemaphoreGive(s_journalLock);
+    if (!mounted) ok = false;
+    if (n == 0) break;
+
+    uint8_t done = 0;
+    ok = timelapseSend(session, items, n, &done, &dropped);
+    for (uint8_t i = 0; i < n; ++i) free(items[i].data);
+    xSemaphoreTake(s_journalLock, portMAX_DELAY);
+    // If the feeder took the card meanwhile the frames are sent again later (at-least-once).
+    if (s_sdMounted) {
+      for (uint8_t i = 0; i < done; ++i) s_timelapse.advance();
+    }
+    xSemaphoreGive(s_journalLock);
+    frames += done;
+    if (done == n && n >= 2) albums++;
+  }
+
+  // Per-frame uploads would pay the association and handshake on every one of those wakes.
+  const uint32_t upload_ms = millis() - t0;
+  const uint32_t overhead_ms = s_wifiConnectMs + session.lastHandshakeMs();
+  const uint32_t batch_ms = overhead_ms + upload_ms;
+  const uint32_t single_ms = frames * overhead_ms + upload_ms;
+  Serial.printf("[TL] %lu frames in %lu album(s), %lu dropped%s: %lu ms radio (~%lu uAh); "
+                "one upload per wake would be ~%lu ms (~%lu uAh)\n",
+                (unsigned long)frames, (unsigned long)albums, (unsigned long)dropped,
+                ok ? "" : ", stopped on error",
+                (unsigned long)batch_ms, (unsigned long)((uint64_t)batch_ms * AWAKE_ACTIVE_MA / 3600),
+                (unsigned long)single_ms, (unsigned long)((uint64_t)single_ms * AWAKE_ACTIVE_MA / 3600));
+  return ok;
+}
+
+// ------------ capture -> upload pipeline ------------
+
+enum PhotoJobKind : uint8_t { JOB_PHOTO, JOB_PREVIEW, JOB_HELD_FRAME, JOB_CLIP };
+
+struct PhotoJob {
+  uint8_t      kind;
+  camera_fb_t* fb;            // JOB_PHOTO: driver frame, returned once sent
+  uint8_t*     jpg;           // JOB_PREVIEW, JOB_HELD_FRAME: heap JPEG, freed once sent
+  size_t       len;
+  uint32_t     request_ms;    // when the image was asked for (TR_FIRST_IMAGE); 0 = not timed
+  uint32_t     held_seq;      // JOB_PREVIEW: the held full frame its button refers to
+  char caption[PHOTO_CAPTION_MAX];
+};
+
+// The button names its preview, so a tap on an older one can't fetch the newest frame.
+static const char kFullResMarkupFmt[] =
+    "{\"inline_keyboard\":[[{\"text\":\"\\uD83D\\uDD0D Full resolution\",\"callback_data\":\"cf:full:%lu\"}]]}";
+
+static bool clipUpload(const char* caption, TelegramSession& session);
+static void notePreviewJob(const PhotoJob& job, bool ok, uint32_t upload_ms);
+
+PhotoPipelineStats photoStats;
+static QueueHandle_t s_photoQueue = nullptr;
+
+// One job, start to finish, on the uploader task or inline on the loop. Frees its buffers.
+static bool runPhotoJob(const PhotoJob& job, TelegramSession& session) {
+  if (job.kind == JOB_CLIP) {
+    s_clipRecording = true;
+    const bool recorded = clipRecord();
+    s_clipRecording = false;
+    if (!recorded) return false;
+  }
+  // Sending into a 429 hold would only extend it.
+  const uint32_t hold = tgRateLimitRemainingMs();
+  if (hold > 0) vTaskDelay(pdMS_TO_TICKS(hold));
+  if (job.kind == JOB_CLIP) return clipUpload(job.caption, session);
+
+  const uint8_t* jpg = job.fb ? job.fb->buf : job.jpg;
+  const size_t len = job.fb ? job.fb->len : job.len;
+  char markup[128];
+  if (job.kind == JOB_PREVIEW) snprintf(markup, sizeof(markup), kFullResMarkupFmt, (unsigned long)job.held_seq);
+  const uint32_t t0 = millis();
+  // Only CHAT_ID may press the button; the extra chats get the preview without it.
+  const bool ok = telegramSendPhoto(jpg, len, job.caption, session,
+                                    job.kind == JOB_PREVIEW ? markup : nullptr);
+  if (!ok && tgFailureIsTransient(session.lastResult())) {
+    journalFrame(jpg, len, job.caption);
+  }
+  if (ok && job.request_ms) traceSpan(TR_FIRST_IMAGE, job.request_ms);
+  if (job.kind != JOB_PHOTO) notePreviewJob(job, ok, millis() - t0);
+  if (job.fb) esp_camera_fb_return(job.fb);
+  free(job.jpg);
+  return ok;
+}
+
+static void logJobResult(const PhotoJob& job, bool ok) {
+  if (!ok) {
+    Serial.println("[TG] Send failed.");
+  } else {
+    Serial.println(job.kind == JOB_CLIP ? "[TG] Clip sent." : "[TG] Photo sent.");
+  }
+}
+
+static void photoUploaderTask(void*) {
+  PhotoJob job;
+  for (;;) {
+    if (xQueueReceive(s_photoQueue, &job, pdMS_TO_TICKS(JOURNAL_IDLE_POLL_MS)) != pdTRUE) {
+      // Idle: send the offline backlog a few frames at a time; fresh photos go first.
+      for (uint8_t i = 0; i < JOURNAL_DRAIN_BATCH && journalDrainEnabled() &&
+                          WiFi.status() == WL_CONNECTED && uxQueueMessagesWaiting(s_photoQueue) == 0 &&
+                          journalDrainOne(tgUploadSession); ++i) {}
+      continue;
+    }
+    // A clip is recorded here too, so polling goes on while it runs.
+    const bool ok = runPhotoJob(job, tgUploadSession);
+    // Each counter has a single writer, so no lock is needed.
+    if (ok) {
+      photoStats.uploaded++;
+    } else {
+      photoStats.failed++;
+    }
+    logJobResult(job, ok);
+  }
+}
+
+bool startPhotoPipeline() {
+  if (s_photoQueue) return true;
+  s_photoQueue = xQueueCreate(PHOTO_QUEUE_DEPTH, sizeof(PhotoJob));
+  if (!s_photoQueue) return false;
+  // The Arduino loop runs on APP_CPU; uploading on PRO_CPU lets both proceed.
+  if (xTaskCreatePinnedToCore(photoUploaderTask, "tg_upload", 10240, nullptr, 1, nullptr,
+                              PRO_CPU_NUM) != pdPASS) {
+    vQueueDelete(s_photoQueue);
+    s_photoQueue = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// Hand a job to the uploader without blocking, or run it here when there is no uploader.
+static bool submitPhotoJob(const PhotoJob& job) {
+  if (!s_photoQueue) {
+    const bool ok = runPhotoJob(job, tgSession);
+    logJobResult(job, ok);
+    return ok;
+  }
+  // Never block the command loop: a full queue means the link is the bottleneck.
+  if (xQueueSend(s_photoQueue, &job, 0) != pdTRUE) {
+    if (job.fb) esp_camera_fb_return(job.fb);
+    free(job.jpg);
+    photoStats.dropped++;
+    Serial.printf("[TG] Upload queue full, %s dropped (%lu so far)\n",
+                  job.kind == JOB_CLIP ? "clip" : "frame", (unsigned long)photoStats.dropped);
+    return false;
+  }
+  photoStats.queued++;
+  uint32_t depth = uxQueueMessagesWaiting(s_photoQueue);
+  if (depth > photoStats.max_depth) photoStats.max_depth = depth;
+  return true;
+}
+
+static PhotoJob makePhotoJob(uint8_t kind, const char* caption) {
+  PhotoJob job = {};
+  job.kind = kind;
+  strlcpy(job.caption, caption ? caption : "", sizeof(job.caption));
+  return job;
+}
+
+bool enqueuePhoto(camera_fb_t* fb, const char* caption, uint32_t request_ms) {
+  PhotoJob job = makePhotoJob(JOB_PHOTO, caption);
+  job.fb = fb;
+  job.request_ms = request_ms;
+  return submitPhotoJob(job);
+}
+
+bool drainPhotoPipeline(uint32_t timeout_ms) {
+  if (!s_photoQueue) return true;
+  journalSetDrainEnabled(false);
+  uint32_t start = millis();
+  while (photoStats.queued != photoStats.uploaded + photoStats.failed || journalBusy()) {
+    if (millis() - start >= timeout_ms) return false;
+    delay(20);
+  }
+  tgUploadSession.stop();
+  return true;
+}
+
+static inline int64_t frameTimestampUs(const camera_fb_t* fb) {
+  return (int64_t)fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec;
+}
+
+camera_fb_t* grabFreshFrame(int64_t request_us) {
+  // Frame timestamps come from esp_timer, the same clock as `request_us`.
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) return nullptr;
+    const int64_t ts = frameTimestampUs(fb);
+    if (ts >= request_us) {
+      lastCaptureAgeMs = (int32_t)((ts - request_us) / 1000);
+      traceValue(TR_CAPTURE, (uint32_t)((esp_timer_get_time() - request_us) / 1000));
+      return fb;
+    }
+    // Finished before the request: hand it back, fb_get() then blocks for the frame in flight.
+    esp_camera_fb_return(fb);
+  }
+  Serial.println("[CAM] No frame newer than the request");
+  return nullptr;
+}
+
+// NOTE: no default args here — defaults live in cat_feeder.h
+bool takeAndSendPhoto(const char* caption) {
+  Serial.println("[CAM] Capturing (fresh /snap)...");
+  const uint32_t t0 = millis();
+
+  applyAdaptiveCapture();
+  camera_fb_t* fb = grabFreshFrame(esp_timer_get_time());
+  if (!fb) {
+    Serial.println("[CAM] Capture failed (no fresh frame)");
+    return false;
+  }
+  noteCapturedSize(fb->len);
+
+  Serial.printf("[CAM] Fresh frame: %u bytes (%ld ms after request)\n",
+                (unsigned)fb->len, (long)lastCaptureAgeMs);
+
+  // Queued notices ride along in the caption instead of costing a request of their own.
+  char merged[PHOTO_CAPTION_MAX];
+  caption = tgOutboxMergeCaption(caption, merged, sizeof(merged));
+
+  // Hand off to the uploader so polling continues while the JPEG goes out.
+  return enqueuePhoto(fb, caption, t0);
+}
+
+// ------------ motion clips (AVI / MJPEG) ------------
+
+static inline void putLe16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void putLe32(uint8_t* p, uint32_t v) {
+  putLe16(p, (uint16_t)v);
+  putLe16(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline void putFourCc(uint8_t* p, const char* cc) {
+  memcpy(p, cc, 4);
+}
+
+void aviWriteHeader(uint8_t out[AVI_HEADER_SIZE], const AviInfo& info) {
+  const uint32_t idx_bytes = 8 + 16 * info.frames;
+  const uint32_t us = info.us_per_frame ? info.us_per_frame : 1;
+  memset(out, 0, AVI_HEADER_SIZE);
+
+  putFourCc(out + 0, "RIFF");
+  putLe32(out + 4, AVI_HEADER_SIZE - 8 + info.movi_bytes + idx_bytes);
+  putFourCc(out + 8, "AVI ");
+
+  putFourCc(out + 12, "LIST");
+  putLe32(out + 16, 192);
+  putFourCc(out + 20, "hdrl");
+  putFourCc(out + 24, "avih");
+  putLe32(out + 28, 56);
+  putLe32(out + 32, us);                                             // dwMicroSecPerFrame
+  putLe32(out + 36, (uint32_t)((uint64_t)info.max_frame_bytes * 1000000 / us));
+  putLe32(out + 44, 0x10);                                           // AVIF_HASINDEX
+  putLe32(out + 48, info.frames);
+  putLe32(out + 56, 1);                                              // dwStreams
+  putLe32(out + 60, info.max_frame_bytes);
+  putLe32(out + 64, info.width);
+  putLe32(out + 68, info.height);
+
+  putFourCc(out + 88, "LIST");
+  putLe32(out + 92, 116);
+  putFourCc(out + 96, "strl");
+  putFourCc(out + 100, "strh");
+  putLe32(out + 104, 56);
+  putFourCc(out + 108, "vids");
+  putFourCc(out + 112, "MJPG");
+  putLe32(out + 128, us);                                            // dwScale / dwRate = s per frame
+  putLe32(out + 132, 1000000);
+  putLe32(out + 140, info.frames);                                   // dwLength
+  putLe32(out + 144, info.max_frame_bytes);
+  putLe32(out + 148, 0xFFFFFFFF);                                    // dwQuality: default
+  putLe16(out + 160, info.width);                                    // rcFrame right / bottom
+  putLe16(out + 162, info.height);
+  putFourCc(out + 164, "strf");
+  putLe32(out + 168, 40);
+  putLe32(out + 172, 40);                                            // BITMAPINFOHEADER
+  putLe32(out + 176, info.width);
+  putLe32(out + 180, info.height);
+  putLe16(out + 184, 1);
+  putLe16(out + 186, 24);
+  putFourCc(out + 188, "MJPG");
+  putLe32(out + 192, (uint32_t)info.width * info.height * 3);
+
+  putFourCc(out + 212, "LIST");
+  putLe32(out + 216, 4 + info.movi_bytes);
+  putFourCc(out + 220, "movi");
+}
+
+struct ClipIndexEntry {
+  uint32_t offset;  // chunk header, from the "movi" fourcc (as idx1 wants it)
+  uint32_t size;
+};
+
+struct ClipStore {
+  uint8_t* buf;     // PSRAM; nullptr while the clip lives on the card
+  size_t   cap;
+  size_t   len;
+  bool     on_sd;
+  bool     ready;
+};
+
+ClipStats clipStats;
+static ClipStore      s_clip = {};
+static ClipIndexEntry s_clipIndex[CLIP_MAX_FRAMES];
+
+static bool clipPut(File& file, const void* data, size_t n) {
+  if (s_clip.on_sd) {
+    if (file.write((const uint8_t*)data, n) != n) return false;
+  } else {
+    if (s_clip.len + n > s_clip.cap) return false;
+    memcpy(s_clip.buf + s_clip.len, data, n);
+  }
+  s_clip.len += n;
+  return true;
+}
+
+void clipDiscard() {
+  free(s_clip.buf);
+  if (s_clip.on_sd && s_journalLock) {
+    xSemaphoreTake(s_journalLock, portMAX_DELAY);
+    if (s_sdMounted && SD_MMC.exists(CLIP_PATH)) SD_MMC.remove(CLIP_PATH);
+    xSemaphoreGive(s_journalLock);
+  }
+  s_clip = {};
+}
+
+// Frames and the index are appended; only the header block is rewritten at the end.
+static bool clipRecordInto(File& file, uint32_t duration_ms) {
+  uint8_t hdr[AVI_HEADER_SIZE];
+  AviInfo info = {};
+  aviWriteHeader(hdr, info);
+  if (!clipPut(file, hdr, sizeof(hdr))) return false;
+
+  const uint32_t t0 = millis();
+  int64_t first_us = 0;
+  int64_t last_us = 0;
+  while (info.frames < CLIP_MAX_FRAMES && millis() - t0 < duration_ms) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) break;
+    const uint32_t pos = s_clip.len;
+    const uint32_t size = fb->len;
+    uint8_t chunk_head[8];
+    putFourCc(chunk_head, "00dc");
+    putLe32(chunk_head + 4, size);
+    static const uint8_t kPad = 0;
+    // Chunks are word aligned: odd-sized JPEGs get a pad byte that the size field excludes.
+    const bool ok = clipPut(file, chunk_head, sizeof(chunk_head)) && clipPut(file, fb->buf, size) &&
+                    ((size & 1) == 0 || clipPut(file, &kPad, 1));
+    if (info.frames == 0) {
+      info.width = fb->width;
+      info.height = fb->height;
+      first_us = frameTimestampUs(fb);
+    }
+    last_us = frameTimestampUs(fb);
+    esp_camera_fb_return(fb);
+    if (!ok) {
+      // Storage full: cut the partial chunk off, the clip ends at the last whole frame.
+      s_clip.len = pos;
+      if (s_clip.on_sd) file.seek(pos);
+      Serial.println("[CLIP] Storage full, stopping early");
+      break;
+    }
+    s_clipIndex[info.frames++] = { pos - (AVI_HEADER_SIZE - 4), size };
+    if (size > info.max_frame_bytes) info.max_frame_bytes = size;
+  }
+  clipStats.record_ms = millis() - t0;
+  if (info.frames == 0) return false;
+
+  info.movi_bytes = s_clip.len - AVI_HEADER_SIZE;
+  info.us_per_frame = info.frames > 1 ? (uint32_t)((last_us - first_us) / (info.frames - 1))
+                                      : 1000000 / 10;
+  uint8_t idx_head[8];
+  putFourCc(idx_head, "idx1");
+  putLe32(idx_head + 4, 16 * info.frames);
+  bool ok = clipPut(file, idx_head, sizeof(idx_head));
+  for (uint32_t i = 0; ok && i < info.frames; ++i) {
+    uint8_t e[16];
+    putFourCc(e, "00dc");
+    putLe32(e + 4, 0x10);                                           // AVIIF_KEYFRAME
+    putLe32(e + 8, s_clipIndex[i].offset);
+    putLe32(e + 12, s_clipIndex[i].size);
+    ok = clipPut(file, e, sizeof(e));
+  }
+  if (!ok) return false;
+
+  aviWriteHeader(hdr, info);
+  if (s_clip.on_sd) {
+    ok = file.seek(0) && file.write(hdr, sizeof(hdr)) == sizeof(hdr);
+  } else {
+    memcpy(s_clip.buf, hdr, sizeof(hdr));
+  }
+  clipStats.frames = info.frames;
+  return ok;
+}
+
+bool clipRecord(uint32_t duration_ms) {
+  clipDiscard();
+  clipStats = {};
+  if (psramFound()) {
+    s_clip.buf = (uint8_t*)ps_malloc(CLIP_PSRAM_BYTES);
+    s_clip.cap = s_clip.buf ? CLIP_PSRAM_BYTES : 0;
+  }
+  File file;
+  if (!s_clip.buf) {
+    if (!s_journalLock) return false;
+    xSemaphoreTake(s_journalLock, portMAX_DELAY);
+    if (journalMountLocked()) file = SD_MMC.open(CLIP_PATH, "w+");
+    s_clip.on_sd = (bool)file;
+    if (!file) {
+      xSemaphoreGive(s_journalLock);
+      Serial.println("[CLIP] No PSRAM buffer and no card");
+      return false;
+    }
+  }
+
+  sensor_t* sensor = esp_camera_sensor_get();
+  if (sensor) {
+    sensor->set_framesize(sensor, CLIP_FRAMESIZE < s_maxFramesize ? CLIP_FRAMESIZE : s_maxFramesize);
+    sensor->set_quality(sensor, CLIP_JPEG_QUALITY);
+    s_appliedRung = -1;  // the next photo goes back to the adaptive ladder
+    warmUpCamera(1);
+  }
+
+  const bool ok = clipRecordInto(file, duration_ms);
+  if (s_clip.on_sd) {
+    file.close();
+    xSemaphoreGive(s_journalLock);
+  }
+  clipStats.bytes = s_clip.len;
+  clipStats.on_sd = s_clip.on_sd;
+  if (!ok) {
+    clipDiscard();
+    return false;
+  }
+  s_clip.ready = true;
+  Serial.printf("[CLIP] %lu frames in %lu ms = %.1f fps, %lu bytes (%s)\n",
+                (unsigned long)clipStats.frames, (unsigned long)clipStats.record_ms,
+                clipStats.record_ms ? clipStats.frames * 1000.0f / clipStats.record_ms : 0.0f,
+                (unsigned long)clipStats.bytes, s_clip.on_sd ? "SD" : "PSRAM");
+  return true;
+}
+
+struct ClipUpload {
+  const ReqBuf* part_head;
+  File*         file;       // open clip file when it lives on the card
+};
+
+static bool writeClipBody(Client& client, void* ctx) {
+  const ClipUpload* up = (const ClipUpload*)ctx;
+  client.write((const uint8_t*)up->part_head->c_str(), up->part_head->length());
+
+  const uint32_t t0 = millis();
+  size_t written = 0;
+  if (!s_clip.on_sd) {
+    written = clientWriteAll(client, s_clip.buf, s_clip.len);
+  } else {
+    uint8_t* chunk = (uint8_t*)malloc(CLIP_CHUNK);
+    while (chunk && written < s_clip.len) {
+      const size_t want = s_clip.len - written < CLIP_CHUNK ? s_clip.len - written : CLIP_CHUNK;
+      const size_t got = up->file->read(chunk, want);
+      if (got != want || clientWriteAll(client, chunk, got) != got) break;
+      written += got;
+    }
+    free(chunk);
+  }
+  clipStats.upload_ms = millis() - t0;
+  clipStats.upload_bps = clipStats.upload_ms ? (uint32_t)((uint64_t)written * 1000 / clipStats.upload_ms) : 0;
+  recordUploadThroughput(written, clipStats.upload_ms);
+  if (written < s_clip.len) {
+    Serial.println("[CLIP] Write stalled");
+    return false;
+  }
+  client.write((const uint8_t*)kMultipartTail, sizeof(kMultipartTail) - 1);
+  return true;
+}
+
+// The caption is final: the outbox belongs to the command loop and is merged there.
+static bool clipUpload(const char* caption, TelegramSession& session) {
+  if (!s_clip.ready || !ensureWiFi()) {
+    clipDiscard();
+    return false;
+  }
+  char part_buf[TG_REQ_BUF_SIZE];
+  ReqBuf part(part_buf, sizeof(part_buf));
+  addFormField(part, "chat_id", CHAT_ID);
+  addFormField(part, "caption", caption ? caption : "");
+  addFormField(part, "supports_streaming", "true");
+  part.add("--" TG_BOUNDARY "\r\n"
+           "Content-Disposition: form-data; name=\"video\"; filename=\"clip.avi\"\r\n"
+           "Content-Type: video/x-msvideo\r\n\r\n");
+  if (part.overflow()) return false;
+  const size_t content_length = part.length() + s_clip.len + sizeof(kMultipartTail) - 1;
+
+  char head_buf[256];
+  ReqBuf req(head_buf, sizeof(head_buf));
+  beginApiRequest(req, "POST", "sendVideo");
+  finishHead(req, content_length, "multipart/form-data; boundary=" TG_BOUNDARY);
+
+  File file;
+  if (s_clip.on_sd) {
+    xSemaphoreTake(s_journalLock, portMAX_DELAY);
+    file = SD_MMC.open(CLIP_PATH, FILE_READ);
+  }
+  bool ok = !s_clip.on_sd || (bool)file;
+  if (ok) {
+    ClipUpload up = { &part, &file };
+    Serial.printf("[CLIP] Uploading %u bytes...\n", (unsigned)s_clip.len);
+    ok = session.request(req, writeClipBody, &up, nullptr, nullptr, 20000);
+  }
+  if (s_clip.on_sd) {
+    file.close();
+    xSemaphoreGive(s_journalLock);
+  }
+  Serial.printf("[CLIP] %s: %lu bytes in %lu ms = %lu B/s\n", ok ? "Sent" : "Upload failed",
+                (unsigned long)s_clip.len, (unsigned long)clipStats.upload_ms,
+                (unsigned long)clipStats.upload_bps);
+  clipDiscard();
+  return ok;
+}
+
+bool clipSend(const char* caption, TelegramSession& session) {
+  char merged[PHOTO_CAPTION_MAX];
+  return clipUpload(tgOutboxMergeCaption(caption, merged, sizeof(merged)), session);
+}
+
+bool clipRecordAndSend(const char* caption) {
+  char merged[PHOTO_CAPTION_MAX];
+  return submitPhotoJob(makePhotoJob(JOB_CLIP, tgOutboxMergeCaption(caption, merged, sizeof(merged))));
+}
+
+// ------------ burst capture with sharpness scoring ------------
+
+// Luma of a big-endian RGB565 pixel (as written by jpg2rgb565), BT.601 weights in 8.8 fixed point.
+static inline uint8_t rgb565Luma(uint8_t hi, uint8_t lo) {
+  const uint32_t r = hi & 0xF8;
+  const uint32_t g = ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3);
+  const uint32_t b = (lo & 0x1F) << 3;
+  return (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+uint32_t scoreSharpness(const uint8_t* luma, int w, int h) {
+  if (w < 3 || h < 3) return 0;
+  // Variance of the 4-neighbour Laplacian, row by row with three live row pointers.
+  int32_t  sum = 0;
+  uint64_t sumsq = 0;
+  uint32_t luma_sum = 0;
+  for (int y = 1; y < h - 1; ++y) {
+    const uint8_t* up  = luma + (y - 1) * w;
+    const uint8_t* row = luma + y * w;
+    const uint8_t* dn  = luma + (y + 1) * w;
+    for (int x = 1; x < w - 1; ++x) {
+      const int32_t lap = 4 * row[x] - row[x - 1] - row[x + 1] - up[x] - dn[x];
+      sum += lap;
+      sumsq += (uint32_t)(lap * lap);
+      luma_sum += row[x];
+    }
+  }
+  const uint32_t n = (uint32_t)(w - 2) * (uint32_t)(h - 2);
+  const uint32_t variance = (uint32_t)((sumsq - (uint64_t)((int64_t)sum * sum) / n) / n);
+
+  // Exposure weight (0..256): full inside [60, 190] mean luma, fading to 0 at black/white.
+  const uint32_t mean = luma_sum / n;
+  uint32_t weight = 256;
+  if (mean < 60)       weight = mean * 256 / 60;
+  else if (mean > 190) weight = (255 - mean) * 256 / 65;
+  return (uint32_t)(((uint64_t)variance * weight) >> 8);
+}
+
+// Decode at 1/8 scale into `scratch` and leave a w*h luma plane at its start.
+static bool decodeLuma8x(const camera_fb_t* fb, uint8_t* scratch, size_t scratch_len,
+                         int* w, int* h) {
+  // The JPEG decoder can scale by 8 for free: it only reconstructs the DC of each block.
+  *w = (fb->width + 7) / 8;
+  *h = (fb->height + 7) / 8;
+  if ((size_t)*w * *h * 2 > scratch_len) return false;
+  if (!jpg2rgb565(fb->buf, fb->len, scratch, JPG_SCALE_8X)) return false;
+  // Collapse to luma in place (output index i never overtakes input index 2i).
+  const int n = *w * *h;
+  for (int i = 0; i < n; ++i) scratch[i] = rgb565Luma(scratch[2 * i], scratch[2 * i + 1]);
+  return true;
+}
+
+bool frameSharpness(const camera_fb_t* fb, uint8_t* scratch, size_t scratch_len, uint32_t* score) {
+  int w, h;
+  if (!decodeLuma8x(fb, scratch, scratch_len, &w, &h)) return false;
+  *score = scoreSharpness(scratch, w, h);
+  return true;
+}
+
+bool takeAndSendBestOfBurst(uint8_t frames, const char* caption) {
+  // Holding the best frame while grabbing more needs the multi-buffer PSRAM ring.
+  if (!psramFound() || frames < 2) return takeAndSendPhoto(caption);
+  Serial.printf("[CAM] Burst of %u frames...\n", (unsigned)frames);
+
+  applyAdaptiveCapture();
+  // Scratch for one 1/8-scale RGB565 decode of the largest frame (SVGA -> 100x75).
+  const size_t scratch_len = (size_t)((800 + 7) / 8) * ((600 + 7) / 8) * 2;
+  uint8_t* scratch = (uint8_t*)ps_malloc(scratch_len);
+  if (!scratch) return takeAndSendPhoto(caption);
+
+  camera_fb_t* best = nullptr;
+  uint32_t best_score = 0;
+  const uint32_t t0 = millis();
+  for (uint8_t i = 0; i < frames; ++i) {
+    camera_fb_t* fb = (i == 0) ? grabFreshFrame(esp_timer_get_time()) : esp_camera_fb_get();
+    if (!fb) break;
+    uint32_t score = 0;
+    const uint32_t ts = micros();
+    const bool scored = frameSharpness(fb, scratch, scratch_len, &score);
+    Serial.printf("[CAM]   frame %u: %u B, score %lu (%lu us)\n", (unsigned)i, (unsigned)fb->len,
+                  (unsigned long)score, (unsigned long)(micros() - ts));
+    if (!best || (scored && score > best_score)) {
+      if (best) esp_camera_fb_return(best);
+      best = fb;
+      best_score = score;
+    } else {
+      esp_camera_fb_return(fb);
+    }
+  }
+  free(scratch);
+  if (!best) {
+    Serial.println("[CAM] Burst capture failed");
+    return false;
+  }
+  Serial.printf("[CAM] Burst done in %lu ms, best score %lu\n",
+                (unsigned long)(millis() - t0), (unsigned long)best_score);
+  noteCapturedSize(best->len);
+
+  char merged[PHOTO_CAPTION_MAX];
+  caption = tgOutboxMergeCaption(caption, merged, sizeof(merged));
+  return enqueuePhoto(best, caption, t0);
+}
+
+// ------------ progressive snap ------------
+
+struct HeldFrame {
+  uint8_t* jpg;            // PSRAM copy of the full frame; nullptr when nothing is held
+  size_t   len;
+  size_t   preview_len;
+  uint32_t seq;
+  char     caption[PHOTO_CAPTION_MAX];
+};
+
+PreviewStats previewStats;
+static HeldFrame         s_held = {};
+static volatile uint32_t s_previewDelivered = 0;  // seq of the last preview that reached the chat
+
+// Per-event bookkeeping once we know whether the full frame was wanted. A requested frame
+// now belongs to its upload job.
+static void settleHeldFrame(bool full_requested) {
+  if (full_requested) {
+    previewStats.bytes_saved -= (int32_t)s_held.preview_len;
+    Serial.printf("[PREVIEW] Full frame asked for: %u B preview was extra\n", (unsigned)s_held.preview_len);
+  } else if (s_previewDelivered == s_held.seq) {
+    previewStats.bytes_saved += (int32_t)(s_held.len - s_held.preview_len);
+    Serial.printf("[PREVIEW] Full frame never asked for: %u B sent instead of %u B\n",
+                  (unsigned)s_held.preview_len, (unsigned)s_held.len);
+    free(s_held.jpg);
+  } else {
+    Serial.println("[PREVIEW] Preview never arrived; its full frame is dropped");
+    free(s_held.jpg);
+  }
+  s_held = {};
+}
+
+void previewRelease() {
+  if (s_held.jpg) settleHeldFrame(false);
+}
+
+// Uploader side of a preview or a held full frame (writes only its own counters).
+static void notePreviewJob(const PhotoJob& job, bool ok, uint32_t upload_ms) {
+  if (job.kind == JOB_HELD_FRAME) {
+    previewStats.last_full_ms = upload_ms;
+    if (ok) previewStats.full_sent++;
+    Serial.printf("[PREVIEW] Full frame %u B %s in %lu ms\n", (unsigned)job.len,
+                  ok ? "sent" : "failed", (unsigned long)upload_ms);
+    return;
+  }
+  previewStats.last_ttfi_ms = millis() - job.request_ms;
+  Serial.printf("[PREVIEW] %u B preview %s %lu ms after the request\n", (unsigned)job.len,
+                ok ? "delivered" : "failed", (unsigned long)previewStats.last_ttfi_ms);
+  if (!ok) return;
+  previewStats.previews++;
+  previewStats.preview_bytes += job.len;
+  s_previewDelivered = job.held_seq;
+}
+
+// Downscale in the JPEG decoder (1/2 or 1/4 costs no extra work) and re-encode small.
+static bool encodePreview(const camera_fb_t* fb, uint8_t** out, size_t* out_len) {
+  jpg_scale_t scale = JPG_SCALE_NONE;
+  int w = fb->width;
+  int h = fb->height;
+  while (w > PREVIEW_MAX_WIDTH && scale < JPG_SCALE_8X) {
+    scale = (jpg_scale_t)(scale + 1);
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+  }
+  if (scale == JPG_SCALE_NONE) return false; // already small: the frame is its own preview
+  uint8_t* rgb = (uint8_t*)ps_malloc((size_t)w * h * 2);
+  if (!rgb) return false;
+  const bool ok = jpg2rgb565(fb->buf, fb->len, rgb, scale) &&
+                  fmt2jpg(rgb, (size_t)w * h * 2, w, h, PIXFORMAT_RGB565, PREVIEW_JPEG_QUALITY,
+                          out, out_len);
+  free(rgb);
+  return ok;
+}
+
+bool takeAndSendPreview(const char* caption) {
+  if (!psramFound()) return takeAndSendPhoto(caption);
+  const uint32_t t0 = millis();
+  applyAdaptiveCapture();
+  camera_fb_t* fb = grabFreshFrame(esp_timer_get_time());
+  if (!fb) {
+    Serial.println("[CAM] Capture failed (no fresh frame)");
+    return false;
+  }
+  noteCapturedSize(fb->len);
+
+  char merged[PHOTO_CAPTION_MAX];
+  const char* sent_caption = tgOutboxMergeCaption(caption, merged, sizeof(merged));
+  uint8_t* preview = nullptr;
+  size_t preview_len = 0;
+  uint8_t* full = nullptr;
+  if (!encodePreview(fb, &preview, &preview_len) || preview_len >= fb->len ||
+      !(full = (uint8_t*)ps_malloc(fb->len))) {
+    free(preview);
+    // The frame in hand is the photo; a second capture would only add latency.
+    Serial.println("[PREVIEW] No preview for this frame, sending it as is");
+    return enqueuePhoto(fb, sent_caption, t0);
+  }
+  // Keep the full frame out of the driver's ring: the camera needs its buffers back.
+  memcpy(full, fb->buf, fb->len);
+  const size_t full_len = fb->len;
+  esp_camera_fb_return(fb);
+
+  previewRelease(); // an older full frame nobody asked for
+  s_held.jpg = full;
+  s_held.len = full_len;
+  s_held.preview_len = preview_len;
+  s_held.seq = ++s_rtc.preview_seq;
+  strlcpy(s_held.caption, caption ? caption : "", sizeof(s_held.caption));
+
+  const uint32_t bps = s_rtc.uplink_bps ? s_rtc.uplink_bps : uplinkPriorBps((int8_t)WiFi.RSSI());
+  Serial.printf("[PREVIEW] %u B preview of a %u B frame (full frame: ~%lu ms more)\n",
+                (unsigned)preview_len, (unsigned)full_len,
+                (unsigned long)((uint64_t)full_len * 1000 / bps));
+  PhotoJob job = makePhotoJob(JOB_PREVIEW, sent_caption);
+  job.jpg = preview;
+  job.len = preview_len;
+  job.request_ms = t0;
+  job.held_seq = s_held.seq;
+  return submitPhotoJob(job);
+}
+
+bool sendHeldFullFrame(uint32_t seq) {
+  if (!s_held.jpg || s_held.seq != seq) return false;
+  PhotoJob job = makePhotoJob(JOB_HELD_FRAME, s_held.caption);
+  job.jpg = s_held.jpg;
+  job.len = s_held.len;
+  settleHeldFrame(true);
+  return submitPhotoJob(job);
+}
+
+// ------------ PIR motion verifier ------------
+
+void lumaBlockMeans(const uint8_t* luma, int w, int h, uint8_t* grid) {
+  uint32_t acc[MOTION_GRID_W * MOTION_GRID_H] = {0};
+  uint16_t rows[MOTION_GRID_H] = {0};
+  // Column span of each block column (x belongs to block x * MOTION_GRID_W / w), computed
+  // once per plane; each row is then summed span by span, left to right.
+  uint16_t x_end[MOTION_GRID_W];
+  for (int b = 0; b < MOTION_GRID_W; ++b) x_end[b] = (uint16_t)(((b + 1) * w + MOTION_GRID_W - 1) / MOTION_GRID_W);
+  for (int y = 0; y < h; ++y) {
+    const uint8_t* row = luma + y * w;
+    const int by = y * MOTION_GRID_H / h;
+    uint32_t* out = acc + by * MOTION_GRID_W;
+    int x = 0;
+    for (int b = 0; b < MOTION_GRID_W; ++b) {
+      uint32_t sum = 0;
+      for (; x < x_end[b]; ++x) sum += row[x];
+      out[b] += sum;
+    }
+    rows[by]++;
+  }
+  for (int by = 0; by < MOTION_GRID_H; ++by) {
+    int x0 = 0;
+    for (int b = 0; b < MOTION_GRID_W; ++b) {
+      const uint32_t cnt = (uint32_t)(x_end[b] - x0) * rows[by];
+      const int i = by * MOTION_GRID_W + b;
+      grid[i] = cnt ? (uint8_t)(acc[i] / cnt) : 0;
+      x0 = x_end[b];
+    }
+  }
+}
+
+uint16_t countChangedBlocks(const uint8_t* a, const uint8_t* b, uint16_t n, uint8_t threshold) {
+  // Remove a global brightness shift first (auto-exposure, lights switched on).
+  int32_t total = 0;
+  for (uint16_t i = 0; i < n; ++i) total += (int32_t)a[i] - b[i];
+  const int32_t shift = total / n;
+  uint16_t changed = 0;
+  for (uint16_t i = 0; i < n; ++i) {
+    int32_t d = (int32_t)a[i] - b[i] - shift;
+    if (d < 0) d = -d;
+    changed += (d > threshold);
+  }
+  return changed;
+}
+
+bool verifyMotion() {
+  const uint32_t t0 = millis();
+  const uint16_t n = MOTION_GRID_W * MOTION_GRID_H;
+  const size_t scratch_len = (size_t)((800 + 7) / 8) * ((600 + 7) / 8) * 2;
+  uint8_t* scratch = (uint8_t*)(psramFound() ? ps_malloc(scratch_len) : malloc(scratch_len));
+  if (!scratch) return true; // cannot tell: assume the PIR is right
+
+  uint8_t grid[MOTION_GRID_W * MOTION_GRID_H];
+  uint8_t prev[MOTION_GRID_W * MOTION_GRID_H];
+  uint16_t vs_bg = 0;     // most blocks changed against the background
+  uint16_t moving = 0;    // most blocks changed between consecutive frames
+  uint8_t frames = 0;
+  for (uint8_t i = 0; i < MOTION_VERIFY_FRAMES; ++i) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) break;
+    int w, h;
+    const bool ok = decodeLuma8x(fb, scratch, scratch_len, &w, &h);
+    esp_camera_fb_return(fb);
+    if (!ok) continue;
+    lumaBlockMeans(scratch, w, h, grid);
+    // Against the stored background, and frame-to-frame for something moving right now.
+    if (s_rtc.motion_bg_valid) vs_bg = max(vs_bg, countChangedBlocks(grid, s_rtc.motion_bg, n, MOTION_BLOCK_THRESHOLD));
+    if (frames > 0)            moving = max(moving, countChangedBlocks(grid, prev, n, MOTION_BLOCK_THRESHOLD));
+    memcpy(prev, grid, n);
+    frames++;
+  }
+  free(scratch);
+
+  if (frames == 0) return true;
+  const bool had_background = s_rtc.motion_bg_valid;
+  const uint16_t worst = max(vs_bg, moving);
+  const bool motion = !had_background || worst >= MOTION_MIN_BLOCKS;
+  bool relearned = false;
+  if (!had_background) {
+    memcpy(s_rtc.motion_bg, prev, n);
+    s_rtc.motion_bg_valid = 1;
+  } else if (!motion) {
+    // Learn slow scene changes (daylight) but never the cat itself.
+    for (uint16_t i = 0; i < n; ++i) s_rtc.motion_bg[i] = (uint8_t)((s_rtc.motion_bg[i] * 3 + prev[i]) / 4);
+  }
+  if (had_background && moving < MOTION_MIN_BLOCKS && vs_bg >= MOTION_MIN_BLOCKS) {
+    // A still scene unlike the background: a cat sitting at the bowl, or the bowl was
+    // moved. Only the second stays put across several wakes; take it as the new background.
+    if (++s_rtc.motion_bg_static >= MOTION_BG_RELEARN_WAKES) {
+      memcpy(s_rtc.motion_bg, prev, n);
+      s_rtc.motion_bg_static = 0;
+      relearned = true;
+    }
+  } else {
+    s_rtc.motion_bg_static = 0;
+  }
+  if (!motion) s_rtc.pir_rejected++;
+  Serial.printf("[PIR] %u frames, %u/%u blocks changed -> %s%s (%lu ms, %lu rejected so far)\n",
+                (unsigned)frames, (unsigned)worst, (unsigned)n,
+                motion ? (had_background ? "motion" : "no background yet") : "false alarm",
+                relearned ? ", background relearned" : "",
+                (unsigned long)(millis() - t0), (unsigned long)s_rtc.pir_rejected);
+  return motion;
+}
+
+// ------------ feeder servo ------------
+
+static const FeedProfile kFeedProfile = {
+  SERVO_STOP_US, FEED_RUN_US, FEED_RAMP_MS, FEED_HOLD_MS, FEED_BRAKE_MS
+};
+
+uint32_t feedProfileDurationMs(const FeedProfile& p) {
+  return 2UL * p.ramp_ms + p.hold_ms + p.brake_ms;
+}
+
+uint16_t feedProfilePulseUs(const FeedProfile& p, uint32_t t_ms) {
+  const int32_t span = (int32_t)p.run_us - p.stop_us;
+  if (t_ms < p.ramp_ms) {
+    return (uint16_t)(p.stop_us + span * (int32_t)t_ms / p.ramp_ms);
+  }
+  t_ms -= p.ramp_ms;
+  if (t_ms < p.hold_ms) return p.run_us;
+  t_ms -= p.hold_ms;
+  if (t_ms < p.ramp_ms) {
+    return (uint16_t)(p.run_us - span * (int32_t)t_ms / p.ramp_ms);
+  }
+  t_ms -= p.ramp_ms;
+  if (t_ms < p.brake_ms) return p.stop_us;
+  return 0;
+}
+
+#define SERVO_LEDC_MODE     LEDC_HIGH_SPEED_MODE
+#define SERVO_LEDC_TIMER    LEDC_TIMER_1
+#define SERVO_LEDC_CHANNEL  LEDC_CHANNEL_1
+#define SERVO_LEDC_BITS     16
+
+struct FeedRun {
+  volatile bool     busy;
+  volatile bool     snap_due;     // set by the timer, cleared by serviceFeeder()
+  volatile bool     report_due;
+  bool              snap_requested;
+  int64_t           start_us;
+  int64_t           last_tick_us;
+  uint32_t          ticks;
+  uint32_t          jitter_max_us;
+  uint64_t          jitter_sum_us;
+};
+
+static FeedRun            s_feed;
+static esp_timer_handle_t s_feedTimer = nullptr;
+static bool               s_servoReady = false;
+
+static void servoWritePulse(uint16_t pulse_us) {
+  const uint32_t duty = (uint32_t)pulse_us * ((1UL << SERVO_LEDC_BITS) - 1) / SERVO_PERIOD_US;
+  ledc_set_duty(SERVO_LEDC_MODE, SERVO_LEDC_CHANNEL, duty);
+  ledc_update_duty(SERVO_LEDC_MODE, SERVO_LEDC_CHANNEL);
+}
+
+// Runs in the esp_timer task once per servo frame; only touches LEDC registers and flags.
+static void feedTimerTick(void*) {
+  const int64_t now = esp_timer_get_time();
+  if (s_feed.last_tick_us) {
+    int32_t err = (int32_t)(now - s_feed.last_tick_us) - SERVO_PERIOD_US;
+    if (err < 0) err = -err;
+    if ((uint32_t)err > s_feed.jitter_max_us) s_feed.jitter_max_us = err;
+    s_feed.jitter_sum_us += err;
+    s_feed.ticks++;
+  }
+  s_feed.last_tick_us = now;
+
+  const uint32_t t_ms = (uint32_t)((now - s_feed.start_us) / 1000);
+  const uint16_t pulse = feedProfilePulseUs(kFeedProfile, t_ms);
+  if (pulse == 0) {
+    ledc_stop(SERVO_LEDC_MODE, SERVO_LEDC_CHANNEL, 0); // release: no holding current
+    esp_timer_stop(s_feedTimer);
+    s_feed.busy = false;
+    s_feed.report_due = true;
+    return;
+  }
+  servoWritePulse(pulse);
+  if (!s_feed.snap_requested && t_ms >= kFeedProfile.ramp_ms + kFeedProfile.hold_ms / 2U) {
+    s_feed.snap_requested = true;
+    s_feed.snap_due = true;
+  }
+}
+
+static bool servoInit() {
+  if (s_servoReady) return true;
+  ledc_timer_config_t timer = {};
+  timer.speed_mode      = SERVO_LEDC_MODE;
+  timer.duty_resolution = (ledc_timer_bit_t)SERVO_LEDC_BITS;
+  timer.timer_num       = SERVO_LEDC_TIMER;
+  timer.freq_hz         = 1000000UL / SERVO_PERIOD_US;
+  timer.clk_cfg         = LEDC_AUTO_CLK;
+  if (ledc_timer_config(&timer) != ESP_OK) return false;
+
+  esp_timer_create_args_t args = {};
+  args.callback = feedTimerTick;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "feed";
+  if (esp_timer_create(&args, &s_feedTimer) != ESP_OK) return false;
+  s_servoReady = true;
+  return true;
+}
+
+bool startFeed() {
+  if (s_feed.busy || !servoInit()) return false;
+  journalSuspend(); // GPIO14 is SD CLK as well
+
+  ledc_channel_config_t ch = {};
+  ch.gpio_num   = SERVO_PIN;
+  ch.speed_mode = SERVO_LEDC_MODE;
+  ch.channel    = SERVO_LEDC_CHANNEL;
+  ch.intr_type  = LEDC_INTR_DISABLE;
+  ch.timer_sel  = SERVO_LEDC_TIMER;
+  ch.duty       = 0;
+  ch.hpoint     = 0;
+  if (ledc_channel_config(&ch) != ESP_OK) return false;
+
+  s_feed = FeedRun();
+  s_feed.busy = true;
+  s_feed.start_us = esp_timer_get_time();
+  servoWritePulse(kFeedProfile.stop_us);
+  if (esp_timer_start_periodic(s_feedTimer, SERVO_PERIOD_US) != ESP_OK) {
+    ledc_stop(SERVO_LEDC_MODE, SERVO_LEDC_CHANNEL, 0);
+    s_feed.busy = false;
+    return false;
+  }
+  Serial.printf("[FEED] Dispensing for %lu ms\n", (unsigned long)feedProfileDurationMs(kFeedProfile));
+  return true;
+}
+
+bool feederBusy() {
+  return s_feed.busy;
+}
+
+void serviceFeeder() {
+  if (s_feed.snap_due) {
+    s_feed.snap_due = false;
+    takeAndSendPhoto("🍽️ Dispensing");
+  }
+  if (s_feed.report_due) {
+    s_feed.report_due = false;
+    const uint32_t ticks = s_feed.ticks;
+    Serial.printf("[FEED] Done: %lu frames, timer jitter avg %lu us, max %lu us\n",
+                  (unsigned long)ticks,
+                  (unsigned long)(ticks ? s_feed.jitter_sum_us / ticks : 0),
+                  (unsigned long)s_feed.jitter_max_us);
+  }
+}
+
+// ------------ streaming JSON scanner ------------
+
+void TgJsonScanner::reset() {
+  state_ = ST_VALUE;
+  in_key_ = false;
+  depth_ = 0;
+  obj_bits_ = 0;
+  value_len_ = 0;
+  high_surrogate_ = 0;
+}
+
+bool TgJsonScanner::keyIs(uint8_t level, const char* key) const {
+  return level < depth_ && level < TG_JSON_MAX_DEPTH && strcmp(keys_[level], key) == 0;
+}
+
+void TgJsonScanner::push(bool is_object) {
+  if (depth_ >= 32) {
+    state_ = ST_ERROR;
+    return;
+  }
+  if (is_object) obj_bits_ |= (1UL << depth_);
+  else           obj_bits_ &= ~(1UL << depth_);
+  if (depth_ < TG_JSON_MAX_DEPTH) keys_[depth_][0] = '\0';
+  depth_++;
+  state_ = is_object ? ST_KEY : ST_VALUE;
+}
+
+void TgJsonScanner::pop(bool is_object) {
+  if (depth_ == 0 || topIsObject() != is_object) {
+    state_ = ST_ERROR;
+    return;
+  }
+  onContainerEnd();
+  depth_--;
+  state_ = ST_AFTER_VALUE;
+}
+
+void TgJsonScanner::appendByte(char c) {
+  if (value_len_ < TG_JSON_VALUE_MAX - 1) value_[value_len_++] = c;
+}
+
+void TgJsonScanner::appendCodepoint(uint32_t cp) {
+  if (cp >= 0xD800 && cp <= 0xDBFF) { high_surrogate_ = cp; return; }
+  if (cp >= 0xDC00 && cp <= 0xDFFF && high_surrogate_) {
+    cp = 0x10000 + ((high_surrogate_ - 0xD800) << 10) + (cp - 0xDC00);
+  }
+  high_surrogate_ = 0;
+  if (cp < 0x80) {
+    appendByte((char)cp);
+  } else if (cp < 0x800) {
+    appendByte((char)(0xC0 | (cp >> 6)));
+    appendByte((char)(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    appendByte((char)(0xE0 | (cp >> 12)));
+    appendByte((char)(0x80 | ((cp >> 6) & 0x3F)));
+    appendByte((char)(0x80 | (cp & 0x3F)));
+  } else {
+    appendByte((char)(0xF0 | (cp >> 18)));
+    appendByte((char)(0x80 | ((cp >> 12) & 0x3F)));
+    appendByte((char)(0x80 | ((cp >> 6) & 0x3F)));
+    appendByte((char)(0x80 | (cp & 0x3F)));
+  }
+}
+
+void TgJsonScanner::endScalar(bool is_string) {
+  value_[value_len_] = '\0';
+  if (depth_ > 0) onValue(value_, value_len_, is_string);
+  value_len_ = 0;
+  state_ = ST_AFTER_VALUE;
+}
+
+// Returns false when `c` was not consumed and has to be fed again.
+bool TgJsonScanner::step(char c) {
+  const bool ws = (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+  switch (state_) {
+    case ST_VALUE:
+      if (ws) return true;
+      if (c == '{') { push(true); return true; }
+      if (c == '[') { push(false); return true; }
+      if (c == ']') { pop(false); return true; }  // empty array
+      if (c == '"') { in_key_ = false; value_len_ = 0; state_ = ST_STRING; return true; }
+      value_len_ = 0;
+      appendByte(c);
+      state_ = ST_LITERAL;
+      return true;
+
+    case ST_KEY:
+      if (ws) return true;
+      if (c == '"') { in_key_ = true; value_len_ = 0; state_ = ST_STRING; return true; }
+      if (c == '}') { pop(true); return true; }    // empty object
+      state_ = ST_ERROR;
+      return true;
+
+    case ST_COLON:
+      if (ws) return true;
+      state_ = (c == ':') ? ST_VALUE : ST_ERROR;
+      return true;
+
+    case ST_STRING:
+      if (c == '\\') { state_ = ST_ESCAPE; return true; }
+      if (c != '"') { appendByte(c); return true; }
+      if (in_key_) {
+        if (depth_ <= TG_JSON_MAX_DEPTH) {
+          char* key = keys_[depth_ - 1];
+          if (value_len_ < TG_JSON_KEY_MAX) {
+            memcpy(key, value_, value_len_);
+            key[value_len_] = '\0';
+          } else {
+            key[0] = '\0'; // too long to be one of ours
+          }
+        }
+        value_len_ = 0;
+        state_ = ST_COLON;
+      } else {
+        endScalar(true);
+      }
+      return true;
+
+    case ST_ESCAPE:
+      state_ = ST_STRING;
+      switch (c) {
+        case 'n': appendByte('\n'); break;
+        case 't': appendByte('\t'); break;
+        case 'r': appendByte('\r'); break;
+        case 'b': appendByte('\b'); break;
+        case 'f': appendByte('\f'); break;
+        case 'u': unicode_cp_ = 0; unicode_digits_ = 0; state_ = ST_UNICODE; break;
+        default:  appendByte(c); break; // \" \\ \/
+      }
+      return true;
+
+    case ST_UNICODE: {
+      uint8_t v;
+      if (c >= '0' && c <= '9')      v = c - '0';
+      else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+      else { state_ = ST_ERROR; return true; }
+      unicode_cp_ = (unicode_cp_ << 4) | v;
+      if (++unicode_digits_ == 4) {
+        appendCodepoint(unicode_cp_);
+        state_ = ST_STRING;
+      }
+      return true;
+    }
+
+    case ST_LITERAL:
+      if (isalnum((unsigned char)c) || c == '-' || c == '+' || c == '.') {
+        appendByte(c);
+        return true;
+      }
+      endScalar(false);
+      return false;
+
+    case ST_AFTER_VALUE:
+      if (ws) return true;
+      if (depth_ == 0) return true; // trailing bytes after the document
+      if (c == ',') { state_ = topIsObject() ? ST_KEY : ST_VALUE; return true; }
+      if (c == '}') { pop(true); return true; }
+      if (c == ']') { pop(false); return true; }
+      state_ = ST_ERROR;
+      return true;
+
+    case ST_ERROR:
+      return true;
+  }
+  return true;
+}
+
+void TgJsonScanner::feed(const char* data, size_t len) {
+  for (size_t i = 0; i < len && state_ != ST_ERROR; ) {
+    if (step(data[i])) i++;
+  }
+}
+
+// ------------ getUpdates parsing ------------
+
+TgUpdateParser::TgUpdateParser(Handler handler, void* ctx)
+  : handler_(handler), ctx_(ctx) {
+  memset(&cur_, 0, sizeof(cur_));
+  cur_.update_id = -1;
+}
+
+// Path levels: 0 = root object, 1 = "result" array, 2 = one update object.
+void TgUpdateParser::onValue(const char* value, size_t len, bool is_string) {
+  if (!keyIs(0, "result")) return;
+  const uint8_t d = depth();
+  if (d == 3 && keyIs(2, "update_id")) {
+    cur_.update_id = atol(value);
+  } else if (d == 4 && keyIs(2, "message") && keyIs(3, "text") && is_string) {
+    strlcpy(cur_.text, value, sizeof(cur_.text));
+  } else if (d == 5 && keyIs(2, "message") && keyIs(3, "chat") && keyIs(4, "id")) {
+    strlcpy(cur_.chat_id, value, sizeof(cur_.chat_id));
+  } else if (d == 4 && keyIs(2, "callback_query") && keyIs(3, "data") && is_string) {
+    cur_.is_callback = true;
+    strlcpy(cur_.text, value, sizeof(cur_.text));
+  } else if (d == 6 && keyIs(2, "callback_query") && keyIs(3, "message") &&
+             keyIs(4, "chat") && keyIs(5, "id")) {
+    strlcpy(cur_.chat_id, value, sizeof(cur_.chat_id));
+  }
+  (void)len;
+}
+
+void TgUpdateParser::onContainerEnd() {
+  if (depth() != 3 || !keyIs(0, "result")) return;
+  if (cur_.update_id > maxUpdateId) maxUpdateId = cur_.update_id;
+  if (handler_) handler_(cur_, ctx_);
+  memset(&cur_, 0, sizeof(cur_));
+  cur_.update_id = -1;
+}
+
+void TgResultParser::onValue(const char* value, size_t, bool is_string) {
+  if (depth() == 1) {
+    if (keyIs(0, "ok")) {
+      result_->ok = !is_string && strcmp(value, "true") == 0;
+    } else if (keyIs(0, "error_code")) {
+      result_->error_code = atoi(value);
+    } else if (keyIs(0, "description") && is_string) {
+      strlcpy(result_->description, value, sizeof(result_->description));
+    }
+  } else if (depth() == 2 && keyIs(0, "parameters") && keyIs(1, "retry_after")) {
+    result_->retry_after_s = strtoul(value, nullptr, 10);
+  }
+}
+
+TgFileIdParser::TgFileIdParser(char* file_id, size_t cap) : file_id_(file_id), cap_(cap) {}
+
+void TgFileIdParser::onValue(const char* value, size_t, bool is_string) {
+  // {"result":{"photo":[{...,"file_id":"..."}, ...]}}: sizes ascend, so the last one wins.
+  if (is_string && depth() == 4 && keyIs(0, "result") && keyIs(1, "photo") && keyIs(3, "file_id")) {
+    strlcpy(file_id_, value, cap_);
+  }
+}
+
+// ------------ live MJPEG stream ------------
+
+#define LIVE_BOUNDARY "cfframe"
+
+struct LiveViewer {
+  WiFiClient client;
+  uint32_t   since_ms;
+  uint32_t   frames;
+  uint32_t   dropped;
+  int8_t     frame;             // index into s_liveFrames of the part going out, -1 = idle
+  uint32_t   sent;              // bytes of that part already written
+  uint32_t   last_progress_ms;  // the socket last took data
+};
+
+// A frame buffer on its way to one or more viewers, with its part header.
+struct LiveFrame {
+  camera_fb_t* fb;
+  uint8_t      users;
+  uint16_t     head_len;
+  char         head[160];
+};
+
+static WiFiServer      s_liveServer(LIVE_PORT, LIVE_MAX_CLIENTS);
+static TaskHandle_t    s_liveTask = nullptr;
+static volatile bool   s_liveRun = false;
+static LiveViewer      s_viewers[LIVE_MAX_CLIENTS];
+static LiveFrame       s_liveFrames[LIVE_FRAMES_HELD];
+static uint32_t        s_liveSeq = 0;
+
+static void liveRelease(LiveViewer& v) {
+  if (v.frame < 0) return;
+  LiveFrame& f = s_liveFrames[v.frame];
+  v.frame = -1;
+  if (--f.users == 0) {
+    esp_camera_fb_return(f.fb);
+    f.fb = nullptr;
+  }
+}
+
+static void liveDropViewer(LiveViewer& v) {
+  const uint32_t secs = (millis() - v.since_ms) / 1000;
+  Serial.printf("[LIVE] Viewer left: %lu frames, %lu skipped, %.1f fps\n",
+                (unsigned long)v.frames, (unsigned long)v.dropped,
+                secs ? (float)v.frames / secs : 0.0f);
+  v.client.stop();
+  liveRelease(v);
+}
+
+static void liveAccept() {
+  WiFiClient c = s_liveServer.accept();
+  if (!c) return;
+  // The request itself is irrelevant: every path gets the stream.
+  while (c.available()) c.read();
+  for (LiveViewer& v : s_viewers) {
+    if (v.client.connected()) continue;
+    liveRelease(v);
+    v = LiveViewer();
+    v.frame = -1;
+    v.client = c;
+    v.client.setNoDelay(true);
+    v.since_ms = millis();
+    // An empty socket buffer takes the response head at once; frames follow from the next one.
+    v.client.print("HTTP/1.1 200 OK\r\n"
+                   "Content-Type: multipart/x-mixed-replace; boundary=" LIVE_BOUNDARY "\r\n"
+                   "Cache-Control: no-cache\r\n"
+                   "Connection: close\r\n\r\n");
+    Serial.println("[LIVE] Viewer connected");
+    awakeNoteActivity();
+    return;
+  }
+  c.print("HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n");
+  c.stop();
+}
+
+// Write as much of the viewer's part (head, JPEG, CRLF) as its socket takes right now.
+// Returns false once the viewer is gone.
+static bool liveSendSome(LiveViewer& v) {
+  const LiveFrame& f = s_liveFrames[v.frame];
+  const uint32_t jpg_end = f.head_len + f.fb->len;
+  while (v.sent < jpg_end + 2) {
+    const uint8_t* p;
+    size_t n;
+    if (v.sent < f.head_len) {
+      p = (const uint8_t*)f.head + v.sent;
+      n = f.head_len - v.sent;
+    } else if (v.sent < jpg_end) {
+      p = f.fb->buf + (v.sent - f.head_len);
+      n = jpg_end - v.sent;
+    } else {
+      p = (const uint8_t*)"\r\n" + (v.sent - jpg_end);
+      n = jpg_end + 2 - v.sent;
+    }
+    const ssize_t w = send(v.client.fd(), p, n, MSG_DONTWAIT);
+    if (w > 0) {
+      v.sent += (uint32_t)w;
+      v.last_progress_ms = millis();
+    } else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return true; // socket buffer full: carry on from `sent` next time
+    } else {
+      return false;
+    }
+  }
+  v.frames++;
+  liveRelease(v);
+  return true;
+}
+
+// Sleep until a busy viewer's socket can take more, or for `max_ms`.
+static void liveWait(uint32_t max_ms) {
+  fd_set wfds;
+  FD_ZERO(&wfds);
+  int max_fd = -1;
+  for (LiveViewer& v : s_viewers) {
+    if (v.frame < 0) continue;
+    FD_SET(v.client.fd(), &wfds);
+    max_fd = max(max_fd, v.client.fd());
+  }
+  if (max_fd < 0) {
+    vTaskDelay(pdMS_TO_TICKS(max_ms));
+    return;
+  }
+  struct timeval tv = { (time_t)(max_ms / 1000), (suseconds_t)(max_ms % 1000) * 1000 };
+  select(max_fd + 1, nullptr, &wfds, nullptr, &tv);
+}
+
+// A new frame for every idle viewer; viewers still sending an older one skip it.
+static void liveNextFrame() {
+  s_liveSeq++;
+  uint8_t idle = 0;
+  for (LiveViewer& v : s_viewers) {
+    if (!v.client.connected()) continue;
+    if (v.frame < 0) idle++;
+    else             v.dropped++;
+  }
+  if (idle == 0) return;
+  int8_t slot = -1;
+  for (int8_t i = 0; i < LIVE_FRAMES_HELD; ++i) {
+    if (!s_liveFrames[i].fb) slot = i;
+  }
+  camera_fb_t* fb = slot >= 0 ? esp_camera_fb_get() : nullptr;
+  if (!fb) {
+    for (LiveViewer& v : s_viewers) v.dropped += (v.client.connected() && v.frame < 0) ? 1 : 0;
+    return;
+  }
+  LiveFrame& f = s_liveFrames[slot];
+  f.fb = fb;
+  f.users = idle;
+  f.head_len = (uint16_t)snprintf(f.head, sizeof(f.head),
+                                  "--" LIVE_BOUNDARY "\r\nContent-Type: image/jpeg\r\n"
+                                  "Content-Length: %u\r\nX-Timestamp: %ld.%06ld\r\nX-Frame: %lu\r\n\r\n",
+                                  (unsigned)fb->len, (long)fb->timestamp.tv_sec,
+                                  (long)fb->timestamp.tv_usec, (unsigned long)s_liveSeq);
+  for (LiveViewer& v : s_viewers) {
+    if (!v.client.connected() || v.frame >= 0) continue;
+    v.frame = slot;
+    v.sent = 0;
+    v.last_progress_ms = millis();
+  }
+}
+
+static void liveTask(void*) {
+  uint32_t last_frame_ms = 0;
+  while (s_liveRun) {
+    liveAccept();
+
+    // Move every part in flight along without ever waiting on a socket.
+    bool any = false;
+    for (LiveViewer& v : s_viewers) {
+      if (!v.client.connected()) {
+        liveRelease(v);
+        continue;
+      }
+      any = true;
+      if (v.frame < 0) continue;
+      if (!liveSendSome(v)) {
+        liveDropViewer(v);
+      } else if (v.frame >= 0 && millis() - v.last_progress_ms >= LIVE_STALL_MS) {
+        Serial.println("[LIVE] Viewer stalled");
+        liveDropViewer(v);
+      }
+    }
+
+    const uint32_t since = millis() - last_frame_ms;
+    if (!any || since < LIVE_FRAME_INTERVAL_MS) {
+      liveWait(any ? min<uint32_t>(LIVE_FRAME_INTERVAL_MS - since, 20) : 50);
+      continue;
+    }
+    last_frame_ms = millis();
+    awakeNoteActivity(); // someone is watching: keep the window open (up to AWAKE_MAX_MS)
+    liveNextFrame();
+  }
+
+  for (LiveViewer& v : s_viewers) {
+    if (v.client.connected()) liveDropViewer(v);
+    liveRelease(v);
+  }
+  s_liveServer.end();
+  s_liveTask = nullptr;
+  vTaskDelete(nullptr);
+}
+
+bool liveStart() {
+  if (s_liveTask) return true;
+  for (LiveViewer& v : s_viewers) v.frame = -1;
+  s_liveServer.begin();
+  s_liveServer.setNoDelay(true);
+  s_liveRun = true;
+  // Same core as the Arduino loop: the uploader keeps PRO_CPU to itself.
+  if (xTaskCreatePinnedToCore(liveTask, "cam_live", 4096, nullptr, 1, &s_liveTask,
+                              APP_CPU_NUM) != pdPASS) {
+    s_liveRun = false;
+    s_liveServer.end();
+    return false;
+  }
+  Serial.printf("[LIVE] Streaming on http://%s:%u/\n", WiFi.localIP().toString().c_str(),
+                (unsigned)LIVE_PORT);
+  return true;
+}
+
+void liveStop() {
+  if (!s_liveTask) return;
+  s_liveRun = false;
+  // The task finishes its current frame, closes viewers and ends the server.
+  const uint32_t start = millis();
+  while (s_liveTask && millis() - start < 3000) delay(10);
+  Serial.println("[LIVE] Stopped");
+}
+
+bool liveActive() {
+  return s_liveTask != nullptr;
+}
+
+// ------------ awake window ------------
+
+struct AwakeWindow {
+  uint32_t start_ms;
+  uint32_t end_ms;
+  uint32_t state_since_ms;
+  uint32_t active_ms;
+  uint32_t modem_sleep_ms;
+  bool     radio_idle;
+};
+static AwakeWindow s_awake;
+
+void awakeWindowBegin() {
+  const uint32_t now = millis();
+  s_awake = AwakeWindow();
+  s_awake.start_ms = now;
+  s_awake.state_since_ms = now;
+  s_awake.end_ms = now + AWAKE_MS;
+  // Arduino turns modem sleep on by default; start from whatever the driver has now.
+  s_awake.radio_idle = WiFi.getSleep() != WIFI_PS_NONE;
+}
+
+void awakeNoteActivity() {
+  const uint32_t now = millis();
+  uint32_t end = now + AWAKE_IDLE_MS;
+  if ((int32_t)(end - (s_awake.start_ms + AWAKE_MAX_MS)) > 0) end = s_awake.start_ms + AWAKE_MAX_MS;
+  s_awake.end_ms = end;
+}
+
+void awakeEndNow(const char* reason) {
+  s_awake.end_ms = millis();
+  Serial.printf("[AWAKE] Window closed early: %s\n", reason);
+}
+
+uint32_t awakeDeadline() {
+  return s_awake.end_ms;
+}
+
+bool awakeWindowOpen() {
+  return (int32_t)(s_awake.end_ms - millis()) > 0;
+}
+
+static void awakeAccount() {
+  const uint32_t now = millis();
+  (s_awake.radio_idle ? s_awake.modem_sleep_ms : s_awake.active_ms) += now - s_awake.state_since_ms;
+  s_awake.state_since_ms = now;
+}
+
+void awakeRadioIdle(bool idle) {
+  if (idle == s_awake.radio_idle) return;
+  awakeAccount();
+  s_awake.radio_idle = idle;
+  WiFi.setSleep(idle);
+}
+
+void awakeWindowReport() {
+  awakeRadioIdle(false);
+  awakeAccount();
+  // Time before the window opened (boot, association) counts as radio-on.
+  const uint32_t awake_ms = millis();
+  const uint32_t active_ms = awake_ms - s_awake.modem_sleep_ms;
+  const uint32_t uah = (uint32_t)(((uint64_t)active_ms * AWAKE_ACTIVE_MA +
+                                   (uint64_t)s_awake.modem_sleep_ms * AWAKE_MODEM_SLEEP_MA) / 3600);
+  s_rtc.last_awake_ms = awake_ms;
+  s_rtc.last_charge_uah = uah;
+  s_rtc.total_charge_uah += uah;
+  Serial.printf("[AWAKE] %lu ms awake (%lu radio on, %lu modem sleep), ~%lu uAh, %lu uAh since power-on\n",
+                (unsigned long)awake_ms, (unsigned long)active_ms,
+                (unsigned long)s_awake.modem_sleep_ms, (unsigned long)uah,
+                (unsigned long)s_rtc.total_charge_uah);
+}
+
+// ------------ command dispatch ------------
+
+static void cmdSnap(const TgUpdate&) {
+  tgNotify("📸 On it! Capturing...");
+  if (PROGRESSIVE_SNAP) {
+    takeAndSendPreview(PHOTO_CAPTION);
+  } else {
+    takeAndSendPhoto(PHOTO_CAPTION);
+  }
+}
+
+static void cmdFull(const TgUpdate& u) {
+  const uint32_t seq = strtoul(u.text + strlen("cf:full:"), nullptr, 10);
+  if (!sendHeldFullFrame(seq)) {
+    tgNotify("⌛ That preview has expired; send /snap for a new one.");
+  }
+}
+
+static void cmdBurst(const TgUpdate&) {
+  tgNotify("📸 Taking a burst, sending the sharpest...");
+  takeAndSendBestOfBurst();
+}
+
+static void cmdIgnore(const TgUpdate&) {
+  tgNotify("✅ Ignored. Going back to sleep.");
+  awakeEndNow("/ignore");
+}
+
+static void cmdFeed(const TgUpdate&) {
+  if (feederBusy()) {
+    tgNotify("🍽️ Already dispensing.");
+  } else if (startFeed()) {
+    tgNotify("🍽️ Dispensing a portion...");
+  } else {
+    tgNotify("⚠️ Feeder servo could not start.");
+  }
+}
+
+static void cmdLive(const TgUpdate&) {
+  if (liveActive()) {
+    liveStop();
+    tgNotify("📺 Live view stopped.");
+    return;
+  }
+  if (!liveStart()) {
+    tgNotify("⚠️ Live view could not start.");
+    return;
+  }
+  char text[128];
+  snprintf(text, sizeof(text), "📺 Live view on http://%s:%u/ (same network). Send /live again to stop.",
+           WiFi.localIP().toString().c_str(), (unsigned)LIVE_PORT);
+  tgNotify(text);
+}
+
+static void cmdClip(const TgUpdate&) {
+  char text[64];
+  snprintf(text, sizeof(text), "🎬 Recording %u s...", (unsigned)CLIP_SECONDS);
+  tgNotify(text);
+  if (!clipRecordAndSend("🎬 Clip")) {
+    tgNotify("⚠️ Clip could not be recorded or sent.");
+  }
+}
+
+static void cmdTimelapse(const TgUpdate&) {
+  timelapseSetEnabled(!timelapseEnabled());
+  char text[128];
+  if (timelapseEnabled()) {
+    snprintf(text, sizeof(text), "⏱ Timelapse on: a frame every %u min, sent as albums of %u.",
+             (unsigned)(TIMELAPSE_INTERVAL_S / 60), (unsigned)TIMELAPSE_BATCH);
+  } else {
+    snprintf(text, sizeof(text), "⏱ Timelapse off.");
+  }
+  tgNotify(text);
+}
+
+static void cmdStatus(const TgUpdate&) {
+  char text[256];
+  snprintf(text, sizeof(text),
+           "📊 Up %lu s, wake #%lu, RSSI %d dBm\n"
+           "Heap %u B free (min %u B), PSRAM %u B free\n"
+           "Uplink ~%lu B/s, false PIR wakes %lu\n"
+           "Last wake %lu ms, ~%lu uAh (%lu uAh total)\n"
+           "Offline backlog: %lu frame(s)",
+           (unsigned long)(millis() / 1000), (unsigned long)s_rtc.wake_count, (int)WiFi.RSSI(),
+           (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(), (unsigned)ESP.getFreePsram(),
+           (unsigned long)s_rtc.uplink_bps, (unsigned long)s_rtc.pir_rejected,
+           (unsigned long)s_rtc.last_awake_ms, (unsigned long)s_rtc.last_charge_uah,
+           (unsigned long)s_rtc.total_charge_uah, (unsigned long)journalPending());
+  telegramSendMessage(text);
+}
+
+static void cmdStats(const TgUpdate&) {
+  char text[384];
+  size_t n = snprintf(text, sizeof(text),
+           "📈 Photos: %lu queued, %lu sent, %lu failed, %lu dropped\n"
+           "HTTPS: %lu requests over %lu handshakes (reuse %.0f%%)\n"
+           "Last reaction %lu ms\n"
+           "Extra chats: %u, %lu photos by file_id, %lu B saved\n"
+           "Last clip: %lu frames in %lu ms, %lu B, uploaded at %lu B/s",
+           (unsigned long)photoStats.queued, (unsigned long)photoStats.uploaded,
+           (unsigned long)photoStats.failed, (unsigned long)photoStats.dropped,
+           (unsigned long)tgSession.requests(), (unsigned long)tgSession.handshakes(),
+           tgSession.reuseRatio() * 100.0f, (unsigned long)lastReactionLatencyMs,
+           (unsigned)extraChatCount(), (unsigned long)fanoutStats.forwards,
+           (unsigned long)fanoutStats.bytes_saved, (unsigned long)clipStats.frames,
+           (unsigned long)clipStats.record_ms, (unsigned long)clipStats.bytes,
+           (unsigned long)clipStats.upload_bps);
+  for (uint8_t i = 0; i <= extraChatCount() && n < sizeof(text); ++i) {
+    const RecipientStats& r = recipientStats(i);
+    n += snprintf(text + n, sizeof(text) - n, "%s%lu/%lu", i ? " " : "\nPer chat ok/failed: ",
+                  (unsigned long)r.ok, (unsigned long)r.failed);
+  }
+  telegramSendMessage(text);
+  // Separate message: URL-encoding roughly doubles this text in the request buffer.
+  char summary[384];
+  traceFormatSummary(summary, sizeof(summary));
+  telegramSendMessage(summary);
+}
+
+struct TgCommand {
+  const char* name;        // "/cmd" for text commands, callback data for buttons ("x:" takes an argument)
+  bool        callback;
+  void      (*handler)(const TgUpdate& update);
+};
+
+// Every command and inline-button callback the bot understands, in one table.
+static constexpr TgCommand kCommands[] = {
+  { "/snap",     false, cmdSnap   },
+  { "/burst",    false, cmdBurst  },
+  { "/ignore",   false, cmdIgnore },
+  { "/feed",     false, cmdFeed   },
+  { "/clip",     false, cmdClip   },
+  { "/live",     false, cmdLive   },
+  { "/timelapse", false, cmdTimelapse },
+  { "/status",   false, cmdStatus },
+  { "/stats",    false, cmdStats  },
+  { "cf:snap",   true,  cmdSnap   },
+  { "cf:ignore", true,  cmdIgnore },
+  { "cf:full:",  true,  cmdFull   },
+};
+static constexpr uint8_t kCommandCount = sizeof(kCommands) / sizeof(kCommands[0]);
+static_assert(kCommandCount < 0xFF, "command index must fit in a uint8_t");
+
+// Look an update up once. "/snap", "/snap@my_bot" and "/snap now" all match /snap;
+// "cf:full:7" matches cf:full:.
+static int8_t matchCommand(const TgUpdate& u) {
+  size_t n = strlen(u.text);
+  if (!u.is_callback) n = strcspn(u.text, " @");
+  for (uint8_t i = 0; i < kCommandCount; ++i) {
+    const TgCommand& c = kCommands[i];
+    if (c.callback != u.is_callback || c.name[0] != u.text[0]) continue;
+    const size_t len = strlen(c.name);
+    const bool match = c.name[len - 1] == ':' ? strncmp(c.name, u.text, len) == 0
+                                               : strncmp(c.name, u.text, n) == 0 && c.name[n] == '\0';
+    if (match) return (int8_t)i;
+  }
+  return -1;
+}
+
+// Commands of one getUpdates batch, in arrival order. They run after the response
+// is fully read because the handlers talk to Telegram over the same session.
+struct PendingCommands {
+  uint8_t  count;
+  uint8_t  index[TG_MAX_UPDATES_PER_POLL];
+  TgUpdate update[TG_MAX_UPDATES_PER_POLL];
+};
+
+static void collectCommand(const TgUpdate& u, void* ctx) {
+  PendingCommands* pending = (PendingCommands*)ctx;
+  if (strcmp(u.chat_id, CHAT_ID) != 0) return; // only obey the configured chat
+  const int8_t idx = matchCommand(u);
+  if (idx < 0) {
+    Serial.printf("[TG] Unknown %s '%s'\n", u.is_callback ? "callback" : "message", u.text);
+    return;
+  }
+  if (pending->count >= TG_MAX_UPDATES_PER_POLL) return; // cannot happen with &limit=
+  pending->index[pending->count] = (uint8_t)idx;
+  pending->update[pending->count] = u;
+  pending->count++;
+}
+
+
+// Poll Telegram (getUpdates with offset=lastUpdateId+1).
+// With TG_LONG_POLL_S > 0 the server holds the request until an update arrives,
+// so the reaction happens one RTT after the command instead of up to one poll period.
+bool pollTelegram(uint32_t deadline_ms) {
+  if (!ensureWiFi() || tgRateLimitRemainingMs() > 0) return false;
+
+  // Never hold the request past the end of the awake window.
+  int32_t remaining_s = (int32_t)(deadline_ms - millis()) / 1000 - 1;
+  uint32_t timeout_s = TG_LONG_POLL_S;
+  if (remaining_s < (int32_t)timeout_s) {
+    if (remaining_s <= 0 && TG_LONG_POLL_S > 0) return false; // window is about to close
+    timeout_s = remaining_s > 0 ? remaining_s : 0;
+  }
+
+  // Come back quickly while the feeder runs so its mid-dispense photo is not held up.
+  if (feederBusy() && timeout_s > 1) timeout_s = 1;
+
+  // Without the uploader task nothing else sends the offline backlog: one frame per round,
+  // with a short poll in between so commands still come first.
+  if (!s_photoQueue && journalDrainEnabled() && journalDrainOne(tgSession) &&
+      journalPending() > 0) {
+    timeout_s = 0;
+  }
+  // Doze through the long-poll unless an upload is still going out.
+  awakeRadioIdle(photoStats.queued == photoStats.uploaded + photoStats.failed && !liveActive());
+
+  char buf[256];
+  ReqBuf req(buf, sizeof(buf));
+  beginApiRequest(req, "GET", "getUpdates");
+  req.add("?timeout=").addUInt(timeout_s);
+  req.add("&limit=").addUInt(TG_MAX_UPDATES_PER_POLL);
+  if (lastUpdateId >= 0) {
+    req.add("&offset=").addInt(lastUpdateId + 1);
+  }
+  finishHead(req);
+
+  Serial.printf("[TG] getUpdates (timeout=%lus)...\n", (unsigned long)timeout_s);
+  // The body is parsed while it streams in; nothing is buffered beyond one socket chunk.
+  PendingCommands pending;
+  pending.count = 0;
+  TgUpdateParser parser(collectCommand, &pending);
+  parser.maxUpdateId = lastUpdateId;
+  tgSession.setDeadline(deadline_ms);
+  bool ok = tgSession.request(req, nullptr, nullptr, feedScannerSink, &parser,
+                              (timeout_s + 5) * 1000UL);
+  tgSession.clearDeadline();
+  if (!ok) {
+    Serial.println("[TG] getUpdates failed or cancelled");
+    return false;
+  }
+  if (parser.failed()) {
+    Serial.println("[TG] Bad getUpdates JSON");
+  }
+  // Held: the update ended the hold, so it is as old as the answer. Answered at once: it was
+  // already waiting, at most since the previous poll came back (or since this one went out).
+  const uint32_t prev_poll_ms = lastPollMs;
+  const TgResult& answer = tgSession.lastResult();
+  const uint32_t held_ms = answer.answer_ms - answer.sent_ms;
+  lastPollMs = answer.answer_ms;
+  uint32_t t_available = answer.answer_ms;
+  if (held_ms < TG_POLL_HELD_MS) t_available = prev_poll_ms ? prev_poll_ms : answer.sent_ms;
+
+  // Update lastUpdateId
+  if (parser.maxUpdateId > lastUpdateId) {
+    lastUpdateId = parser.maxUpdateId;
+    Serial.printf("[TG] lastUpdateId -> %ld\n", lastUpdateId);
+  }
+
+  if (pending.count > 0) {
+    awakeRadioIdle(false); // full radio speed for replies and uploads
+    awakeNoteActivity();
+  }
+  for (uint8_t i = 0; i < pending.count; ++i) {
+    const TgCommand& cmd = kCommands[pending.index[i]];
+    const TgUpdate& u = pending.update[i];
+    Serial.printf("[TG] Update %ld: %s\n", u.update_id, u.is_callback ? u.text : cmd.name);
+    cmd.handler(u);
+    if (i == 0) {
+      lastReactionLatencyMs = millis() - t_available;
+      Serial.printf("[TG] %u command(s) after %lu ms held, first reacted to in %lu ms\n",
+                    (unsigned)pending.count, (unsigned long)held_ms,
+                    (unsigned long)lastReactionLatencyMs);
+    }
+  }
+  // Replies to this round that no photo picked up go out as one message.
+  tgOutboxService();
+  return true;
+}
+
+static void configurePirRtcInput() {
+  pinMode(PIR_PIN, INPUT);
+  rtc_gpio_deinit((gpio_num_t)PIR_PIN);
+  rtc_gpio_init((gpio_num_t)PIR_PIN);
+  rtc_gpio_set_direction((gpio_num_t)PIR_PIN, RTC_GPIO_MODE_INPUT_ONLY);
+  rtc_gpio_pullup_dis((gpio_num_t)PIR_PIN);
+  rtc_gpio_pulldown_en((gpio_num_t)PIR_PIN);  // idle LOW
+}
+
+void logWakeCause() {
+  esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+  switch (cause) {
+    case ESP_SLEEP_WAKEUP_EXT1: Serial.println("[BOOT] Wake: EXT1 (PIR)"); break;
+    case ESP_SLEEP_WAKEUP_EXT0: Serial.println("[BOOT] Wake: EXT0"); break;
+    case ESP_SLEEP_WAKEUP_TIMER: Serial.println("[BOOT] Wake: TIMER"); break;
+    case ESP_SLEEP_WAKEUP_UNDEFINED: Serial.println("[BOOT] Power-on reset"); break;
+    default: Serial.printf("[BOOT] Wake cause: %d\n", (int)cause); break;
+  }
+}
+
+void enterDeepSleep() {
+  liveStop();
+  traceEndWake();
+  logTraceRing();
+  journalSuspend();
+  tlsSessionCacheSave();
+  rtcStateSave();
+  configurePirRtcInput();
   esp_sleep_enable_ext1_wakeup(1ULL << PIR_PIN, ESP_EXT1_WAKEUP_ANY_HIGH);
+  if (timelapseEnabled()) {
+    esp_sleep_enable_timer_wakeup((uint64_t)TIMELAPSE_INTERVAL_S * 1000000ULL);
+    Serial.printf("[SLEEP] Timelapse: timer wake in %u s\n", (unsigned)TIMELAPSE_INTERVAL_S);
+  }
   Serial.println("[SLEEP] Going to deep sleep. PIR HIGH will wake me.");
   delay(50);
   esp_deep_sleep_start();
@@ -5,11 +5,24 @@
 #include "user_wifi_and_telegram_config.h"
 #include <Arduino.h>
 #include "esp_camera.h"
+#include "img_converters.h"
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
+#include "FS.h"
+#include "SD_MMC.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
 #include "esp_bt.h"   // to disable BT for power saving (optional)
 #include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
 #include "driver/rtc_io.h"
+#include "driver/ledc.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 
 
 
@@ -28,13 +41,16 @@
  *
  * @note
  *  - Fill your credentials in `user_wifi_and_telegram_config.h` (SSID/PASS, BOT_TOKEN, CHAT_ID).
- *  - TLS is used with `client.setInsecure()` for simplicity (OK for hobby use; not for production).
- *  - JSON handling is done via naive string scanning (no ArduinoJson dependency).
+ *  - TLS skips certificate validation for simplicity (OK for hobby use; not for production).
+ *  - All Telegram calls share one keep-alive TLS connection (`tgSession`).
+ *  - JSON handling is done by a small streaming scanner (no ArduinoJson dependency).
  *  - PIR wake is configured via EXT1; see implementation for RTC GPIO setup.
  *
  * @warning
- *  - The code performs network I/O on the main thread; avoid blocking for long to keep the
- *    watchdog happy. Default timeouts are modest (6–8 seconds).
+ *  - Polling and replies run on the loop task: getUpdates long-polls for up to
+ *    `TG_LONG_POLL_S` (cut short at the end of the awake window), other requests time out
+ *    after 6 s without response bytes (8 s for photos, 15–20 s for albums and clips).
+ *    Photo uploads run on their own task when PSRAM is present.
  *  - Ensure adequate power rails and decoupling for ESP32-CAM and any servo you attach.
  */
 
@@ -61,13 +77,41 @@
 #define HREF_GPIO_NUM     23
 #define PCLK_GPIO_NUM     22
 
+// Photos waiting for the uploader task (frames are held, not copied)
+#define PHOTO_QUEUE_DEPTH  2
+// Frame buffers kept in PSRAM for grab-latest capture, enough for every holder at once:
+// queued + one being uploaded + two in a /burst (best so far and the next candidate)
+// + LIVE_FRAMES_HELD the live stream is sending. The driver fills whichever is left.
+#define CAM_FB_COUNT       (PHOTO_QUEUE_DEPTH + 3 + LIVE_FRAMES_HELD)
+#define PHOTO_CAPTION_MAX  128
+// Frames scored by /burst; only the sharpest is uploaded
+#define BURST_FRAMES       4
+// Frames thrown away after init for auto-exposure to settle
+#define CAM_WARMUP_FRAMES  3
+
 // Onboard flash LED (helpful to see life)
 #define LED_FLASH_PIN      4
 #define PIR_PIN           13
 
 // ========= POLLING SETTINGS =========
+// getUpdates long-poll hold time in seconds (0 = classic short polling every POLL_PERIOD_MS)
+#ifndef TG_LONG_POLL_S
+#define TG_LONG_POLL_S    20
+#endif
+/** millis() when the last getUpdates answer arrived. */
 extern uint32_t lastPollMs;
 extern long     lastUpdateId;
+/**
+ * Milliseconds from a command becoming available to the bot until its handler has sent the
+ * reply (or handed its photo to the uploader). A command that ended a held long-poll became
+ * available when the answer arrived; one already waiting at the server is counted from the
+ * previous poll's answer, so time spent away from polling shows up here.
+ */
+extern uint32_t lastReactionLatencyMs;
+/** Longer than a getUpdates round trip: an answer this late means the server held the poll. */
+#ifndef TG_POLL_HELD_MS
+#define TG_POLL_HELD_MS   1000
+#endif
 
 
 
@@ -81,6 +125,340 @@ extern const char* PHOTO_CAPTION;
 /** @} */
 
 
+/** @name Request building
+ *  @{
+ */
+/** Stack buffer size used for one Bot API request head (URL-encoded text included). */
+#define TG_REQ_BUF_SIZE   1024
+
+/**
+ * @brief Append-only text builder over a caller-supplied fixed buffer (no heap).
+ *
+ * @details
+ * Used to assemble request lines, headers and multipart parts in place. Appends that do
+ * not fit are dropped and the overflow is sticky, so a request can be built without
+ * checking every step and rejected once via `overflow()`.
+ */
+class ReqBuf {
+public:
+  ReqBuf(char* buf, size_t cap) : buf_(buf), cap_(cap) { clear(); }
+
+  ReqBuf& add(const char* s);
+  ReqBuf& add(const char* s, size_t n);
+  ReqBuf& addUInt(unsigned long v);
+  ReqBuf& addInt(long v);
+  /** Percent-encode everything but RFC 3986 unreserved characters (table-driven). */
+  ReqBuf& addUrlEncoded(const char* s);
+  void clear();
+
+  const char* c_str() const { return buf_; }
+  size_t length() const { return len_; }
+  bool overflow() const { return overflow_; }
+
+private:
+  char*  buf_;
+  size_t cap_;
+  size_t len_;
+  bool   overflow_;
+};
+
+/** Length of `s` after `ReqBuf::addUrlEncoded()`, e.g. to precompute Content-Length. */
+size_t urlEncodedLength(const char* s);
+/** @} */
+
+
+/** @name TLS transport with session resumption
+ *  @{
+ */
+#define TLS_HANDSHAKE_TIMEOUT_MS  10000
+#define TLS_IO_TIMEOUT_MS          5000
+// Room in the RTC block for one serialized mbedtls session (ticket + peer certificate)
+#define TLS_SESSION_BLOB_MAX       2048
+
+/**
+ * @brief Minimal mbedtls client (Arduino `Client` interface) that resumes TLS sessions.
+ *
+ * @details
+ * Like `WiFiClientSecure` with `setInsecure()`, but before each handshake it offers the
+ * last session negotiated by any `TlsClient` (session ticket or session ID), so the
+ * server can skip the certificate exchange and the ECDHE key agreement. Whether that
+ * happened, and how long the handshake took, is reported per connection.
+ */
+class TlsClient : public Client {
+public:
+  ~TlsClient();
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+  using Print::write;
+
+  bool lastHandshakeResumed() const { return resumed_; }
+  uint32_t lastHandshakeMs() const { return handshake_ms_; }
+  /** Block (in select(), so other tasks run) until the socket has data or `timeout_ms` passes. */
+  bool waitReadable(uint32_t timeout_ms);
+
+private:
+  mbedtls_net_context      net_;
+  mbedtls_ssl_context      ssl_;
+  mbedtls_ssl_config       conf_;
+  mbedtls_ctr_drbg_context drbg_;
+  mbedtls_entropy_context  entropy_;
+  bool     rng_ready_    = false;
+  bool     open_         = false;
+  bool     resumed_      = false;
+  uint32_t handshake_ms_ = 0;
+};
+
+/**
+ * @brief Set up the shared session cache and reload the session kept in RTC memory.
+ *
+ * Call once per boot after `rtcStateRestore()` and before any connection is made.
+ */
+void tlsSessionCacheRestore();
+
+/** Serialize the cached session into the RTC block (done in `enterDeepSleep()`). */
+void tlsSessionCacheSave();
+/** @} */
+
+
+/** @name Telegram keep-alive session
+ *  @{
+ */
+/** Bot API endpoint; override both to point the firmware at a local TLS stand-in server. */
+#ifndef TELEGRAM_HOST
+#define TELEGRAM_HOST "api.telegram.org"
+#endif
+#ifndef TELEGRAM_PORT
+#define TELEGRAM_PORT 443
+#endif
+
+/**
+ * @brief One HTTP/1.1 keep-alive TLS connection shared by all Telegram calls.
+ *
+ * @details
+ * Requests are sent strictly in order: each call to `request()` writes the request,
+ * then consumes exactly one response (delimited by `Content-Length`) so the socket is
+ * ready for the next one. The TLS handshake is only paid when the connection is not
+ * open yet. If a reused connection turns out to be closed by the server, the request
+ * is retried once on a fresh connection.
+ */
+#define TG_ERROR_DESC_MAX  96   ///< Bot API error descriptions are truncated to this size
+#define TG_RX_BUF_SIZE    512   ///< response bytes buffered per session
+
+/** Outcome of one Bot API call: HTTP status plus the JSON envelope of the body. */
+struct TgResult {
+  int      http_status;       ///< 0 if no status line arrived
+  bool     ok;                ///< 2xx and `"ok":true`
+  int      error_code;        ///< `error_code` from the body, 0 if absent
+  uint32_t retry_after_s;     ///< `parameters.retry_after` or a Retry-After header (429)
+  char     description[TG_ERROR_DESC_MAX];
+  uint32_t sent_ms;           ///< millis() once the request was written
+  uint32_t answer_ms;         ///< millis() when the status line arrived
+};
+
+class TelegramSession {
+public:
+  /** Streams the request body after the head; return false to abort the request. */
+  typedef bool (*BodyWriter)(Client& client, void* ctx);
+  /** Receives the response body chunk by chunk, straight from a fixed socket buffer. */
+  typedef void (*BodySink)(const char* data, size_t len, void* ctx);
+
+  /**
+   * @brief Send one request and wait for its complete response.
+   *
+   * @param head           Request line and headers, terminated by an empty line.
+   * @param write_body     Optional body writer (e.g. multipart upload).
+   * @param write_ctx      Opaque pointer handed to `write_body`.
+   * @param sink           Optional consumer of the response body.
+   * @param sink_ctx       Opaque pointer handed to `sink`.
+   * @param timeout_ms     Idle timeout while waiting for response bytes.
+   * @return true when a complete response was received and the API reported success;
+   *         see `lastResult()` for the status code and error description.
+   *
+   * @details
+   * The response is framed by Content-Length or chunked transfer encoding, so the call
+   * returns as soon as the body ends instead of waiting for the server to close.
+   */
+  bool request(const ReqBuf& head, BodyWriter write_body = nullptr, void* write_ctx = nullptr,
+               BodySink sink = nullptr, void* sink_ctx = nullptr, uint32_t timeout_ms = 6000);
+
+  /** Close the connection (e.g. before Wi-Fi is shut down). */
+  void stop();
+  bool connected();
+
+  /**
+   * @brief Abort any request still waiting at `deadline_ms` (millis() clock).
+   *
+   * Used to cancel a long-poll when the awake window ends; the connection is closed.
+   */
+  void setDeadline(uint32_t deadline_ms);
+  void clearDeadline();
+
+  /** Status and envelope of the most recent request. */
+  const TgResult& lastResult() const { return result_; }
+
+  uint32_t handshakes() const { return handshakes_; }
+  /** Duration of the most recent TLS handshake on this session. */
+  uint32_t lastHandshakeMs() const { return client_.lastHandshakeMs(); }
+  uint32_t requests() const { return requests_; }
+  /** Fraction of requests that did not need a new TLS handshake (0..1). */
+  float reuseRatio() const;
+  void logStats() const;
+
+private:
+  bool connect();
+  bool cancelled() const;
+  size_t fill(uint32_t timeout_ms);
+  bool readLine(char* line, size_t cap, uint32_t timeout_ms);
+  bool readBody(long len, BodySink sink, void* sink_ctx, uint32_t timeout_ms);
+  bool readResponse(BodySink sink, void* sink_ctx, uint32_t timeout_ms, bool* got_any,
+                    uint32_t sent_ms);
+
+  TlsClient client_;
+  TgResult  result_ = {};
+  char     rx_[TG_RX_BUF_SIZE];
+  uint16_t rx_pos_ = 0;
+  uint16_t rx_len_ = 0;
+  bool     reused_     = false;
+  uint32_t handshakes_ = 0;
+  uint32_t resumed_handshakes_ = 0;
+  uint32_t resumed_ms_ = 0;
+  uint32_t full_ms_    = 0;
+  uint32_t requests_   = 0;
+  uint32_t deadline_ms_  = 0;
+  bool     has_deadline_ = false;
+};
+
+/** The session used by the Telegram helpers below. */
+extern TelegramSession tgSession;
+/** Second connection owned by the photo uploader task, so uploads never block polling. */
+extern TelegramSession tgUploadSession;
+/** @} */
+
+
+/** @name Streaming JSON parsing
+ *  @{
+ */
+#define TG_JSON_MAX_DEPTH   8   ///< levels whose keys are tracked (deeper levels are skipped)
+#define TG_JSON_KEY_MAX    16   ///< longest key we ever match, plus NUL
+#define TG_JSON_VALUE_MAX 128   ///< scalar values are truncated to this size (fits a file_id)
+
+/**
+ * @brief Incremental, allocation-free JSON tokenizer for Bot API responses.
+ *
+ * @details
+ * Bytes can be fed in arbitrary chunks as they come off the socket. For every scalar
+ * the subclass gets `onValue()` with the current key path available through
+ * `depth()` / `keyIs()`; `onContainerEnd()` fires right before an object or array
+ * closes. Memory use is fixed (a few hundred bytes) regardless of the body size,
+ * and every byte is looked at exactly once.
+ */
+class TgJsonScanner {
+public:
+  virtual ~TgJsonScanner() {}
+  void reset();
+  void feed(const char* data, size_t len);
+  bool failed() const { return state_ == ST_ERROR; }
+
+protected:
+  TgJsonScanner() { reset(); }
+  /** @param value  NUL-terminated (possibly truncated) string contents or raw literal. */
+  virtual void onValue(const char* value, size_t len, bool is_string) = 0;
+  virtual void onContainerEnd() {}
+  /** Number of open containers; a value inside the root object has depth 1. */
+  uint8_t depth() const { return depth_; }
+  /** True if the container at `level` (0 = root) is currently at member `key`. */
+  bool keyIs(uint8_t level, const char* key) const;
+
+private:
+  enum State : uint8_t {
+    ST_VALUE, ST_KEY, ST_COLON, ST_STRING, ST_ESCAPE, ST_UNICODE, ST_LITERAL,
+    ST_AFTER_VALUE, ST_ERROR
+  };
+  bool step(char c);
+  void push(bool is_object);
+  void pop(bool is_object);
+  bool topIsObject() const { return depth_ && (obj_bits_ & (1UL << (depth_ - 1))); }
+  void appendByte(char c);
+  void appendCodepoint(uint32_t cp);
+  void endScalar(bool is_string);
+
+  State    state_;
+  bool     in_key_;
+  uint8_t  depth_;
+  uint32_t obj_bits_;
+  char     keys_[TG_JSON_MAX_DEPTH][TG_JSON_KEY_MAX];
+  char     value_[TG_JSON_VALUE_MAX];
+  uint8_t  value_len_;
+  uint8_t  unicode_digits_;
+  uint32_t unicode_cp_;
+  uint32_t high_surrogate_;
+};
+
+/** The fields of one getUpdates entry that the firmware acts on. */
+struct TgUpdate {
+  long update_id;
+  bool is_callback;   ///< true for inline button presses (`text` holds callback data)
+  char chat_id[24];   ///< kept as text; compared against `CHAT_ID`
+  char text[64];      ///< message text or callback data
+};
+
+/**
+ * @brief Single-pass getUpdates parser: reports each update as soon as its object closes.
+ */
+class TgUpdateParser : public TgJsonScanner {
+public:
+  typedef void (*Handler)(const TgUpdate& update, void* ctx);
+  TgUpdateParser(Handler handler, void* ctx);
+  /** Highest update_id seen so far (seed it with the current offset). */
+  long maxUpdateId = -1;
+
+protected:
+  void onValue(const char* value, size_t len, bool is_string) override;
+  void onContainerEnd() override;
+
+private:
+  Handler  handler_;
+  void*    ctx_;
+  TgUpdate cur_;
+};
+
+/** Keeps the `file_id` of the largest size in a sendPhoto response (`result.photo[]`). */
+class TgFileIdParser : public TgJsonScanner {
+public:
+  TgFileIdParser(char* file_id, size_t cap);
+
+protected:
+  void onValue(const char* value, size_t len, bool is_string) override;
+
+private:
+  char*  file_id_;
+  size_t cap_;
+};
+
+/** Picks `ok`, `error_code`, `description` and `parameters.retry_after` out of any response. */
+class TgResultParser : public TgJsonScanner {
+public:
+  explicit TgResultParser(TgResult* result) : result_(result) {}
+
+protected:
+  void onValue(const char* value, size_t len, bool is_string) override;
+
+private:
+  TgResult* result_;
+};
+/** @} */
+
+
 /**
  * @brief Blink the onboard flash LED for basic visual feedback.
  *
@@ -96,6 +474,59 @@ void flashBlink(int times = 2, int on_ms = 60, int off_ms = 120);
 
 
 
+/** @name RTC-retained state
+ *  @{
+ */
+// Give up on the cached BSSID/channel/IP after this long and rescan + DHCP
+#define WIFI_FAST_TIMEOUT_MS     3000
+// Redo DHCP every N wakes, or once the lease is this old (RTC clock), so a reused lease
+// does not outlive the server's; keep WIFI_LEASE_REUSE_S below the DHCP lease time
+#define WIFI_DHCP_REFRESH_WAKES  32
+#define WIFI_LEASE_REUSE_S       (4UL * 3600UL)
+
+/**
+ * @brief Validate the RTC slow-memory state block and restore `lastUpdateId` from it.
+ *
+ * @return true if the block survived deep sleep intact (magic, version, size and CRC32 match);
+ *         false after power-on or corruption, in which case it is reset to defaults.
+ *
+ * @details
+ * The block carries the last AP BSSID/channel, the DHCP lease (IP/gateway/mask/DNS),
+ * `lastUpdateId` and wake/reconnect counters. Call once per boot before `startWiFi()`.
+ */
+bool rtcStateRestore();
+
+/** Store `lastUpdateId` and reseal the block with a fresh CRC (done in `enterDeepSleep()`). */
+void rtcStateSave();
+
+/** Number of boots seen by the RTC block (1 after power-on). */
+uint32_t rtcWakeCount();
+/** @} */
+
+/**
+ * @brief Start associating with `WIFI_SSID` in the background and return immediately.
+ *
+ * @details
+ * The Wi-Fi driver runs the association/DHCP on its own task, so the caller can
+ * do other work (camera bring-up) and collect the result with `waitWiFi()`.
+ * With a valid RTC cache the association is locked to the last BSSID/channel and
+ * the previous lease is applied as a static IP, skipping the scan and DHCP. A lease is
+ * reused for at most `WIFI_DHCP_REFRESH_WAKES` wakes and `WIFI_LEASE_REUSE_S` seconds.
+ */
+void startWiFi();
+
+/**
+ * @brief Wait for a connection started by `startWiFi()`.
+ *
+ * @param timeout_ms  Maximum time to wait.
+ * @return true once connected (prints IP, RSSI and reconnect time), false on timeout.
+ *
+ * @details
+ * If a cached reconnect has not succeeded within `WIFI_FAST_TIMEOUT_MS`, the cache is
+ * dropped and a normal scan + DHCP connect is started within the same timeout.
+ */
+bool waitWiFi(uint32_t timeout_ms);
+
 /**
  * @brief Ensure the ESP32 is connected to Wi-Fi (STA mode).
  *
@@ -103,12 +534,83 @@ void flashBlink(int times = 2, int on_ms = 60, int off_ms = 120);
  * @return false if connection attempts failed within the built-in retry window.
  *
  * @details
- * - Performs a quick reconnect sequence if disconnected.
+ * - Performs a quick reconnect sequence (`startWiFi()` + `waitWiFi()`) if disconnected.
  * - Prints local IP on success and current RSSI (dBm).
  * - Requires `WIFI_SSID` / `WIFI_PASSWORD` to be defined in your user config header.
  */
 bool ensureWiFi();
 
+/**
+ * @brief First TLS connect of the wake failed on a reused lease: forget the cache and
+ *        reconnect with DHCP.
+ *
+ * @return true if a fresh lease was obtained and the connect is worth retrying; false if
+ *         the lease was not cached, already proved good, or DHCP failed as well.
+ */
+bool wifiDropCachedLease();
+/** A connect went through: the cached lease is fine for the rest of this wake. */
+void wifiCachedLeaseWorks();
+
+/** @name Boot timeline
+ *  @{
+ */
+#define BOOT_MAX_MARKS    12
+
+/** Record the end of a boot phase (name must be a string literal). */
+void bootMark(const char* phase);
+/** Print each recorded phase with its absolute and relative time. */
+void logBootTimeline();
+/** @} */
+
+
+/** @name Tracing
+ *  @{
+ */
+#define TRACE_RING_SIZE     32   ///< spans kept for the current wake (printed before sleep)
+#define TRACE_HIST_BUCKETS  20   ///< log2 buckets: [0], [1], [2,3], [4,7] ... [2^18, inf)
+
+/** What a trace sample measures. Durations are in ms. */
+enum TraceKind : uint8_t {
+  TR_WAKE,           ///< reset to deep sleep
+  TR_WIFI_ASSOC,     ///< WiFi.begin() to associated
+  TR_DHCP,           ///< associated to IP (near zero with a cached lease)
+  TR_TLS_HANDSHAKE,
+  TR_CAPTURE,        ///< frame request to a fresh frame in hand
+  TR_RESPONSE_WAIT,  ///< request sent to status line (long-polls excluded)
+  TR_JPEG_BYTES,
+  TR_UPLINK_BPS,     ///< upload write-loop throughput, bytes/s
+  TR_FIRST_IMAGE,    ///< photo or preview asked for to sent (time to first image)
+  TR_KIND_COUNT
+};
+
+/**
+ * @brief Record one sample: appended to the wake's ring and folded into the RTC aggregates.
+ *
+ * @details
+ * The aggregates (count, sum, max and a log2 histogram per kind) survive deep sleep in the
+ * RTC state block, so `/stats` describes many wakes. A sample costs a short critical section
+ * and a count-leading-zeros, well under a few microseconds; safe from any task.
+ */
+void traceValue(TraceKind kind, uint32_t value);
+
+/** Record the time since `start_ms` (millis() clock) as a `kind` span. */
+inline void traceSpan(TraceKind kind, uint32_t start_ms) { traceValue(kind, millis() - start_ms); }
+
+/** Close the wake: records `TR_WAKE` and the heap/PSRAM low-water marks (done in `enterDeepSleep()`). */
+void traceEndWake();
+
+/** Print the spans recorded during this wake. */
+void logTraceRing();
+
+/**
+ * @brief Compact multi-wake summary for the `/stats` reply.
+ *
+ * One line per kind with samples: count, average, approximate p50/p90 (bucket upper
+ * bounds) and max, followed by the heap and PSRAM low-water marks.
+ */
+size_t traceFormatSummary(char* out, size_t cap);
+/** @} */
+
 
 /** 
  * @brief Send a short message and present inline buttons: **snap** and **ignore**.
@@ -123,51 +625,132 @@ void sendPirAlertButtons();
  * @brief Send a plain text message to the configured Telegram chat.
  *
  * @param text  Message body (will be URL-encoded).
- * @return true on successful HTTP exchange (does not validate JSON success),
- * @return false on connection/IO errors.
+ * @return true if Telegram accepted it, or if it was queued during a rate-limit hold,
+ * @return false on connection/IO errors or an API error.
  *
- * @note Uses HTTPS to `api.telegram.org` with `setInsecure()`.
+ * @note Sent over the shared keep-alive `tgSession` (HTTPS, no certificate validation).
+ *       Use `tgNotify()` for anything that can wait for the next photo or batch.
  */
-bool telegramSendMessage(const String& text);
+bool telegramSendMessage(const char* text);
 
 /**
  * @brief Send a text message with two inline buttons (**snap**, **ignore**).
  *
  * @param text  Prompt shown above the inline keyboard.
- * @return true on successful HTTP exchange (does not validate JSON success),
- * @return false on connection/IO errors.
+ * @return true if Telegram answered 2xx with `"ok":true`,
+ * @return false on connection/IO errors or an API error (see `tgSession.lastResult()`).
  */
-bool telegramSendMessageWithButtons(const String& text);
+bool telegramSendMessageWithButtons(const char* text);
+
+/** @name Outbound message queue
+ *  @{
+ */
+#define TG_OUTBOX_TEXT_MAX  320   ///< queued notice text, sent as one message
+#define TG_BACKOFF_MAX_S     32   ///< cap of the doubling backoff when a 429 has no retry_after
 
 /**
- * @brief Upload a JPEG frame to Telegram via `sendPhoto` (multipart/form-data).
- *
- * @param jpg_buf   Pointer to JPEG buffer.
- * @param jpg_len   Length of the JPEG buffer in bytes.
- * @param caption   Optional text shown with the photo (may be empty).
- * @return true on successful HTTP exchange (does not validate JSON success),
- * @return false on connection/IO errors or stalled write.
+ * @brief Queue a low-priority notice ("dispensing…", "going to sleep") for the chat.
  *
  * @details
- * Streams the JPEG in chunks to avoid large RAM copies. Prints the HTTP response lines
- * to the serial monitor for debugging.
+ * Notices are not sent on their own: the next photo carries them in its caption
+ * (`tgOutboxMergeCaption()`), otherwise `tgOutboxService()` sends everything queued
+ * as one message. Loop task only.
+ *
+ * @return false if the notice was dropped (queue full while rate limited).
+ */
+bool tgNotify(const char* text);
+
+/**
+ * @brief Put queued notices in front of `caption` if they fit in `PHOTO_CAPTION_MAX`.
+ *
+ * @return `out` when notices were merged (and dequeued), otherwise `caption`.
  */
-bool telegramSendPhoto(const uint8_t* jpg_buf, size_t jpg_len, const char* caption);
+const char* tgOutboxMergeCaption(const char* caption, char* out, size_t cap);
+
+/** Send the queued notices as one message, unless Telegram asked us to back off. */
+void tgOutboxService();
+
+/**
+ * @brief Send what is still queued before the radio goes down, waiting out a 429 for at
+ *        most `timeout_ms`.
+ *
+ * @return true if the queue is empty afterwards.
+ */
+bool tgOutboxFlush(uint32_t timeout_ms);
+
+/**
+ * @brief Called for every HTTP 429: hold all requests for `retry_after_s`, or for a
+ *        doubling backoff (1 s up to `TG_BACKOFF_MAX_S`) when the server gave none.
+ */
+void tgNoteRateLimit(uint32_t retry_after_s);
+/** Milliseconds left of the current rate-limit hold, 0 when requests may go out. */
+uint32_t tgRateLimitRemainingMs();
+
+struct OutboxStats {
+  uint32_t notices;         ///< tgNotify() calls
+  uint32_t merged;          ///< notices that rode along in a photo caption
+  uint32_t messages;        ///< sendMessage requests made for queued notices
+  uint32_t dropped;
+  uint32_t rate_limited;    ///< 429 responses seen
+};
+extern OutboxStats outboxStats;
 /** @} */
 
-/** @name String utilities
+/** @name Multi-chat delivery
  *  @{
  */
+#ifndef EXTRA_CHAT_IDS
 /**
- * @brief Minimal URL-encoder for Telegram GET query parameters.
+ * Further chats that receive every photo, each entry followed by a comma, e.g.
+ * `#define EXTRA_CHAT_IDS "-1001234", "5678",` in `user_wifi_and_telegram_config.h`.
+ * Commands are still only taken from `CHAT_ID`.
+ */
+#define EXTRA_CHAT_IDS
+#endif
+#define TG_FILE_ID_MAX  TG_JSON_VALUE_MAX
+
+/** Delivery counters for one recipient (index 0 is `CHAT_ID`). */
+struct RecipientStats {
+  uint32_t ok;
+  uint32_t failed;
+};
+
+/** Totals of the upload-once, forward-by-file_id scheme. */
+struct FanoutStats {
+  uint32_t uploads;        ///< multipart uploads that returned a usable file_id
+  uint32_t forwards;       ///< photos re-sent by file_id
+  uint32_t upload_bytes;   ///< bytes written for those uploads
+  uint32_t forward_bytes;  ///< bytes written for the file_id requests
+  uint32_t bytes_saved;    ///< what re-uploading to every extra chat would have cost, minus the above
+};
+extern FanoutStats fanoutStats;
+
+/** Number of chats in `EXTRA_CHAT_IDS`. */
+uint8_t extraChatCount();
+/** Counters for recipient `i` (0 = `CHAT_ID`, 1.. = `EXTRA_CHAT_IDS` in order). */
+const RecipientStats& recipientStats(uint8_t i);
+/** @} */
+
+/**
+ * @brief Upload a JPEG frame to Telegram via `sendPhoto` (multipart/form-data).
  *
- * @param s  Input string.
- * @return   URL-encoded string where non-alphanumerics are percent-escaped,
- *           and spaces become `%20`.
+ * @param jpg_buf   Pointer to JPEG buffer.
+ * @param jpg_len   Length of the JPEG buffer in bytes.
+ * @param caption   Optional text shown with the photo (may be empty).
+ * @param session   Connection to upload on (the uploader task passes `tgUploadSession`).
+ * @return true if `CHAT_ID` received the photo (HTTP 2xx and `"ok":true`).
+ * @return false on connection/IO errors, a stalled write or an API error.
  *
- * @note This is not a fully RFC-compliant encoder but is sufficient for typical text.
+ * @details
+ * Streams the JPEG straight from the frame buffer over `session`. The JPEG is uploaded
+ * once, to `CHAT_ID`; the `file_id` from that response is then sent to every chat in
+ * `EXTRA_CHAT_IDS` with a small `sendPhoto?photo=<file_id>` request on the same
+ * connection. Each recipient's result is counted in `recipientStats()`. If no usable
+ * file_id comes back the extra chats get their own upload. `reply_markup` (inline
+ * buttons) goes to `CHAT_ID` only, the one chat whose presses are obeyed.
  */
-String urlencode(const String& s);
+bool telegramSendPhoto(const uint8_t* jpg_buf, size_t jpg_len, const char* caption,
+                       TelegramSession& session = tgSession, const char* reply_markup = nullptr);
 /** @} */
 
 /** @name Camera setup and capture
@@ -179,46 +762,623 @@ String urlencode(const String& s);
  * @return true on successful `esp_camera_init`, false otherwise.
  *
  * @details
- * - Checks for PSRAM; if present, configures VGA and quality settings accordingly.
- * - Adjusts sensor framesize/quality for a balance between size and clarity.
+ * - Checks for PSRAM; if present, configures SVGA/quality 20 over a grab-latest ring,
+ *   otherwise QVGA in a single DRAM buffer.
+ * - The final framesize/quality are part of the init config (no later reconfiguration).
  * - Prints error code (`esp_err_t`) on failure.
  */
 bool initCamera();
 
+/** @name Adaptive framesize / quality
+ *  @{
+ */
+/** Target upload time for one photo; the controller picks the best rung predicted to fit. */
+#ifndef UPLOAD_BUDGET_MS
+#define UPLOAD_BUDGET_MS  3000
+#endif
+
+/**
+ * @brief Pick and apply the framesize/quality for the next capture.
+ *
+ * @details
+ * Walks a fixed ladder (SVGA q20 down to QVGA q35) and takes the first rung whose
+ * predicted upload time fits `UPLOAD_BUDGET_MS`. The prediction uses the uplink rate
+ * learned from previous uploads (discounted when `WiFi.RSSI()` has dropped since it was
+ * measured, or an RSSI-based guess when nothing is known yet) and a learned JPEG size
+ * scale. Both are kept in the RTC block, so they carry over between wakes. Every
+ * decision is logged with an `[ADAPT]` prefix. While a clip is recording the sensor is
+ * left alone and the capture goes out at the current rung; it never waits for the clip.
+ */
+void applyAdaptiveCapture();
+
+/** Feed the byte count and duration of one photo write loop into the uplink estimate. */
+void recordUploadThroughput(size_t bytes, uint32_t ms);
+
+/** Feed the size of a frame taken at the current rung into the JPEG size estimate. */
+void noteCapturedSize(size_t bytes);
+/** @} */
+
+/**
+ * @brief Capture and discard a few frames so exposure and white balance settle.
+ *
+ * @param frames  Number of frames to throw away.
+ *
+ * @note Meant to run while Wi-Fi is still associating, off the critical path.
+ */
+void warmUpCamera(uint8_t frames = CAM_WARMUP_FRAMES);
+
+/**
+ * @brief Milliseconds between a capture request and the end of the frame handed out for it.
+ *
+ * Updated by `grabFreshFrame()`; always >= 0 since older frames are never returned.
+ */
+extern int32_t lastCaptureAgeMs;
+
+/**
+ * @brief Get the first frame that finished after `request_us` (esp_timer clock).
+ *
+ * @param request_us  `esp_timer_get_time()` at the moment the photo was asked for.
+ * @return a frame buffer the caller must give back with `esp_camera_fb_return()`,
+ *         or nullptr on capture failure.
+ *
+ * @details
+ * With PSRAM the driver runs in `CAMERA_GRAB_LATEST` mode over `CAM_FB_COUNT` buffers, so
+ * the freshest frame is normally ready already; otherwise this waits for the frame
+ * currently being captured. No fixed delays are involved.
+ */
+camera_fb_t* grabFreshFrame(int64_t request_us);
+
 /**
  * @brief Capture a *fresh* JPEG frame and send it to Telegram.
  *
  * @param caption         Optional caption (defaults to `PHOTO_CAPTION`).
- * @param fresh_wait_ms   Milliseconds to wait after discarding a possibly stale frame
- *                        before grabbing a new one (default: 120 ms).
- * @return true if the frame was captured and the upload request was issued successfully,
- * @return false on capture or network errors.
+ * @return true if the frame was captured and the upload succeeded or was queued,
+ * @return false on capture or network errors, or when the upload queue was full.
+ *
+ * @details
+ * Uses `grabFreshFrame()`, so the uploaded frame is guaranteed to be newer than the
+ * call, and logs its age (`lastCaptureAgeMs`). When the photo pipeline is running the
+ * frame is handed to the uploader task and this returns right away; otherwise the
+ * upload happens inline. The frame buffer always goes back to the camera driver.
+ */
+bool takeAndSendPhoto(const char* caption = PHOTO_CAPTION);
+
+/**
+ * @brief Capture a burst of frames and upload only the sharpest one.
+ *
+ * @param frames   Number of frames to capture and score.
+ * @param caption  Caption of the uploaded photo.
+ * @return same as `takeAndSendPhoto()`.
+ *
+ * @details
+ * Each frame is decoded at 1/8 scale (DC coefficients only), reduced to luma and scored
+ * with `scoreSharpness()`. The best frame so far stays checked out of the driver's PSRAM
+ * ring while the next one is grabbed, so no JPEG is ever copied. Without PSRAM this
+ * falls back to a single `takeAndSendPhoto()`.
+ */
+bool takeAndSendBestOfBurst(uint8_t frames = BURST_FRAMES, const char* caption = PHOTO_CAPTION);
+
+/**
+ * @brief Sharpness score of a luma plane: variance of the 4-neighbour Laplacian, weighted
+ *        down for under/over-exposed frames.
+ *
+ * Integer-only and row-streaming (three row pointers), about 1 ms for a 100x75 plane.
+ */
+uint32_t scoreSharpness(const uint8_t* luma, int w, int h);
+
+/**
+ * @brief Decode `fb` at 1/8 scale into `scratch` and score it.
+ *
+ * @param scratch_len  Must hold `ceil(w/8) * ceil(h/8) * 2` bytes (RGB565).
+ * @return false if the scratch buffer is too small or the JPEG does not decode.
+ */
+bool frameSharpness(const camera_fb_t* fb, uint8_t* scratch, size_t scratch_len, uint32_t* score);
+
+/** @name Progressive snap
+ *  @{
+ */
+#ifndef PROGRESSIVE_SNAP
+#define PROGRESSIVE_SNAP      1    ///< /snap sends a small preview first, full resolution on request
+#endif
+#define PREVIEW_MAX_WIDTH     400  ///< SVGA halves to 400x300
+#define PREVIEW_JPEG_QUALITY  40   ///< fmt2jpg quality, 1..100 (higher is better)
+
+/** Written by whichever task runs the upload, except `bytes_saved` (command loop). */
+struct PreviewStats {
+  uint32_t previews;        ///< previews delivered
+  uint32_t full_sent;       ///< full frames uploaded after a "Full resolution" press
+  uint32_t preview_bytes;
+  int32_t  bytes_saved;     ///< full frames never uploaded, minus previews that were followed by one
+  uint32_t last_ttfi_ms;    ///< capture request → preview delivered
+  uint32_t last_full_ms;    ///< upload time of the last full frame
+};
+extern PreviewStats previewStats;
+
+/**
+ * @brief Capture a full frame, send a downscaled preview with a "Full resolution" button.
+ *
+ * @details
+ * The preview is decoded at 1/2 (or 1/4) scale by the JPEG decoder and re-encoded with
+ * `fmt2jpg()`, then queued like any photo: it fans out to `EXTRA_CHAT_IDS` (without the
+ * button) and is journaled if the link fails. Its delivery records `TR_FIRST_IMAGE`.
+ * The full frame is copied to PSRAM and held until the button is pressed
+ * (`sendHeldFullFrame()`), the next preview replaces it, or the window ends. A frame
+ * that yields no smaller preview is queued as the photo itself. Without PSRAM this is
+ * `takeAndSendPhoto()`.
+ */
+bool takeAndSendPreview(const char* caption = PHOTO_CAPTION);
+
+/**
+ * Queue the held full frame for upload (the `cf:full:<seq>` button). False if `seq` is not
+ * the held frame's preview (superseded or already sent), or the queue is full.
+ */
+bool sendHeldFullFrame(uint32_t seq);
+
+/** Drop the held full frame at the end of the awake window and count the bytes saved. */
+void previewRelease();
+/** @} */
+
+/** @name PIR motion verifier
+ *  @{
+ */
+#define MOTION_GRID_W           16   ///< background model: 16x12 luma block means (RTC memory)
+#define MOTION_GRID_H           12
+#define MOTION_VERIFY_FRAMES     3   ///< frames compared per PIR wake
+#define MOTION_BLOCK_THRESHOLD  18   ///< luma change for a block to count as changed
+#define MOTION_MIN_BLOCKS        4   ///< changed blocks needed to call it motion
+#define MOTION_BG_RELEARN_WAKES  3   ///< wakes in a row with a still but changed scene before it becomes the background
+
+/**
+ * @brief Confirm a PIR wake with the camera before any network traffic.
+ *
+ * @return true if something moved (or no background model exists yet), false for a
+ *         false alarm, e.g. a heat draft.
+ *
+ * @details
+ * Grabs `MOTION_VERIFY_FRAMES` frames, decodes each at 1/8 scale to luma and reduces it
+ * to a `MOTION_GRID_W` x `MOTION_GRID_H` grid of block means. Each grid is compared with
+ * the background model kept in RTC memory and with the previous frame, using
+ * `countChangedBlocks()`. The background adapts slowly on wakes without motion. When the
+ * frames of a wake agree with each other but not with the background for
+ * `MOTION_BG_RELEARN_WAKES` wakes in a row, the scene itself changed (the bowl was moved)
+ * and the current grid replaces the background; those wakes still count as motion.
+ */
+bool verifyMotion();
+
+/** Average a w x h luma plane down to the motion grid (row-streaming, integer only). */
+void lumaBlockMeans(const uint8_t* luma, int w, int h, uint8_t* grid);
+
+/**
+ * @brief Block-wise absolute difference after removing the mean (global brightness) shift.
+ *
+ * @return number of blocks whose difference exceeds `threshold`.
+ */
+uint16_t countChangedBlocks(const uint8_t* a, const uint8_t* b, uint16_t n, uint8_t threshold);
+/** @} */
+
+/** @name Feeder servo (MG996 360°)
+ *  @{
+ */
+#define SERVO_PIN          14     ///< servo signal (also SD CLK (SD_MMC, 1-bit mode as used here))
+#define SERVO_PERIOD_US    20000  ///< 50 Hz frame; the profile timer ticks once per frame
+#define SERVO_STOP_US      1500   ///< continuous-rotation servo: no motion
+#define FEED_RUN_US        1900   ///< dispensing speed and direction
+#define FEED_RAMP_MS       300    ///< ramp up / ramp down, limits the current spike
+#define FEED_HOLD_MS       1500   ///< full-speed dispensing time (calibrate per portion)
+#define FEED_BRAKE_MS      200    ///< hold the stop pulse before the output is released
+
+/** Shape of one dispense cycle. */
+struct FeedProfile {
+  uint16_t stop_us;
+  uint16_t run_us;
+  uint16_t ramp_ms;
+  uint16_t hold_ms;
+  uint16_t brake_ms;
+};
+
+/**
+ * @brief Servo pulse width at `t_ms` into a dispense: ramp up, hold, ramp down, stop.
+ *
+ * @return pulse width in µs, or 0 once the cycle is over (output released).
+ *
+ * Pure function of its arguments, so the profile can be checked off-target.
+ */
+uint16_t feedProfilePulseUs(const FeedProfile& profile, uint32_t t_ms);
+
+/** Total length of a dispense cycle including the brake phase. */
+uint32_t feedProfileDurationMs(const FeedProfile& profile);
+
+/**
+ * @brief Start a dispense cycle in the background.
+ *
+ * @return false if a cycle is already running or the LEDC/timer setup failed.
+ *
+ * @details
+ * The servo is driven by LEDC (high-speed timer 1 / channel 1; timer 0 belongs to the
+ * camera XCLK) and an `esp_timer` updates the duty once per 20 ms frame, so polling and
+ * uploads keep running while it feeds. Midway through the hold phase a photo is
+ * requested; `serviceFeeder()` takes it from the main loop.
+ */
+bool startFeed();
+
+/** True while a dispense cycle is running. */
+bool feederBusy();
+
+/** Call from the main loop: takes the mid-dispense photo and logs timer jitter when done. */
+void serviceFeeder();
+/** @} */
+
+/** Counters of the capture → upload pipeline (each field has a single writer task). */
+struct PhotoPipelineStats {
+  volatile uint32_t queued;     ///< frames (and clip jobs) accepted into the queue
+  volatile uint32_t uploaded;   ///< uploads that completed
+  volatile uint32_t failed;     ///< uploads that errored
+  volatile uint32_t dropped;    ///< frames rejected because the queue was full
+  volatile uint32_t max_depth;  ///< deepest the queue got
+};
+extern PhotoPipelineStats photoStats;
+
+/**
+ * @brief Start the uploader task (pinned to PRO_CPU) and its bounded frame queue.
+ *
+ * @return true if the pipeline is running.
+ *
+ * @note Only worth it with PSRAM: every queued photo holds one of the `CAM_FB_COUNT`
+ *       driver frame buffers until it has been uploaded.
+ */
+bool startPhotoPipeline();
+
+/**
+ * @brief Queue a captured frame for upload without blocking.
+ *
+ * The upload fans out to `EXTRA_CHAT_IDS` and a transient failure journals the frame.
+ * Without the pipeline the frame is uploaded inline.
+ *
+ * @param request_ms  millis() when the photo was asked for; the upload then records a
+ *                    `TR_FIRST_IMAGE` span. 0 = not timed.
+ * @return false if the queue was full; the frame is then returned and counted as dropped.
+ */
+bool enqueuePhoto(camera_fb_t* fb, const char* caption, uint32_t request_ms = 0);
+
+/**
+ * @brief Wait until every queued photo has been uploaded (call before deep sleep).
+ *
+ * @return false if uploads were still pending after `timeout_ms`.
+ */
+bool drainPhotoPipeline(uint32_t timeout_ms);
+/** @} */
+
+/** @name microSD frame journal
+ *  @{
+ */
+#define JOURNAL_BASE_PATH      "/cfj"  ///< files: <base>.dat (records), .idx (index), .pos (drain cursor)
+#define JOURNAL_MAGIC          0x314A4643UL  ///< "CFJ1" at the start of every record
+#define JOURNAL_MAX_RECORD     (256 * 1024)  ///< larger records are treated as corrupt
+#define JOURNAL_IDLE_POLL_MS   500     ///< upload task checks for backlog this often when idle
+#define JOURNAL_DRAIN_BATCH    4       ///< backlog frames sent per idle turn of the upload task
+
+/** Fixed header in front of every journal record; the caption and JPEG follow it. */
+struct JournalRecord {
+  uint32_t magic;
+  uint32_t seq;          ///< running record number (index position)
+  uint32_t wake;         ///< `rtcWakeCount()` when it was captured
+  uint32_t uptime_ms;    ///< millis() when it was captured
+  uint16_t caption_len;
+  uint8_t  kind;         ///< `JOURNAL_KIND_PHOTO`
+  uint8_t  reserved;
+  uint32_t data_len;
+  uint32_t crc;          ///< CRC32 over the fields above, the caption and the data
+};
+#define JOURNAL_KIND_PHOTO  1
+
+/**
+ * @brief Append-only record log with an index, written against any `fs::FS`.
+ *
+ * @details
+ * Records are appended to `<base>.dat`; only after the record is flushed is its
+ * `{offset, length}` appended to `<base>.idx`, so the index is the commit log. `<base>.pos`
+ * holds how many indexed records have been uploaded. `open()` recovers from a write cut
+ * off by a reset: a partial index entry is dropped (the index is rewritten), a record
+ * that never made it into the index is ignored, and an indexed record whose header or
+ * CRC does not check out is skipped when drained. Once everything is drained the files
+ * are removed, so the journal never grows without bound.
+ *
+ * Not thread-safe by itself; the `journal*()` helpers below serialize access.
+ */
+class FrameJournal {
+public:
+  FrameJournal(fs::FS& fs, const char* base);
+  /** Load the index and drain cursor, repairing a torn tail. */
+  bool open();
+  bool append(uint8_t kind, uint32_t wake, const char* caption, const uint8_t* data, size_t len);
+  /** Records appended but not yet drained. */
+  uint32_t pending() const { return entries_ - drained_; }
+  /**
+   * @brief Read the k-th undrained record (0 = oldest).
+   *
+   * @param data  Receives `rec->data_len` bytes allocated with `ps_malloc()`/`malloc()`;
+   *              the caller frees it.
+   * @return false if there is no such record or it is unreadable (for the oldest, call
+   *         `advance()` to skip it).
+   */
+  bool read(uint32_t k, JournalRecord* rec, char* caption, size_t caption_cap, uint8_t** data);
+  bool readNext(JournalRecord* rec, char* caption, size_t caption_cap, uint8_t** data) {
+    return read(0, rec, caption, caption_cap, data);
+  }
+  /** Mark the oldest record drained; removes the files once the journal is empty. */
+  bool advance();
+
+private:
+  struct IndexEntry {
+    uint32_t offset;
+    uint32_t length;
+  };
+  bool readIndexEntry(uint32_t i, IndexEntry* e);
+  bool readHeader(File& dat, const IndexEntry& e, JournalRecord* rec, char* cap_buf);
+  bool saveCursor();
+  void path(char* out, size_t cap, const char* ext) const;
+
+  fs::FS&     fs_;
+  const char* base_;
+  uint32_t    entries_ = 0;
+  uint32_t    drained_ = 0;
+};
+
+/** Create the journal lock; call once in `setup()` before any task uses the journal. */
+void journalBegin();
+
+/**
+ * @brief Append a frame to the microSD journal (mounting the card on first use).
+ *
+ * @return false without a card or while the feeder runs (the servo shares GPIO14 with SD CLK).
+ */
+bool journalFrame(const uint8_t* jpg, size_t len, const char* caption);
+
+/** Capture a fresh frame and journal it, e.g. for a PIR event while Wi-Fi is down. */
+bool journalCapture(const char* caption);
+
+/** True for failures worth journaling and retrying: no response, 429 or 5xx. */
+bool tgFailureIsTransient(const TgResult& result);
+
+/**
+ * @brief Upload the oldest journaled frame through `session`.
+ *
+ * @return true if a record was consumed (sent, or dropped because Telegram rejected it).
+ *         On a network failure the record stays for the next wake.
+ */
+bool journalDrainOne(TelegramSession& session);
+
+/** Allow or stop backlog uploads (stopped before sleep so the queue can drain). */
+void journalSetDrainEnabled(bool enabled);
+bool journalDrainEnabled();
+/** True while a backlog record is being read or uploaded. */
+bool journalBusy();
+/** Records waiting in the journal (0 if the card was never mounted). */
+uint32_t journalPending();
+
+/** Unmount the card so GPIO14 can drive the servo; it is remounted on next use. */
+void journalSuspend();
+/** @} */
+
+/** @name Timelapse
+ *  @{
+ */
+#ifndef TIMELAPSE_ENABLED
+#define TIMELAPSE_ENABLED     0      ///< power-on default; `/timelapse` toggles it
+#endif
+#ifndef TIMELAPSE_INTERVAL_S
+#define TIMELAPSE_INTERVAL_S  900    ///< timer wake period while timelapse is on
+#endif
+#ifndef TIMELAPSE_BATCH
+#define TIMELAPSE_BATCH       6      ///< frames per album (sendMediaGroup takes 2..10)
+#endif
+#define TIMELAPSE_BASE_PATH   "/cftl"
+#ifndef TIMELAPSE_MAX_PENDING
+#define TIMELAPSE_MAX_PENDING 96     ///< frames kept while uploads fail (a day at 15 min); later ones are not stored
+#endif
+#define TIMELAPSE_ALBUM_BYTES (1024 * 1024) ///< PSRAM an album may read ahead; a larger one is cut short
+
+bool timelapseEnabled();
+/** Switch timer wakes on or off (kept in RTC memory; power-on resets to `TIMELAPSE_ENABLED`). */
+void timelapseSetEnabled(bool enabled);
+
+/**
+ * @brief Timer wake: capture one frame into the SD timelapse journal, without Wi-Fi.
+ *
+ * Once `TIMELAPSE_MAX_PENDING` frames are waiting the new one is not stored, so a
+ * bot that stays unreachable cannot fill the card.
+ *
+ * @return frames now waiting for upload, or -1 if there is no card or the capture failed.
+ */
+int timelapseCapture();
+
+/**
+ * @brief Upload every waiting frame as albums of up to 10 with `sendMediaGroup`.
+ *
+ * @details
+ * Each album is read into memory under the journal lock and uploaded with the lock
+ * released, so `journalFrame()` is not held up for the length of an upload. A batch of
+ * N frames costs one association and one TLS handshake instead of N. A record that does
+ * not read back is skipped. An album Telegram rejects for good (HTTP 4xx) is sent again
+ * frame by frame so one bad JPEG does not hold back the rest; a transient failure keeps
+ * every unsent frame for the next upload. Logs the batch's radio time and charge next to
+ * the estimate for uploading each frame on its own wake. Albums go to `CHAT_ID` only.
+ */
+bool timelapseUpload(TelegramSession& session);
+/** @} */
+
+/** @name Motion clips (AVI / MJPEG)
+ *  @{
+ */
+#ifndef CLIP_ON_PIR
+#define CLIP_ON_PIR           1      ///< record a clip after the alert on every verified PIR wake
+#endif
+#ifndef CLIP_SECONDS
+#define CLIP_SECONDS          4
+#endif
+#define CLIP_MAX_FRAMES       120    ///< index entries kept in RAM while recording
+#define CLIP_FRAMESIZE        FRAMESIZE_VGA
+#define CLIP_JPEG_QUALITY     25
+#define CLIP_PSRAM_BYTES      (1536 * 1024) ///< clip buffer in PSRAM; without it the clip goes to SD
+#define CLIP_PATH             "/cfclip.avi"
+#define CLIP_CHUNK            4096   ///< SD → socket copy buffer while uploading
+
+#define AVI_HEADER_SIZE       224    ///< RIFF/hdrl/strl headers up to and including "movi"
+
+/** What the AVI headers describe; filled in once the last frame is known. */
+struct AviInfo {
+  uint16_t width;
+  uint16_t height;
+  uint32_t frames;
+  uint32_t us_per_frame;
+  uint32_t max_frame_bytes;
+  uint32_t movi_bytes;      ///< frame chunks ("00dc" + size + JPEG + pad) after "movi"
+};
+
+/**
+ * @brief Write the fixed-size AVI header block for one MJPEG stream.
+ *
+ * Pure function: called with zero frames before recording and again at the end, when
+ * the result overwrites the placeholder at offset 0.
+ */
+void aviWriteHeader(uint8_t out[AVI_HEADER_SIZE], const AviInfo& info);
+
+struct ClipStats {
+  uint32_t frames;
+  uint32_t record_ms;
+  uint32_t bytes;           ///< whole AVI file
+  uint32_t upload_ms;
+  uint32_t upload_bps;
+  bool     on_sd;
+};
+extern ClipStats clipStats;   ///< the most recent clip
+
+/**
+ * @brief Record up to `duration_ms` of camera frames into an AVI container.
  *
  * @details
- * Implements a "flush & grab" technique:
- *  1. Grabs the current frame (if any) and discards it (records its timestamp).
- *  2. Waits `fresh_wait_ms` to allow the driver to produce the *next* frame.
- *  3. Captures the fresh frame and uploads it via `telegramSendPhoto()`.
- * Always returns the frame buffer to the camera driver.
+ * Frames are appended as they arrive to a PSRAM buffer, or to `CLIP_PATH` on the card
+ * when PSRAM is short; the idx1 index is appended and the headers patched once the
+ * real frame count and rate are known. Recording stops early when storage runs out.
+ * Adaptive capture settings are re-applied on the next photo.
+ *
+ * @return true if at least one frame was stored.
+ */
+bool clipRecord(uint32_t duration_ms = CLIP_SECONDS * 1000UL);
+
+/**
+ * @brief Upload the recorded clip with `sendVideo`, streaming it from PSRAM or SD.
+ *
+ * The clip is released afterwards whether or not the upload succeeded.
  */
-bool takeAndSendPhoto(const char* caption = PHOTO_CAPTION, uint32_t fresh_wait_ms = 120);
+bool clipSend(const char* caption, TelegramSession& session = tgSession);
+
+/**
+ * @brief Record a clip and send it on the upload task, so the command loop keeps polling.
+ *
+ * The job takes a slot in the photo queue and counts in `photoStats` like a photo.
+ * Photos asked for meanwhile wait until the recording ends, since it holds the sensor
+ * at `CLIP_FRAMESIZE`. Without the pipeline the clip is recorded and sent inline.
+ *
+ * @return false if the queue was full, or (inline) if recording or upload failed.
+ */
+bool clipRecordAndSend(const char* caption);
+
+/** Release the clip buffer / delete the clip file without sending it. */
+void clipDiscard();
+/** @} */
+
+/** @name Live MJPEG stream
+ *  @{
+ */
+#define LIVE_PORT               81     ///< http://<device-ip>:81/
+#define LIVE_MAX_CLIENTS         2     ///< further viewers get 503
+#define LIVE_FRAME_INTERVAL_MS 100     ///< ~10 fps cap; leaves air time for Telegram
+#define LIVE_STALL_MS         5000     ///< a viewer whose socket takes nothing for this long is dropped
+#define LIVE_FRAMES_HELD         2     ///< frames in flight at once: a slow viewer's and everyone else's
+
+/**
+ * @brief Start the `multipart/x-mixed-replace` MJPEG server in its own task.
+ *
+ * @details
+ * Each frame buffer is written straight to the client sockets, never copied, with
+ * non-blocking `send()`s: every viewer keeps its own offset into its part and gets more
+ * whenever its socket has room, so one slow viewer never stalls the task. A viewer still
+ * sending a frame skips newer ones rather than queueing them, so its stream slows to what
+ * its link carries and latency does not grow; the others move on to the next frame (up
+ * to `LIVE_FRAMES_HELD` buffers are out at once).
+ *
+ * Every part carries `X-Frame` (sequence number from 1, gaps are skipped frames) and
+ * `X-Timestamp`, the capture time in seconds since boot on the `esp_timer` clock. The
+ * feeder keeps no wall-clock time, so latency is measured from differences between parts.
+ */
+bool liveStart();
+
+/** Stop the server and disconnect viewers (before sleep, or on a second `/live`). */
+void liveStop();
+bool liveActive();
+/** @} */
+
+/** @name Awake window
+ *  @{
+ */
+#define AWAKE_MS             90000UL   ///< window after a wake when nobody has answered yet
+#define AWAKE_IDLE_MS        30000UL   ///< after a command, stay this long for the next one
+#define AWAKE_MAX_MS        300000UL   ///< hard cap on one wake, however chatty the chat is
+#define AWAKE_ACTIVE_MA        160     ///< rough board current with the radio fully on
+#define AWAKE_MODEM_SLEEP_MA    50     ///< rough board current in Wi-Fi modem sleep
+
+/** Open the window; the end is `AWAKE_MS` from now. */
+void awakeWindowBegin();
+
+/** A command arrived: the window now ends `AWAKE_IDLE_MS` from now (capped at `AWAKE_MAX_MS`). */
+void awakeNoteActivity();
+
+/** Close the window at once (e.g. `/ignore`). */
+void awakeEndNow(const char* reason);
+
+/** Current end of the window (millis() clock); moves as commands arrive. */
+uint32_t awakeDeadline();
+bool awakeWindowOpen();
+
+/**
+ * @brief Switch Wi-Fi modem sleep on while nothing is in flight, off for commands and uploads.
+ *
+ * Modem sleep lets the radio doze between DTIM beacons during the long-poll; time in each
+ * state feeds the charge estimate.
+ */
+void awakeRadioIdle(bool idle);
+
+/** Print the wake's awake time and estimated charge; adds it to the RTC totals. */
+void awakeWindowReport();
 /** @} */
 
 /** @name Telegram polling
  *  @{
  */
+#define TG_MAX_UPDATES_PER_POLL  8   ///< getUpdates `limit`; commands of one batch run in order
+
 /**
- * @brief Poll Telegram updates via `getUpdates` and handle `/snap` commands for the configured chat.
+ * @brief Poll Telegram updates via `getUpdates` and run the commands of the configured chat.
+ *
+ * @param deadline_ms  End of the awake window (millis() clock). The long-poll hold time is
+ *                     clipped to it and a request still pending at the deadline is cancelled.
+ * @return true if a getUpdates response was received, false on network errors or cancel.
  *
  * @details
+ * - Long-polls with `timeout=TG_LONG_POLL_S`: the server answers as soon as an update arrives.
  * - Uses a stored `lastUpdateId` offset to avoid re-processing older updates.
- * - Naively scans the JSON string for `/snap` occurrences within the correct `chat.id`.
- * - On `/snap`, sends an acknowledgment message and triggers `takeAndSendPhoto()`.
+ * - Streams the body through `TgUpdateParser`; only updates from `CHAT_ID` are obeyed.
+ * - Each update is matched once against a constant command table (`/snap`, `/burst`,
+ *   `/ignore`, `/feed`, `/live`, `/status`, `/stats` and the `cf:snap` / `cf:ignore` buttons).
+ *   The matched commands run in update order once the response has been read.
+ * - Records `lastReactionLatencyMs` for the first command of each batch, from when it became
+ *   available (see there) until its handler returns.
  *
- * @note Designed to be called periodically (e.g., every ~3 seconds during the awake window).
+ * @note Designed to be called back-to-back during the awake window.
  *       Requires Wi-Fi connectivity; function returns early if Wi-Fi is down.
  */
-void pollTelegram();
+bool pollTelegram(uint32_t deadline_ms);
 /** @} */
 
 /** @name Arduino entry points
@@ -257,14 +1417,9 @@ void logWakeCause();
    their linkage to the translation unit. They are documented here but not
    declared publicly to avoid ODR/linkage mismatches:
 
-   - static long  extractMaxUpdateId(const String& body);
-       Scans the Telegram JSON string for all `"update_id":<num>` occurrences and
-       returns the maximum value found (or the current `lastUpdateId` if none).
-
-   - static bool  bodyContainsSnapForMe(const String& body);
-       Checks if the Telegram JSON contains a `/snap` message (or callback) that
-       belongs to the configured `CHAT_ID`. Uses a small sliding window around the
-       found token to associate it with the correct `"chat":{"id":...}`.
+   - static int8_t matchCommand(const TgUpdate& u);
+       Index of the `kCommands` entry for an update, or -1. Text commands match
+       with an optional `@botname` suffix or arguments; callbacks match exactly.
 
    - static void  configurePirRtcInput();
        Configures the PIR GPIO as an RTC input (INPUT_ONLY) with pulldown enabled,
@@ -10,21 +10,73 @@ void setup() {
   digitalWrite(LED_FLASH_PIN, LOW);
 
   Serial.begin(115200);
-  delay(200);
   Serial.println("\n[BOOT] ESP32-CAM Telegram /snap bot");
   logWakeCause();
   esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+  rtcStateRestore();
+  tlsSessionCacheRestore();
+  journalBegin();
+  bootMark("serial");
 
-  // Bring up Wi-Fi for messaging & polling
-  WiFi.mode(WIFI_STA);
-  const bool wifi_ok = ensureWiFi();
+  // A PIR wake is checked with the camera first, so a false alarm costs no radio time.
+  const bool verify_pir = (cause == ESP_SLEEP_WAKEUP_EXT1);
+  // A timelapse wake stores its frame on the card and only brings Wi-Fi up for a full batch.
+  const bool timelapse_wake = (cause == ESP_SLEEP_WAKEUP_TIMER) && timelapseEnabled();
 
-  if (!initCamera()) {
+  // Otherwise Wi-Fi associates on its own task while the camera comes up here;
+  // wake-to-first-photo is bounded by the slower of the two, not their sum.
+  if (!verify_pir && !timelapse_wake) {
+    startWiFi();
+    bootMark("wifi_begin");
+  }
+
+  const bool cam_ok = initCamera();
+  bootMark("camera_init");
+  if (cam_ok) {
+    warmUpCamera();
+    bootMark("camera_warm");
+  }
+
+  if (verify_pir) {
+    if (cam_ok && !verifyMotion()) {
+      logBootTimeline();
+      enterDeepSleep(); // does not return
+    }
+    bootMark("pir_verified");
+    startWiFi();
+    bootMark("wifi_begin");
+  }
+
+  int timelapse_waiting = -1;
+  if (timelapse_wake) {
+    timelapse_waiting = cam_ok ? timelapseCapture() : -1;
+    bootMark("timelapse_frame");
+    if (timelapse_waiting >= 0 && timelapse_waiting < TIMELAPSE_BATCH) {
+      logBootTimeline();
+      enterDeepSleep(); // does not return
+    }
+    // Batch full, or no card: this wake uploads.
+    startWiFi();
+    bootMark("wifi_begin");
+  }
+
+  const bool wifi_ok = waitWiFi(10000);
+  bootMark("wifi_up");
+
+  if (!cam_ok) {
     flashBlink(8, 40, 60);
     if (wifi_ok) {
       telegramSendMessage("Camera could not initiate properly.");
     }
     // Even if camera failed, we still configure sleep so battery isn't drained.
+  } else if (psramFound() && !startPhotoPipeline()) {
+    Serial.println("[CAM] Upload task failed to start; uploading inline");
+  }
+  logBootTimeline();
+
+  // Nobody can be told right now: keep the event on the card, it goes out on a later wake.
+  if (!wifi_ok && cam_ok && cause == ESP_SLEEP_WAKEUP_EXT1) {
+    journalCapture("🚨 Motion while offline");
   }
 
   // Optional hello
@@ -33,17 +85,30 @@ void setup() {
     switch (cause) {
       case ESP_SLEEP_WAKEUP_EXT1:
         Serial.println("[BOOT] Wake: EXT1 (PIR)");
+        // The alert goes first; the clip is recorded and sent by the upload task.
         sendPirAlertButtons();
+        if (CLIP_ON_PIR && cam_ok) clipRecordAndSend("🎬 Motion clip");
         break;
       case ESP_SLEEP_WAKEUP_EXT0:
         Serial.println("[BOOT] Wake: EXT0");
         break;
       case ESP_SLEEP_WAKEUP_TIMER:
         Serial.println("[BOOT] Wake: TIMER");
+        if (timelapse_wake && timelapse_waiting >= 0) {
+          timelapseUpload(tgSession);
+        } else if (timelapse_wake && cam_ok) {
+          takeAndSendPhoto("⏱ Timelapse"); // no card: one frame per wake, sent live
+        }
         break;
       case ESP_SLEEP_WAKEUP_UNDEFINED:
         Serial.println("[BOOT] Power-on reset");
-        telegramSendMessage("🤖 ESP32-CAM awake. You have 90s; send /snap or /ignore.");
+        {
+          char hello[128];
+          snprintf(hello, sizeof(hello),
+                   "🤖 ESP32-CAM awake for %lu s, %lu s more after each command; send /snap or /ignore.",
+                   (unsigned long)(AWAKE_MS / 1000), (unsigned long)(AWAKE_IDLE_MS / 1000));
+          tgNotify(hello);
+        }
         break;
       default:
         Serial.printf("[BOOT] Wake cause: %d\n", (int)cause);
@@ -52,24 +117,63 @@ void setup() {
   }   // <-- close if (wifi_ok)
 
   // ---------- ACTIVE WINDOW AFTER WAKE ----------
-  // Stay awake for 90 seconds total, polling every ~0.5 seconds.
-  const uint32_t AWAKE_MS = 90 * 1000UL;
+  // Awake for AWAKE_MS, or AWAKE_IDLE_MS after the last command; /ignore ends it at once.
+  // getUpdates long-polls, so the next poll starts right away; the pause only applies
+  // to short polling or after a network error.
   const uint32_t POLL_PERIOD_MS = 500UL;
-  const uint32_t t_end = millis() + AWAKE_MS;
+  awakeWindowBegin();
+  if (!wifi_ok) {
+    awakeEndNow("no Wi-Fi"); // no command can reach us
+  } else if (timelapse_wake) {
+    awakeEndNow("timelapse wake"); // nobody is watching a scheduled upload
+  }
 
-  while ((int32_t)(t_end - millis()) > 0) {
+  while (awakeWindowOpen()) {
+    bool polled = false;
     if (wifi_ok) {
-      pollTelegram();   // <-- your existing single-iteration getUpdates handler
+      tgOutboxService();
+      polled = pollTelegram(awakeDeadline());
     }
-    // Sleep between polls (keeps CPU idle and saves some power)
-    delay(POLL_PERIOD_MS);
+    serviceFeeder();
+    if (!polled || TG_LONG_POLL_S == 0) {
+      // Sleep between polls (keeps CPU idle and saves some power)
+      delay(POLL_PERIOD_MS);
+    }
+  }
+
+  // A dispense started late in the window still runs to its end
+  while (feederBusy()) {
+    serviceFeeder();
+    delay(20);
   }
+  serviceFeeder();
 
-  // notify to telegram that going to sleep:
+  // Let queued photos finish before the radio goes down
+  if (!drainPhotoPipeline(20000UL)) {
+    Serial.println("[TG] Uploads still pending at sleep time");
+  }
+
+  // notify to telegram that going to sleep, together with anything still queued:
   if (wifi_ok) {
-    telegramSendMessage("😴 Going back to deep sleep. Wake me with motion (PIR).");
+    tgNotify("😴 Going back to deep sleep. Wake me with motion (PIR).");
+    tgOutboxFlush(5000UL);
   }
 
+  Serial.printf("[TG] Photos: %lu queued, %lu sent, %lu failed, %lu dropped (max depth %lu)\n",
+                (unsigned long)photoStats.queued, (unsigned long)photoStats.uploaded,
+                (unsigned long)photoStats.failed, (unsigned long)photoStats.dropped,
+                (unsigned long)photoStats.max_depth);
+
+  previewRelease();
+  Serial.printf("[PREVIEW] %lu previews (%lu B), %lu full frames asked for, %ld B saved\n",
+                (unsigned long)previewStats.previews, (unsigned long)previewStats.preview_bytes,
+                (unsigned long)previewStats.full_sent, (long)previewStats.bytes_saved);
+
+  liveStop();
+  tgSession.logStats();
+  tgSession.stop();
+  awakeWindowReport();
+
   // Tear down radios before deep sleep
   WiFi.disconnect(true, true);
   WiFi.mode(WIFI_OFF);
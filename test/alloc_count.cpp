@@ -0,0 +1,33 @@
+// Counts heap allocations by interposing glibc's malloc family, so tests can assert that
+// a code path stays off the heap and benchmarks can report allocations per call.
+#include "check.h"
+
+#include <atomic>
+#include <stddef.h>
+
+extern "C" {
+void* __libc_malloc(size_t n);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t n);
+}
+
+static std::atomic<uint64_t> s_allocs{ 0 };
+
+extern "C" void* malloc(size_t n) {
+  s_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(n);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+  s_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* p, size_t n) {
+  s_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(p, n);
+}
+
+uint64_t check::allocations() {
+  return s_allocs.load(std::memory_order_relaxed);
+}
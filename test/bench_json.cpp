@@ -0,0 +1,51 @@
+// getUpdates parsing throughput on a large payload, fed in socket-buffer-sized pieces.
+#include "check.h"
+#include "cat_feeder.h"
+
+namespace {
+
+std::string bigGetUpdates(int count) {
+  std::string s = "{\"ok\":true,\"result\":[";
+  char one[512];
+  for (int i = 0; i < count; ++i) {
+    snprintf(one, sizeof(one),
+             "%s{\"update_id\":%d,\"message\":{\"message_id\":%d,\"from\":{\"id\":42,"
+             "\"is_bot\":false,\"first_name\":\"Tom\",\"language_code\":\"en\"},"
+             "\"chat\":{\"id\":-1001000,\"title\":\"Feeder \\u00e9\\u00e8\",\"type\":\"group\"},"
+             "\"date\":1760000000,\"text\":\"/feed %d\",\"entities\":[{\"offset\":0,"
+             "\"length\":5,\"type\":\"bot_command\"}]}}",
+             i ? "," : "", 1000 + i, i, i);
+    s += one;
+  }
+  s += "]}";
+  return s;
+}
+
+void count(const TgUpdate&, void* ctx) {
+  ++*static_cast<int*>(ctx);
+}
+
+}  // namespace
+
+BENCH(bench_getupdates_parse) {
+  const int kUpdates = 2000;
+  const std::string body = bigGetUpdates(kUpdates);
+  const int kRounds = 20;
+  int seen = 0;
+  const int64_t t0 = check::hostNs();
+  for (int r = 0; r < kRounds; ++r) {
+    TgUpdateParser p(count, &seen);
+    // TG_RX_BUF_SIZE is what TelegramSession hands the sink per read.
+    for (size_t i = 0; i < body.size(); i += TG_RX_BUF_SIZE) {
+      p.feed(body.data() + i, std::min<size_t>(TG_RX_BUF_SIZE, body.size() - i));
+    }
+    CHECK(!p.failed());
+    CHECK_EQ(p.maxUpdateId, 1000L + kUpdates - 1);
+  }
+  const double secs = (check::hostNs() - t0) / 1e9;
+  CHECK_EQ(seen, kUpdates * kRounds);
+  check::report("payload", body.size() / 1024.0, "KiB");
+  check::report("throughput (host)", body.size() * kRounds / secs / (1 << 20), "MiB/s");
+  check::report("per update (host)", secs * 1e9 / (kUpdates * kRounds), "ns");
+  check::report("parser state", sizeof(TgUpdateParser), "bytes");
+}
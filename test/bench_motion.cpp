@@ -0,0 +1,41 @@
+// PIR verifier: the block-mean and block-difference kernels, and a whole verify pass.
+#include "fixtures.h"
+
+#include <vector>
+
+BENCH(bench_motion_kernels) {
+  const int w = 100, h = 75;  // SVGA at 1/8 scale
+  std::vector<uint8_t> plane(w * h);
+  for (int i = 0; i < w * h; ++i) plane[i] = (uint8_t)(i * 2654435761u >> 24);
+  uint8_t grid[MOTION_GRID_W * MOTION_GRID_H], bg[MOTION_GRID_W * MOTION_GRID_H];
+  lumaBlockMeans(plane.data(), w, h, bg);
+
+  const int kRounds = 100000;
+  int64_t t0 = check::hostNs();
+  for (int i = 0; i < kRounds; ++i) {
+    plane[i % (w * h)] ^= 1;
+    lumaBlockMeans(plane.data(), w, h, grid);
+  }
+  check::report("lumaBlockMeans 100x75 (host)", (double)(check::hostNs() - t0) / kRounds, "ns");
+
+  volatile uint32_t sink = 0;
+  t0 = check::hostNs();
+  for (int i = 0; i < kRounds; ++i) {
+    grid[i % sizeof(grid)] ^= 0x20;
+    sink += countChangedBlocks(grid, bg, sizeof(grid), MOTION_BLOCK_THRESHOLD);
+  }
+  check::report("countChangedBlocks 16x12 (host)", (double)(check::hostNs() - t0) / kRounds, "ns");
+}
+
+BENCH(bench_verify_motion) {
+  CHECK(initCamera());
+  warmUpCamera();
+  CHECK(verifyMotion());  // learns the background
+  int64_t t0 = hal::nowUs();
+  CHECK(!verifyMotion());
+  check::report("false alarm, camera to verdict (device model)", (hal::nowUs() - t0) / 1000.0, "ms");
+  hal::scene().cat = true;
+  t0 = hal::nowUs();
+  CHECK(verifyMotion());
+  check::report("cat, camera to verdict (device model)", (hal::nowUs() - t0) / 1000.0, "ms");
+}
@@ -0,0 +1,76 @@
+// Request building: the fixed-buffer ReqBuf against the String concatenation it replaced.
+#include "check.h"
+#include "cat_feeder.h"
+
+namespace {
+
+const char* kText = "Cat at the bowl 🐱 — wake #1234, 2 portions left, battery 3.91 V";
+const char* kMarkup =
+  "{\"inline_keyboard\":[[{\"text\":\"📸 Snap\",\"callback_data\":\"/snap\"},"
+  "{\"text\":\"🍽 Feed\",\"callback_data\":\"/feed\"},{\"text\":\"🙈 Ignore\","
+  "\"callback_data\":\"/ignore\"}]]}";
+
+// The helper and request assembly the sketch used before ReqBuf. std::string's small-string
+// buffer makes this cheaper than Arduino's String, so the comparison flatters the baseline.
+std::string urlencode(const std::string& s) {
+  const char* hex = "0123456789ABCDEF";
+  std::string out;
+  for (size_t i = 0; i < s.length(); i++) {
+    char c = s[i];
+    if (('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') ||
+        c == '-' || c == '_' || c == '.' || c == '~') {
+      out += c;
+    } else {
+      out += '%';
+      out += hex[(c >> 4) & 0xF];
+      out += hex[c & 0xF];
+    }
+  }
+  return out;
+}
+
+size_t buildWithString() {
+  std::string host = TELEGRAM_HOST;
+  std::string url = "/bot" + std::string(BOT_TOKEN) + "/sendMessage?chat_id=" + std::string(CHAT_ID) +
+                    "&text=" + urlencode(kText) + "&reply_markup=" + urlencode(kMarkup);
+  std::string req = "GET " + url + " HTTP/1.1\r\n" + "Host: " + host + "\r\n" +
+                    "User-Agent: ESP32-CAM\r\n" + "Connection: keep-alive\r\n\r\n";
+  return req.size();
+}
+
+size_t buildWithReqBuf() {
+  char buf[TG_REQ_BUF_SIZE];
+  ReqBuf req(buf, sizeof(buf));
+  req.add("GET /bot" BOT_TOKEN "/sendMessage?chat_id=").addUrlEncoded(CHAT_ID)
+     .add("&text=").addUrlEncoded(kText)
+     .add("&reply_markup=").addUrlEncoded(kMarkup)
+     .add(" HTTP/1.1\r\nHost: " TELEGRAM_HOST "\r\nUser-Agent: ESP32-CAM\r\n"
+          "Connection: keep-alive\r\n\r\n");
+  return req.length();
+}
+
+template <typename F>
+void measure(const char* label, F build, size_t* len) {
+  const int kRounds = 200000;
+  const uint64_t a0 = check::allocations();
+  const int64_t t0 = check::hostNs();
+  size_t sum = 0;
+  for (int i = 0; i < kRounds; ++i) sum += build();
+  const double ns = (double)(check::hostNs() - t0) / kRounds;
+  const double allocs = (double)(check::allocations() - a0) / kRounds;
+  *len = sum / kRounds;
+  std::string name = std::string(label) + " allocations/request";
+  check::report(name.c_str(), allocs, "");
+  name = std::string(label) + " time/request (host)";
+  check::report(name.c_str(), ns, "ns");
+}
+
+}  // namespace
+
+BENCH(bench_request_building) {
+  size_t string_len = 0, reqbuf_len = 0;
+  measure("String", buildWithString, &string_len);
+  measure("ReqBuf", buildWithReqBuf, &reqbuf_len);
+  CHECK_EQ(string_len, reqbuf_len);
+  check::report("request size", reqbuf_len, "bytes");
+}
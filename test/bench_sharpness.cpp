@@ -0,0 +1,92 @@
+// Burst scoring: the fixed-point Laplacian kernel, the 1/8-scale decode, and a whole burst.
+#include "fixtures.h"
+
+#include <math.h>
+
+namespace {
+
+// The same metric in floating point, straight from the definition.
+double referenceScore(const uint8_t* l, int w, int h) {
+  double sum = 0, sumsq = 0, luma = 0;
+  for (int y = 1; y < h - 1; ++y) {
+    for (int x = 1; x < w - 1; ++x) {
+      const double lap = 4.0 * l[y * w + x] - l[y * w + x - 1] - l[y * w + x + 1] -
+                         l[(y - 1) * w + x] - l[(y + 1) * w + x];
+      sum += lap;
+      sumsq += lap * lap;
+      luma += l[y * w + x];
+    }
+  }
+  const double n = (double)(w - 2) * (h - 2);
+  const double var = sumsq / n - (sum / n) * (sum / n);
+  const double mean = floor(luma / n);  // the kernel weighs by the integer mean
+  double weight = 1.0;
+  if (mean < 60) weight = mean / 60;
+  else if (mean > 190) weight = (255 - mean) / 65;
+  return var * weight;
+}
+
+}  // namespace
+
+BENCH(bench_sharpness_scoring) {
+  CHECK(initCamera());
+  const size_t scratch_len = (size_t)((800 + 7) / 8) * ((600 + 7) / 8) * 2;
+  std::vector<uint8_t> scratch(scratch_len);
+
+  // Sample frames: sharp, soft, dark, bright. Decode once, score many times.
+  const struct { uint8_t blur, light; } kSamples[] = { { 0, 120 }, { 5, 120 }, { 0, 30 }, { 0, 220 } };
+  const int kRounds = 20000;
+  for (const auto& sample : kSamples) {
+    hal::scene().blur = sample.blur;
+    hal::scene().light = sample.light;
+    camera_fb_t* fb = esp_camera_fb_get();
+    CHECK(fb != nullptr);
+    if (!fb) return;
+    uint32_t score = 0;
+    const int64_t d0 = hal::nowUs();
+    CHECK(frameSharpness(fb, scratch.data(), scratch.size(), &score));
+    const int64_t decode_us = hal::nowUs() - d0;
+    const int w = (fb->width + 7) / 8, h = (fb->height + 7) / 8;
+    esp_camera_fb_return(fb);
+
+    volatile uint32_t sink = 0;
+    int64_t t0 = check::hostNs();
+    for (int i = 0; i < kRounds; ++i) sink += scoreSharpness(scratch.data(), w, h);
+    const double fixed_ns = (double)(check::hostNs() - t0) / kRounds;
+    volatile double fsink = 0;
+    t0 = check::hostNs();
+    for (int i = 0; i < kRounds; ++i) fsink += referenceScore(scratch.data(), w, h);
+    const double float_ns = (double)(check::hostNs() - t0) / kRounds;
+    const double ref = referenceScore(scratch.data(), w, h);
+    // Fixed point truncates; it must stay within a few counts of the definition.
+    CHECK(fabs((double)score - ref) <= 2.0 + ref * 0.01);
+
+    char name[96];
+    snprintf(name, sizeof(name), "blur %u light %u: score", sample.blur, sample.light);
+    check::report(name, score, "");
+    snprintf(name, sizeof(name), "blur %u light %u: kernel (host, %dx%d)", sample.blur, sample.light, w, h);
+    check::report(name, fixed_ns, "ns");
+    snprintf(name, sizeof(name), "blur %u light %u: float reference (host)", sample.blur, sample.light);
+    check::report(name, float_ns, "ns");
+    snprintf(name, sizeof(name), "blur %u light %u: 1/8 decode (device model)", sample.blur, sample.light);
+    check::report(name, decode_us / 1000.0, "ms");
+  }
+}
+
+BENCH(bench_burst_latency) {
+  using hal::telegram;
+  hal::setTasksEnabled(false);
+  telegram().model().uplink_kbps = 0;  // time the capture side only
+  CHECK(initCamera() && bootOnline());
+  CHECK(telegramSendMessage("warm up"));  // keep the handshake out of both numbers
+  const int64_t t0 = hal::nowUs();
+  CHECK(takeAndSendPhoto("single"));
+  const int64_t single_us = hal::nowUs() - t0;
+  const int64_t t1 = hal::nowUs();
+  CHECK(takeAndSendBestOfBurst(BURST_FRAMES, "burst"));
+  const int64_t burst_us = hal::nowUs() - t1;
+  check::report("single photo, capture to answer", single_us / 1000.0, "ms");
+  char name[64];
+  snprintf(name, sizeof(name), "best of %d, capture to answer", BURST_FRAMES);
+  check::report(name, burst_us / 1000.0, "ms");
+}
@@ -0,0 +1,90 @@
+// Minimal test registry for the host build. Every TEST/BENCH runs in its own forked
+// process on a freshly reset HAL, so firmware statics never leak between cases.
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace check {
+
+struct Case {
+  const char* name;
+  void (*fn)();
+  bool bench;
+};
+
+std::vector<Case>& cases();
+/** Failed CHECKs in the running case. */
+extern int failures;
+
+struct Registrar {
+  Registrar(const char* name, void (*fn)(), bool bench) { cases().push_back(Case{ name, fn, bench }); }
+};
+
+/** One benchmark result line: "  <name>: <value> <unit>". */
+void report(const char* name, double value, const char* unit);
+
+/** malloc/calloc/realloc calls made by this process so far (alloc_count.cpp). */
+uint64_t allocations();
+
+/** Host wall-clock nanoseconds, for timing host-side compute in benchmarks. */
+int64_t hostNs();
+
+inline std::string str(long long v) { return std::to_string(v); }
+inline std::string str(unsigned long long v) { return std::to_string(v); }
+inline std::string str(long v) { return std::to_string(v); }
+inline std::string str(unsigned long v) { return std::to_string(v); }
+inline std::string str(int v) { return std::to_string(v); }
+inline std::string str(unsigned v) { return std::to_string(v); }
+inline std::string str(double v) { return std::to_string(v); }
+inline std::string str(bool v) { return v ? "true" : "false"; }
+inline std::string str(const char* v) { return v ? "\"" + std::string(v) + "\"" : "null"; }
+inline std::string str(const std::string& v) { return "\"" + v + "\""; }
+
+}  // namespace check
+
+#define CHECK_CAT2(a, b) a##b
+#define CHECK_CAT(a, b) CHECK_CAT2(a, b)
+
+#define TEST(name)                                                               \
+  static void name();                                                            \
+  static check::Registrar CHECK_CAT(reg_, name)(#name, name, false);             \
+  static void name()
+
+#define BENCH(name)                                                              \
+  static void name();                                                            \
+  static check::Registrar CHECK_CAT(reg_, name)(#name, name, true);              \
+  static void name()
+
+#define CHECK(cond)                                                              \
+  do {                                                                           \
+    if (!(cond)) {                                                               \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);   \
+      check::failures++;                                                         \
+    }                                                                            \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                           \
+  do {                                                                           \
+    const auto& check_a_ = (a);                                                  \
+    const auto& check_b_ = (b);                                                  \
+    if (!(check_a_ == check_b_)) {                                               \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %s vs %s\n", __FILE__,    \
+              __LINE__, #a, #b, check::str(check_a_).c_str(),                    \
+              check::str(check_b_).c_str());                                     \
+      check::failures++;                                                         \
+    }                                                                            \
+  } while (0)
+
+#define CHECK_STREQ(a, b)                                                        \
+  do {                                                                           \
+    const char* check_a_ = (a);                                                  \
+    const char* check_b_ = (b);                                                  \
+    if (strcmp(check_a_, check_b_) != 0) {                                       \
+      fprintf(stderr, "%s:%d: CHECK_STREQ(%s, %s) failed: \"%s\" vs \"%s\"\n",   \
+              __FILE__, __LINE__, #a, #b, check_a_, check_b_);                   \
+      check::failures++;                                                         \
+    }                                                                            \
+  } while (0)
@@ -0,0 +1,19 @@
+// Shared set-up for tests that run firmware code paths end to end.
+#pragma once
+#include "check.h"
+#include "cat_feeder.h"
+#include "hal/host.h"
+#include "hal/telegram_server.h"
+
+/** The parts of setup() every networked test needs: RTC state, TLS cache, Wi-Fi up. */
+inline bool bootOnline() {
+  rtcStateRestore();
+  tlsSessionCacheRestore();
+  startWiFi();
+  return waitWiFi(10000);
+}
+
+/** True if the firmware printed `text` since the test started. */
+inline bool logged(const char* text) {
+  return hal::serialLog().find(text) != std::string::npos;
+}
@@ -0,0 +1,185 @@
+// Host stand-in for the Arduino-ESP32 core: just what cat_feeder.cpp uses.
+// Time comes from the virtual clock in host.h; delay() lets other tasks run.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+inline size_t strlcpy(char* dst, const char* src, size_t cap) {
+  const size_t len = strlen(src);
+  if (cap) {
+    const size_t n = len < cap - 1 ? len : cap - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+
+inline size_t strlcat(char* dst, const char* src, size_t cap) {
+  const size_t len = strnlen(dst, cap);
+  return len + strlcpy(dst + len, src, cap > len ? cap - len : 0);
+}
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define IRAM_ATTR
+#define EXT_RAM_ATTR
+#define PROGMEM
+#define F(x) x
+// RTC memory survives deep sleep: the simulator carries this section from wake to wake.
+#define RTC_DATA_ATTR   __attribute__((section("rtc_sim")))
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_sim")))
+
+// The RTC clock: virtual wall time that keeps running through deep sleep.
+int hal_gettimeofday(struct timeval* tv, void* tz);
+#define gettimeofday(tv, tz) hal_gettimeofday(tv, tz)
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int level);
+int  digitalRead(int pin);
+
+bool  psramFound();
+void* ps_malloc(size_t n);
+inline void btStop() {}
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+class String {
+public:
+  String(const char* s = "") : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  String(int v) : s_(std::to_string(v)) {}
+  String(unsigned v) : s_(std::to_string(v)) {}
+  String(long v) : s_(std::to_string(v)) {}
+  String(unsigned long v) : s_(std::to_string(v)) {}
+  const char* c_str() const { return s_.c_str(); }
+  size_t length() const { return s_.size(); }
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  bool operator==(const char* o) const { return s_ == o; }
+
+private:
+  std::string s_;
+};
+
+class IPAddress {
+public:
+  IPAddress() {}
+  IPAddress(uint32_t v) { memcpy(b_, &v, 4); }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : b_{ a, b, c, d } {}
+  operator uint32_t() const {
+    uint32_t v;
+    memcpy(&v, b_, 4);
+    return v;
+  }
+  uint8_t operator[](int i) const { return b_[i]; }
+  String toString() const {
+    char s[16];
+    snprintf(s, sizeof(s), "%u.%u.%u.%u", b_[0], b_[1], b_[2], b_[3]);
+    return String(s);
+  }
+
+private:
+  uint8_t b_[4] = { 0, 0, 0, 0 };
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t n) {
+    size_t done = 0;
+    while (n--) done += write(*buf++);
+    return done;
+  }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(const IPAddress& ip) { return print(ip.toString()); }
+  size_t print(long v) { return printf("%ld", v); }
+  size_t print(unsigned long v) { return printf("%lu", v); }
+  size_t print(int v) { return print((long)v); }
+  size_t print(unsigned v) { return print((unsigned long)v); }
+  size_t println() { return write("\r\n"); }
+  template <class T> size_t println(const T& v) { return print(v) + println(); }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char small[256];
+    va_list ap;
+    va_start(ap, fmt);
+    const int n = vsnprintf(small, sizeof(small), fmt, ap);
+    va_end(ap);
+    if (n < 0) return 0;
+    if ((size_t)n < sizeof(small)) return write((const uint8_t*)small, n);
+    std::string big(n + 1, '\0');
+    va_start(ap, fmt);
+    vsnprintf(&big[0], big.size(), fmt, ap);
+    va_end(ap);
+    return write((const uint8_t*)big.data(), n);
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long) {}
+};
+
+// Serial goes to stdout when hal::verbose is set, and nowhere otherwise.
+class HardwareSerial : public Stream {
+public:
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t n) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void begin(unsigned long) {}
+};
+extern HardwareSerial Serial;
+
+class Client : public Stream {
+public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  using Print::write;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t n) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t* buf, size_t n) = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+};
+
+struct EspClass {
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getHeapSize() { return 320 * 1024; }
+  uint32_t getFreePsram();
+  uint32_t getMinFreePsram();
+  uint32_t getPsramSize() { return 4 * 1024 * 1024; }
+};
+extern EspClass ESP;
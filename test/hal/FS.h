@@ -0,0 +1,54 @@
+#pragma once
+// fs::FS over a host directory: "/cfj.dat" on the card is <root>/cfj.dat on the host.
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <string>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File {
+public:
+  File() {}
+  File(std::shared_ptr<FILE> f, bool append) : f_(std::move(f)), append_(append) {}
+  size_t write(const uint8_t* buf, size_t n);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t read(uint8_t* buf, size_t n);
+  int    read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+  int    available();
+  bool   seek(uint32_t pos);
+  size_t position() const;
+  size_t size() const;
+  void   flush();
+  void   close() { f_.reset(); }
+  operator bool() const { return (bool)f_; }
+
+private:
+  std::shared_ptr<FILE> f_;
+  bool append_ = false;
+};
+
+class FS {
+public:
+  explicit FS(const std::string& root = "") : root_(root) {}
+  File open(const char* path, const char* mode = FILE_READ, bool create = false);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+  bool mkdir(const char* path);
+
+protected:
+  std::string host(const char* path) const { return root_ + path; }
+  std::string root_;
+};
+
+}  // namespace fs
+using fs::File;
@@ -0,0 +1,14 @@
+#pragma once
+#include "FS.h"
+
+class SDMMCFS : public fs::FS {
+public:
+  /** Fails unless the test gave the card a directory (hal::sdSetRoot()). */
+  bool begin(const char* mount = "/sdcard", bool mode1bit = false, bool format_if_failed = false,
+             int freq = 0, uint8_t max_files = 5);
+  void end();
+  uint64_t cardSize();
+  uint64_t totalBytes() { return cardSize(); }
+  uint64_t usedBytes();
+};
+extern SDMMCFS SD_MMC;
@@ -0,0 +1,79 @@
+#pragma once
+// Station interface on a simulated AP (host.h: hal::radio()), plus WiFiServer/WiFiClient on
+// real localhost sockets for the live stream.
+#include <Arduino.h>
+#include <memory>
+#include "esp_wifi.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1 } wifi_mode_t;
+
+class WiFiClient : public Client {
+public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd);
+  int connect(IPAddress ip, uint16_t port) override { return 0; }
+  int connect(const char* host, uint16_t port) override { return 0; }
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  /** Blocks like the real client: until sent, the peer goes away or 5 s pass. */
+  size_t write(const uint8_t* buf, size_t n) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t n) override;
+  int peek() override { return -1; }
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return fd() >= 0; }
+  int fd() const { return sock_ ? *sock_ : -1; }
+  void setNoDelay(bool on);
+
+private:
+  std::shared_ptr<int> sock_;  // copies share the socket, as on the device
+};
+
+class WiFiServer {
+public:
+  WiFiServer(uint16_t port = 80, uint8_t max_clients = 4) : port_(port) {}
+  void begin(uint16_t port = 0);
+  void end();
+  WiFiClient accept();
+  WiFiClient available() { return accept(); }
+  void setNoDelay(bool on) {}
+  operator bool() const { return fd_ >= 0; }
+
+private:
+  uint16_t port_;
+  int      fd_ = -1;
+};
+
+class WiFiClass {
+public:
+  wl_status_t status();
+  int  begin(const char* ssid, const char* pass, int32_t channel = 0,
+             const uint8_t* bssid = nullptr, bool connect = true);
+  bool config(IPAddress ip, IPAddress gateway, IPAddress subnet,
+              IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+  bool disconnect(bool wifi_off = false, bool erase_ap = false);
+  bool mode(wifi_mode_t m);
+  bool persistent(bool) { return true; }
+  bool setAutoReconnect(bool) { return true; }
+  bool setSleep(bool enabled) { return setSleep(enabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE); }
+  bool setSleep(wifi_ps_type_t type) { return esp_wifi_set_ps(type) == 0; }
+  wifi_ps_type_t getSleep();
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t i = 0);
+  int8_t   RSSI();
+  uint8_t* BSSID();
+  int32_t  channel();
+};
+extern WiFiClass WiFi;
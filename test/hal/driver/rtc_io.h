@@ -0,0 +1,9 @@
+#pragma once
+#include "esp_err.h"
+typedef int gpio_num_t;
+typedef enum { RTC_GPIO_MODE_INPUT_ONLY } rtc_gpio_mode_t;
+inline esp_err_t rtc_gpio_init(gpio_num_t) { return ESP_OK; }
+inline esp_err_t rtc_gpio_deinit(gpio_num_t) { return ESP_OK; }
+inline esp_err_t rtc_gpio_set_direction(gpio_num_t, rtc_gpio_mode_t) { return ESP_OK; }
+inline esp_err_t rtc_gpio_pullup_dis(gpio_num_t) { return ESP_OK; }
+inline esp_err_t rtc_gpio_pulldown_en(gpio_num_t) { return ESP_OK; }
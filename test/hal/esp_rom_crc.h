@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+/** Same CRC-32 as the ROM routine (and zlib): pass the previous result to continue. */
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t primary;
+  int8_t  rssi;
+} wifi_ap_record_t;
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap);
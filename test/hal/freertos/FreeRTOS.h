@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE   1
+#define pdFALSE  0
+#define pdPASS   1
+#define pdFAIL   0
+#define portMAX_DELAY      0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+#define PRO_CPU_NUM 0
+#define APP_CPU_NUM 1
+
+// Only one task runs at a time on the host, so critical sections have nothing to exclude.
+typedef struct {
+  int owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux)     ((void)(mux))
+#define portEXIT_CRITICAL(mux)      ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)  ((void)(mux))
@@ -0,0 +1,12 @@
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct QueueDef* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void          vQueueDelete(QueueHandle_t q);
+BaseType_t    xQueueSend(QueueHandle_t q, const void* item, TickType_t wait);
+BaseType_t    xQueueReceive(QueueHandle_t q, void* item, TickType_t wait);
+BaseType_t    xQueuePeek(QueueHandle_t q, void* item, TickType_t wait);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t q);
+#define xQueueSendToBack xQueueSend
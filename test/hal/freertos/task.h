@@ -0,0 +1,15 @@
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct TaskDef* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+BaseType_t   xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack,
+                                     void* arg, UBaseType_t prio, TaskHandle_t* handle,
+                                     BaseType_t core);
+void         vTaskDelay(TickType_t ticks);
+/** Only vTaskDelete(nullptr) (a task ending itself) is supported. */
+void         vTaskDelete(TaskHandle_t task);
+TickType_t   xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t  uxTaskGetStackHighWaterMark(TaskHandle_t task);
@@ -0,0 +1,267 @@
+// Camera stand-in. The sensor finishes a frame every frame period (virtual time) from
+// esp_camera_init() on; fb_get() hands out the newest finished frame it has not handed out
+// yet, or waits for the next one, like CAMERA_GRAB_LATEST on the PSRAM ring. With every
+// buffer checked out it waits fb_timeout_ms and returns NULL, as the driver does.
+//
+// A frame is a synthetic JPEG: SOI, an APP0 segment carrying the scene, filler of the
+// size a real OV2640 JPEG would have at that framesize/quality, EOI. jpg2rgb565() renders
+// the scene from the APP0 segment, so motion and sharpness code sees real pixels.
+#include "host.h"
+
+#include <Arduino.h>
+#include "img_converters.h"
+
+const resolution_info_t resolution[] = {
+  { 96, 96 },   { 160, 120 },  { 176, 144 },  { 240, 176 },  { 240, 240 },
+  { 320, 240 }, { 400, 296 },  { 480, 320 },  { 640, 480 },  { 800, 600 },
+  { 1024, 768 }, { 1280, 720 }, { 1280, 1024 }, { 1600, 1200 }, { 0, 0 },
+};
+
+namespace hal {
+
+std::function<void(Scene&)> beforeFrame;
+
+namespace {
+
+struct Slot {
+  camera_fb_t          fb;
+  std::vector<uint8_t> mem;
+  bool                 out = false;
+};
+
+Scene       g_scene;
+CameraModel g_model;
+bool        g_inited = false;
+framesize_t g_size = FRAMESIZE_SVGA;
+int         g_quality = 12;
+int64_t     g_t0 = 0;
+int64_t     g_lastIndex = 0;
+uint32_t    g_captured = 0;
+std::vector<Slot> g_slots;
+sensor_t    g_sensor;
+
+const uint8_t kApp0Len = 22;  // length field of our APP0 segment
+
+int64_t framePeriodUs() {
+  return (int64_t)(g_size <= FRAMESIZE_SVGA ? g_model.frame_ms_small : g_model.frame_ms_large) * 1000;
+}
+
+uint32_t hash3(uint32_t a, uint32_t b, uint32_t c) {
+  uint32_t h = a * 0x9E3779B1u ^ b * 0x85EBCA77u ^ c * 0xC2B2AE3Du;
+  h ^= h >> 15;
+  h *= 0x2C1B3C6Du;
+  h ^= h >> 12;
+  return h;
+}
+
+size_t jpegBytes(int w, int h, float bytes_per_px, float detail) {
+  return (size_t)max(600.0f, (float)w * h * bytes_per_px * detail);
+}
+
+// Writes the synthetic JPEG for `s` into `out` (capacity `cap`); returns its length.
+size_t writeJpeg(uint8_t* out, size_t cap, int w, int h, uint32_t index, const Scene& s, size_t len) {
+  len = min(len, cap);
+  const uint8_t head[] = {
+    0xFF, 0xD8, 0xFF, 0xE0, 0x00, kApp0Len, 'C', 'F',
+    (uint8_t)w, (uint8_t)(w >> 8), (uint8_t)h, (uint8_t)(h >> 8),
+    (uint8_t)index, (uint8_t)(index >> 8), (uint8_t)(index >> 16), (uint8_t)(index >> 24),
+    (uint8_t)s.cat, (uint8_t)s.cat_x, (uint8_t)s.cat_y, s.light, s.blur, s.noise, 0, 0,
+  };
+  memcpy(out, head, sizeof(head));
+  uint32_t x = index * 2654435761u + 1;
+  for (size_t i = sizeof(head); i + 2 < len; ++i) {
+    x = x * 1664525u + 1013904223u;
+    out[i] = (uint8_t)(x >> 24) % 0xFF;  // no 0xFF: markers stay unambiguous
+  }
+  out[len - 2] = 0xFF;
+  out[len - 1] = 0xD9;
+  return len;
+}
+
+int sensorSetFramesize(sensor_t* s, framesize_t size) {
+  if (size >= FRAMESIZE_INVALID) return -1;
+  g_size = size;
+  s->status.framesize = size;
+  return 0;
+}
+
+int sensorSetQuality(sensor_t* s, int quality) {
+  g_quality = quality;
+  s->status.quality = (uint8_t)quality;
+  return 0;
+}
+
+Slot* freeSlot() {
+  for (Slot& s : g_slots) {
+    if (!s.out) return &s;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+Scene& scene() { return g_scene; }
+CameraModel& camera() { return g_model; }
+uint32_t framesCaptured() { return g_captured; }
+
+int framesOut() {
+  int n = 0;
+  for (const Slot& s : g_slots) n += s.out ? 1 : 0;
+  return n;
+}
+
+}  // namespace hal
+
+using namespace hal;
+
+esp_err_t esp_camera_init(const camera_config_t* config) {
+  sleepUs((int64_t)g_model.init_ms * 1000);
+  if (g_model.fail_init) return ESP_FAIL;
+  g_size = config->frame_size;
+  g_quality = config->jpeg_quality;
+  const resolution_info_t& r = resolution[g_size];
+  // Same sizing rule as the driver: a JPEG never needs more than ~1/5 of the raw frame.
+  const size_t cap = max<size_t>((size_t)r.width * r.height / 5, 32 * 1024);
+  g_slots.assign(config->fb_count ? config->fb_count : 1, Slot());
+  for (Slot& s : g_slots) s.mem.resize(cap);
+  g_sensor.status.framesize = g_size;
+  g_sensor.status.quality = (uint8_t)g_quality;
+  g_sensor.set_framesize = sensorSetFramesize;
+  g_sensor.set_quality = sensorSetQuality;
+  g_t0 = nowUs();
+  g_lastIndex = 0;
+  g_inited = true;
+  mark("camera_init");
+  return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit() {
+  g_inited = false;
+  g_slots.clear();
+  return ESP_OK;
+}
+
+sensor_t* esp_camera_sensor_get() {
+  return g_inited ? &g_sensor : nullptr;
+}
+
+camera_fb_t* esp_camera_fb_get() {
+  if (!g_inited) return nullptr;
+  if (!freeSlot() && !waitUntil([] { return freeSlot() != nullptr; },
+                                nowUs() + (int64_t)g_model.fb_timeout_ms * 1000)) {
+    Serial.println("[HAL] cam_hal: Failed to get the frame on time!");
+    return nullptr;
+  }
+  const int64_t period = framePeriodUs();
+  int64_t index = (nowUs() - g_t0) / period;
+  if (index <= g_lastIndex) {
+    index = g_lastIndex + 1;
+    sleepUs(g_t0 + index * period - nowUs());
+  }
+  g_lastIndex = index;
+
+  Slot* slot = freeSlot();
+  if (!slot) return nullptr;  // taken while we waited for the frame
+  Scene s = g_scene;
+  if (beforeFrame) {
+    beforeFrame(g_scene);
+    s = g_scene;
+  }
+  if (s.cat && s.cat_step) {
+    // Bounce between 15% and 85% of the frame.
+    const int span = 70, pos = (int)((s.cat_x - 15 + s.cat_step * (index % 1000)) % (2 * span));
+    s.cat_x = 15 + (pos < span ? pos : 2 * span - pos);
+  }
+  const resolution_info_t& r = resolution[g_size];
+  // Indoor OV2640 JPEG: about 1.67 / quality bytes per pixel (SVGA q20 ~ 40 kB).
+  const size_t want = jpegBytes(r.width, r.height, 1.67f / max(g_quality, 1),
+                                s.detail * (s.cat ? 1.1f : 1.0f));
+  slot->fb.buf = slot->mem.data();
+  slot->fb.len = writeJpeg(slot->mem.data(), slot->mem.size(), r.width, r.height,
+                           (uint32_t)index, s, want);
+  slot->fb.width = r.width;
+  slot->fb.height = r.height;
+  slot->fb.format = PIXFORMAT_JPEG;
+  const int64_t ts = g_t0 + index * period;
+  slot->fb.timestamp.tv_sec = (time_t)(ts / 1000000);
+  slot->fb.timestamp.tv_usec = (suseconds_t)(ts % 1000000);
+  slot->out = true;
+  g_captured++;
+  return &slot->fb;
+}
+
+void esp_camera_fb_return(camera_fb_t* fb) {
+  for (Slot& s : g_slots) {
+    if (&s.fb == fb) s.out = false;
+  }
+}
+
+// ---- image conversion ----
+
+static bool parseJpeg(const uint8_t* src, size_t len, int* w, int* h, uint32_t* index, Scene* s) {
+  if (len < 26 || src[0] != 0xFF || src[1] != 0xD8 || src[2] != 0xFF || src[3] != 0xE0 ||
+      src[6] != 'C' || src[7] != 'F') {
+    return false;
+  }
+  *w = src[8] | (src[9] << 8);
+  *h = src[10] | (src[11] << 8);
+  *index = src[12] | (src[13] << 8) | (src[14] << 16) | ((uint32_t)src[15] << 24);
+  s->cat = src[16];
+  s->cat_x = src[17];
+  s->cat_y = src[18];
+  s->light = src[19];
+  s->blur = src[20];
+  s->noise = src[21];
+  return *w > 0 && *h > 0;
+}
+
+// Luma of the scene at full-resolution pixel (x, y).
+static int sceneLuma(int x, int y, int w, int h, uint32_t index, const Scene& s) {
+  // Gentle left-to-right gradient plus a blocky texture (16 px blocks, so it survives
+  // the 1/8-scale decode); blur flattens the texture.
+  int v = s.light + (x * 16 / w) - 8;
+  const int amp = 48 / (1 + s.blur);
+  v += (int)(hash3(x / 16, y / 16, 7) % (2 * amp + 1)) - amp;
+  if (s.cat) {
+    const int cx = w * s.cat_x / 100, cy = h * s.cat_y / 100;
+    const int rx = w * 18 / 100, ry = h * 22 / 100;
+    const int64_t dx = x - cx, dy = y - cy;
+    if (dx * dx * ry * ry + dy * dy * rx * rx <= (int64_t)rx * rx * ry * ry) v = 40 + (v - s.light) / 4;
+  }
+  if (s.noise) v += (int)(hash3(x, y, index) % (2 * s.noise + 1)) - s.noise;
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+bool jpg2rgb565(const uint8_t* src, size_t src_len, uint8_t* out, jpg_scale_t scale) {
+  int w, h;
+  uint32_t index;
+  Scene s;
+  if (!parseJpeg(src, src_len, &w, &h, &index, &s)) return false;
+  const int f = 1 << scale;
+  // Decode time on the device: the 1/8 scale only rebuilds DC coefficients.
+  sleepUs((int64_t)w * h / (scale == JPG_SCALE_8X ? 32 : scale == JPG_SCALE_4X ? 16 : 6));
+  const int ow = (w + f - 1) / f, oh = (h + f - 1) / f;
+  for (int y = 0; y < oh; ++y) {
+    for (int x = 0; x < ow; ++x) {
+      const int l = sceneLuma(min(x * f + f / 2, w - 1), min(y * f + f / 2, h - 1), w, h, index, s);
+      const uint16_t px = (uint16_t)(((l >> 3) << 11) | ((l >> 2) << 5) | (l >> 3));
+      out[2 * (y * ow + x)] = (uint8_t)(px >> 8);
+      out[2 * (y * ow + x) + 1] = (uint8_t)px;
+    }
+  }
+  return true;
+}
+
+bool fmt2jpg(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format,
+             uint8_t quality, uint8_t** out, size_t* out_len) {
+  if (!src || src_len < (size_t)width * height * (format == PIXFORMAT_RGB565 ? 2 : 1)) return false;
+  // Re-encoding costs CPU time on the device: ~25 ms per 100 kpx at 240 MHz.
+  sleepUs((int64_t)width * height / 4);
+  const size_t len = jpegBytes(width, height, quality / 400.0f, 1.0f);
+  *out = (uint8_t*)malloc(len);
+  if (!*out) return false;
+  Scene s;
+  s.noise = 0;
+  *out_len = writeJpeg(*out, len, width, height, 0, s, len);
+  return true;
+}
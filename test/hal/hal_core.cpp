@@ -0,0 +1,509 @@
+// Virtual clock, the one-task-at-a-time scheduler and FreeRTOS on top of it, esp_timer,
+// sleep, LEDC, GPIO and the rest of the small stuff.
+#include "host.h"
+
+#include <signal.h>
+#include <Arduino.h>
+#include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <signal.h>
+#include <thread>
+#include "driver/ledc.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+namespace hal {
+
+bool verbose = false;
+bool psram = true;
+uint32_t timerJitterUs = 0;
+std::function<void(int channel, uint32_t duty)> onLedcUpdate;
+
+namespace {
+
+struct Task {
+  std::string           name;
+  TaskFunction_t        fn = nullptr;
+  void*                 arg = nullptr;
+  bool                  alive = true;
+  int64_t               wake_us = 0;
+  std::function<bool()> ready;
+};
+
+struct Event {
+  int64_t               t_us;
+  uint64_t              seq;
+  std::function<void()> fn;
+};
+
+struct TaskExit {};
+
+// g_m guards the hand-over between threads; everything else is only touched by the task
+// that holds the CPU (or by pick() on its behalf), so it needs no lock of its own.
+std::mutex              g_m;
+std::condition_variable g_cv;
+std::vector<Task*>      g_tasks;
+Task*                   g_running = nullptr;
+thread_local Task*      t_self = nullptr;
+int64_t                 g_now = 0;
+int64_t                 g_wall0 = 0;
+bool                    g_tasksEnabled = true;
+
+std::mutex              g_evm;  // at() may be called from an event callback
+std::vector<Event>      g_events;
+uint64_t                g_eventSeq = 0;
+
+std::vector<Mark>       g_marks;
+esp_sleep_wakeup_cause_t g_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+uint64_t                g_timerWakeUs = 0;
+uint32_t                g_ledcDuty[LEDC_CHANNEL_MAX];
+int                     g_pins[40];
+std::string             g_serial;
+
+bool eventBefore(const Event& a, const Event& b) {
+  return a.t_us != b.t_us ? a.t_us > b.t_us : a.seq > b.seq;  // min-heap
+}
+
+bool popDueEvent(int64_t up_to, Event* out) {
+  std::lock_guard<std::mutex> lk(g_evm);
+  if (g_events.empty() || g_events.front().t_us > up_to) return false;
+  std::pop_heap(g_events.begin(), g_events.end(), eventBefore);
+  *out = std::move(g_events.back());
+  g_events.pop_back();
+  return true;
+}
+
+int64_t nextEventTime() {
+  std::lock_guard<std::mutex> lk(g_evm);
+  return g_events.empty() ? kForever : g_events.front().t_us;
+}
+
+void dumpTasks() {
+  fprintf(stderr, "[HAL] t=%lld us, tasks:\n", (long long)g_now);
+  for (Task* t : g_tasks) {
+    if (t->alive) fprintf(stderr, "  %s wake=%lld ready=%d\n", t->name.c_str(),
+                          (long long)t->wake_us, t->ready ? 1 : 0);
+  }
+}
+
+// Next task to run, advancing the clock and firing events while nobody can run.
+// Called with g_m held; `me` is the task giving up the CPU (it may be dead).
+Task* pick(Task* me) {
+  for (;;) {
+    Event ev;
+    while (popDueEvent(g_now, &ev)) ev.fn();
+
+    const size_t n = g_tasks.size();
+    size_t start = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (g_tasks[i] == me) start = i + 1;
+    }
+    for (size_t k = 0; k < n; ++k) {
+      Task* t = g_tasks[(start + k) % n];
+      if (!t->alive) continue;
+      if (t->wake_us <= g_now || (t->ready && t->ready())) return t;
+    }
+
+    int64_t next = nextEventTime();
+    for (Task* t : g_tasks) {
+      if (t->alive && t->wake_us < next) next = t->wake_us;
+    }
+    if (next == kForever) {
+      fprintf(stderr, "[HAL] Deadlock: every task waits forever\n");
+      dumpTasks();
+      abort();
+    }
+    if (next > g_now) g_now = next;
+  }
+}
+
+// Give up the CPU until `me` is picked again.
+void handOver(std::unique_lock<std::mutex>& lk, Task* me) {
+  Task* next = pick(me);
+  if (next == me) return;
+  g_running = next;
+  g_cv.notify_all();
+  if (me->alive) g_cv.wait(lk, [me] { return g_running == me; });
+}
+
+void taskMain(Task* t) {
+  {
+    std::unique_lock<std::mutex> lk(g_m);
+    g_cv.wait(lk, [t] { return g_running == t; });
+  }
+  t_self = t;
+  t->wake_us = kForever;
+  t->ready = nullptr;
+  try {
+    t->fn(t->arg);
+  } catch (const TaskExit&) {
+  }
+  std::unique_lock<std::mutex> lk(g_m);
+  t->alive = false;
+  handOver(lk, t);
+}
+
+}  // namespace
+
+void reset(int64_t wall_us) {
+  // lwIP reports a closed peer through errno; it has no SIGPIPE.
+  signal(SIGPIPE, SIG_IGN);
+  std::lock_guard<std::mutex> lk(g_m);
+  // Tasks of an earlier boot stay parked for good.
+  g_tasks.clear();
+  Task* loop = new Task;
+  loop->name = "loopTask";
+  loop->wake_us = kForever;
+  g_tasks.push_back(loop);
+  g_running = loop;
+  t_self = loop;
+  g_now = 0;
+  g_wall0 = wall_us;
+  {
+    std::lock_guard<std::mutex> elk(g_evm);
+    g_events.clear();
+  }
+  g_marks.clear();
+  g_serial.clear();
+}
+
+int64_t nowUs() {
+  return g_now;
+}
+
+int64_t wallUs() {
+  return g_wall0 + g_now;
+}
+
+bool waitUntil(const std::function<bool()>& ready, int64_t deadline_us) {
+  if (ready && ready()) return true;
+  Task* me = t_self;
+  assert(me && "hal::waitUntil() outside a task");
+  {
+    std::unique_lock<std::mutex> lk(g_m);
+    me->wake_us = deadline_us;
+    me->ready = ready;
+    handOver(lk, me);
+    me->wake_us = kForever;
+    me->ready = nullptr;
+  }
+  return ready ? ready() : true;
+}
+
+void sleepUs(int64_t us) {
+  waitUntil(nullptr, g_now + (us > 0 ? us : 0));
+}
+
+void at(int64_t t_us, std::function<void()> fn) {
+  std::lock_guard<std::mutex> lk(g_evm);
+  g_events.push_back(Event{ t_us, g_eventSeq++, std::move(fn) });
+  std::push_heap(g_events.begin(), g_events.end(), eventBefore);
+}
+
+void setTasksEnabled(bool enabled) {
+  g_tasksEnabled = enabled;
+}
+
+int liveTasks() {
+  int n = 0;
+  for (Task* t : g_tasks) n += t->alive ? 1 : 0;
+  return n;
+}
+
+void mark(const char* name) {
+  g_marks.push_back(Mark{ name, g_now });
+}
+
+const std::vector<Mark>& marks() {
+  return g_marks;
+}
+
+std::string& serialLog() {
+  return g_serial;
+}
+
+void setWakeCause(esp_sleep_wakeup_cause_t cause) {
+  g_cause = cause;
+}
+
+uint32_t ledcDuty(int channel) {
+  return (channel >= 0 && channel < LEDC_CHANNEL_MAX) ? g_ledcDuty[channel] : 0;
+}
+
+}  // namespace hal
+
+using hal::g_now;
+
+// ---- Arduino core ----
+
+HardwareSerial Serial;
+EspClass ESP;
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t n) {
+  hal::g_serial.append((const char*)buf, n);
+  if (hal::g_serial.size() > (1u << 20)) hal::g_serial.erase(0, hal::g_serial.size() / 2);
+  if (hal::verbose) fwrite(buf, 1, n, stdout);
+  return n;
+}
+
+uint32_t EspClass::getFreeHeap() { return 180 * 1024; }
+uint32_t EspClass::getMinFreeHeap() { return 150 * 1024; }
+uint32_t EspClass::getFreePsram() { return hal::psram ? 3 * 1024 * 1024 : 0; }
+uint32_t EspClass::getMinFreePsram() { return hal::psram ? 2 * 1024 * 1024 : 0; }
+
+int hal_gettimeofday(struct timeval* tv, void*) {
+  const int64_t wall = hal::wallUs();
+  tv->tv_sec = (time_t)(wall / 1000000);
+  tv->tv_usec = (suseconds_t)(wall % 1000000);
+  return 0;
+}
+
+uint32_t millis() { return (uint32_t)(g_now / 1000); }
+uint32_t micros() { return (uint32_t)g_now; }
+void delay(uint32_t ms) { hal::sleepUs((int64_t)ms * 1000); }
+void yield() { hal::sleepUs(0); }
+
+void pinMode(int, int) {}
+void digitalWrite(int pin, int level) {
+  if (pin >= 0 && pin < 40) hal::g_pins[pin] = level;
+}
+int digitalRead(int pin) {
+  return (pin >= 0 && pin < 40) ? hal::g_pins[pin] : 0;
+}
+
+bool psramFound() { return hal::psram; }
+void* ps_malloc(size_t n) { return hal::psram ? malloc(n) : nullptr; }
+
+const char* esp_err_to_name(esp_err_t err) {
+  return err == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  static uint32_t table[256];
+  if (!table[1]) {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+  }
+  crc = ~crc;
+  while (len--) crc = table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+// ---- FreeRTOS ----
+
+struct QueueDef {
+  bool                              is_mutex;
+  size_t                            item_size;
+  size_t                            length;
+  std::deque<std::vector<uint8_t>>  items;
+  void*                             holder = nullptr;
+};
+
+static int64_t ticksDeadline(TickType_t wait) {
+  return wait == portMAX_DELAY ? hal::kForever : g_now + (int64_t)wait * 1000;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  return new QueueDef{ false, item_size, length, {} };
+}
+
+void vQueueDelete(QueueHandle_t q) {
+  delete q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t wait) {
+  if (q->items.size() >= q->length &&
+      (wait == 0 || !hal::waitUntil([q] { return q->items.size() < q->length; },
+                                    ticksDeadline(wait)))) {
+    return pdFALSE;
+  }
+  const uint8_t* p = (const uint8_t*)item;
+  q->items.emplace_back(p, p + q->item_size);
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t wait) {
+  if (q->items.empty() &&
+      (wait == 0 || !hal::waitUntil([q] { return !q->items.empty(); }, ticksDeadline(wait)))) {
+    return pdFALSE;
+  }
+  memcpy(item, q->items.front().data(), q->item_size);
+  q->items.pop_front();
+  return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void* item, TickType_t wait) {
+  if (q->items.empty() &&
+      (wait == 0 || !hal::waitUntil([q] { return !q->items.empty(); }, ticksDeadline(wait)))) {
+    return pdFALSE;
+  }
+  memcpy(item, q->items.front().data(), q->item_size);
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  return (UBaseType_t)q->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new QueueDef{ true, 0, 1, {} };
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t wait) {
+  if (m->holder && (wait == 0 || !hal::waitUntil([m] { return m->holder == nullptr; },
+                                                 ticksDeadline(wait)))) {
+    return pdFALSE;
+  }
+  m->holder = hal::t_self;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t m) {
+  if (m->holder != hal::t_self) return pdFALSE;
+  m->holder = nullptr;
+  return pdTRUE;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t, void* arg,
+                                   UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+  if (!hal::g_tasksEnabled) return pdFAIL;
+  hal::Task* t = new hal::Task;
+  t->name = name;
+  t->fn = fn;
+  t->arg = arg;
+  t->wake_us = g_now;  // runs as soon as the creator blocks
+  {
+    std::lock_guard<std::mutex> lk(hal::g_m);
+    hal::g_tasks.push_back(t);
+  }
+  if (handle) *handle = (TaskHandle_t)t;
+  std::thread(hal::taskMain, t).detach();
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  hal::sleepUs((int64_t)ticks * 1000);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  assert(task == nullptr || (hal::Task*)task == hal::t_self);
+  throw hal::TaskExit();
+}
+
+TickType_t xTaskGetTickCount() { return millis(); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return (TaskHandle_t)hal::t_self; }
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 2048; }
+
+// ---- esp_timer ----
+
+struct esp_timer {
+  esp_timer_cb_t cb;
+  void*          arg;
+  uint64_t       period_us = 0;
+  uint64_t       generation = 0;
+  bool           active = false;
+};
+
+static uint32_t s_jitterSeed = 12345;
+
+static void timerArm(esp_timer* t, int64_t due, uint64_t gen) {
+  // The timer task may get to a callback late (hal::timerJitterUs), never early.
+  int64_t fire = due;
+  if (hal::timerJitterUs) {
+    s_jitterSeed = s_jitterSeed * 1103515245u + 12345u;
+    fire += (s_jitterSeed >> 8) % (hal::timerJitterUs + 1);
+  }
+  hal::at(fire, [t, due, gen] {
+    if (!t->active || t->generation != gen) return;
+    if (t->period_us) {
+      timerArm(t, due + (int64_t)t->period_us, gen);
+    } else {
+      t->active = false;
+    }
+    t->cb(t->arg);
+  });
+}
+
+int64_t esp_timer_get_time() { return g_now; }
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+  esp_timer* t = new esp_timer;
+  t->cb = args->callback;
+  t->arg = args->arg;
+  *out = t;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t period_us) {
+  if (t->active) return ESP_ERR_INVALID_STATE;
+  t->period_us = period_us;
+  t->active = true;
+  timerArm(t, g_now + (int64_t)period_us, ++t->generation);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t timeout_us) {
+  if (t->active) return ESP_ERR_INVALID_STATE;
+  t->period_us = 0;
+  t->active = true;
+  timerArm(t, g_now + (int64_t)timeout_us, ++t->generation);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t) {
+  if (!t->active) return ESP_ERR_INVALID_STATE;
+  t->active = false;
+  t->generation++;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t t) {
+  if (t->active) return ESP_ERR_INVALID_STATE;
+  t->generation++;  // a pending event may still point here: leak it rather than free
+  return ESP_OK;
+}
+
+// ---- sleep ----
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return hal::g_cause; }
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t, esp_sleep_ext1_wakeup_mode_t) { return ESP_OK; }
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us) {
+  hal::g_timerWakeUs = us;
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start() {
+  hal::mark("deep_sleep");
+  const uint64_t timer = hal::g_timerWakeUs;
+  hal::g_timerWakeUs = 0;
+  throw hal::DeepSleep{ timer };
+}
+
+// ---- LEDC ----
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t*) { return ESP_OK; }
+esp_err_t ledc_channel_config(const ledc_channel_config_t* cfg) {
+  hal::g_ledcDuty[cfg->channel] = cfg->duty;
+  return ESP_OK;
+}
+esp_err_t ledc_set_duty(ledc_mode_t, ledc_channel_t ch, uint32_t duty) {
+  hal::g_ledcDuty[ch] = duty;
+  return ESP_OK;
+}
+esp_err_t ledc_update_duty(ledc_mode_t, ledc_channel_t ch) {
+  if (hal::onLedcUpdate) hal::onLedcUpdate(ch, hal::g_ledcDuty[ch]);
+  return ESP_OK;
+}
+esp_err_t ledc_stop(ledc_mode_t, ledc_channel_t ch, uint32_t) {
+  hal::g_ledcDuty[ch] = 0;
+  if (hal::onLedcUpdate) hal::onLedcUpdate(ch, 0);
+  return ESP_OK;
+}
@@ -0,0 +1,120 @@
+// fs::FS and SD_MMC over a host directory, with an optional cut-off to simulate power loss
+// in the middle of a write.
+#include "host.h"
+
+#include <SD_MMC.h>
+#include <Arduino.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SDMMCFS SD_MMC;
+
+namespace hal {
+namespace {
+std::string g_sdRoot;
+long        g_cutAfter = -1;
+}  // namespace
+
+void sdSetRoot(const std::string& dir) {
+  g_sdRoot = dir;
+}
+
+void sdCutAfter(long bytes) {
+  g_cutAfter = bytes;
+}
+
+std::string makeTempDir() {
+  const char* root = getenv("CF_HOST_TMP");
+  std::string tmpl = std::string(root ? root : "/tmp") + "/cf_host_XXXXXX";
+  const char* d = mkdtemp(&tmpl[0]);
+  return d ? std::string(d) : std::string();
+}
+
+}  // namespace hal
+
+namespace fs {
+
+size_t File::write(const uint8_t* buf, size_t n) {
+  if (!f_) return 0;
+  if (hal::g_cutAfter >= 0) {
+    n = min<size_t>(n, (size_t)hal::g_cutAfter);
+    hal::g_cutAfter -= (long)n;
+  }
+  return fwrite(buf, 1, n, f_.get());
+}
+
+size_t File::read(uint8_t* buf, size_t n) {
+  return f_ ? fread(buf, 1, n, f_.get()) : 0;
+}
+
+int File::available() {
+  return f_ ? (int)(size() - position()) : 0;
+}
+
+bool File::seek(uint32_t pos) {
+  return f_ && fseek(f_.get(), pos, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+  return f_ ? (size_t)ftell(f_.get()) : 0;
+}
+
+size_t File::size() const {
+  if (!f_) return 0;
+  fflush(f_.get());
+  struct stat st;
+  return fstat(fileno(f_.get()), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+void File::flush() {
+  if (f_) fflush(f_.get());
+}
+
+File FS::open(const char* path, const char* mode, bool) {
+  if (root_.empty()) return File();
+  // Arduino's modes are stdio's; binary on every host.
+  std::string m = mode;
+  m += 'b';
+  FILE* f = fopen(host(path).c_str(), m.c_str());
+  if (!f) return File();
+  return File(std::shared_ptr<FILE>(f, fclose), mode[0] == 'a');
+}
+
+bool FS::exists(const char* path) {
+  struct stat st;
+  return !root_.empty() && stat(host(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+  return !root_.empty() && unlink(host(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  return !root_.empty() && ::rename(host(from).c_str(), host(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+  return !root_.empty() && ::mkdir(host(path).c_str(), 0755) == 0;
+}
+
+}  // namespace fs
+
+bool SDMMCFS::begin(const char*, bool, bool, int, uint8_t) {
+  // Card init and FAT mount take a moment on the device.
+  hal::sleepUs(120000);
+  root_ = hal::g_sdRoot;
+  return !root_.empty();
+}
+
+void SDMMCFS::end() {
+  root_.clear();
+}
+
+uint64_t SDMMCFS::cardSize() {
+  return root_.empty() ? 0 : 8ULL << 30;
+}
+
+uint64_t SDMMCFS::usedBytes() {
+  return 0;
+}
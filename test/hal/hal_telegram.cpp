@@ -0,0 +1,668 @@
+// Stand-in Telegram Bot API server (see telegram_server.h).
+#include "telegram_server.h"
+#include "host.h"
+
+#include <errno.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "user_wifi_and_telegram_config.h"
+
+namespace hal {
+
+TelegramServer& telegram() {
+  static TelegramServer server;
+  return server;
+}
+
+namespace {
+
+std::string jsonEscape(const std::string& s) {
+  std::string out;
+  for (unsigned char c : s) {
+    switch (c) {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          char u[8];
+          snprintf(u, sizeof(u), "\\u%04x", c);
+          out += u;
+        } else {
+          out += (char)c;
+        }
+    }
+  }
+  return out;
+}
+
+std::string urlDecode(const std::string& s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '%' && i + 2 < s.size()) {
+      out += (char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += s[i] == '+' ? ' ' : s[i];
+    }
+  }
+  return out;
+}
+
+void parseQuery(const std::string& q, std::map<std::string, std::string>* out) {
+  size_t pos = 0;
+  while (pos < q.size()) {
+    size_t amp = q.find('&', pos);
+    if (amp == std::string::npos) amp = q.size();
+    const std::string kv = q.substr(pos, amp - pos);
+    const size_t eq = kv.find('=');
+    if (eq != std::string::npos) (*out)[urlDecode(kv.substr(0, eq))] = urlDecode(kv.substr(eq + 1));
+    pos = amp + 1;
+  }
+}
+
+std::string headerValue(const std::string& head, const char* name) {
+  const std::string key = std::string("\r\n") + name + ":";
+  size_t p = 0;
+  // Case-insensitive search for the header line.
+  for (;;) {
+    p = head.find("\r\n", p);
+    if (p == std::string::npos) return "";
+    if (strncasecmp(head.c_str() + p, key.c_str(), key.size()) == 0) break;
+    p += 2;
+  }
+  p += key.size();
+  while (p < head.size() && head[p] == ' ') p++;
+  return head.substr(p, head.find("\r\n", p) - p);
+}
+
+void parseMultipart(const std::string& body, const std::string& boundary,
+                    std::map<std::string, std::string>* out) {
+  const std::string delim = "--" + boundary;
+  size_t p = body.find(delim);
+  while (p != std::string::npos) {
+    p += delim.size();
+    if (body.compare(p, 2, "--") == 0) break;
+    const size_t head_end = body.find("\r\n\r\n", p);
+    const size_t next = body.find("\r\n" + delim, p);
+    if (head_end == std::string::npos || next == std::string::npos) break;
+    const std::string head = body.substr(p, head_end - p);
+    const std::string content = body.substr(head_end + 4, next - head_end - 4);
+    const size_t n = head.find("name=\"");
+    if (n != std::string::npos) {
+      const std::string name = head.substr(n + 6, head.find('"', n + 6) - n - 6);
+      const size_t f = head.find("filename=\"");
+      if (f != std::string::npos) {
+        (*out)[name + "#bytes"] = std::to_string(content.size());
+        (*out)[name + "#filename"] = head.substr(f + 10, head.find('"', f + 10) - f - 10);
+      } else {
+        (*out)[name] = content;
+      }
+    }
+    p = next + 2;
+  }
+}
+
+const char* reason(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 413: return "Request Entity Too Large";
+    case 429: return "Too Many Requests";
+    case 502: return "Bad Gateway";
+    default:  return "Error";
+  }
+}
+
+int64_t airtimeUs(size_t bytes, uint32_t kbps) {
+  return kbps ? (int64_t)bytes * 8000 / kbps : 0;
+}
+
+}  // namespace
+
+void TelegramServer::pushUpdate(const char* text, int64_t at_us, bool callback, const char* chat_id) {
+  const std::string t = text, chat = chat_id ? chat_id : CHAT_ID;
+  auto arrive = [this, t, chat, callback] {
+    Update u;
+    u.id = state_.next_update_id++;
+    u.callback = callback;
+    u.text = t;
+    u.chat_id = chat;
+    updates_.push_back(u);
+    wakeHeldPolls();
+  };
+  if (at_us < 0 || at_us <= nowUs()) {
+    arrive();
+  } else {
+    at(at_us, arrive);
+  }
+}
+
+void TelegramServer::failNext(const char* api, int status, uint32_t retry_after_s,
+                              const char* description) {
+  faults_.push_back(Fault{ api ? api : "", status, retry_after_s, description ? description : "" });
+}
+
+void TelegramServer::resetNext(const char* api) {
+  failNext(api, 0);
+}
+
+void TelegramServer::dropConnections() {
+  for (auto& kv : conns_) {
+    if (kv.second.open) close(kv.second);
+  }
+}
+
+int TelegramServer::count(const char* api) const {
+  int n = 0;
+  for (const TgRequest& r : requests_) n += r.api == api ? 1 : 0;
+  return n;
+}
+
+int TelegramServer::openConnections() const {
+  int n = 0;
+  for (const auto& kv : conns_) n += kv.second.open ? 1 : 0;
+  return n;
+}
+
+uint64_t TelegramServer::bytesIn() const {
+  uint64_t n = 0;
+  for (const TgRequest& r : requests_) n += r.bytes_in;
+  return n;
+}
+
+uint64_t TelegramServer::bytesOut() const {
+  uint64_t n = 0;
+  for (const TgRequest& r : requests_) n += r.bytes_out;
+  return n;
+}
+
+int TelegramServer::unackedUpdates() const {
+  int n = 0;
+  for (const Update& u : updates_) n += (u.delivered && u.id > state_.acked_update_id) ? 1 : 0;
+  return n;
+}
+
+int TelegramServer::pendingUpdates() const {
+  int n = 0;
+  for (const Update& u : updates_) n += (!u.delivered && u.id > state_.acked_update_id) ? 1 : 0;
+  return n;
+}
+
+// ---- across wakes ----
+
+namespace {
+
+void putNum(std::string* out, long long v) {
+  *out += std::to_string(v) + " ";
+}
+
+void putStr(std::string* out, const std::string& v) {
+  putNum(out, (long long)v.size());
+  *out += v;
+}
+
+long long getNum(const std::string& in, size_t* pos) {
+  char* end = nullptr;
+  const long long v = strtoll(in.c_str() + *pos, &end, 10);
+  *pos = (size_t)(end - in.c_str()) + 1;
+  return v;
+}
+
+std::string getStr(const std::string& in, size_t* pos) {
+  const size_t n = (size_t)getNum(in, pos);
+  std::string v = in.substr(*pos, n);
+  *pos += n;
+  return v;
+}
+
+}  // namespace
+
+std::string TelegramServer::save() const {
+  std::string out;
+  putNum(&out, state_.next_update_id);
+  putNum(&out, state_.acked_update_id);
+  putNum(&out, state_.next_message_id);
+  putNum(&out, state_.next_session);
+  putNum(&out, (long long)state_.sessions.size());
+  for (uint32_t s : state_.sessions) putNum(&out, s);
+  putNum(&out, (long long)state_.file_ids.size());
+  for (const std::string& id : state_.file_ids) putStr(&out, id);
+  int n = 0;
+  for (const Update& u : updates_) n += u.id > state_.acked_update_id ? 1 : 0;
+  putNum(&out, n);
+  for (const Update& u : updates_) {
+    if (u.id <= state_.acked_update_id) continue;
+    putNum(&out, u.id);
+    putNum(&out, u.callback);
+    putNum(&out, u.delivered);
+    putStr(&out, u.text);
+    putStr(&out, u.chat_id);
+  }
+  putNum(&out, (long long)faults_.size());
+  for (const Fault& f : faults_) {
+    putStr(&out, f.api);
+    putNum(&out, f.status);
+    putNum(&out, f.retry_after);
+    putStr(&out, f.description);
+  }
+  return out;
+}
+
+void TelegramServer::restore(const std::string& in) {
+  size_t pos = 0;
+  state_ = TgServerState();
+  state_.next_update_id = (long)getNum(in, &pos);
+  state_.acked_update_id = (long)getNum(in, &pos);
+  state_.next_message_id = (uint32_t)getNum(in, &pos);
+  state_.next_session = (uint32_t)getNum(in, &pos);
+  for (long long n = getNum(in, &pos); n > 0; --n) state_.sessions.push_back((uint32_t)getNum(in, &pos));
+  for (long long n = getNum(in, &pos); n > 0; --n) state_.file_ids.push_back(getStr(in, &pos));
+  updates_.clear();
+  for (long long n = getNum(in, &pos); n > 0; --n) {
+    Update u;
+    u.id = (long)getNum(in, &pos);
+    u.callback = getNum(in, &pos) != 0;
+    u.delivered = getNum(in, &pos) != 0;
+    u.text = getStr(in, &pos);
+    u.chat_id = getStr(in, &pos);
+    updates_.push_back(u);
+  }
+  faults_.clear();
+  for (long long n = getNum(in, &pos); n > 0; --n) {
+    Fault f;
+    f.api = getStr(in, &pos);
+    f.status = (int)getNum(in, &pos);
+    f.retry_after = (uint32_t)getNum(in, &pos);
+    f.description = getStr(in, &pos);
+    faults_.push_back(f);
+  }
+}
+
+// ---- connections ----
+
+TelegramServer::Conn* TelegramServer::find(int fd) {
+  for (auto& kv : conns_) {
+    if (kv.second.client_fd == fd) return &kv.second;
+  }
+  return nullptr;
+}
+
+int TelegramServer::connect() {
+  if (!model_.up || !wifiRoutable()) {
+    sleepUs(3000000);  // SYN retries until lwIP gives up
+    return -1;
+  }
+  sleepUs((int64_t)model_.rtt_ms * 1000);
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return -1;
+  fcntl(sv[0], F_SETFL, O_NONBLOCK);
+  fcntl(sv[1], F_SETFL, O_NONBLOCK);
+  Conn c;
+  c.id = (int)++connections_;
+  c.client_fd = sv[0];
+  c.server_fd = sv[1];
+  c.last_activity = nowUs();
+  conns_[c.id] = c;
+  armIdleClose(c.id);
+  return sv[0];
+}
+
+bool TelegramServer::handshake(int fd, bool offered, uint32_t offered_id, uint32_t* session_id) {
+  Conn* c = find(fd);
+  if (!c || !c->open) return false;
+  bool known = false;
+  for (uint32_t s : state_.sessions) known |= (s == offered_id);
+  if (offered && known && model_.resumption) {
+    sleepUs((int64_t)model_.resumed_handshake_ms * 1000);
+    resumed_++;
+    *session_id = offered_id;
+  } else {
+    sleepUs((int64_t)model_.full_handshake_ms * 1000);
+    full_++;
+    *session_id = state_.next_session++;
+    state_.sessions.push_back(*session_id);
+  }
+  c = find(fd);  // the server may have dropped it meanwhile
+  if (!c || !c->open) return false;
+  c->last_activity = nowUs();
+  armIdleClose(c->id);
+  return true;
+}
+
+void TelegramServer::receive(int fd, const uint8_t* data, size_t len) {
+  Conn* c = find(fd);
+  if (!c || !c->open) return;  // the peer is gone; TCP would answer with a reset
+  if (c->rx.empty()) {
+    TgRequest r;
+    r.conn = c->id;
+    r.t_start = nowUs();
+    requests_.push_back(r);  // filled in by parseRequests()
+  }
+  c->rx.append((const char*)data, len);
+  c->last_activity = nowUs();
+  parseRequests(*c);
+}
+
+void TelegramServer::clientClosed(int fd) {
+  Conn* c = find(fd);
+  if (!c) return;
+  if (c->open) close(*c);
+  c->client_fd = -1;
+}
+
+void TelegramServer::close(Conn& c) {
+  if (!c.open) return;
+  ::close(c.server_fd);
+  c.open = false;
+  c.held = -1;
+}
+
+void TelegramServer::armIdleClose(int conn_id) {
+  if (!model_.idle_close_ms) return;
+  const int64_t due = nowUs() + (int64_t)model_.idle_close_ms * 1000;
+  at(due, [this, conn_id] {
+    auto it = conns_.find(conn_id);
+    if (it == conns_.end()) return;
+    Conn& c = it->second;
+    const bool idle = c.open && c.held < 0 && c.rx.empty() && c.tx.empty() &&
+                      nowUs() - c.last_activity >= (int64_t)model_.idle_close_ms * 1000;
+    if (idle) close(c);
+  });
+}
+
+// ---- HTTP ----
+
+void TelegramServer::parseRequests(Conn& c) {
+  const size_t head_end = c.rx.find("\r\n\r\n");
+  if (head_end == std::string::npos) return;
+  const std::string head = c.rx.substr(0, head_end + 2);
+  const size_t body_len = (size_t)atol(headerValue(head, "Content-Length").c_str());
+  if (c.rx.size() < head_end + 4 + body_len) return;
+
+  // The pending record for this connection is the last one it opened.
+  int idx = -1;
+  for (int i = (int)requests_.size() - 1; i >= 0; --i) {
+    if (requests_[i].conn == c.id) {
+      idx = i;
+      break;
+    }
+  }
+  TgRequest& r = requests_[idx];
+  r.t_received = nowUs();
+  r.bytes_in = head_end + 4 + body_len;
+  const std::string body = c.rx.substr(head_end + 4, body_len);
+  c.rx.erase(0, r.bytes_in);
+
+  // "POST /bot<token>/sendPhoto?x=y HTTP/1.1"
+  const size_t sp1 = head.find(' '), sp2 = head.find(' ', sp1 + 1);
+  r.http_method = head.substr(0, sp1);
+  std::string target = head.substr(sp1 + 1, sp2 - sp1 - 1);
+  const size_t q = target.find('?');
+  if (q != std::string::npos) {
+    parseQuery(target.substr(q + 1), &r.params);
+    target.resize(q);
+  }
+  const std::string prefix = std::string("/bot") + BOT_TOKEN + "/";
+  if (target.compare(0, prefix.size(), prefix) == 0) {
+    r.api = target.substr(prefix.size());
+  } else {
+    r.api = "(unauthorized)";
+  }
+  const std::string ctype = headerValue(head, "Content-Type");
+  const size_t b = ctype.find("boundary=");
+  if (b != std::string::npos) parseMultipart(body, ctype.substr(b + 9), &r.params);
+  else if (ctype.find("x-www-form-urlencoded") != std::string::npos) parseQuery(body, &r.params);
+
+  handle(c, idx);
+  if (!c.rx.empty()) {
+    TgRequest next;
+    next.conn = c.id;
+    next.t_start = nowUs();
+    requests_.push_back(next);
+    parseRequests(c);
+  }
+}
+
+std::string TelegramServer::newFileId(const char* kind) {
+  // Real ids are ~80 characters of URL-safe base64.
+  static const char kAlphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  std::string id = kind;
+  uint32_t x = (uint32_t)state_.file_ids.size() * 2654435761u + 7;
+  while (id.size() < model_.file_id_len) {
+    x = x * 1664525u + 1013904223u;
+    id += kAlphabet[(x >> 24) & 63];
+  }
+  id.resize(model_.file_id_len);
+  state_.file_ids.push_back(id);
+  return id;
+}
+
+std::string TelegramServer::messageJson(const TgRequest& r, uint32_t message_id) {
+  char head[256];
+  snprintf(head, sizeof(head),
+           "{\"message_id\":%u,\"from\":{\"id\":5550001,\"is_bot\":true,\"first_name\":\"Feeder\","
+           "\"username\":\"cat_feeder_bot\"},\"chat\":{\"id\":%s,\"title\":\"Cat feeder\","
+           "\"type\":\"group\"},\"date\":%lld",
+           message_id, r.params.count("chat_id") ? r.param("chat_id") : "0",
+           (long long)(wallUs() / 1000000));
+  std::string m = head;
+  if (r.params.count("text")) m += ",\"text\":\"" + jsonEscape(r.param("text")) + "\"";
+  if (r.params.count("caption")) m += ",\"caption\":\"" + jsonEscape(r.param("caption")) + "\"";
+  if (r.api == "sendPhoto" && model_.photo_sizes) {
+    const bool by_id = r.params.count("photo") > 0;
+    const std::string big = by_id ? r.param("photo") : newFileId("AgACAgQAAxkDAAI");
+    m += ",\"photo\":[{\"file_id\":\"" + newFileId("AgACAgQAAxkDAAI") +
+         "\",\"file_unique_id\":\"AQADs1\",\"file_size\":1410,\"width\":90,\"height\":67},"
+         "{\"file_id\":\"" + newFileId("AgACAgQAAxkDAAI") +
+         "\",\"file_unique_id\":\"AQADs2\",\"file_size\":18720,\"width\":320,\"height\":240},"
+         "{\"file_id\":\"" + big +
+         "\",\"file_unique_id\":\"AQADs3\",\"file_size\":" +
+         std::string(r.param("photo#bytes")[0] ? r.param("photo#bytes") : "40000") +
+         ",\"width\":800,\"height\":600}]";
+  } else if (r.api == "sendVideo") {
+    m += ",\"video\":{\"file_id\":\"" + newFileId("BAACAgQAAxkDAAI") +
+         "\",\"file_unique_id\":\"AgADv1\",\"width\":640,\"height\":480,\"duration\":5,"
+         "\"mime_type\":\"video/x-msvideo\",\"file_size\":" +
+         std::string(r.param("video#bytes")[0] ? r.param("video#bytes") : "0") + "}";
+  }
+  return m + "}";
+}
+
+void TelegramServer::handle(Conn& c, int idx) {
+  TgRequest& r = requests_[idx];
+  for (size_t i = 0; i < faults_.size(); ++i) {
+    if (!faults_[i].api.empty() && faults_[i].api != r.api) continue;
+    const Fault f = faults_[i];
+    faults_.erase(faults_.begin() + i);
+    if (f.status == 0) {
+      close(c);
+      return;
+    }
+    std::string body = "{\"ok\":false,\"error_code\":" + std::to_string(f.status) +
+                       ",\"description\":\"" +
+                       jsonEscape(f.description.empty()
+                                    ? (f.status == 429 ? "Too Many Requests: retry after " +
+                                                         std::to_string(f.retry_after)
+                                                       : std::string(reason(f.status)))
+                                    : f.description) + "\"";
+    if (f.retry_after) body += ",\"parameters\":{\"retry_after\":" + std::to_string(f.retry_after) + "}";
+    respond(c, idx, f.status, body + "}");
+    return;
+  }
+
+  if (r.api == "(unauthorized)") {
+    respond(c, idx, 401, "{\"ok\":false,\"error_code\":401,\"description\":\"Unauthorized\"}");
+  } else if (r.api == "getUpdates") {
+    const char* offset = r.param("offset");
+    if (offset[0]) state_.acked_update_id = std::max(state_.acked_update_id, atol(offset) - 1);
+    if (!answerPoll(c, idx, atol(r.param("timeout")) <= 0)) {
+      c.held = idx;
+      r.held = true;
+      const int64_t until = nowUs() + (int64_t)model_.rtt_ms * 500 + atol(r.param("timeout")) * 1000000LL;
+      const int conn_id = c.id;
+      at(until, [this, conn_id, idx] {
+        auto it = conns_.find(conn_id);
+        if (it != conns_.end() && it->second.open && it->second.held == idx) {
+          answerPoll(it->second, idx, true);
+        }
+      });
+    }
+  } else if (r.api == "sendPhoto" && r.params.count("photo")) {
+    bool known = false;
+    for (const std::string& id : state_.file_ids) known |= (id == r.param("photo"));
+    if (known) {
+      respond(c, idx, 200, "{\"ok\":true,\"result\":" + messageJson(r, state_.next_message_id++) + "}");
+    } else {
+      respond(c, idx, 400, "{\"ok\":false,\"error_code\":400,\"description\":"
+                           "\"Bad Request: wrong file identifier/HTTP URL specified\"}");
+    }
+  } else if (r.api == "sendMediaGroup") {
+    // One message per attached file.
+    std::string result = "[";
+    int n = 0;
+    for (const auto& kv : r.params) {
+      if (kv.first.size() < 7 || kv.first.compare(kv.first.size() - 6, 6, "#bytes") != 0) continue;
+      TgRequest one = r;
+      one.api = "sendPhoto";
+      one.params["photo#bytes"] = kv.second;
+      one.params.erase("photo");
+      result += (n++ ? "," : "") + messageJson(one, state_.next_message_id++);
+    }
+    respond(c, idx, 200, "{\"ok\":true,\"result\":" + result + "]}");
+  } else if (r.api == "answerCallbackQuery" || r.api == "sendChatAction") {
+    respond(c, idx, 200, "{\"ok\":true,\"result\":true}");
+  } else if (r.api.compare(0, 4, "send") == 0 || r.api.compare(0, 4, "edit") == 0) {
+    respond(c, idx, 200, "{\"ok\":true,\"result\":" + messageJson(r, state_.next_message_id++) + "}");
+  } else {
+    respond(c, idx, 404, "{\"ok\":false,\"error_code\":404,\"description\":\"Not Found\"}");
+  }
+}
+
+bool TelegramServer::answerPoll(Conn& c, int idx, bool timed_out) {
+  TgRequest& r = requests_[idx];
+  const long limit = r.params.count("limit") ? atol(r.param("limit")) : 100;
+  std::string result;
+  int n = 0;
+  for (Update& u : updates_) {
+    if (u.id <= state_.acked_update_id || n >= limit) continue;
+    char head[256];
+    const long mid = 9000 + u.id % 1000;
+    if (u.callback) {
+      snprintf(head, sizeof(head),
+               "{\"update_id\":%ld,\"callback_query\":{\"id\":\"cb%ld\",\"from\":{\"id\":42,"
+               "\"is_bot\":false,\"first_name\":\"Owner\"},\"message\":{\"message_id\":%ld,"
+               "\"chat\":{\"id\":%s,\"type\":\"group\"},",
+               u.id, u.id, mid, u.chat_id.c_str());
+      result += std::string(n ? "," : "") + head +
+                "\"text\":\"Motion detected\"},\"chat_instance\":\"-77\",\"data\":\"" +
+                jsonEscape(u.text) + "\"}}";
+    } else {
+      snprintf(head, sizeof(head),
+               "{\"update_id\":%ld,\"message\":{\"message_id\":%ld,\"from\":{\"id\":42,"
+               "\"is_bot\":false,\"first_name\":\"Owner\"},\"chat\":{\"id\":%s,\"type\":\"group\"},",
+               u.id, mid, u.chat_id.c_str());
+      result += std::string(n ? "," : "") + head + "\"date\":" +
+                std::to_string(wallUs() / 1000000) + ",\"text\":\"" + jsonEscape(u.text) + "\"";
+      if (!u.text.empty() && u.text[0] == '/') {
+        result += ",\"entities\":[{\"offset\":0,\"length\":" +
+                  std::to_string(u.text.find(' ') == std::string::npos ? u.text.size()
+                                                                       : u.text.find(' ')) +
+                  ",\"type\":\"bot_command\"}]";
+      }
+      result += "}}";
+    }
+    u.delivered = true;
+    n++;
+  }
+  if (n == 0 && !timed_out) return false;
+  if (c.held == idx) c.held = -1;
+  // A held poll is already at the server: only the way back remains.
+  respond(c, idx, 200, "{\"ok\":true,\"result\":[" + result + "]}",
+          r.held ? -(int64_t)(model_.process_ms * 1000 + model_.rtt_ms * 500) : 0);
+  return true;
+}
+
+void TelegramServer::wakeHeldPolls() {
+  for (auto& kv : conns_) {
+    Conn& c = kv.second;
+    if (c.open && c.held >= 0) answerPoll(c, c.held, false);
+  }
+}
+
+void TelegramServer::respond(Conn& c, int idx, int status, const std::string& body,
+                             int64_t extra_delay_us) {
+  TgRequest& r = requests_[idx];
+  std::string wire = "HTTP/1.1 " + std::to_string(status) + " " + reason(status) + "\r\n"
+                     "Server: nginx/1.18.0\r\n"
+                     "Content-Type: application/json\r\n";
+  bool close_after = false;
+  switch (model_.framing) {
+    case TgServerModel::CONTENT_LENGTH:
+      wire += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: keep-alive\r\n\r\n" + body;
+      break;
+    case TgServerModel::CHUNKED:
+      wire += "Transfer-Encoding: chunked\r\nConnection: keep-alive\r\n\r\n";
+      for (size_t p = 0; p < body.size(); p += model_.chunk_size) {
+        const size_t n = std::min(model_.chunk_size, body.size() - p);
+        char size[16];
+        snprintf(size, sizeof(size), "%zx\r\n", n);
+        wire += size + body.substr(p, n) + "\r\n";
+      }
+      wire += "0\r\n\r\n";
+      break;
+    case TgServerModel::CLOSE_DELIMITED:
+      wire += "Connection: close\r\n\r\n" + body;
+      close_after = true;
+      break;
+  }
+  r.status = status;
+  r.bytes_out = wire.size();
+  // Half an RTT up, server time, half an RTT down, then the bytes themselves.
+  const int64_t due = nowUs() + (int64_t)model_.rtt_ms * 1000 + (int64_t)model_.process_ms * 1000 +
+                      extra_delay_us + airtimeUs(wire.size(), model_.downlink_kbps);
+  const int conn_id = c.id;
+  at(std::max(due, nowUs()), [this, conn_id, idx, wire, close_after] {
+    auto it = conns_.find(conn_id);
+    if (it == conns_.end() || !it->second.open) return;
+    it->second.tx += wire;
+    it->second.tx_req = idx;
+    it->second.close_after |= close_after;
+    flush(conn_id);
+  });
+}
+
+void TelegramServer::flush(int conn_id) {
+  auto it = conns_.find(conn_id);
+  if (it == conns_.end() || !it->second.open) return;
+  Conn& c = it->second;
+  while (!c.tx.empty()) {
+    const ssize_t n = ::send(c.server_fd, c.tx.data(), c.tx.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n > 0) {
+      c.tx.erase(0, (size_t)n);
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      at(nowUs() + 1000, [this, conn_id] { flush(conn_id); });  // device reads slower
+      return;
+    } else {
+      close(c);
+      return;
+    }
+  }
+  if (c.tx_req >= 0) requests_[c.tx_req].t_answered = nowUs();
+  c.tx_req = -1;
+  c.last_activity = nowUs();
+  if (c.close_after) {
+    close(c);
+    return;
+  }
+  armIdleClose(conn_id);
+}
+
+}  // namespace hal
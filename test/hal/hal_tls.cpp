@@ -0,0 +1,179 @@
+// mbedtls over the stand-in server: no crypto, but the handshake, session resumption and
+// record I/O cost what telegram_server.h says. Also select() through the scheduler.
+#include "host.h"
+#include "telegram_server.h"
+
+#include <sys/ioctl.h>
+#include <Arduino.h>
+#include <sys/select.h>
+#include "lwip/sockets.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/error.h"
+#include "mbedtls/ssl.h"
+
+#undef select
+
+int hal_select(int nfds, fd_set* rd, fd_set* wr, fd_set* ex, struct timeval* timeout) {
+  // Poll the real sockets each time the scheduler looks at this task; waiting costs
+  // virtual time only.
+  fd_set r0, w0, e0;
+  if (rd) r0 = *rd;
+  if (wr) w0 = *wr;
+  if (ex) e0 = *ex;
+  int result = 0;
+  auto poll = [&] {
+    if (rd) *rd = r0;
+    if (wr) *wr = w0;
+    if (ex) *ex = e0;
+    timeval zero = { 0, 0 };
+    result = select(nfds, rd, wr, ex, &zero);
+    return result != 0;
+  };
+  const int64_t deadline = timeout ? hal::nowUs() + (int64_t)timeout->tv_sec * 1000000 + timeout->tv_usec
+                                   : hal::kForever;
+  if (!hal::waitUntil(poll, deadline)) {
+    if (rd) FD_ZERO(rd);
+    if (wr) FD_ZERO(wr);
+    if (ex) FD_ZERO(ex);
+    return 0;
+  }
+  return result;
+}
+
+void mbedtls_entropy_init(mbedtls_entropy_context*) {}
+int mbedtls_entropy_func(void*, unsigned char* out, size_t len) {
+  memset(out, 0x5A, len);
+  return 0;
+}
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx) { ctx->state = 1; }
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*)(void*, unsigned char*, size_t),
+                          void*, const unsigned char*, size_t) {
+  ctx->state = 0x2545F491u;
+  return 0;
+}
+int mbedtls_ctr_drbg_random(void* p, unsigned char* out, size_t len) {
+  mbedtls_ctr_drbg_context* ctx = (mbedtls_ctr_drbg_context*)p;
+  for (size_t i = 0; i < len; ++i) {
+    ctx->state = ctx->state * 1103515245u + 12345u;
+    out[i] = (unsigned char)(ctx->state >> 16);
+  }
+  return 0;
+}
+
+void mbedtls_strerror(int err, char* buf, size_t len) {
+  snprintf(buf, len, "mbedtls error -0x%04X", (unsigned)-err);
+}
+
+void mbedtls_net_init(mbedtls_net_context* ctx) { ctx->fd = -1; }
+void mbedtls_net_free(mbedtls_net_context* ctx) {
+  if (ctx->fd < 0) return;
+  hal::telegram().clientClosed(ctx->fd);
+  close(ctx->fd);
+  ctx->fd = -1;
+}
+int mbedtls_net_connect(mbedtls_net_context* ctx, const char*, const char*, int) {
+  ctx->fd = hal::telegram().connect();
+  return ctx->fd >= 0 ? 0 : MBEDTLS_ERR_NET_CONNECT_FAILED;
+}
+int mbedtls_net_set_nonblock(mbedtls_net_context*) { return 0; }
+int mbedtls_net_set_block(mbedtls_net_context*) { return 0; }
+// The firmware only hands these to mbedtls_ssl_set_bio(); records never pass through them.
+int mbedtls_net_send(void*, const unsigned char*, size_t) { return MBEDTLS_ERR_NET_SEND_FAILED; }
+int mbedtls_net_recv(void*, unsigned char*, size_t) { return MBEDTLS_ERR_NET_RECV_FAILED; }
+
+static int sslFd(const mbedtls_ssl_context* ssl) {
+  return ssl->net ? ssl->net->fd : -1;
+}
+
+static uint32_t sessionId(const mbedtls_ssl_session* s) {
+  uint32_t id = 0;
+  memcpy(&id, s->id, sizeof(id));
+  return id;
+}
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl) { memset(ssl, 0, sizeof(*ssl)); }
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl) { memset(ssl, 0, sizeof(*ssl)); }
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf) { conf->endpoint = 0; }
+void mbedtls_ssl_config_free(mbedtls_ssl_config*) {}
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config*, int, int, int) { return 0; }
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config*, int) {}
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config*, int (*)(void*, unsigned char*, size_t), void*) {}
+int mbedtls_ssl_setup(mbedtls_ssl_context*, const mbedtls_ssl_config*) { return 0; }
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context*, const char*) { return 0; }
+void mbedtls_ssl_set_bio(mbedtls_ssl_context* ssl, void* bio, mbedtls_ssl_send_t*, mbedtls_ssl_recv_t*,
+                         mbedtls_ssl_recv_timeout_t*) {
+  ssl->net = (mbedtls_net_context*)bio;
+}
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl) {
+  uint32_t id = 0;
+  if (sslFd(ssl) < 0 ||
+      !hal::telegram().handshake(sslFd(ssl), ssl->has_offer, sessionId(&ssl->offered), &id)) {
+    return MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE;
+  }
+  // The master secret follows from the session id, so a resumed session carries the
+  // offered secret and a full handshake a fresh one.
+  memset(&ssl->session, 0, sizeof(ssl->session));
+  memcpy(ssl->session.id, &id, sizeof(id));
+  ssl->session.id_len = 32;
+  for (size_t i = 0; i < sizeof(ssl->session.master); ++i) {
+    ssl->session.master[i] = (unsigned char)((id * 2654435761u) >> (i % 4 * 8)) ^ (unsigned char)i;
+  }
+  ssl->handshake_done = 1;
+  return 0;
+}
+
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len) {
+  const int fd = sslFd(ssl);
+  if (fd < 0 || !ssl->handshake_done) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  unsigned char peek;
+  const ssize_t r = len ? recv(fd, buf, len, MSG_DONTWAIT) : recv(fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (r > 0) return len ? (int)r : 0;
+  if (r == 0) return len ? 0 : MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+  if (errno == EAGAIN || errno == EWOULDBLOCK) return MBEDTLS_ERR_SSL_WANT_READ;
+  return MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+int mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len) {
+  const int fd = sslFd(ssl);
+  if (fd < 0 || !ssl->handshake_done) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  // Radio time for the record; after a server-side close the bytes vanish, as they do
+  // over TCP until the reset comes back.
+  const uint32_t kbps = hal::telegram().model().uplink_kbps;
+  if (kbps) hal::sleepUs((int64_t)len * 8000 / kbps);
+  hal::telegram().receive(fd, buf, len);
+  return (int)len;
+}
+
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context* ssl) {
+  int n = 0;
+  if (sslFd(ssl) < 0 || ioctl(sslFd(ssl), FIONREAD, &n) < 0) return 0;
+  return (size_t)n;
+}
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context*) { return 0; }
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* s) { memset(s, 0, sizeof(*s)); }
+void mbedtls_ssl_session_free(mbedtls_ssl_session* s) { memset(s, 0, sizeof(*s)); }
+int mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* out) {
+  *out = ssl->session;
+  return 0;
+}
+int mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* s) {
+  ssl->offered = *s;
+  ssl->has_offer = 1;
+  return 0;
+}
+int mbedtls_ssl_session_save(const mbedtls_ssl_session* s, unsigned char* buf, size_t len, size_t* olen) {
+  *olen = sizeof(*s);
+  if (len < sizeof(*s)) return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+  memcpy(buf, s, sizeof(*s));
+  return 0;
+}
+int mbedtls_ssl_session_load(mbedtls_ssl_session* s, const unsigned char* buf, size_t len) {
+  if (len != sizeof(*s)) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  memcpy(s, buf, sizeof(*s));
+  return 0;
+}
@@ -0,0 +1,238 @@
+// Station on a simulated AP, and WiFiServer/WiFiClient on real localhost sockets.
+#include "host.h"
+
+#include <WiFi.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+WiFiClass WiFi;
+
+namespace hal {
+
+int serverPortBase = 20000;
+
+namespace {
+
+Radio          g_radio;
+bool           g_on = false;
+int64_t        g_assocAt = -1;   // -1: not going to associate
+int64_t        g_upAt = -1;
+bool           g_static = false;
+IPAddress      g_ip, g_gateway, g_subnet, g_dns;
+wifi_ps_type_t g_ps = WIFI_PS_MIN_MODEM;
+bool           g_upMarked = false;
+
+IPAddress dhcpAddress() {
+  const uint32_t a = g_radio.dhcp_ip ? g_radio.dhcp_ip : 0xC0A80139;  // 192.168.1.57
+  return IPAddress(a >> 24, a >> 16, a >> 8, a);
+}
+
+bool associated() {
+  return g_assocAt >= 0 && nowUs() >= g_assocAt && g_radio.ap_up;
+}
+
+bool up() {
+  return g_upAt >= 0 && nowUs() >= g_upAt && g_radio.ap_up;
+}
+
+}  // namespace
+
+Radio& radio() { return g_radio; }
+
+bool wifiRoutable() {
+  // A reused lease the DHCP server has since given to someone else associates fine but
+  // nothing comes back.
+  return up() && (!g_static || (uint32_t)g_ip == (uint32_t)dhcpAddress());
+}
+
+}  // namespace hal
+
+using namespace hal;
+
+wl_status_t WiFiClass::status() {
+  if (!up()) return g_on ? WL_DISCONNECTED : WL_IDLE_STATUS;
+  if (!g_upMarked) {
+    g_upMarked = true;
+    mark("wifi_up");
+  }
+  return WL_CONNECTED;
+}
+
+int WiFiClass::begin(const char*, const char*, int32_t channel, const uint8_t* bssid, bool) {
+  g_on = true;
+  g_upMarked = false;
+  const bool locked = channel != 0 && bssid != nullptr;
+  if (locked && (channel != g_radio.channel || memcmp(bssid, g_radio.bssid, 6) != 0)) {
+    // Channel-locked to an AP that is not there any more: never associates.
+    g_assocAt = g_upAt = -1;
+    return WL_DISCONNECTED;
+  }
+  g_assocAt = nowUs() + (int64_t)(locked ? g_radio.fast_assoc_ms : g_radio.scan_assoc_ms) * 1000;
+  g_upAt = g_assocAt + (g_static ? 0 : (int64_t)g_radio.dhcp_ms * 1000);
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::config(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress) {
+  g_static = (uint32_t)ip != 0;
+  g_ip = ip;
+  g_gateway = gateway;
+  g_subnet = subnet;
+  g_dns = dns1;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool, bool) {
+  g_assocAt = g_upAt = -1;
+  return true;
+}
+
+bool WiFiClass::mode(wifi_mode_t m) {
+  if (m == WIFI_OFF) {
+    g_on = false;
+    g_assocAt = g_upAt = -1;
+  }
+  return true;
+}
+
+wifi_ps_type_t WiFiClass::getSleep() { return g_ps; }
+
+IPAddress WiFiClass::localIP() {
+  if (!up()) return IPAddress();
+  return g_static ? g_ip : dhcpAddress();
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  if (!up()) return IPAddress();
+  return g_static ? g_gateway : IPAddress(192, 168, 1, 1);
+}
+
+IPAddress WiFiClass::subnetMask() {
+  if (!up()) return IPAddress();
+  return g_static ? g_subnet : IPAddress(255, 255, 255, 0);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t) {
+  if (!up()) return IPAddress();
+  return g_static ? g_dns : IPAddress(192, 168, 1, 1);
+}
+
+int8_t WiFiClass::RSSI() { return associated() ? g_radio.rssi : 0; }
+uint8_t* WiFiClass::BSSID() { return associated() ? g_radio.bssid : nullptr; }
+int32_t WiFiClass::channel() { return associated() ? g_radio.channel : 0; }
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+  g_ps = type;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap) {
+  if (!associated()) return ESP_ERR_NOT_FOUND;
+  memcpy(ap->bssid, g_radio.bssid, 6);
+  ap->primary = (uint8_t)g_radio.channel;
+  ap->rssi = g_radio.rssi;
+  return ESP_OK;
+}
+
+// ---- sockets (live stream) ----
+
+static std::shared_ptr<int> ownSocket(int fd) {
+  return std::shared_ptr<int>(new int(fd), [](int* p) {
+    if (*p >= 0) close(*p);
+    delete p;
+  });
+}
+
+WiFiClient::WiFiClient(int fd) : sock_(ownSocket(fd)) {}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t n) {
+  size_t done = 0;
+  int64_t last_progress = nowUs();
+  while (done < n && fd() >= 0) {
+    const ssize_t r = send(fd(), buf + done, n - done, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (r > 0) {
+      done += (size_t)r;
+      last_progress = nowUs();
+    } else if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (nowUs() - last_progress > 5000000) break;
+      delay(1);  // lwIP waits for the window to open; other tasks run meanwhile
+    } else {
+      break;
+    }
+  }
+  return done;
+}
+
+int WiFiClient::available() {
+  int n = 0;
+  if (fd() < 0 || ioctl(fd(), FIONREAD, &n) < 0) return 0;
+  return n;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t n) {
+  if (fd() < 0) return -1;
+  const ssize_t r = recv(fd(), buf, n, MSG_DONTWAIT);
+  return r > 0 ? (int)r : -1;
+}
+
+void WiFiClient::stop() {
+  if (sock_ && *sock_ >= 0) {
+    close(*sock_);
+    *sock_ = -1;  // every copy sees the close
+  }
+  sock_.reset();
+}
+
+uint8_t WiFiClient::connected() {
+  if (fd() < 0) return 0;
+  uint8_t c;
+  const ssize_t r = recv(fd(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return r > 0 || (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+void WiFiClient::setNoDelay(bool on) {
+  int v = on;
+  if (fd() >= 0) setsockopt(fd(), IPPROTO_TCP, TCP_NODELAY, &v, sizeof(v));
+}
+
+void WiFiServer::begin(uint16_t port) {
+  if (port) port_ = port;
+  end();
+  fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int one = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in a = {};
+  a.sin_family = AF_INET;
+  a.sin_port = htons((uint16_t)(serverPortBase + port_));
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd_, (sockaddr*)&a, sizeof(a)) != 0 || listen(fd_, 4) != 0) {
+    Serial.printf("[HAL] WiFiServer: cannot listen on %d\n", serverPortBase + port_);
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void WiFiServer::end() {
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+}
+
+WiFiClient WiFiServer::accept() {
+  if (fd_ < 0) return WiFiClient();
+  const int c = ::accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK);
+  if (c < 0) return WiFiClient();
+  // lwIP's send buffer on the ESP32 is a few kB, not the megabytes Linux grants localhost.
+  int snd = 5744;
+  setsockopt(c, SOL_SOCKET, SO_SNDBUF, &snd, sizeof(snd));
+  return WiFiClient(c);
+}
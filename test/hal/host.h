@@ -0,0 +1,114 @@
+// Control surface of the host stand-ins. Tests and the simulator drive the "hardware"
+// through this header; the firmware only ever sees the ESP32/Arduino APIs.
+//
+// Time is virtual. Every FreeRTOS task is a host thread, but only one runs at a time:
+// a task gives up the CPU when it blocks (delay, queue, mutex, select, camera, radio),
+// and the clock jumps to the next wake-up once nobody can run. Compute is free, waiting
+// is what costs time, so runs are deterministic and as fast as the host allows.
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "esp_sleep.h"
+#include "esp_camera.h"
+
+namespace hal {
+
+// ---- clock and scheduler ----
+/** Power up (or wake) a fresh device: boot clock at 0, wall clock (RTC) at `wall_us`;
+ *  the calling thread becomes the loop task. */
+void    reset(int64_t wall_us = 1760000000LL * 1000000LL);
+/** Time since boot: millis(), micros(), esp_timer_get_time(). */
+int64_t nowUs();
+/** RTC time: gettimeofday(). Keeps counting through deep sleep. */
+int64_t wallUs();
+/** Block the running task until `ready()` holds or the clock reaches `deadline_us`. */
+bool    waitUntil(const std::function<bool()>& ready, int64_t deadline_us);
+void    sleepUs(int64_t us);
+/** Run `fn` from the scheduler when the clock reaches `t_us` (like an esp_timer callback). */
+void    at(int64_t t_us, std::function<void()> fn);
+/** With false, xTaskCreatePinnedToCore() fails and the firmware takes its inline paths. */
+void    setTasksEnabled(bool enabled);
+int     liveTasks();
+constexpr int64_t kForever = INT64_MAX;
+
+/** Serial output to stdout. */
+extern bool verbose;
+/** Everything the firmware printed this boot (the last 1 MB at most). */
+std::string& serialLog();
+
+// ---- phase marks (simulator report) ----
+struct Mark {
+  std::string name;
+  int64_t     t_us;
+};
+void mark(const char* name);
+const std::vector<Mark>& marks();
+
+// ---- board ----
+extern bool psram;
+/** Thrown by esp_deep_sleep_start(); the wake ends there. */
+struct DeepSleep {
+  uint64_t timer_us;  ///< 0 = no timer wake armed
+};
+void setWakeCause(esp_sleep_wakeup_cause_t cause);
+uint32_t ledcDuty(int channel);
+/** Called on every ledc_update_duty()/ledc_stop(), from the task or timer that did it. */
+extern std::function<void(int channel, uint32_t duty)> onLedcUpdate;
+/** esp_timer callbacks run up to this much late (deterministic pseudo-random). */
+extern uint32_t timerJitterUs;
+
+// ---- camera ----
+struct Scene {
+  bool    cat = false;      ///< a dark blob in front of the lens
+  int     cat_x = 50;       ///< blob centre, percent of the width
+  int     cat_y = 55;
+  int     cat_step = 0;     ///< blob moves this many percent per frame
+  uint8_t light = 120;      ///< mean background luma
+  uint8_t blur = 0;         ///< 0 = sharp texture; larger values wash it out
+  uint8_t noise = 2;        ///< per-frame sensor noise (+/- luma)
+  float   detail = 1.0f;    ///< scales JPEG size
+};
+struct CameraModel {
+  bool     fail_init = false;
+  uint32_t init_ms = 420;         ///< sensor probe + PSRAM ring allocation
+  uint32_t frame_ms_small = 40;   ///< up to SVGA
+  uint32_t frame_ms_large = 80;   ///< XGA and above
+  uint32_t fb_timeout_ms = 4000;  ///< fb_get() with every buffer checked out
+};
+/** Called before each frame is rendered; may change the scene (burst blur, motion). */
+extern std::function<void(Scene&)> beforeFrame;
+Scene&       scene();
+CameraModel& camera();
+uint32_t     framesCaptured();
+int          framesOut();  ///< buffers the firmware holds right now
+
+// ---- Wi-Fi ----
+struct Radio {
+  bool     ap_up = true;
+  uint8_t  bssid[6] = { 0x24, 0x0a, 0xc4, 0x11, 0x22, 0x33 };
+  int32_t  channel = 6;
+  int8_t   rssi = -63;
+  uint32_t fast_assoc_ms = 240;   ///< known BSSID and channel: no scan
+  uint32_t scan_assoc_ms = 1700;  ///< full scan then association
+  uint32_t dhcp_ms = 650;
+  uint32_t dhcp_ip = 0;           ///< address the DHCP server hands out (host order a.b.c.d)
+};
+Radio& radio();
+/** True once associated with an address that actually routes. */
+bool   wifiRoutable();
+
+// ---- microSD ----
+/** Back SD_MMC with a host directory ("" = no card). */
+void sdSetRoot(const std::string& dir);
+/** Cut every later write short once `bytes` more have been written (power loss); -1 = off. */
+void sdCutAfter(long bytes);
+/** Fresh empty directory for one test, under $CF_HOST_TMP (the runner removes it) or /tmp. */
+std::string makeTempDir();
+
+// ---- live stream sockets ----
+/** WiFiServer(port) listens on 127.0.0.1:(base + port). */
+extern int serverPortBase;
+
+}  // namespace hal
@@ -0,0 +1,8 @@
+#pragma once
+#include "esp_camera.h"
+typedef enum { JPG_SCALE_NONE, JPG_SCALE_2X, JPG_SCALE_4X, JPG_SCALE_8X } jpg_scale_t;
+/** Decode into big-endian RGB565, (width >> scale) x (height >> scale), rounded up. */
+bool jpg2rgb565(const uint8_t* src, size_t src_len, uint8_t* out, jpg_scale_t scale);
+/** Encode; `*out` is malloc()ed. */
+bool fmt2jpg(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format,
+             uint8_t quality, uint8_t** out, size_t* out_len);
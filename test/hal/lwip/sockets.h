@@ -0,0 +1,13 @@
+#pragma once
+// lwIP's BSD socket layer maps onto the host's; select() goes through the scheduler so
+// a task waiting on a socket lets the others run and the clock advance.
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int hal_select(int nfds, fd_set* rd, fd_set* wr, fd_set* ex, struct timeval* timeout);
+#define select hal_select
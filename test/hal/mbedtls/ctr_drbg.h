@@ -0,0 +1,9 @@
+#pragma once
+#include <stddef.h>
+typedef struct {
+  unsigned state;
+} mbedtls_ctr_drbg_context;
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx);
+int  mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*entropy)(void*, unsigned char*, size_t),
+                           void* entropy_ctx, const unsigned char* custom, size_t len);
+int  mbedtls_ctr_drbg_random(void* ctx, unsigned char* out, size_t len);
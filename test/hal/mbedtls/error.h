@@ -0,0 +1,3 @@
+#pragma once
+#include <stddef.h>
+void mbedtls_strerror(int err, char* buf, size_t len);
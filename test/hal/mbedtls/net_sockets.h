@@ -0,0 +1,22 @@
+#pragma once
+// The "network" ends at the in-process stand-in server: mbedtls_net_connect() hands back
+// one end of a socketpair whose other end the server answers on.
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_NET_PROTO_TCP 0
+#define MBEDTLS_ERR_NET_CONNECT_FAILED -0x0044
+#define MBEDTLS_ERR_NET_RECV_FAILED    -0x004C
+#define MBEDTLS_ERR_NET_SEND_FAILED    -0x004E
+
+typedef struct {
+  int fd;
+} mbedtls_net_context;
+
+void mbedtls_net_init(mbedtls_net_context* ctx);
+void mbedtls_net_free(mbedtls_net_context* ctx);
+int  mbedtls_net_connect(mbedtls_net_context* ctx, const char* host, const char* port, int proto);
+int  mbedtls_net_set_nonblock(mbedtls_net_context* ctx);
+int  mbedtls_net_set_block(mbedtls_net_context* ctx);
+int  mbedtls_net_send(void* ctx, const unsigned char* buf, size_t len);
+int  mbedtls_net_recv(void* ctx, unsigned char* buf, size_t len);
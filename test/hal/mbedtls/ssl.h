@@ -0,0 +1,66 @@
+#pragma once
+// TLS without the crypto: records go over the socket in the clear, while the handshake
+// costs what the stand-in server says a full or resumed handshake costs. Sessions carry an
+// id and a master secret, so resumption is detected exactly as on the device.
+#include <stddef.h>
+#include <stdint.h>
+#include "net_sockets.h"
+
+#define MBEDTLS_SSL_IS_CLIENT         0
+#define MBEDTLS_SSL_TRANSPORT_STREAM  0
+#define MBEDTLS_SSL_PRESET_DEFAULT    0
+#define MBEDTLS_SSL_VERIFY_NONE       0
+#define MBEDTLS_ERR_SSL_WANT_READ        -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE       -0x6880
+#define MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY -0x7880
+#define MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL -0x6A00
+#define MBEDTLS_ERR_SSL_BAD_INPUT_DATA   -0x7100
+#define MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE -0x7780
+
+typedef int mbedtls_ssl_send_t(void* ctx, const unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_t(void* ctx, unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_timeout_t(void* ctx, unsigned char* buf, size_t len, uint32_t timeout);
+
+typedef struct {
+  unsigned char id[32];
+  size_t        id_len;
+  unsigned char master[48];
+} mbedtls_ssl_session;
+
+typedef struct {
+  int endpoint;
+} mbedtls_ssl_config;
+
+typedef struct {
+  mbedtls_net_context* net;
+  mbedtls_ssl_session  offered;
+  int                  has_offer;
+  mbedtls_ssl_session  session;
+  int                  handshake_done;
+  int                  handshake_started;
+} mbedtls_ssl_context;
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl);
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl);
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf);
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf);
+int  mbedtls_ssl_config_defaults(mbedtls_ssl_config* conf, int endpoint, int transport, int preset);
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int mode);
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config* conf, int (*rng)(void*, unsigned char*, size_t), void* ctx);
+int  mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf);
+int  mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* host);
+void mbedtls_ssl_set_bio(mbedtls_ssl_context* ssl, void* bio, mbedtls_ssl_send_t* send,
+                         mbedtls_ssl_recv_t* recv, mbedtls_ssl_recv_timeout_t* recv_timeout);
+int  mbedtls_ssl_handshake(mbedtls_ssl_context* ssl);
+int  mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len);
+int  mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len);
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context* ssl);
+int  mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl);
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* session);
+void mbedtls_ssl_session_free(mbedtls_ssl_session* session);
+int  mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* out);
+int  mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session);
+int  mbedtls_ssl_session_save(const mbedtls_ssl_session* session, unsigned char* buf, size_t len,
+                              size_t* olen);
+int  mbedtls_ssl_session_load(mbedtls_ssl_session* session, const unsigned char* buf, size_t len);
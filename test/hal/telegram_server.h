@@ -0,0 +1,154 @@
+// In-process stand-in for api.telegram.org. The firmware's TlsClient reaches it through
+// the mbedtls shim (hal_tls.cpp): connects, handshakes, request bytes and response bytes
+// all cost virtual time according to TgServerModel, and every request is recorded with
+// its timing and size for tests and the simulator report.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace hal {
+
+struct TgServerModel {
+  bool     up = true;                  ///< false: connects time out
+  uint32_t rtt_ms = 60;
+  uint32_t full_handshake_ms = 1100;   ///< ECDHE + certificate check on the ESP32
+  uint32_t resumed_handshake_ms = 240;
+  bool     resumption = true;          ///< server accepts offered sessions
+  uint32_t uplink_kbps = 1500;         ///< device to server
+  uint32_t downlink_kbps = 8000;
+  uint32_t process_ms = 35;            ///< server time per request
+  uint32_t idle_close_ms = 0;          ///< server closes idle keep-alive connections (0 = never)
+  size_t   file_id_len = 83;           ///< length of the file_ids handed out
+  bool     photo_sizes = true;         ///< false: sendPhoto answers lack the "photo" array (no file_id)
+  enum Framing { CONTENT_LENGTH, CHUNKED, CLOSE_DELIMITED } framing = CONTENT_LENGTH;
+  size_t   chunk_size = 700;           ///< with CHUNKED
+};
+
+/** One request as the server saw it. */
+struct TgRequest {
+  int         conn;          ///< connection number, from 1
+  std::string http_method;
+  std::string api;           ///< "sendPhoto", "getUpdates", ...
+  std::map<std::string, std::string> params;  ///< query or form fields; files as "<name>#bytes"
+  size_t      bytes_in = 0;  ///< request head + body
+  size_t      bytes_out = 0; ///< response as framed on the wire
+  int64_t     t_start = 0;   ///< first request bytes reached the server
+  int64_t     t_received = 0;
+  int64_t     t_answered = 0;  ///< last response byte arrives at the device
+  int         status = 0;    ///< 0 = not answered (connection reset or still held)
+  bool        held = false;  ///< long-poll that waited for an update or its timeout
+
+  const char* param(const char* name) const {
+    auto it = params.find(name);
+    return it == params.end() ? "" : it->second.c_str();
+  }
+};
+
+/** State that outlives a device wake (the real server does not reboot with the feeder). */
+struct TgServerState {
+  long     next_update_id = 700000;
+  long     acked_update_id = 0;   ///< highest update_id confirmed by an offset
+  uint32_t next_message_id = 100;
+  uint32_t next_session = 1;
+  std::vector<uint32_t> sessions; ///< session ids the server can resume
+  std::vector<std::string> file_ids;
+};
+
+class TelegramServer {
+public:
+  TgServerModel& model() { return model_; }
+  TgServerState& state() { return state_; }
+
+  /** A message (or button press) from the configured chat, arriving at `at_us` (-1 = now). */
+  void pushUpdate(const char* text, int64_t at_us = -1, bool callback = false,
+                  const char* chat_id = nullptr);
+  /** Answer the next `api` request (any if empty) with an error instead. */
+  void failNext(const char* api, int status, uint32_t retry_after_s = 0,
+                const char* description = nullptr);
+  /** Close the connection on the next `api` request without answering. */
+  void resetNext(const char* api);
+  /** Close every open connection now, as a load balancer or NAT timeout would. */
+  void dropConnections();
+
+  const std::vector<TgRequest>& requests() const { return requests_; }
+  int      count(const char* api) const;
+  uint32_t connections() const { return connections_; }
+  uint32_t fullHandshakes() const { return full_; }
+  uint32_t resumedHandshakes() const { return resumed_; }
+  int      openConnections() const;
+  uint64_t bytesIn() const;
+  uint64_t bytesOut() const;
+  /** Updates delivered to the device but not yet confirmed by an offset. */
+  int      unackedUpdates() const;
+  /** Updates not yet delivered at all. */
+  int      pendingUpdates() const;
+
+  /** Everything a deep sleep does not clear (state(), updates not confirmed by an offset,
+   *  armed faults) as bytes, for the simulator to carry into the next wake's process. */
+  std::string save() const;
+  void        restore(const std::string& saved);
+
+  // ---- used by the mbedtls shim ----
+  /** New TCP connection; returns the device's socket or -1. Costs one RTT. */
+  int  connect();
+  /** Costs a full or an abbreviated handshake; fills `session`. */
+  bool handshake(int fd, bool offered, uint32_t offered_id, uint32_t* session_id);
+  void receive(int fd, const uint8_t* data, size_t len);
+  void clientClosed(int fd);
+
+private:
+  struct Update {
+    long        id;
+    bool        callback;
+    std::string text;
+    std::string chat_id;
+    bool        delivered = false;
+  };
+  struct Fault {
+    std::string api;
+    int         status;       ///< 0 = reset the connection
+    uint32_t    retry_after;
+    std::string description;
+  };
+  struct Conn {
+    int         id;
+    int         client_fd;
+    int         server_fd;
+    bool        open = true;
+    std::string rx;
+    std::string tx;           ///< response bytes not yet taken by the socket
+    int64_t     last_activity = 0;
+    int         held = -1;    ///< index into requests_ of a held long-poll
+    bool        close_after = false;  ///< close once tx is out (close-delimited body)
+    int         tx_req = -1;  ///< request whose response is in tx
+  };
+
+  Conn* find(int fd);
+  void  parseRequests(Conn& c);
+  void  handle(Conn& c, int req);
+  bool  answerPoll(Conn& c, int req, bool timed_out);
+  void  respond(Conn& c, int req, int status, const std::string& body, int64_t extra_delay_us = 0);
+  void  flush(int conn_id);
+  void  close(Conn& c);
+  void  armIdleClose(int conn_id);
+  void  wakeHeldPolls();
+  std::string messageJson(const TgRequest& r, uint32_t message_id);
+  std::string newFileId(const char* kind);
+
+  TgServerModel          model_;
+  TgServerState          state_;
+  std::vector<TgRequest> requests_;
+  std::vector<Update>    updates_;
+  std::vector<Fault>     faults_;
+  std::map<int, Conn>    conns_;  ///< by connection number
+  uint32_t               connections_ = 0;
+  uint32_t               full_ = 0;
+  uint32_t               resumed_ = 0;
+};
+
+TelegramServer& telegram();
+
+}  // namespace hal
@@ -0,0 +1,8 @@
+// Credentials for the host build. Nothing leaves the machine: every connection ends at the
+// in-process stand-in server, whatever TELEGRAM_HOST says.
+#pragma once
+#define WIFI_SSID       "host-ap"
+#define WIFI_PASSWORD   "host-pass"
+#define BOT_TOKEN       "123456:HOST-TEST-TOKEN"
+#define CHAT_ID         "-1001000"
+#define TELEGRAM_HOST   "stand-in.local"
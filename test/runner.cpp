@@ -0,0 +1,94 @@
+// Runs the registered cases, each in a forked child with a fresh HAL and a time limit.
+//   unit_tests [filter...]     run tests whose name contains any filter
+//   benchmarks [filter...]     same for benchmarks
+//   -v                         echo the firmware's Serial output
+#include "check.h"
+#include "hal/host.h"
+
+#include <chrono>
+#include <ftw.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace check {
+
+int failures = 0;
+
+std::vector<Case>& cases() {
+  static std::vector<Case> all;
+  return all;
+}
+
+void report(const char* name, double value, const char* unit) {
+  printf("  %-40s %12.3f %s\n", name, value, unit);
+  fflush(stdout);
+}
+
+int64_t hostNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace check
+
+#ifndef RUN_BENCHMARKS
+#define RUN_BENCHMARKS 0
+#endif
+
+static bool selected(const char* name, const std::vector<std::string>& filters) {
+  if (filters.empty()) return true;
+  for (const std::string& f : filters) {
+    if (strstr(name, f.c_str())) return true;
+  }
+  return false;
+}
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+  return remove(path);
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> filters;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-v") == 0) hal::verbose = true;
+    else filters.push_back(argv[i]);
+  }
+
+  // Card directories from hal::makeTempDir() go under one root, removed after the run.
+  char tmp_root[] = "/tmp/cf_host_XXXXXX";
+  if (mkdtemp(tmp_root)) setenv("CF_HOST_TMP", tmp_root, 1);
+
+  int run = 0, failed = 0;
+  for (const check::Case& c : check::cases()) {
+    if (c.bench != (bool)RUN_BENCHMARKS || !selected(c.name, filters)) continue;
+    run++;
+    if (c.bench) printf("%s\n", c.name);
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+      alarm(c.bench ? 300 : 30);
+      hal::reset();
+      c.fn();
+      fflush(stdout);
+      _exit(check::failures ? 1 : 0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    const bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!ok) {
+      failed++;
+      if (WIFSIGNALED(status)) {
+        printf("FAIL %s (%s)\n", c.name, strsignal(WTERMSIG(status)));
+      } else {
+        printf("FAIL %s\n", c.name);
+      }
+    } else if (!c.bench) {
+      printf("ok   %s\n", c.name);
+    }
+  }
+  if (getenv("CF_HOST_TMP")) nftw(tmp_root, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+  printf("%d/%d passed\n", run - failed, run);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,588 @@
+// Host simulator: the whole sketch, setup() from cat_feeder.ino included, through a scenario
+// of wakes against the stand-ins in hal/.
+//   simulator [-v] scenario...     -v echoes the firmware's Serial output
+//
+// Every wake runs in its own forked process, so each firmware static starts out as it does
+// after a real reset. The carry-over between wakes is what survives deep sleep on the
+// board: RTC memory (the "rtc_sim" section), the card, the RTC wall clock and the Telegram
+// server. After each wake the simulator prints the phase timeline and what every API put on
+// the wire; `expect` lines turn the run totals into a pass/fail.
+//
+// Scenario lines ('#' starts a comment, times in seconds since power-on):
+//   until <s>                         end of the run (default 3600)
+//   card on|off   psram on|off        board fit (default: both on)
+//   expect <metric> <op> <value>      checked at the end; op is one of < <= == >= >
+//   at <s> pir                        motion; wakes the board on EXT1 if it is asleep
+//   at <s> msg <text>                 a message from CHAT_ID
+//   at <s> press <data>               an inline button press
+//   at <s> fail <api> <status> [retry_after_s]
+//   at <s> reset <api>                close the connection on the next <api> request
+//   at <s> drop                       the server closes every open connection
+//   at <s> scene|link|radio <field> <value>
+// Whatever happens while the board sleeps is applied when it next wakes: messages wait at
+// the server, a fault hits the next matching request.
+#include "cat_feeder.h"
+#include "hal/host.h"
+#include "hal/telegram_server.h"
+
+#include <errno.h>
+#include <ftw.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+void setup();
+
+// Bounds of RTC_DATA_ATTR / RTC_NOINIT_ATTR memory (hal/Arduino.h), laid out by the linker.
+extern "C" char __start_rtc_sim[];
+extern "C" char __stop_rtc_sim[];
+
+namespace {
+
+const int64_t kWall0 = 1760000000LL * 1000000LL;
+
+struct Event {
+  int64_t     t_us;
+  std::string what;   ///< "pir", "msg", "press", "fail", "reset", "drop", "scene", ...
+  std::string a, b, c;
+};
+
+struct Expect {
+  std::string metric, op;
+  double      value;
+  int         line;
+};
+
+struct Scenario {
+  std::string         name;
+  int64_t             until_us = 3600LL * 1000000;
+  bool                card = true;
+  bool                psram = true;
+  std::vector<Event>  events;  ///< sorted by time, stable
+  std::vector<Expect> expects;
+};
+
+/** Persistent settings: scene, link and radio fields. False for an unknown field. */
+bool setField(const std::string& group, const std::string& field, double v, hal::Scene* scene,
+              hal::TgServerModel* link, hal::Radio* radio) {
+  if (group == "scene") {
+    if (field == "cat") scene->cat = v != 0;
+    else if (field == "cat_x") scene->cat_x = (int)v;
+    else if (field == "cat_y") scene->cat_y = (int)v;
+    else if (field == "cat_step") scene->cat_step = (int)v;
+    else if (field == "light") scene->light = (uint8_t)v;
+    else if (field == "blur") scene->blur = (uint8_t)v;
+    else if (field == "noise") scene->noise = (uint8_t)v;
+    else if (field == "detail") scene->detail = (float)v;
+    else return false;
+  } else if (group == "link") {
+    if (field == "up") link->up = v != 0;
+    else if (field == "rtt_ms") link->rtt_ms = (uint32_t)v;
+    else if (field == "full_handshake_ms") link->full_handshake_ms = (uint32_t)v;
+    else if (field == "resumed_handshake_ms") link->resumed_handshake_ms = (uint32_t)v;
+    else if (field == "resumption") link->resumption = v != 0;
+    else if (field == "uplink_kbps") link->uplink_kbps = (uint32_t)v;
+    else if (field == "downlink_kbps") link->downlink_kbps = (uint32_t)v;
+    else if (field == "process_ms") link->process_ms = (uint32_t)v;
+    else if (field == "idle_close_ms") link->idle_close_ms = (uint32_t)v;
+    else return false;
+  } else if (group == "radio") {
+    if (field == "ap_up") radio->ap_up = v != 0;
+    else if (field == "rssi") radio->rssi = (int8_t)v;
+    else if (field == "channel") radio->channel = (int32_t)v;
+    else if (field == "fast_assoc_ms") radio->fast_assoc_ms = (uint32_t)v;
+    else if (field == "scan_assoc_ms") radio->scan_assoc_ms = (uint32_t)v;
+    else if (field == "dhcp_ms") radio->dhcp_ms = (uint32_t)v;
+    else return false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool persistent(const Event& e) {
+  return e.what == "scene" || e.what == "link" || e.what == "radio";
+}
+
+/** Scenario events that happened during this wake, for the timeline. */
+std::vector<hal::Mark> g_arrivals;
+
+void apply(const Event& e) {
+  hal::TelegramServer& tg = hal::telegram();
+  if (e.what != "pir") g_arrivals.push_back(hal::Mark{ e.what + " " + e.a, hal::nowUs() });
+  if (persistent(e)) setField(e.what, e.a, atof(e.b.c_str()), &hal::scene(), &tg.model(), &hal::radio());
+  else if (e.what == "msg") tg.pushUpdate(e.a.c_str());
+  else if (e.what == "press") tg.pushUpdate(e.a.c_str(), -1, true);
+  else if (e.what == "fail") tg.failNext(e.a.c_str(), atoi(e.b.c_str()), (uint32_t)atoi(e.c.c_str()));
+  else if (e.what == "reset") tg.resetNext(e.a.c_str());
+  else if (e.what == "drop") tg.dropConnections();
+}
+
+// ---- scenario files ----
+
+bool parseError(const char* file, int line, const char* msg) {
+  fprintf(stderr, "%s:%d: %s\n", file, line, msg);
+  return false;
+}
+
+bool load(const char* file, Scenario* sc) {
+  FILE* f = fopen(file, "r");
+  if (!f) return parseError(file, 0, strerror(errno));
+  const char* slash = strrchr(file, '/');
+  sc->name = slash ? slash + 1 : file;
+  char buf[512];
+  int line = 0;
+  bool ok = true;
+  while (ok && fgets(buf, sizeof(buf), f)) {
+    line++;
+    if (char* hash = strchr(buf, '#')) *hash = 0;
+    std::vector<std::string> w;
+    std::string rest;  // the text of "msg" keeps its spaces
+    for (char* p = buf; *p;) {
+      while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+      if (!*p) break;
+      if (w.size() == 3 && w[0] == "at" && w[2] == "msg") {
+        rest = p;
+        rest.erase(rest.find_last_not_of(" \t\r\n") + 1);
+        break;
+      }
+      char* end = p;
+      while (*end && *end != ' ' && *end != '\t' && *end != '\n' && *end != '\r') end++;
+      w.emplace_back(p, end - p);
+      p = end;
+    }
+    if (w.empty()) continue;
+
+    if (w[0] == "until" && w.size() == 2) {
+      sc->until_us = (int64_t)(atof(w[1].c_str()) * 1e6);
+    } else if ((w[0] == "card" || w[0] == "psram") && w.size() == 2 && (w[1] == "on" || w[1] == "off")) {
+      (w[0] == "card" ? sc->card : sc->psram) = w[1] == "on";
+    } else if (w[0] == "expect" && w.size() == 4) {
+      static const char* ops[] = { "<", "<=", "==", ">=", ">" };
+      bool known = false;
+      for (const char* op : ops) known |= w[2] == op;
+      if (!known) ok = parseError(file, line, "expect: unknown operator");
+      sc->expects.push_back(Expect{ w[1], w[2], atof(w[3].c_str()), line });
+    } else if (w[0] == "at" && w.size() >= 3) {
+      Event e;
+      e.t_us = (int64_t)(atof(w[1].c_str()) * 1e6);
+      e.what = w[2];
+      if (e.what == "msg") {
+        e.a = rest;
+      } else {
+        if (w.size() > 3) e.a = w[3];
+        if (w.size() > 4) e.b = w[4];
+        if (w.size() > 5) e.c = w[5];
+      }
+      hal::Scene s;
+      hal::TgServerModel m;
+      hal::Radio r;
+      if (persistent(e)) {
+        if (e.b.empty() || !setField(e.what, e.a, 0, &s, &m, &r)) ok = parseError(file, line, "unknown field");
+      } else if (e.what == "msg" || e.what == "press") {
+        if (e.a.empty()) ok = parseError(file, line, "missing text");
+      } else if (e.what == "fail") {
+        if (e.b.empty()) ok = parseError(file, line, "fail <api> <status> [retry_after_s]");
+      } else if (e.what != "pir" && e.what != "reset" && e.what != "drop") {
+        ok = parseError(file, line, "unknown event");
+      }
+      sc->events.push_back(e);
+    } else {
+      ok = parseError(file, line, "cannot parse");
+    }
+  }
+  fclose(f);
+  std::stable_sort(sc->events.begin(), sc->events.end(),
+                   [](const Event& x, const Event& y) { return x.t_us < y.t_us; });
+  return ok;
+}
+
+// ---- one wake, in a child process ----
+
+struct WakeIn {
+  int                      index;  ///< from 1
+  int64_t                  at_us;  ///< since power-on
+  esp_sleep_wakeup_cause_t cause;
+  std::string              rtc;    ///< RTC memory as the previous wake left it
+  size_t                   first_event;
+};
+
+/** Fixed part of what a wake sends back; RTC memory, server state and metrics follow. */
+struct WakeOut {
+  int64_t  awake_us;
+  uint64_t timer_us;  ///< 0 = PIR only
+};
+
+const char* causeName(esp_sleep_wakeup_cause_t cause) {
+  switch (cause) {
+    case ESP_SLEEP_WAKEUP_EXT1:  return "PIR (EXT1)";
+    case ESP_SLEEP_WAKEUP_TIMER: return "timer";
+    case ESP_SLEEP_WAKEUP_EXT0:  return "EXT0";
+    default:                     return "power-on";
+  }
+}
+
+bool isImage(const hal::TgRequest& r) {
+  return r.status == 200 && (r.api == "sendPhoto" || r.api == "sendMediaGroup" || r.api == "sendVideo");
+}
+
+struct Point {
+  std::string name;
+  int64_t     t_us;
+};
+
+/** Prints the wake's report and returns its metrics as "name value" lines. */
+std::string report(const WakeIn& in, const WakeOut& out) {
+  const hal::TelegramServer& tg = hal::telegram();
+  const std::vector<hal::TgRequest>& reqs = tg.requests();
+  std::map<std::string, double> m;
+
+  // Phase boundaries: what the hardware saw, what the scenario did, and the first answers
+  // the owner would notice.
+  std::vector<Point> points;
+  for (const hal::Mark& mk : hal::marks()) {
+    points.push_back(Point{ mk.name, mk.t_us });
+    if (mk.name == "wifi_up" && !m.count("max_wifi_up_ms")) m["max_wifi_up_ms"] = mk.t_us / 1000.0;
+  }
+  for (const hal::Mark& a : g_arrivals) points.push_back(Point{ "<- " + a.name, a.t_us });
+  const hal::TgRequest* first_send = nullptr;
+  const hal::TgRequest* first_image = nullptr;
+  for (const hal::TgRequest& r : reqs) {
+    if (r.status == 200 && r.api != "getUpdates" && (!first_send || r.t_answered < first_send->t_answered)) first_send = &r;
+    if (isImage(r) && (!first_image || r.t_answered < first_image->t_answered)) first_image = &r;
+  }
+  if (first_send) {
+    points.push_back(Point{ "first_send (" + first_send->api + ")", first_send->t_answered });
+    m["max_first_send_ms"] = first_send->t_answered / 1000.0;
+  }
+  if (first_image) {
+    points.push_back(Point{ "first_image (" + first_image->api + ")", first_image->t_answered });
+    m["max_first_image_ms"] = first_image->t_answered / 1000.0;
+  }
+  std::stable_sort(points.begin(), points.end(),
+                   [](const Point& x, const Point& y) { return x.t_us < y.t_us; });
+
+  printf("== wake %d at %.3f s: %s, awake %.3f s, then sleeps until PIR", in.index,
+         in.at_us / 1e6, causeName(in.cause), out.awake_us / 1e6);
+  if (out.timer_us) printf(" or timer in %.0f s", out.timer_us / 1e6);
+  printf("\n  %-34s %9s %9s %9s %9s\n", "phase", "at ms", "+ms", "up B", "down B");
+  int64_t prev = 0;
+  for (const Point& p : points) {
+    uint64_t up = 0, down = 0;
+    for (const hal::TgRequest& r : reqs) {
+      if (r.t_start > prev && r.t_start <= p.t_us) {
+        up += r.bytes_in;
+        down += r.bytes_out;
+      }
+    }
+    printf("  %-34s %9.1f %9.1f %9llu %9llu\n", p.name.c_str(), p.t_us / 1000.0,
+           (p.t_us - prev) / 1000.0, (unsigned long long)up, (unsigned long long)down);
+    prev = p.t_us;
+  }
+
+  struct Api {
+    int      n = 0, answered = 0;
+    uint64_t up = 0, down = 0;
+    int64_t  sum_us = 0, max_us = 0;
+  };
+  std::map<std::string, Api> apis;
+  for (const hal::TgRequest& r : reqs) {
+    Api& a = apis[r.api];
+    a.n++;
+    a.up += r.bytes_in;
+    a.down += r.bytes_out;
+    if (r.status) {
+      const int64_t us = r.t_answered - r.t_start;
+      a.answered++;
+      a.sum_us += us;
+      a.max_us = std::max(a.max_us, us);
+    }
+    m["images"] += isImage(r) ? 1 : 0;
+  }
+  if (!apis.empty()) {
+    printf("  %-20s %5s %9s %9s %9s %9s\n", "api", "n", "up B", "down B", "mean ms", "max ms");
+    for (const auto& kv : apis) {
+      const Api& a = kv.second;
+      printf("  %-20s %5d %9llu %9llu %9.1f %9.1f\n", kv.first.c_str(), a.n,
+             (unsigned long long)a.up, (unsigned long long)a.down,
+             a.answered ? a.sum_us / 1000.0 / a.answered : 0.0, a.max_us / 1000.0);
+      m["n." + kv.first] = a.n;
+    }
+  }
+  printf("  tls: %u connection(s), %u full handshake(s), %u resumed; %llu B up, %llu B down\n",
+         tg.connections(), tg.fullHandshakes(), tg.resumedHandshakes(),
+         (unsigned long long)tg.bytesIn(), (unsigned long long)tg.bytesOut());
+
+  m["wakes.offline"] = m.count("max_wifi_up_ms") ? 0 : 1;
+  m["awake_ms"] = out.awake_us / 1000.0;
+  m["max_awake_ms"] = out.awake_us / 1000.0;
+  m["bytes_up"] = (double)tg.bytesIn();
+  m["bytes_down"] = (double)tg.bytesOut();
+  m["requests"] = (double)reqs.size();
+  m["connections"] = tg.connections();
+  m["full_handshakes"] = tg.fullHandshakes();
+  m["resumed_handshakes"] = tg.resumedHandshakes();
+  std::string lines;
+  char buf[160];
+  for (const auto& kv : m) {
+    snprintf(buf, sizeof(buf), "%s %.3f\n", kv.first.c_str(), kv.second);
+    lines += buf;
+  }
+  return lines;
+}
+
+bool writeAll(int fd, const void* data, size_t len) {
+  const char* p = (const char*)data;
+  while (len > 0) {
+    const ssize_t n = write(fd, p, len);
+    if (n <= 0) return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+bool writeBlob(int fd, const std::string& s) {
+  const uint64_t n = s.size();
+  return writeAll(fd, &n, sizeof(n)) && writeAll(fd, s.data(), s.size());
+}
+
+bool readAll(int fd, void* data, size_t len) {
+  char* p = (char*)data;
+  while (len > 0) {
+    const ssize_t n = read(fd, p, len);
+    if (n <= 0) return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+bool readBlob(int fd, std::string* s) {
+  uint64_t n = 0;
+  if (!readAll(fd, &n, sizeof(n)) || n > (64u << 20)) return false;
+  s->resize(n);
+  return readAll(fd, &(*s)[0], n);
+}
+
+[[noreturn]] void runWake(const Scenario& sc, const WakeIn& in, int fd) {
+  alarm(300);
+  hal::reset(kWall0 + in.at_us);
+  memcpy(__start_rtc_sim, in.rtc.data(), in.rtc.size());
+  hal::setWakeCause(in.cause);
+  g_arrivals.clear();
+  // Anything from the sleep happens now; the rest at its time, should the wake last that long.
+  for (size_t i = in.first_event; i < sc.events.size(); ++i) {
+    const Event& e = sc.events[i];
+    if (e.what == "pir") continue;
+    if (e.t_us <= in.at_us) {
+      apply(e);
+    } else {
+      hal::at(e.t_us - in.at_us, [&e] { apply(e); });
+    }
+  }
+
+  WakeOut out = {};
+  try {
+    setup();
+    fprintf(stderr, "wake %d: setup() returned without going to sleep\n", in.index);
+    _exit(2);
+  } catch (const hal::DeepSleep& s) {
+    out.awake_us = hal::nowUs();
+    out.timer_us = s.timer_us;
+  }
+  const std::string metrics = report(in, out);
+  fflush(stdout);
+  const bool sent = writeAll(fd, &out, sizeof(out)) &&
+                    writeBlob(fd, std::string(__start_rtc_sim, __stop_rtc_sim - __start_rtc_sim)) &&
+                    writeBlob(fd, hal::telegram().save()) && writeBlob(fd, metrics);
+  _exit(sent ? 0 : 2);
+}
+
+// ---- the run ----
+
+int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+  return remove(path);
+}
+
+void merge(const std::string& lines, std::map<std::string, double>* totals) {
+  size_t pos = 0;
+  while (pos < lines.size()) {
+    const size_t nl = lines.find('\n', pos);
+    const std::string l = lines.substr(pos, nl - pos);
+    pos = nl == std::string::npos ? lines.size() : nl + 1;
+    const size_t sp = l.find(' ');
+    if (sp == std::string::npos) continue;
+    const std::string name = l.substr(0, sp);
+    const double v = atof(l.c_str() + sp + 1);
+    if (name.compare(0, 4, "max_") == 0) {
+      auto it = totals->find(name);
+      (*totals)[name] = it == totals->end() ? v : std::max(it->second, v);
+    } else {
+      (*totals)[name] += v;
+    }
+  }
+}
+
+bool holds(double actual, const std::string& op, double want) {
+  if (op == "<") return actual < want;
+  if (op == "<=") return actual <= want;
+  if (op == "==") return actual == want;
+  if (op == ">=") return actual >= want;
+  return actual > want;
+}
+
+/** Runs one scenario; 0 if every wake slept normally and every expectation held. */
+int runScenario(const Scenario& sc) {
+  char card[] = "/tmp/cf_sim_XXXXXX";
+  if (sc.card && !mkdtemp(card)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  hal::sdSetRoot(sc.card ? card : "");
+  hal::psram = sc.psram;
+
+  std::map<std::string, double> totals;
+  WakeIn in;
+  in.index = 1;
+  in.at_us = 0;
+  in.cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+  in.rtc.assign(__start_rtc_sim, __stop_rtc_sim - __start_rtc_sim);  // as after power-on
+  in.first_event = 0;
+  int failed = 0;
+
+  printf("### %s: %zu event(s) over %.0f s\n", sc.name.c_str(), sc.events.size(), sc.until_us / 1e6);
+  for (;;) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      perror("pipe");
+      failed = 1;
+      break;
+    }
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      runWake(sc, in, fds[1]);
+    }
+    close(fds[1]);
+    WakeOut out = {};
+    std::string rtc, server, metrics;
+    const bool got = readAll(fds[0], &out, sizeof(out)) && readBlob(fds[0], &rtc) &&
+                     readBlob(fds[0], &server) && readBlob(fds[0], &metrics);
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!got || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("FAIL wake %d at %.3f s did not reach deep sleep (%s)\n", in.index, in.at_us / 1e6,
+             WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "exited");
+      failed = 1;
+      break;
+    }
+    merge(metrics, &totals);
+    totals["wakes"] += 1;
+    totals[in.cause == ESP_SLEEP_WAKEUP_EXT1 ? "wakes.pir"
+           : in.cause == ESP_SLEEP_WAKEUP_TIMER ? "wakes.timer" : "wakes.power_on"] += 1;
+
+    // Bring this process up to the moment the board fell asleep.
+    const int64_t asleep = in.at_us + out.awake_us;
+    size_t next = in.first_event;
+    for (; next < sc.events.size() && sc.events[next].t_us < asleep; ++next) {
+      const Event& e = sc.events[next];
+      if (persistent(e)) apply(e);
+      if (e.what == "pir" && e.t_us > in.at_us) {
+        printf("  motion at %.3f s while awake: no wake\n", e.t_us / 1e6);
+      }
+    }
+    hal::telegram().restore(server);
+
+    // The next wake: motion, or the timer the firmware armed, whichever comes first.
+    int64_t wake = INT64_MAX;
+    esp_sleep_wakeup_cause_t cause = ESP_SLEEP_WAKEUP_TIMER;
+    if (out.timer_us) wake = asleep + (int64_t)out.timer_us;
+    for (size_t i = next; i < sc.events.size(); ++i) {
+      if (sc.events[i].what == "pir") {
+        if (sc.events[i].t_us < wake) {
+          wake = sc.events[i].t_us;
+          cause = ESP_SLEEP_WAKEUP_EXT1;
+        }
+        break;
+      }
+    }
+    if (wake > sc.until_us) break;
+    // Settings changed during the sleep are the hardware's; messages and faults wait at the
+    // server, so the next wake replays those from `first` on.
+    const size_t first = next;
+    for (; next < sc.events.size() && sc.events[next].t_us <= wake; ++next) {
+      if (persistent(sc.events[next])) apply(sc.events[next]);
+    }
+    in.index++;
+    in.at_us = wake;
+    in.cause = cause;
+    in.rtc = rtc;
+    in.first_event = first;
+  }
+
+  const double pending = hal::telegram().pendingUpdates() + hal::telegram().unackedUpdates();
+  totals["unconfirmed_updates"] = pending;
+  printf("### %s: %.0f wake(s), awake %.1f s of %.0f s, %.0f B up, %.0f B down\n", sc.name.c_str(),
+         totals["wakes"], totals["awake_ms"] / 1000, sc.until_us / 1e6, totals["bytes_up"],
+         totals["bytes_down"]);
+  for (const auto& kv : totals) printf("  %-28s %12.1f\n", kv.first.c_str(), kv.second);
+  for (const Expect& x : sc.expects) {
+    auto it = totals.find(x.metric);
+    const bool seen = it != totals.end() || (x.metric.compare(0, 4, "max_") != 0);
+    const double actual = it == totals.end() ? 0 : it->second;
+    const bool ok = seen && holds(actual, x.op, x.value);
+    if (seen) {
+      printf("%s expect %s %s %g (%.1f)\n", ok ? "ok  " : "FAIL", x.metric.c_str(), x.op.c_str(),
+             x.value, actual);
+    } else {
+      printf("FAIL expect %s %s %g (never observed)\n", x.metric.c_str(), x.op.c_str(), x.value);
+    }
+    failed |= ok ? 0 : 1;
+  }
+  if (sc.card) nftw(card, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+  fflush(stdout);
+  return failed;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-v") == 0) hal::verbose = true;
+    else files.push_back(argv[i]);
+  }
+  if (files.empty()) {
+    fprintf(stderr, "usage: %s [-v] scenario...\n", argv[0]);
+    return 2;
+  }
+  int run = 0, failed = 0;
+  for (const char* file : files) {
+    Scenario sc;
+    run++;
+    if (!load(file, &sc)) {
+      failed++;
+      continue;
+    }
+    // Scenarios leave settings behind in this process; each gets its own.
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) _exit(runScenario(sc));
+    int status = 0;
+    waitpid(pid, &status, 0);
+    failed += (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : 1;
+  }
+  printf("%d/%d scenarios passed\n", run - failed, run);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+// Burst capture: sharpness scoring, best-frame choice, frame buffers under full load.
+#include "fixtures.h"
+
+#include <stdlib.h>
+
+using hal::telegram;
+
+namespace {
+
+const size_t kScratch = (size_t)((800 + 7) / 8) * ((600 + 7) / 8) * 2;
+
+uint32_t scoreScene(uint8_t blur, uint8_t light) {
+  hal::scene().blur = blur;
+  hal::scene().light = light;
+  std::vector<uint8_t> scratch(kScratch);
+  camera_fb_t* fb = esp_camera_fb_get();
+  uint32_t score = 0;
+  CHECK(fb && frameSharpness(fb, scratch.data(), scratch.size(), &score));
+  if (fb) esp_camera_fb_return(fb);
+  return score;
+}
+
+// Byte size the burst log gave frame `i`, or 0.
+long burstFrameBytes(int i) {
+  const std::string key = "frame " + std::to_string(i) + ": ";
+  const size_t at = hal::serialLog().find(key);
+  return at == std::string::npos ? 0 : atol(hal::serialLog().c_str() + at + key.size());
+}
+
+}  // namespace
+
+TEST(blur_lowers_the_score) {
+  CHECK(initCamera());
+  const uint32_t sharp = scoreScene(0, 120);
+  const uint32_t soft = scoreScene(4, 120);
+  const uint32_t mush = scoreScene(12, 120);
+  CHECK(sharp > 2 * soft);
+  CHECK(soft > mush);
+}
+
+TEST(bad_exposure_lowers_the_score) {
+  CHECK(initCamera());
+  const uint32_t good = scoreScene(0, 120);
+  CHECK(scoreScene(0, 25) < good / 2);
+  CHECK(scoreScene(0, 235) < good / 2);
+}
+
+TEST(flat_and_tiny_planes_score_zero) {
+  std::vector<uint8_t> flat(100 * 75, 128);
+  CHECK_EQ(scoreSharpness(flat.data(), 100, 75), 0u);
+  CHECK_EQ(scoreSharpness(flat.data(), 2, 75), 0u);
+}
+
+TEST(burst_uploads_the_sharpest_frame) {
+  // Only the third frame of the burst is in focus; sizes differ so the upload identifies it.
+  // Render 0 is the frame already in the ring, older than the request, which
+  // grabFreshFrame() hands back, so burst frame i is render i + 1.
+  int n = 0;
+  hal::beforeFrame = [&n](hal::Scene& s) {
+    s.blur = (n == 3) ? 0 : 6;
+    s.detail = 1.0f + 0.05f * n;
+    ++n;
+  };
+  CHECK(initCamera() && bootOnline());
+  CHECK(takeAndSendBestOfBurst(4, "burst"));
+  CHECK_EQ(n, 5);
+  CHECK_EQ(telegram().count("sendPhoto"), 1);
+  CHECK(burstFrameBytes(2) > 0);
+  CHECK_EQ(atol(telegram().requests().back().param("photo#bytes")), burstFrameBytes(2));
+  CHECK_EQ(hal::framesOut(), 0);
+}
+
+TEST(burst_gets_its_frames_while_every_other_holder_is_full) {
+  // Live stream holds a frame, the uploader has one on the air and a full queue behind it.
+  telegram().model().uplink_kbps = 50;
+  CHECK(initCamera() && bootOnline() && startPhotoPipeline());
+  camera_fb_t* live = esp_camera_fb_get();
+  CHECK(live != nullptr);
+  for (int i = 0; i < PHOTO_QUEUE_DEPTH + 1; ++i) CHECK(takeAndSendPhoto("q"));
+  CHECK_EQ(hal::framesOut(), PHOTO_QUEUE_DEPTH + 2);
+
+  takeAndSendBestOfBurst(BURST_FRAMES, "burst");
+  CHECK(!logged("Failed to get the frame on time"));
+  CHECK(logged("frame 3: "));
+  CHECK(logged("Burst done"));
+
+  esp_camera_fb_return(live);
+  CHECK(drainPhotoPipeline(600000));
+  CHECK_EQ(hal::framesOut(), 0);
+}
+
+TEST(burst_without_psram_falls_back_to_one_frame) {
+  hal::psram = false;
+  CHECK(initCamera() && bootOnline());
+  CHECK(takeAndSendBestOfBurst(4, "burst"));
+  CHECK(!logged("Burst of"));
+  CHECK_EQ(telegram().count("sendPhoto"), 1);
+}
@@ -0,0 +1,180 @@
+// Motion clips: the AVI header layout, a recorded file walked chunk by chunk, and the
+// clip job on the upload task while the command loop keeps polling.
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using hal::TgRequest;
+using hal::telegram;
+
+namespace {
+
+uint32_t le32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint16_t le16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+bool fourcc(const uint8_t* p, const char* cc) {
+  return memcmp(p, cc, 4) == 0;
+}
+
+std::vector<uint8_t> readFile(const std::string& path) {
+  std::vector<uint8_t> v;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return v;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) v.insert(v.end(), buf, buf + n);
+  fclose(f);
+  return v;
+}
+
+const TgRequest* lastRequest(const char* api) {
+  const TgRequest* found = nullptr;
+  for (const TgRequest& r : telegram().requests()) {
+    if (r.api == api) found = &r;
+  }
+  return found;
+}
+
+}  // namespace
+
+TEST(avi_header_fields_sit_at_their_offsets) {
+  AviInfo info = {};
+  info.width = 640;
+  info.height = 480;
+  info.frames = 37;
+  info.us_per_frame = 83333;
+  info.max_frame_bytes = 23001;
+  info.movi_bytes = 500002;
+  uint8_t h[AVI_HEADER_SIZE];
+  aviWriteHeader(h, info);
+
+  const uint32_t idx_bytes = 8 + 16 * info.frames;
+  CHECK(fourcc(h + 0, "RIFF") && fourcc(h + 8, "AVI "));
+  CHECK_EQ(le32(h + 4), AVI_HEADER_SIZE - 8 + info.movi_bytes + idx_bytes);
+  // Every list and chunk ends exactly where the next one starts.
+  CHECK(fourcc(h + 12, "LIST") && fourcc(h + 20, "hdrl"));
+  CHECK_EQ(20 + le32(h + 16), 212u);
+  CHECK(fourcc(h + 24, "avih"));
+  CHECK_EQ(32 + le32(h + 28), 88u);
+  CHECK(fourcc(h + 88, "LIST") && fourcc(h + 96, "strl"));
+  CHECK_EQ(96 + le32(h + 92), 212u);
+  CHECK(fourcc(h + 100, "strh"));
+  CHECK_EQ(108 + le32(h + 104), 164u);
+  CHECK(fourcc(h + 164, "strf"));
+  CHECK_EQ(172 + le32(h + 168), 212u);
+  CHECK(fourcc(h + 212, "LIST") && fourcc(h + 220, "movi"));
+  CHECK_EQ(le32(h + 216), 4 + info.movi_bytes);
+
+  // avih
+  CHECK_EQ(le32(h + 32), info.us_per_frame);
+  CHECK_EQ(le32(h + 44), 0x10u);
+  CHECK_EQ(le32(h + 48), info.frames);
+  CHECK_EQ(le32(h + 56), 1u);
+  CHECK_EQ(le32(h + 60), info.max_frame_bytes);
+  CHECK_EQ(le32(h + 64), 640u);
+  CHECK_EQ(le32(h + 68), 480u);
+  // strh: MJPG video at dwRate / dwScale frames per second
+  CHECK(fourcc(h + 108, "vids") && fourcc(h + 112, "MJPG"));
+  CHECK_EQ(le32(h + 128), info.us_per_frame);
+  CHECK_EQ(le32(h + 132), 1000000u);
+  CHECK_EQ(le32(h + 140), info.frames);
+  CHECK_EQ(le16(h + 160), 640);
+  CHECK_EQ(le16(h + 162), 480);
+  // strf: BITMAPINFOHEADER
+  CHECK_EQ(le32(h + 172), 40u);
+  CHECK_EQ(le32(h + 176), 640u);
+  CHECK_EQ(le32(h + 180), 480u);
+  CHECK(fourcc(h + 188, "MJPG"));
+  CHECK_EQ(le32(h + 192), 640u * 480u * 3u);
+}
+
+TEST(recorded_clip_walks_as_an_avi) {
+  // No PSRAM: the clip goes to the card, where the test can read it back.
+  hal::psram = false;
+  const std::string dir = hal::makeTempDir();
+  hal::sdSetRoot(dir);
+  journalBegin();
+  CHECK(initCamera());
+  CHECK(clipRecord(1000));
+  CHECK(clipStats.on_sd);
+  const std::vector<uint8_t> f = readFile(dir + CLIP_PATH);
+  CHECK_EQ(f.size(), (size_t)clipStats.bytes);
+  if (f.size() < AVI_HEADER_SIZE) return;
+  const uint8_t* h = f.data();
+  CHECK_EQ(le32(h + 4) + 8, (uint32_t)f.size());
+  CHECK_EQ(le32(h + 48), clipStats.frames);
+  CHECK(clipStats.frames >= 5);
+
+  // idx1 follows the movi list; each entry points at a "00dc" chunk holding a JPEG.
+  const size_t idx = 220 + le32(h + 216);
+  CHECK(idx + 8 <= f.size() && fourcc(h + idx, "idx1"));
+  if (idx + 8 > f.size()) return;
+  CHECK_EQ(le32(h + idx + 4), 16 * clipStats.frames);
+  uint32_t max_frame = 0;
+  size_t expect_pos = AVI_HEADER_SIZE;
+  for (uint32_t i = 0; i < clipStats.frames; ++i) {
+    const uint8_t* e = h + idx + 8 + 16 * i;
+    const size_t pos = 220 + le32(e + 8);
+    const uint32_t size = le32(e + 12);
+    CHECK(fourcc(e, "00dc"));
+    CHECK_EQ(pos, expect_pos);
+    CHECK(fourcc(h + pos, "00dc"));
+    CHECK_EQ(le32(h + pos + 4), size);
+    CHECK(h[pos + 8] == 0xFF && h[pos + 9] == 0xD8);
+    expect_pos = pos + 8 + size + (size & 1);
+    if (size > max_frame) max_frame = size;
+  }
+  CHECK_EQ(expect_pos, idx);
+  CHECK_EQ(le32(h + 60), max_frame);
+  // The measured frame period, not a nominal one.
+  const uint32_t us = le32(h + 32);
+  CHECK(us > 0 && us * (clipStats.frames - 1) <= clipStats.record_ms * 1000);
+  clipDiscard();
+  CHECK(readFile(dir + CLIP_PATH).empty());
+}
+
+TEST(clip_job_leaves_the_command_loop_polling) {
+  CHECK(initCamera() && bootOnline() && startPhotoPipeline());
+  const int64_t t0 = hal::nowUs();
+  CHECK(clipRecordAndSend("🎬 Motion clip"));
+  CHECK(hal::nowUs() - t0 < 50000);
+  telegram().pushUpdate("/stats", t0 + 500000);
+  CHECK(pollTelegram(millis() + 30000));
+  CHECK(logged("Update 700000: /stats"));
+  CHECK(drainPhotoPipeline(60000));
+  CHECK_EQ(photoStats.queued, 1u);
+  CHECK_EQ(photoStats.uploaded, 1u);
+  CHECK(logged("[TG] Clip sent."));
+
+  const TgRequest* video = lastRequest("sendVideo");
+  const TgRequest* reply = lastRequest("sendMessage");
+  CHECK(video != nullptr && reply != nullptr);
+  if (!video || !reply) return;
+  CHECK_EQ(std::string(video->param("video#bytes")), std::to_string(clipStats.bytes));
+  CHECK_EQ(std::string(video->param("caption")), std::string("🎬 Motion clip"));
+  // /stats was answered while the clip was still being recorded.
+  CHECK(reply->t_answered < t0 + (int64_t)CLIP_SECONDS * 1000000);
+  CHECK(reply->t_answered < video->t_start);
+}
+
+TEST(photo_during_a_clip_keeps_the_clip_settings_and_does_not_wait) {
+  CHECK(initCamera() && bootOnline() && startPhotoPipeline());
+  CHECK(clipRecordAndSend("clip"));
+  delay(200);  // the upload task is recording now
+  const uint32_t t0 = millis();
+  CHECK(takeAndSendPhoto("during"));
+  // The loop was back well before the recording could have ended.
+  CHECK(millis() - t0 < 1000);
+  CHECK(logged("[ADAPT] Clip recording, keeping the current rung"));
+  CHECK(drainPhotoPipeline(60000));
+  CHECK_EQ(photoStats.uploaded, 2u);
+  CHECK_EQ(telegram().count("sendVideo"), 1);
+  CHECK_EQ(telegram().count("sendPhoto"), 1);
+}
@@ -0,0 +1,117 @@
+// Multi-chat delivery, built with two EXTRA_CHAT_IDS (see the Makefile): one upload to
+// CHAT_ID, the extra chats by file_id, per-chat counters and the bytes that saved.
+#include "fixtures.h"
+
+#include <string>
+#include <vector>
+
+using hal::TgRequest;
+using hal::telegram;
+
+namespace {
+
+std::vector<uint8_t> jpeg(size_t len) {
+  std::vector<uint8_t> v(len, 0x55);
+  v[0] = 0xFF;
+  v[1] = 0xD8;
+  return v;
+}
+
+std::vector<const TgRequest*> photos() {
+  std::vector<const TgRequest*> out;
+  for (const TgRequest& r : telegram().requests()) {
+    if (r.api == "sendPhoto") out.push_back(&r);
+  }
+  return out;
+}
+
+// Arms `status` for the first forward, once the upload before it has been answered.
+void failFirstForward(void* status) {
+  hal::waitUntil([] { return !photos().empty() && photos()[0]->status != 0; }, hal::kForever);
+  telegram().failNext("sendPhoto", *(int*)status, 0, "Forbidden: bot was kicked from the group chat");
+  vTaskDelete(nullptr);
+}
+
+}  // namespace
+
+TEST(photo_is_uploaded_once_and_forwarded_by_file_id) {
+  CHECK_EQ(extraChatCount(), 2);
+  CHECK(bootOnline());
+  const std::vector<uint8_t> jpg = jpeg(20000);
+  CHECK(telegramSendPhoto(jpg.data(), jpg.size(), "look"));
+
+  const std::vector<const TgRequest*> sent = photos();
+  CHECK_EQ(sent.size(), 3u);
+  if (sent.size() != 3) return;
+  CHECK_EQ(sent[0]->http_method, std::string("POST"));
+  CHECK_STREQ(sent[0]->param("chat_id"), CHAT_ID);
+  CHECK_STREQ(sent[0]->param("photo#bytes"), "20000");
+  const char* chats[] = { "-1002000", "3000" };
+  for (int i = 1; i <= 2; ++i) {
+    CHECK_EQ(sent[i]->http_method, std::string("GET"));
+    CHECK_STREQ(sent[i]->param("chat_id"), chats[i - 1]);
+    CHECK_EQ(sent[i]->params.count("photo#bytes"), 0u);
+    CHECK_STREQ(sent[i]->param("caption"), "look");
+    CHECK_EQ(sent[i]->status, 200);  // the server only knows the file_ids it handed out
+    CHECK(sent[i]->bytes_in < 1000);
+  }
+  CHECK_EQ(std::string(sent[1]->param("photo")), std::string(sent[2]->param("photo")));
+  bool known = false;
+  for (const std::string& id : telegram().state().file_ids) known |= id == sent[1]->param("photo");
+  CHECK(known);
+
+  for (uint8_t i = 0; i <= 2; ++i) {
+    CHECK_EQ(recipientStats(i).ok, 1u);
+    CHECK_EQ(recipientStats(i).failed, 0u);
+  }
+  CHECK_EQ(fanoutStats.uploads, 1u);
+  CHECK_EQ(fanoutStats.forwards, 2u);
+  CHECK_EQ(fanoutStats.upload_bytes, (uint32_t)sent[0]->bytes_in);
+  CHECK_EQ(fanoutStats.forward_bytes, (uint32_t)(sent[1]->bytes_in + sent[2]->bytes_in));
+  CHECK_EQ(fanoutStats.bytes_saved,
+           (uint32_t)(2 * sent[0]->bytes_in - sent[1]->bytes_in - sent[2]->bytes_in));
+}
+
+TEST(failed_forward_is_counted_for_its_chat_only) {
+  CHECK(bootOnline());
+  static int status = 403;
+  CHECK(xTaskCreatePinnedToCore(failFirstForward, "fault", 4096, &status, 1, nullptr, 0) == pdPASS);
+  const std::vector<uint8_t> jpg = jpeg(20000);
+  CHECK(telegramSendPhoto(jpg.data(), jpg.size(), "look"));
+
+  const std::vector<const TgRequest*> sent = photos();
+  CHECK_EQ(sent.size(), 3u);
+  if (sent.size() != 3) return;
+  CHECK_EQ(sent[1]->status, 403);
+  CHECK_EQ(sent[2]->status, 200);
+  CHECK_EQ(recipientStats(0).ok, 1u);
+  CHECK_EQ(recipientStats(1).ok, 0u);
+  CHECK_EQ(recipientStats(1).failed, 1u);
+  CHECK_EQ(recipientStats(2).ok, 1u);
+  CHECK(logged("Photo to extra chat 1 failed"));
+  CHECK_EQ(fanoutStats.forwards, 1u);
+  CHECK_EQ(fanoutStats.bytes_saved, (uint32_t)(sent[0]->bytes_in - sent[2]->bytes_in));
+}
+
+TEST(answer_without_file_id_falls_back_to_full_uploads) {
+  telegram().model().photo_sizes = false;
+  CHECK(bootOnline());
+  const std::vector<uint8_t> jpg = jpeg(20000);
+  CHECK(telegramSendPhoto(jpg.data(), jpg.size(), "look"));
+
+  const std::vector<const TgRequest*> sent = photos();
+  CHECK_EQ(sent.size(), 3u);
+  if (sent.size() != 3) return;
+  const char* chats[] = { CHAT_ID, "-1002000", "3000" };
+  for (int i = 0; i < 3; ++i) {
+    CHECK_EQ(sent[i]->http_method, std::string("POST"));
+    CHECK_STREQ(sent[i]->param("chat_id"), chats[i]);
+    CHECK_STREQ(sent[i]->param("photo#bytes"), "20000");
+    CHECK_EQ(sent[i]->status, 200);
+    CHECK_EQ(recipientStats((uint8_t)i).ok, 1u);
+  }
+  // Nothing went by file_id, so nothing was saved.
+  CHECK_EQ(fanoutStats.uploads, 0u);
+  CHECK_EQ(fanoutStats.forwards, 0u);
+  CHECK_EQ(fanoutStats.bytes_saved, 0u);
+}
@@ -0,0 +1,161 @@
+// Feeder servo: the dispense profile, the LEDC output it produces, and timer jitter.
+#include "fixtures.h"
+
+#include <stdlib.h>
+#include <vector>
+
+namespace {
+
+const FeedProfile kProfile = { SERVO_STOP_US, FEED_RUN_US, FEED_RAMP_MS, FEED_HOLD_MS, FEED_BRAKE_MS };
+
+struct Pulse {
+  int64_t  t_us;
+  uint32_t duty;
+};
+
+// Every duty the servo channel was given, with the virtual time it happened.
+std::vector<Pulse>& recordServo() {
+  static std::vector<Pulse> pulses;
+  pulses.clear();
+  hal::onLedcUpdate = [](int channel, uint32_t duty) {
+    if (channel == 1) pulses.push_back(Pulse{ hal::nowUs(), duty });
+  };
+  return pulses;
+}
+
+uint32_t dutyToUs(uint32_t duty) {
+  return (uint32_t)(((uint64_t)duty * SERVO_PERIOD_US + 0xFFFF / 2) / 0xFFFF);
+}
+
+// Runs the main loop's share until the cycle ends.
+void feedToTheEnd() {
+  while (feederBusy()) {
+    serviceFeeder();
+    delay(20);
+  }
+  serviceFeeder();
+}
+
+// "timer jitter avg A us, max M us" from the report line.
+bool jitterReport(long* avg, long* max_us) {
+  const size_t at = hal::serialLog().find("timer jitter avg ");
+  if (at == std::string::npos) return false;
+  const char* p = hal::serialLog().c_str() + at + strlen("timer jitter avg ");
+  *avg = strtol(p, (char**)&p, 10);
+  p = strstr(p, "max ");
+  *max_us = p ? atol(p + 4) : -1;
+  return p != nullptr;
+}
+
+}  // namespace
+
+TEST(profile_endpoints) {
+  const uint32_t ramp = FEED_RAMP_MS, hold = FEED_HOLD_MS;
+  CHECK_EQ(feedProfileDurationMs(kProfile), 2 * ramp + hold + FEED_BRAKE_MS);
+  CHECK_EQ(feedProfilePulseUs(kProfile, 0), SERVO_STOP_US);
+  CHECK_EQ(feedProfilePulseUs(kProfile, ramp / 2), (SERVO_STOP_US + FEED_RUN_US) / 2);
+  CHECK_EQ(feedProfilePulseUs(kProfile, ramp), FEED_RUN_US);
+  CHECK_EQ(feedProfilePulseUs(kProfile, ramp + hold - 1), FEED_RUN_US);
+  CHECK_EQ(feedProfilePulseUs(kProfile, ramp + hold), FEED_RUN_US);
+  CHECK_EQ(feedProfilePulseUs(kProfile, ramp + hold + ramp / 2), (SERVO_STOP_US + FEED_RUN_US) / 2);
+  CHECK_EQ(feedProfilePulseUs(kProfile, 2 * ramp + hold), SERVO_STOP_US);
+  CHECK_EQ(feedProfilePulseUs(kProfile, feedProfileDurationMs(kProfile) - 1), SERVO_STOP_US);
+  CHECK_EQ(feedProfilePulseUs(kProfile, feedProfileDurationMs(kProfile)), 0);
+  CHECK_EQ(feedProfilePulseUs(kProfile, 0xFFFFFFFFu), 0);
+}
+
+TEST(profile_ramps_are_monotonic_and_never_overshoot) {
+  uint16_t last = SERVO_STOP_US;
+  for (uint32_t t = 0; t <= FEED_RAMP_MS; ++t) {
+    const uint16_t p = feedProfilePulseUs(kProfile, t);
+    CHECK(p >= last && p <= FEED_RUN_US);
+    last = p;
+  }
+  for (uint32_t t = FEED_RAMP_MS + FEED_HOLD_MS; t <= 2 * FEED_RAMP_MS + FEED_HOLD_MS; ++t) {
+    const uint16_t p = feedProfilePulseUs(kProfile, t);
+    CHECK(p <= last && p >= SERVO_STOP_US);
+    last = p;
+  }
+}
+
+TEST(profile_reversed_and_without_ramps) {
+  // Running backwards (pulse below stop) ramps down instead of up.
+  const FeedProfile back = { 1500, 1100, 100, 200, 50 };
+  CHECK_EQ(feedProfilePulseUs(back, 50), 1300);
+  CHECK_EQ(feedProfilePulseUs(back, 100), 1100);
+  CHECK_EQ(feedProfilePulseUs(back, 350), 1300);
+  // No ramps: straight to speed and straight back to stop, no division by zero.
+  const FeedProfile step = { 1500, 1900, 0, 200, 50 };
+  CHECK_EQ(feedProfileDurationMs(step), 250u);
+  CHECK_EQ(feedProfilePulseUs(step, 0), 1900);
+  CHECK_EQ(feedProfilePulseUs(step, 199), 1900);
+  CHECK_EQ(feedProfilePulseUs(step, 200), 1500);
+  CHECK_EQ(feedProfilePulseUs(step, 250), 0);
+}
+
+TEST(servo_output_follows_the_profile_each_frame) {
+  std::vector<Pulse>& pulses = recordServo();
+  const int64_t t0 = hal::nowUs();
+  CHECK(startFeed());
+  // Starting costs nothing: the timer does the rest.
+  CHECK(hal::nowUs() - t0 < 1000);
+  CHECK(feederBusy());
+  CHECK(!startFeed());
+  feedToTheEnd();
+
+  const uint32_t frames = feedProfileDurationMs(kProfile) * 1000 / SERVO_PERIOD_US;
+  CHECK(pulses.size() >= frames);
+  CHECK(pulses.size() <= frames + 2);
+  CHECK_EQ(dutyToUs(pulses.front().duty), (uint32_t)SERVO_STOP_US);
+  // The output is released (duty 0) once the brake phase is over, not before.
+  CHECK_EQ(pulses.back().duty, 0u);
+  CHECK(pulses.back().t_us - t0 >= (int64_t)feedProfileDurationMs(kProfile) * 1000);
+  CHECK(pulses.back().t_us - t0 < (int64_t)feedProfileDurationMs(kProfile) * 1000 + SERVO_PERIOD_US);
+  for (size_t i = 1; i + 1 < pulses.size(); ++i) {
+    const uint32_t t_ms = (uint32_t)((pulses[i].t_us - t0) / 1000);
+    const long want = feedProfilePulseUs(kProfile, t_ms);
+    CHECK(labs((long)dutyToUs(pulses[i].duty) - want) <= 1);
+  }
+  CHECK(logged("timer jitter avg 0 us, max 0 us"));
+}
+
+TEST(timer_jitter_is_measured) {
+  hal::timerJitterUs = 3000;
+  std::vector<Pulse>& pulses = recordServo();
+  CHECK(startFeed());
+  feedToTheEnd();
+  long avg = -1, max_us = -1;
+  CHECK(jitterReport(&avg, &max_us));
+  // Measured from the pulse times independently of the firmware's own numbers.
+  long worst = 0, sum = 0, n = 0;
+  for (size_t i = 2; i + 1 < pulses.size(); ++i) {
+    const long err = labs((long)(pulses[i].t_us - pulses[i - 1].t_us) - SERVO_PERIOD_US);
+    worst = err > worst ? err : worst;
+    sum += err;
+    ++n;
+  }
+  CHECK(max_us > 0 && max_us <= 3000);
+  CHECK_EQ(max_us, worst);
+  CHECK(n > 0 && labs(avg - sum / n) <= 50);
+  // Late callbacks never shift the profile: the pulse is taken from the time since start.
+  CHECK_EQ(pulses.back().duty, 0u);
+}
+
+TEST(dispense_does_not_block_polling_and_snaps_midway) {
+  CHECK(initCamera() && bootOnline());
+  const int64_t t0 = hal::nowUs();
+  CHECK(startFeed());
+  hal::telegram().pushUpdate("/stats", hal::nowUs() + 400000);
+  CHECK(pollTelegram(millis() + 30000));
+  CHECK(feederBusy());  // the command was answered while the servo was still running
+  CHECK(logged("Update 700000: /stats"));
+  feedToTheEnd();
+  CHECK_EQ(hal::telegram().count("sendPhoto"), 1);
+  for (const hal::TgRequest& r : hal::telegram().requests()) {
+    if (r.api != "sendPhoto") continue;
+    CHECK(strstr(r.param("caption"), "Dispensing") != nullptr);
+    // Asked for halfway through the hold phase; it reaches the server before the ramp down ends.
+    CHECK(r.t_start - t0 >= (int64_t)(FEED_RAMP_MS + FEED_HOLD_MS / 2) * 1000);
+    CHECK(r.t_start - t0 < (int64_t)feedProfileDurationMs(kProfile) * 1000);
+  }
+}
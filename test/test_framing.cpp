@@ -0,0 +1,173 @@
+// Response framing and typed results: Content-Length, chunked, close-delimited, errors.
+#include "fixtures.h"
+
+using hal::telegram;
+using hal::TgServerModel;
+
+namespace {
+
+// Two commands in one batch; both only queue notices, so the round is one poll plus one
+// merged sendMessage.
+void pushTwoCommands() {
+  telegram().pushUpdate("/stats");
+  telegram().pushUpdate("/ignore");
+}
+
+}  // namespace
+
+TEST(content_length_keeps_the_connection) {
+  CHECK(bootOnline());
+  pushTwoCommands();
+  CHECK(pollTelegram(millis() + 30000));
+  CHECK_EQ(lastUpdateId, telegram().state().next_update_id - 1);
+  CHECK(pollTelegram(millis() + 30000));
+  CHECK_EQ(telegram().connections(), 1u);
+  CHECK_EQ(telegram().unackedUpdates(), 0);
+}
+
+TEST(chunked_body_in_tiny_chunks_is_parsed_and_reused) {
+  telegram().model().framing = TgServerModel::CHUNKED;
+  telegram().model().chunk_size = 7;
+  CHECK(bootOnline());
+  pushTwoCommands();
+  CHECK(pollTelegram(millis() + 30000));
+  CHECK(logged("Update 700000: /stats"));
+  CHECK(logged("Update 700001: /ignore"));
+  // Every reply went out on the same connection: each chunked body was consumed exactly.
+  CHECK(telegram().count("sendMessage") >= 2);
+  for (const hal::TgRequest& r : telegram().requests()) CHECK_EQ(r.status, 200);
+  CHECK_EQ(telegram().connections(), 1u);
+  CHECK(tgSession.lastResult().ok);
+  CHECK_EQ(tgSession.lastResult().http_status, 200);
+}
+
+TEST(close_delimited_body_ends_at_close_and_reconnects) {
+  telegram().model().framing = TgServerModel::CLOSE_DELIMITED;
+  CHECK(bootOnline());
+  CHECK(telegramSendMessage("one"));
+  CHECK(tgSession.lastResult().ok);
+  CHECK(telegramSendMessage("two"));
+  CHECK_EQ(telegram().connections(), 2u);
+  // Nothing was retried: each request got its complete answer.
+  CHECK_EQ(telegram().count("sendMessage"), 2);
+}
+
+TEST(rate_limit_sets_a_hold_and_queues_messages) {
+  CHECK(bootOnline());
+  telegram().failNext("sendMessage", 429, 7);
+  CHECK(!telegramSendMessage("first"));
+  const TgResult& r = tgSession.lastResult();
+  CHECK_EQ(r.http_status, 429);
+  CHECK_EQ(r.error_code, 429);
+  CHECK_EQ(r.retry_after_s, 7u);
+  CHECK(!r.ok);
+  CHECK_STREQ(r.description, "Too Many Requests: retry after 7");
+  CHECK_EQ(outboxStats.rate_limited, 1u);
+  const uint32_t hold = tgRateLimitRemainingMs();
+  CHECK(hold > 6800 && hold <= 7000);
+
+  // During the hold a message waits in the outbox instead of going out.
+  CHECK(telegramSendMessage("second"));
+  CHECK_EQ(telegram().count("sendMessage"), 1);
+  tgOutboxService();
+  CHECK_EQ(telegram().count("sendMessage"), 1);
+
+  CHECK(tgOutboxFlush(10000));
+  CHECK_EQ(telegram().count("sendMessage"), 2);
+  CHECK_STREQ(telegram().requests().back().param("text"), "second");
+  CHECK(telegram().requests().back().t_received >= 7000000);
+}
+
+TEST(rate_limit_without_retry_after_backs_off) {
+  CHECK(bootOnline());
+  telegram().failNext("sendMessage", 429);
+  CHECK(!telegramSendMessage("x"));
+  CHECK_EQ(tgSession.lastResult().retry_after_s, 0u);
+  const uint32_t first = tgRateLimitRemainingMs();
+  CHECK(first > 0 && first <= 1000);
+  delay(first);
+  // A second 429 in a row doubles the hold; an accepted request resets it.
+  telegram().failNext("sendMessage", 429);
+  CHECK(!telegramSendMessage("x"));
+  const uint32_t second = tgRateLimitRemainingMs();
+  CHECK(second > 1000 && second <= 2000);
+  delay(second);
+  CHECK(telegramSendMessage("x"));
+  telegram().failNext("sendMessage", 429);
+  CHECK(!telegramSendMessage("x"));
+  CHECK(tgRateLimitRemainingMs() <= 1000);
+  CHECK_EQ(outboxStats.rate_limited, 3u);
+}
+
+TEST(api_error_is_typed_and_holds_nothing) {
+  CHECK(bootOnline());
+  telegram().failNext("sendMessage", 400, 0, "Bad Request: message text is empty");
+  CHECK(!telegramSendMessage("x"));
+  const TgResult& r = tgSession.lastResult();
+  CHECK_EQ(r.http_status, 400);
+  CHECK_EQ(r.error_code, 400);
+  CHECK_STREQ(r.description, "Bad Request: message text is empty");
+  CHECK_EQ(tgRateLimitRemainingMs(), 0u);
+  // A complete error response leaves the connection usable.
+  CHECK(telegramSendMessage("y"));
+  CHECK_EQ(telegram().connections(), 1u);
+}
+
+TEST(server_error_is_transient) {
+  CHECK(bootOnline());
+  telegram().failNext("sendMessage", 502);
+  CHECK(!telegramSendMessage("x"));
+  CHECK_EQ(tgSession.lastResult().http_status, 502);
+  CHECK(tgFailureIsTransient(tgSession.lastResult()));
+  telegram().failNext("sendMessage", 400);
+  CHECK(!telegramSendMessage("x"));
+  CHECK(!tgFailureIsTransient(tgSession.lastResult()));
+}
+
+TEST(long_poll_returns_one_round_trip_after_the_update) {
+  CHECK(bootOnline());
+  CHECK(pollTelegram(millis() + 60000));  // first poll: offset set, nothing pending
+  const int64_t sent_at = hal::nowUs() + 3000000;
+  telegram().pushUpdate("/stats", sent_at);
+  const int64_t t0 = hal::nowUs();
+  CHECK(pollTelegram(millis() + 60000));
+  const hal::TgRequest* poll = nullptr;
+  for (const hal::TgRequest& r : telegram().requests()) {
+    if (r.api == "getUpdates") poll = &r;
+  }
+  CHECK(poll && poll->held);
+  if (poll) {
+    // Held at the server, answered half an RTT plus airtime after the update came in.
+    CHECK(poll->t_answered - sent_at >= telegram().model().rtt_ms * 500);
+    CHECK(poll->t_answered - sent_at < telegram().model().rtt_ms * 500 + 5000);
+  }
+  CHECK(hal::nowUs() - t0 < 6000000);
+  CHECK(logged("Update 700000: /stats"));
+}
+
+TEST(reaction_to_a_held_poll_counts_until_the_reply_is_out) {
+  CHECK(bootOnline());
+  CHECK(pollTelegram(millis() + 60000));
+  const int64_t sent_at = hal::nowUs() + 3000000;
+  telegram().pushUpdate("/status", sent_at);
+  CHECK(pollTelegram(millis() + 60000));
+  const hal::TgRequest& reply = telegram().requests().back();
+  CHECK_EQ(reply.api, std::string("sendMessage"));
+  // From the answer that carried the command to the end of the reply's round trip.
+  CHECK(lastReactionLatencyMs >= (reply.t_answered - reply.t_start) / 1000);
+  CHECK(lastReactionLatencyMs <= (reply.t_answered - sent_at) / 1000 + 1);
+  CHECK(logged("first reacted to in"));
+}
+
+TEST(reaction_to_a_waiting_command_includes_the_time_away) {
+  CHECK(bootOnline());
+  CHECK(pollTelegram(millis() + 60000));  // held until its timeout
+  const int64_t back_at = telegram().requests().back().t_answered;
+  telegram().pushUpdate("/status", hal::nowUs() + 1000000);
+  delay(5000);  // busy elsewhere; the command waits at the server
+  CHECK(pollTelegram(millis() + 60000));
+  const hal::TgRequest& reply = telegram().requests().back();
+  CHECK_EQ(reply.api, std::string("sendMessage"));
+  CHECK(lastReactionLatencyMs >= 5000);
+  CHECK(lastReactionLatencyMs <= (reply.t_answered - back_at) / 1000 + 1);
+}
@@ -0,0 +1,206 @@
+// microSD frame journal over a host directory: append, drain, and recovery from writes
+// cut off by a reset at any byte.
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <vector>
+
+using hal::telegram;
+
+namespace {
+
+std::vector<uint8_t> frame(uint32_t seed, size_t len) {
+  std::vector<uint8_t> v(len);
+  for (size_t i = 0; i < len; ++i) v[i] = (uint8_t)((seed * 2654435761u + i * 40503u) >> 11);
+  return v;
+}
+
+bool appendFrame(FrameJournal& j, uint32_t seed, size_t len = 900) {
+  const std::vector<uint8_t> f = frame(seed, len);
+  const std::string caption = "frame " + std::to_string(seed);
+  return j.append(JOURNAL_KIND_PHOTO, seed, caption.c_str(), f.data(), f.size());
+}
+
+// Reads the oldest record and checks it is the frame appended with `seed`.
+bool readsBack(FrameJournal& j, uint32_t seed, size_t len = 900) {
+  JournalRecord rec;
+  char caption[PHOTO_CAPTION_MAX];
+  uint8_t* data = nullptr;
+  if (!j.readNext(&rec, caption, sizeof(caption), &data)) return false;
+  const std::vector<uint8_t> want = frame(seed, len);
+  const bool ok = rec.wake == seed && rec.data_len == len && memcmp(data, want.data(), len) == 0 &&
+                  std::string(caption) == "frame " + std::to_string(seed);
+  free(data);
+  return ok;
+}
+
+long fileSize(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+}  // namespace
+
+TEST(append_read_and_drain) {
+  const std::string dir = hal::makeTempDir();
+  fs::FS card(dir);
+  FrameJournal j(card, "/j");
+  CHECK(j.open());
+  CHECK_EQ(j.pending(), 0u);
+  for (uint32_t s = 1; s <= 3; ++s) CHECK(appendFrame(j, s));
+  CHECK_EQ(j.pending(), 3u);
+  CHECK_EQ(fileSize(dir + "/j.idx"), 3 * 8L);
+  for (uint32_t s = 1; s <= 3; ++s) {
+    CHECK(readsBack(j, s));
+    CHECK(j.advance());
+  }
+  CHECK_EQ(j.pending(), 0u);
+  // Fully drained: the files are gone, nothing grows across wakes.
+  CHECK_EQ(fileSize(dir + "/j.dat"), -1L);
+  CHECK_EQ(fileSize(dir + "/j.idx"), -1L);
+  CHECK_EQ(fileSize(dir + "/j.pos"), -1L);
+}
+
+TEST(cursor_survives_a_reboot) {
+  const std::string dir = hal::makeTempDir();
+  fs::FS card(dir);
+  {
+    FrameJournal j(card, "/j");
+    CHECK(j.open());
+    for (uint32_t s = 1; s <= 3; ++s) CHECK(appendFrame(j, s));
+    CHECK(j.advance());
+  }
+  FrameJournal j(card, "/j");
+  CHECK(j.open());
+  CHECK_EQ(j.pending(), 2u);
+  CHECK(readsBack(j, 2));
+}
+
+TEST(torn_write_at_every_byte_recovers) {
+  // Two committed records, then power fails after `cut` bytes of the third append
+  // (record header, caption, data, then the index entry).
+  const size_t third = 300;
+  const long total = (long)(sizeof(JournalRecord) + strlen("frame 3") + third + 8);
+  int recovered_with_third = 0;
+  for (long cut = 0; cut < total; ++cut) {
+    const std::string dir = hal::makeTempDir();
+    fs::FS card(dir);
+    {
+      FrameJournal j(card, "/j");
+      CHECK(j.open());
+      CHECK(appendFrame(j, 1) && appendFrame(j, 2));
+      hal::sdCutAfter(cut);
+      CHECK(!appendFrame(j, 3, third));
+      hal::sdCutAfter(-1);
+    }
+    FrameJournal j(card, "/j");
+    CHECK(j.open());
+    // The index is the commit point: a cut anywhere before its last byte loses only
+    // the third record, never the two before it.
+    CHECK_EQ(j.pending(), 2u);
+    recovered_with_third += j.pending() == 3;
+    CHECK_EQ(fileSize(dir + "/j.idx") % 8, 0L);
+    // New appends land after the torn bytes and read back intact.
+    CHECK(appendFrame(j, 4));
+    CHECK(readsBack(j, 1) && j.advance());
+    CHECK(readsBack(j, 2) && j.advance());
+    CHECK(readsBack(j, 4) && j.advance());
+    CHECK_EQ(j.pending(), 0u);
+    if (check::failures) {
+      fprintf(stderr, "  at cut %ld of %ld\n", cut, total);
+      return;
+    }
+  }
+  CHECK_EQ(recovered_with_third, 0);
+  CHECK(logged("Repaired index"));
+  CHECK(logged("Ignoring"));
+}
+
+TEST(torn_cursor_resends_instead_of_losing) {
+  const std::string dir = hal::makeTempDir();
+  fs::FS card(dir);
+  {
+    FrameJournal j(card, "/j");
+    CHECK(j.open());
+    for (uint32_t s = 1; s <= 3; ++s) CHECK(appendFrame(j, s));
+    CHECK(j.advance());
+    hal::sdCutAfter(3);
+    j.advance();  // the cursor write is torn
+    hal::sdCutAfter(-1);
+  }
+  FrameJournal j(card, "/j");
+  CHECK(j.open());
+  // The complement check fails, so nothing counts as drained: at-least-once.
+  CHECK_EQ(j.pending(), 3u);
+  CHECK(readsBack(j, 1));
+}
+
+TEST(corrupt_record_is_skipped_by_the_drain) {
+  const std::string dir = hal::makeTempDir();
+  hal::sdSetRoot(dir);
+  journalBegin();
+  CHECK(initCamera());
+  CHECK(journalCapture("one") && journalCapture("two"));
+  CHECK_EQ(journalPending(), 2u);
+  // Flip a data byte of the first record on the card.
+  FILE* f = fopen((dir + JOURNAL_BASE_PATH ".dat").c_str(), "r+b");
+  CHECK(f != nullptr);
+  if (f) {
+    fseek(f, (long)sizeof(JournalRecord) + 3 + 100, SEEK_SET);
+    fputc(0x5A ^ fgetc(f), f);
+    fclose(f);
+  }
+  CHECK(bootOnline());
+  CHECK(journalDrainOne(tgSession));
+  CHECK(logged("Skipped a corrupt record"));
+  CHECK_EQ(telegram().count("sendPhoto"), 0);
+  CHECK(journalDrainOne(tgSession));
+  CHECK_EQ(telegram().count("sendPhoto"), 1);
+  CHECK(strstr(telegram().requests().back().param("caption"), "two") != nullptr);
+  CHECK_EQ(journalPending(), 0u);
+}
+
+TEST(drain_keeps_transient_failures_and_drops_rejections) {
+  hal::sdSetRoot(hal::makeTempDir());
+  journalBegin();
+  CHECK(initCamera());
+  CHECK(journalCapture("a") && journalCapture("b"));
+  CHECK(bootOnline());
+  telegram().failNext("sendPhoto", 502);
+  CHECK(!journalDrainOne(tgSession));
+  CHECK_EQ(journalPending(), 2u);
+  telegram().failNext("sendPhoto", 400, 0, "Bad Request: IMAGE_PROCESS_FAILED");
+  CHECK(journalDrainOne(tgSession));
+  CHECK_EQ(journalPending(), 1u);
+  CHECK(journalDrainOne(tgSession));
+  CHECK_EQ(journalPending(), 0u);
+  CHECK(strstr(telegram().requests().back().param("caption"), "⏪ b") != nullptr);
+}
+
+TEST(no_card_means_no_journal) {
+  journalBegin();
+  CHECK(initCamera());
+  CHECK(!journalCapture("lost"));
+  CHECK(logged("No microSD card"));
+  CHECK_EQ(journalPending(), 0u);
+}
+
+TEST(long_caption_is_drained_whole_and_cut_on_a_character) {
+  hal::sdSetRoot(hal::makeTempDir());
+  journalBegin();
+  CHECK(initCamera());
+  // 36 four-byte characters: longer than a caption may be, and the byte limit falls inside one.
+  std::string caption;
+  for (int i = 0; i < 36; ++i) caption += "🐈";
+  CHECK(journalCapture(caption.c_str()));
+  const uint32_t wake = rtcWakeCount();
+  CHECK(bootOnline());
+  CHECK(journalDrainOne(tgSession));
+  CHECK_EQ(journalPending(), 0u);
+  const hal::TgRequest& sent = telegram().requests().back();
+  CHECK_EQ(sent.status, 200);
+  const std::string kept = caption.substr(0, (PHOTO_CAPTION_MAX - 1) / 4 * 4);
+  const std::string want = "⏪ " + kept + " (wake #" + std::to_string(wake) + ")";
+  CHECK_EQ(std::string(sent.param("caption")), want);
+}
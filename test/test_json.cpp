@@ -0,0 +1,183 @@
+// Streaming JSON: getUpdates, sendPhoto file_id and the error envelope.
+#include "check.h"
+#include "cat_feeder.h"
+
+namespace {
+
+struct Seen {
+  std::vector<TgUpdate> updates;
+};
+
+void collect(const TgUpdate& u, void* ctx) {
+  static_cast<Seen*>(ctx)->updates.push_back(u);
+}
+
+// Feed `body` in pieces of `chunk` bytes, as the socket buffer would hand it over.
+template <typename P>
+void feedChunked(P& parser, const std::string& body, size_t chunk) {
+  for (size_t i = 0; i < body.size(); i += chunk) {
+    parser.feed(body.data() + i, std::min(chunk, body.size() - i));
+  }
+}
+
+const char* kTwoUpdates =
+  "{\"ok\":true,\"result\":["
+  "{\"update_id\":501,\"message\":{\"message_id\":7,\"from\":{\"id\":42,\"is_bot\":false},"
+  "\"chat\":{\"id\":-1001000,\"type\":\"group\"},\"date\":1760000000,\"text\":\"/feed\","
+  "\"entities\":[{\"offset\":0,\"length\":5,\"type\":\"bot_command\"}]}},"
+  "{\"update_id\":502,\"callback_query\":{\"id\":\"99\",\"from\":{\"id\":42},"
+  "\"message\":{\"message_id\":8,\"chat\":{\"id\":-1001000,\"type\":\"group\"},"
+  "\"text\":\"Cat at the bowl\"},\"data\":\"/snap\"}}"
+  "]}";
+
+}  // namespace
+
+TEST(updates_arrive_in_order_with_chat_ids) {
+  Seen seen;
+  TgUpdateParser p(collect, &seen);
+  p.feed(kTwoUpdates, strlen(kTwoUpdates));
+  CHECK(!p.failed());
+  CHECK_EQ(seen.updates.size(), (size_t)2);
+  if (seen.updates.size() != 2) return;
+  CHECK_EQ(seen.updates[0].update_id, 501L);
+  CHECK(!seen.updates[0].is_callback);
+  CHECK_STREQ(seen.updates[0].text, "/feed");
+  CHECK_STREQ(seen.updates[0].chat_id, "-1001000");
+  // The button press carries the chat of the message the keyboard was attached to,
+  // not the text of that message.
+  CHECK_EQ(seen.updates[1].update_id, 502L);
+  CHECK(seen.updates[1].is_callback);
+  CHECK_STREQ(seen.updates[1].text, "/snap");
+  CHECK_STREQ(seen.updates[1].chat_id, "-1001000");
+  CHECK_EQ(p.maxUpdateId, 502L);
+}
+
+TEST(updates_survive_any_split) {
+  for (size_t chunk = 1; chunk <= 17; ++chunk) {
+    Seen seen;
+    TgUpdateParser p(collect, &seen);
+    feedChunked(p, kTwoUpdates, chunk);
+    CHECK(!p.failed());
+    CHECK_EQ(seen.updates.size(), (size_t)2);
+    if (seen.updates.size() == 2) {
+      CHECK_STREQ(seen.updates[0].text, "/feed");
+      CHECK_STREQ(seen.updates[1].text, "/snap");
+    }
+  }
+}
+
+TEST(max_update_id_keeps_the_seeded_offset) {
+  Seen seen;
+  TgUpdateParser p(collect, &seen);
+  p.maxUpdateId = 900;
+  const char* body = "{\"ok\":true,\"result\":[{\"update_id\":17,\"message\":{\"text\":\"x\"}}]}";
+  p.feed(body, strlen(body));
+  CHECK_EQ(seen.updates.size(), (size_t)1);
+  CHECK_EQ(p.maxUpdateId, 900L);
+}
+
+TEST(empty_result_reports_nothing) {
+  Seen seen;
+  TgUpdateParser p(collect, &seen);
+  const char* body = "{\"ok\":true,\"result\":[]}";
+  p.feed(body, strlen(body));
+  CHECK(!p.failed());
+  CHECK(seen.updates.empty());
+  CHECK_EQ(p.maxUpdateId, -1L);
+}
+
+TEST(escapes_and_surrogate_pairs_decode_to_utf8) {
+  Seen seen;
+  TgUpdateParser p(collect, &seen);
+  // "/feed \"2\" 🐱"
+  const char* body =
+    "{\"result\":[{\"update_id\":1,\"message\":{\"chat\":{\"id\":5},"
+    "\"text\":\"/feed \\\"2\\\" \\ud83d\\udc31\"}}]}";
+  p.feed(body, strlen(body));
+  CHECK(!p.failed());
+  CHECK_EQ(seen.updates.size(), (size_t)1);
+  if (!seen.updates.empty()) CHECK_STREQ(seen.updates[0].text, "/feed \"2\" \xF0\x9F\x90\xB1");
+}
+
+TEST(nested_text_does_not_leak_into_the_update) {
+  // A reply carries the original message (with its own text) one level deeper.
+  Seen seen;
+  TgUpdateParser p(collect, &seen);
+  const char* body =
+    "{\"result\":[{\"update_id\":3,\"message\":{\"reply_to_message\":{\"text\":\"/feed\","
+    "\"chat\":{\"id\":666}},\"chat\":{\"id\":5},\"text\":\"hello\"}}]}";
+  p.feed(body, strlen(body));
+  CHECK_EQ(seen.updates.size(), (size_t)1);
+  if (!seen.updates.empty()) {
+    CHECK_STREQ(seen.updates[0].text, "hello");
+    CHECK_STREQ(seen.updates[0].chat_id, "5");
+  }
+}
+
+TEST(malformed_body_fails_without_reporting) {
+  Seen seen;
+  TgUpdateParser p(collect, &seen);
+  const char* body = "{\"result\":[{\"update_id\":3 \"message\":{}}]}";
+  p.feed(body, strlen(body));
+  CHECK(p.failed());
+  CHECK(seen.updates.empty());
+}
+
+TEST(rate_limit_envelope_carries_retry_after) {
+  TgResult r = {};
+  TgResultParser p(&r);
+  const char* body =
+    "{\"ok\":false,\"error_code\":429,\"description\":\"Too Many Requests: retry after 17\","
+    "\"parameters\":{\"retry_after\":17}}";
+  feedChunked(p, body, 5);
+  CHECK(!r.ok);
+  CHECK_EQ(r.error_code, 429);
+  CHECK_EQ(r.retry_after_s, 17u);
+  CHECK_STREQ(r.description, "Too Many Requests: retry after 17");
+}
+
+TEST(ok_envelope_ignores_nested_ok_fields) {
+  TgResult r = {};
+  TgResultParser p(&r);
+  const char* body = "{\"ok\":true,\"result\":{\"ok\":false,\"error_code\":5,\"retry_after\":9}}";
+  p.feed(body, strlen(body));
+  CHECK(r.ok);
+  CHECK_EQ(r.error_code, 0);
+  CHECK_EQ(r.retry_after_s, 0u);
+}
+
+TEST(file_id_takes_the_largest_size) {
+  char id[TG_FILE_ID_MAX];
+  TgFileIdParser p(id, sizeof(id));
+  const char* body =
+    "{\"ok\":true,\"result\":{\"message_id\":9,\"photo\":["
+    "{\"file_id\":\"small\",\"width\":90},{\"file_id\":\"medium\",\"width\":320},"
+    "{\"file_id\":\"AgACAgQAAxkDAAIBlarge\",\"width\":800}],\"caption\":\"x\"}}";
+  id[0] = '\0';
+  feedChunked(p, body, 3);
+  CHECK_STREQ(id, "AgACAgQAAxkDAAIBlarge");
+}
+
+TEST(oversized_file_id_is_visibly_truncated) {
+  // A file_id longer than the scanner's value buffer comes back cut at the buffer size;
+  // telegramSendPhoto() treats a full-length id as untrustworthy and re-uploads instead.
+  std::string longId(200, 'A');
+  for (size_t i = 0; i < longId.size(); ++i) longId[i] = (char)('A' + i % 26);
+  const std::string body =
+    "{\"ok\":true,\"result\":{\"photo\":[{\"file_id\":\"" + longId + "\"}]}}";
+  char id[TG_FILE_ID_MAX];
+  id[0] = '\0';
+  TgFileIdParser p(id, sizeof(id));
+  p.feed(body.data(), body.size());
+  CHECK(!p.failed());
+  CHECK_EQ(strlen(id), sizeof(id) - 1);
+  CHECK(longId.compare(0, strlen(id), id) == 0);
+
+  // One that fits is kept whole and is shorter than the buffer.
+  const std::string fits(100, 'B');
+  const std::string body2 = "{\"result\":{\"photo\":[{\"file_id\":\"" + fits + "\"}]}}";
+  TgFileIdParser p2(id, sizeof(id));
+  p2.feed(body2.data(), body2.size());
+  CHECK_EQ(std::string(id), fits);
+  CHECK(strlen(id) < sizeof(id) - 1);
+}
@@ -0,0 +1,213 @@
+// /live MJPEG server against local HTTP clients: frame rate, latency, slow and stalled viewers.
+#include "fixtures.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Part {
+  long    seq;
+  int64_t captured_us;  // X-Timestamp
+  int64_t arrived_us;   // virtual time the whole part was in
+  size_t  len;
+  bool    intact;       // JPEG markers and trailing CRLF where Content-Length says
+};
+
+struct Viewer {
+  int               fd = -1;
+  std::string       in;
+  bool              head_seen = false;
+  int               status = 0;
+  std::vector<Part> parts;
+};
+
+// A viewer on the device's live port; a small receive buffer makes a slow reader push back.
+Viewer connectViewer(int rcvbuf = 0) {
+  Viewer v;
+  v.fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (rcvbuf) setsockopt(v.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  sockaddr_in a = {};
+  a.sin_family = AF_INET;
+  a.sin_port = htons((uint16_t)(hal::serverPortBase + LIVE_PORT));
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  CHECK(connect(v.fd, (sockaddr*)&a, sizeof(a)) == 0);
+  const char req[] = "GET / HTTP/1.1\r\nHost: feeder\r\n\r\n";
+  CHECK(send(v.fd, req, sizeof(req) - 1, MSG_NOSIGNAL) == (ssize_t)sizeof(req) - 1);
+  return v;
+}
+
+// Takes up to `max` bytes the device has sent and parses every complete part.
+void pump(Viewer& v, size_t max = SIZE_MAX) {
+  char buf[4096];
+  while (max > 0) {
+    const ssize_t n = recv(v.fd, buf, max < sizeof(buf) ? max : sizeof(buf), MSG_DONTWAIT);
+    if (n <= 0) break;
+    v.in.append(buf, (size_t)n);
+    max -= (size_t)n;
+  }
+  if (!v.head_seen) {
+    const size_t end = v.in.find("\r\n\r\n");
+    if (end == std::string::npos) return;
+    v.status = atoi(v.in.c_str() + 9);
+    v.in.erase(0, end + 4);
+    v.head_seen = true;
+  }
+  for (;;) {
+    const size_t end = v.in.find("\r\n\r\n");
+    if (end == std::string::npos) return;
+    const std::string head = v.in.substr(0, end);
+    const size_t cl = head.find("Content-Length: ");
+    const size_t ts = head.find("X-Timestamp: ");
+    const size_t fr = head.find("X-Frame: ");
+    if (head.compare(0, 9, "--cfframe") != 0 || cl == std::string::npos ||
+        ts == std::string::npos || fr == std::string::npos) {
+      CHECK(false);
+      v.in.clear();
+      return;
+    }
+    const size_t len = strtoul(head.c_str() + cl + 16, nullptr, 10);
+    if (v.in.size() < end + 4 + len + 2) return;
+    const char* jpg = v.in.data() + end + 4;
+    Part p;
+    p.seq = atol(head.c_str() + fr + 9);
+    p.captured_us = (int64_t)(atof(head.c_str() + ts + 13) * 1e6 + 0.5);
+    p.arrived_us = hal::nowUs();
+    p.len = len;
+    p.intact = (uint8_t)jpg[0] == 0xFF && (uint8_t)jpg[1] == 0xD8 &&
+               (uint8_t)jpg[len - 2] == 0xFF && (uint8_t)jpg[len - 1] == 0xD9 &&
+               jpg[len] == '\r' && jpg[len + 1] == '\n';
+    v.parts.push_back(p);
+    v.in.erase(0, end + 4 + len + 2);
+  }
+}
+
+bool peerClosed(const Viewer& v) {
+  char c;
+  return recv(v.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+double fps(const Viewer& v) {
+  if (v.parts.size() < 2) return 0;
+  return (v.parts.size() - 1) * 1e6 / (v.parts.back().arrived_us - v.parts.front().arrived_us);
+}
+
+}  // namespace
+
+TEST(fast_viewer_gets_the_frame_rate_cap_with_low_latency) {
+  CHECK(initCamera());
+  CHECK(liveStart());
+  Viewer v = connectViewer();
+  for (int t = 0; t < 3000; t += 5) {
+    delay(5);
+    pump(v);
+  }
+  CHECK_EQ(v.status, 200);
+  CHECK(v.parts.size() >= 28);
+  const double rate = fps(v);
+  CHECK(rate > 9.5 && rate < 10.5);
+  int64_t worst = 0;
+  for (size_t i = 0; i < v.parts.size(); ++i) {
+    CHECK(v.parts[i].intact);
+    CHECK_EQ(v.parts[i].seq, (long)i + 1);  // nothing skipped
+    worst = std::max(worst, v.parts[i].arrived_us - v.parts[i].captured_us);
+  }
+  // X-Timestamp is the esp_timer capture time, so the difference is end-to-end latency.
+  CHECK(worst >= 0 && worst < 60000);
+  check::report("fast viewer", rate, "fps");
+  check::report("fast viewer, worst capture-to-client", worst / 1000.0, "ms");
+  liveStop();
+  CHECK_EQ(hal::framesOut(), 0);
+  close(v.fd);
+}
+
+TEST(slow_viewer_skips_frames_without_stalling_the_server) {
+  CHECK(initCamera());
+  CHECK(liveStart());
+  // ~30 kB/s, slower than one frame per 100 ms.
+  Viewer slow = connectViewer(4096);
+  Viewer other = connectViewer();
+  for (int t = 0; t < 4000; t += 10) {
+    delay(10);
+    pump(slow, 300);
+    pump(other);
+  }
+  CHECK(slow.parts.size() >= 2);
+  long gaps = 0;
+  for (size_t i = 0; i < slow.parts.size(); ++i) {
+    CHECK(slow.parts[i].intact);
+    if (i) gaps += slow.parts[i].seq - slow.parts[i - 1].seq - 1;
+  }
+  // Frames were skipped, not queued: X-Frame jumps instead of the stream falling behind.
+  CHECK(gaps > 0);
+  CHECK_EQ(slow.parts.back().seq - slow.parts.front().seq + 1, (long)slow.parts.size() + gaps);
+  // The other viewer is not held to the slow one's pace.
+  for (const Part& p : other.parts) CHECK(p.intact);
+  CHECK(fps(other) > 9.0);
+  check::report("slow viewer", fps(slow), "fps");
+  check::report("other viewer meanwhile", fps(other), "fps");
+
+  // While both viewers are busy the server still answers a third one at once.
+  Viewer third = connectViewer();
+  const int64_t t0 = hal::nowUs();
+  while (!third.head_seen && hal::nowUs() - t0 < 1000000) {
+    delay(5);
+    pump(third);
+    pump(slow, 300);
+  }
+  CHECK_EQ(third.status, 503);
+  CHECK(hal::nowUs() - t0 < 100000);
+  liveStop();
+  CHECK_EQ(hal::framesOut(), 0);
+  close(slow.fd);
+  close(other.fd);
+  close(third.fd);
+}
+
+TEST(stalled_viewer_is_dropped_and_the_other_speeds_up) {
+  CHECK(initCamera());
+  CHECK(liveStart());
+  Viewer stuck = connectViewer(4096);
+  Viewer v = connectViewer();
+  const int64_t t0 = hal::nowUs();
+  for (int t = 0; t < 9000; t += 5) {
+    delay(5);
+    pump(v);  // `stuck` never reads
+  }
+  CHECK(logged("[LIVE] Viewer stalled"));
+  pump(stuck);
+  CHECK(peerClosed(stuck));
+  // The stuck viewer never held the other one back.
+  CHECK(fps(v) > 9.5);
+  CHECK_EQ(v.parts.back().seq - v.parts.front().seq + 1, (long)v.parts.size());
+  CHECK(hal::nowUs() - t0 >= LIVE_STALL_MS * 1000LL);
+  liveStop();
+  CHECK_EQ(hal::framesOut(), 0);
+  close(stuck.fd);
+  close(v.fd);
+}
+
+TEST(stop_closes_viewers_and_the_port) {
+  CHECK(initCamera());
+  CHECK(liveStart());
+  CHECK(liveActive());
+  Viewer v = connectViewer();
+  delay(500);
+  pump(v);
+  CHECK(!v.parts.empty());
+  liveStop();
+  CHECK(!liveActive());
+  pump(v);
+  CHECK(peerClosed(v));
+  CHECK_EQ(hal::framesOut(), 0);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in a = {};
+  a.sin_family = AF_INET;
+  a.sin_port = htons((uint16_t)(hal::serverPortBase + LIVE_PORT));
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  CHECK(connect(fd, (sockaddr*)&a, sizeof(a)) != 0);
+  close(fd);
+  close(v.fd);
+}
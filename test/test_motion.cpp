@@ -0,0 +1,110 @@
+// PIR verifier: block means, changed-block counting, background learning across wakes.
+#include "fixtures.h"
+
+#include <vector>
+
+namespace {
+
+const uint16_t kCells = MOTION_GRID_W * MOTION_GRID_H;
+
+// One PIR wake as setup() runs it: RTC state, camera, warm-up, verify, and the RTC save
+// enterDeepSleep() does.
+bool pirWake() {
+  rtcStateRestore();
+  CHECK(initCamera());
+  warmUpCamera();
+  const bool motion = verifyMotion();
+  esp_camera_deinit();
+  rtcStateSave();
+  return motion;
+}
+
+}  // namespace
+
+TEST(block_means_cover_planes_wider_than_the_lookup) {
+  // 200 px wide (UXGA at 1/8): left half black, right half white.
+  const int w = 200, h = 24;
+  std::vector<uint8_t> plane(w * h);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) plane[y * w + x] = x < w / 2 ? 0 : 255;
+  }
+  uint8_t grid[kCells];
+  lumaBlockMeans(plane.data(), w, h, grid);
+  for (int by = 0; by < MOTION_GRID_H; ++by) {
+    CHECK_EQ(grid[by * MOTION_GRID_W], 0);
+    CHECK_EQ(grid[by * MOTION_GRID_W + MOTION_GRID_W / 2 - 1], 0);
+    CHECK_EQ(grid[by * MOTION_GRID_W + MOTION_GRID_W / 2], 255);
+    CHECK_EQ(grid[by * MOTION_GRID_W + MOTION_GRID_W - 1], 255);
+  }
+}
+
+TEST(block_means_average_uneven_blocks_exactly) {
+  // 100 columns over 16 blocks: spans of 6 and 7; each block is a ramp of its own columns.
+  const int w = 100, h = 75;
+  std::vector<uint8_t> plane(w * h);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) plane[y * w + x] = (uint8_t)(x * 2);
+  }
+  uint8_t grid[kCells];
+  lumaBlockMeans(plane.data(), w, h, grid);
+  for (int b = 0; b < MOTION_GRID_W; ++b) {
+    int sum = 0, n = 0;
+    for (int x = 0; x < w; ++x) {
+      if (x * MOTION_GRID_W / w == b) { sum += x * 2; ++n; }
+    }
+    CHECK_EQ(grid[b], sum / n);
+    CHECK_EQ(grid[(MOTION_GRID_H - 1) * MOTION_GRID_W + b], sum / n);
+  }
+}
+
+TEST(global_brightness_shift_is_not_a_change) {
+  uint8_t a[kCells], b[kCells];
+  for (uint16_t i = 0; i < kCells; ++i) {
+    a[i] = (uint8_t)(60 + i % 50);
+    b[i] = (uint8_t)(a[i] + 40);
+  }
+  CHECK_EQ(countChangedBlocks(a, b, kCells, MOTION_BLOCK_THRESHOLD), 0);
+  b[5] = (uint8_t)(a[5] + 40 + MOTION_BLOCK_THRESHOLD + 2);
+  b[6] = (uint8_t)(a[6] + 40 - MOTION_BLOCK_THRESHOLD - 2);
+  CHECK_EQ(countChangedBlocks(a, b, kCells, MOTION_BLOCK_THRESHOLD), 2);
+}
+
+TEST(heat_draft_is_rejected_and_a_cat_is_not) {
+  CHECK(pirWake());   // first wake learns the background
+  CHECK(logged("no background yet"));
+  CHECK(!pirWake());  // same empty scene
+  CHECK(logged("false alarm"));
+  hal::scene().light = 150;  // lights on: a global shift only
+  CHECK(!pirWake());
+  hal::scene().cat = true;
+  CHECK(pirWake());
+}
+
+TEST(moving_cat_is_motion_even_against_its_own_background) {
+  hal::scene().cat = true;
+  CHECK(pirWake());
+  hal::scene().cat_step = 6;
+  CHECK(pirWake());
+}
+
+TEST(moved_bowl_becomes_the_background_after_a_few_wakes) {
+  CHECK(pirWake());
+  // Something big and still now sits in the frame and stays there.
+  hal::scene().cat = true;
+  for (int i = 0; i < MOTION_BG_RELEARN_WAKES; ++i) CHECK(pirWake());
+  CHECK(logged("background relearned"));
+  // From here on the PIR firing at that scene is a false alarm again.
+  CHECK(!pirWake());
+  CHECK(!pirWake());
+}
+
+TEST(a_moving_wake_restarts_the_relearn_count) {
+  CHECK(pirWake());
+  hal::scene().cat = true;
+  for (int i = 0; i < MOTION_BG_RELEARN_WAKES - 1; ++i) CHECK(pirWake());
+  hal::scene().cat_step = 6;
+  CHECK(pirWake());  // moving: not a still scene
+  hal::scene().cat_step = 0;
+  for (int i = 0; i < MOTION_BG_RELEARN_WAKES - 1; ++i) CHECK(pirWake());
+  CHECK(!logged("background relearned"));
+}
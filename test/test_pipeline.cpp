@@ -0,0 +1,93 @@
+// Capture -> upload pipeline: bounded queue, backpressure, drop counter, overlap with polling.
+#include "fixtures.h"
+
+using hal::telegram;
+
+namespace {
+
+bool bootWithPipeline() {
+  return initCamera() && bootOnline() && startPhotoPipeline();
+}
+
+}  // namespace
+
+TEST(queue_full_drops_and_returns_the_buffer) {
+  // A slow uplink keeps the first photo on the air while the rest arrive.
+  telegram().model().uplink_kbps = 100;
+  CHECK(bootWithPipeline());
+  int accepted = 0;
+  for (int i = 0; i < PHOTO_QUEUE_DEPTH + 3; ++i) accepted += takeAndSendPhoto("q") ? 1 : 0;
+  // One job is with the uploader, PHOTO_QUEUE_DEPTH wait, the rest are dropped.
+  CHECK_EQ(accepted, PHOTO_QUEUE_DEPTH + 1);
+  CHECK_EQ(photoStats.dropped, 2u);
+  CHECK_EQ(photoStats.max_depth, (uint32_t)PHOTO_QUEUE_DEPTH);
+  CHECK(logged("Upload queue full, frame dropped (2 so far)"));
+  // Dropped frames went straight back to the driver; only queued ones are still held.
+  CHECK_EQ(hal::framesOut(), PHOTO_QUEUE_DEPTH + 1);
+
+  CHECK(drainPhotoPipeline(120000));
+  CHECK_EQ(photoStats.uploaded, (uint32_t)accepted);
+  CHECK_EQ(photoStats.failed, 0u);
+  CHECK_EQ(telegram().count("sendPhoto"), accepted);
+  CHECK_EQ(hal::framesOut(), 0);
+}
+
+TEST(enqueue_never_blocks_the_caller) {
+  telegram().model().uplink_kbps = 100;
+  CHECK(bootWithPipeline());
+  CHECK(takeAndSendPhoto("first"));
+  const int64_t t0 = hal::nowUs();
+  CHECK(takeAndSendPhoto("second"));
+  // Capture only: one frame period or two, nowhere near the seconds the upload takes.
+  CHECK(hal::nowUs() - t0 < 200000);
+  CHECK(drainPhotoPipeline(120000));
+}
+
+TEST(polling_continues_while_a_photo_uploads) {
+  telegram().model().uplink_kbps = 100;
+  CHECK(bootWithPipeline());
+  CHECK(takeAndSendPhoto("slow"));
+  const int64_t t_queued = hal::nowUs();
+  telegram().pushUpdate("/stats", t_queued + 500000);
+  CHECK(pollTelegram(millis() + 30000));
+  CHECK(logged("Update 700000: /stats"));
+  // The command was answered before the photo finished going out.
+  CHECK_EQ(photoStats.uploaded, 0u);
+  const hal::TgRequest* stats_reply = nullptr;
+  for (const hal::TgRequest& r : telegram().requests()) {
+    if (r.api == "sendMessage") stats_reply = &r;
+  }
+  CHECK(stats_reply != nullptr);
+  CHECK(drainPhotoPipeline(120000));
+  CHECK_EQ(photoStats.uploaded, 1u);
+  if (stats_reply) {
+    for (const hal::TgRequest& r : telegram().requests()) {
+      if (r.api == "sendPhoto") CHECK(stats_reply->t_answered < r.t_answered);
+    }
+  }
+}
+
+TEST(failed_upload_is_counted_and_frees_the_buffer) {
+  CHECK(bootWithPipeline());
+  telegram().failNext("sendPhoto", 400, 0, "Bad Request: IMAGE_PROCESS_FAILED");
+  CHECK(takeAndSendPhoto("bad"));
+  CHECK(takeAndSendPhoto("good"));
+  CHECK(drainPhotoPipeline(30000));
+  CHECK_EQ(photoStats.queued, 2u);
+  CHECK_EQ(photoStats.failed, 1u);
+  CHECK_EQ(photoStats.uploaded, 1u);
+  CHECK_EQ(hal::framesOut(), 0);
+}
+
+TEST(without_the_task_uploads_run_inline) {
+  hal::setTasksEnabled(false);
+  CHECK(initCamera() && bootOnline());
+  CHECK(!startPhotoPipeline());
+  CHECK(takeAndSendPhoto("inline"));
+  // Returned only after the server answered.
+  CHECK_EQ(telegram().count("sendPhoto"), 1);
+  CHECK_EQ(telegram().requests().back().status, 200);
+  CHECK_EQ(photoStats.queued, 0u);
+  CHECK_EQ(hal::framesOut(), 0);
+  CHECK(drainPhotoPipeline(0));
+}
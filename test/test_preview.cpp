@@ -0,0 +1,171 @@
+// Progressive snap: the preview and the held full frame ride the upload pipeline (fan-out
+// accounting, journal on failure), time to first image is traced, and the fallback sends
+// the frame already captured.
+#include "fixtures.h"
+
+#include <string>
+
+using hal::TgRequest;
+using hal::telegram;
+
+namespace {
+
+bool bootWithPipeline() {
+  return initCamera() && bootOnline() && startPhotoPipeline();
+}
+
+std::vector<const TgRequest*> photos() {
+  std::vector<const TgRequest*> out;
+  for (const TgRequest& r : telegram().requests()) {
+    if (r.api == "sendPhoto") out.push_back(&r);
+  }
+  return out;
+}
+
+std::string lastMessage() {
+  std::string text;
+  for (const TgRequest& r : telegram().requests()) {
+    if (r.api == "sendMessage") text = r.param("text");
+  }
+  return text;
+}
+
+// The callback data of a preview's "Full resolution" button.
+std::string fullButton(const TgRequest* r) {
+  const char* at = strstr(r->param("reply_markup"), "cf:full:");
+  return at ? std::string(at, strcspn(at, "\"")) : std::string();
+}
+
+uint32_t buttonSeq(const TgRequest* r) {
+  return (uint32_t)strtoul(fullButton(r).c_str() + strlen("cf:full:"), nullptr, 10);
+}
+
+std::string traceSummary() {
+  char buf[1024];
+  traceFormatSummary(buf, sizeof(buf));
+  return buf;
+}
+
+}  // namespace
+
+TEST(preview_goes_out_on_the_upload_task) {
+  telegram().model().uplink_kbps = 100;
+  CHECK(bootWithPipeline());
+  const int64_t t0 = hal::nowUs();
+  CHECK(takeAndSendPreview("look"));
+  // Capture and downscale only; the upload is the uploader's.
+  CHECK(hal::nowUs() - t0 < 300000);
+  CHECK_EQ(photoStats.queued, 1u);
+  telegram().pushUpdate("/stats", hal::nowUs() + 100000);
+  CHECK(pollTelegram(millis() + 30000));
+  CHECK(drainPhotoPipeline(60000));
+
+  const std::vector<const TgRequest*> sent = photos();
+  CHECK_EQ(sent.size(), 1u);
+  if (sent.empty()) return;
+  CHECK(!fullButton(sent[0]).empty());
+  // Through telegramSendPhoto(): counted like every other photo for CHAT_ID.
+  CHECK_EQ(recipientStats(0).ok, 1u);
+  CHECK_EQ(previewStats.previews, 1u);
+  CHECK_EQ(std::to_string(previewStats.preview_bytes), std::string(sent[0]->param("photo#bytes")));
+  // Time to first image: request to the preview's answer, and it lands in the trace.
+  const uint32_t ttfi_ms = (uint32_t)((sent[0]->t_answered - t0) / 1000);
+  CHECK(previewStats.last_ttfi_ms + 5 >= ttfi_ms && previewStats.last_ttfi_ms <= ttfi_ms + 5);
+  CHECK(traceSummary().find("image n1 ") != std::string::npos);
+}
+
+TEST(full_frame_follows_on_request) {
+  CHECK(bootWithPipeline());
+  CHECK(takeAndSendPreview("look"));
+  CHECK(drainPhotoPipeline(60000));
+  const uint32_t seq = buttonSeq(photos()[0]);
+  CHECK(sendHeldFullFrame(seq));
+  CHECK(!sendHeldFullFrame(seq));  // handed to the uploader, nothing held any more
+  CHECK(drainPhotoPipeline(60000));
+
+  const std::vector<const TgRequest*> sent = photos();
+  CHECK_EQ(sent.size(), 2u);
+  if (sent.size() != 2) return;
+  const long preview = std::stol(sent[0]->param("photo#bytes"));
+  const long full = std::stol(sent[1]->param("photo#bytes"));
+  CHECK(full > 2 * preview);
+  CHECK_EQ(std::string(sent[1]->param("reply_markup")), std::string(""));
+  CHECK_EQ(std::string(sent[1]->param("caption")), std::string("look"));
+  CHECK_EQ(previewStats.full_sent, 1u);
+  CHECK_EQ(previewStats.bytes_saved, (int32_t)-preview);
+  CHECK(traceSummary().find("image n1 ") != std::string::npos);  // the full frame is not a first image
+}
+
+TEST(older_preview_button_has_expired) {
+  CHECK(bootWithPipeline());
+  CHECK(takeAndSendPreview("first"));
+  CHECK(drainPhotoPipeline(60000));
+  CHECK(takeAndSendPreview("second"));
+  CHECK(drainPhotoPipeline(60000));
+  const std::string first = fullButton(photos()[0]);
+  const std::string second = fullButton(photos()[1]);
+  CHECK(!first.empty() && first != second);
+
+  telegram().pushUpdate(first.c_str(), -1, true);
+  CHECK(pollTelegram(millis() + 5000));
+  CHECK(drainPhotoPipeline(60000));
+  CHECK_EQ(photos().size(), 2u);  // not the second preview's full frame
+  CHECK(lastMessage().find("That preview has expired") != std::string::npos);
+  CHECK_EQ(previewStats.full_sent, 0u);
+
+  telegram().pushUpdate(second.c_str(), -1, true);
+  CHECK(pollTelegram(millis() + 5000));
+  CHECK(drainPhotoPipeline(60000));
+  CHECK_EQ(photos().size(), 3u);
+  if (photos().size() != 3) return;
+  CHECK_EQ(std::string(photos()[2]->param("caption")), std::string("second"));
+  CHECK_EQ(previewStats.full_sent, 1u);
+}
+
+TEST(unrequested_full_frame_counts_as_saved) {
+  CHECK(bootWithPipeline());
+  CHECK(takeAndSendPreview("look"));
+  CHECK(drainPhotoPipeline(60000));
+  previewRelease();
+  const long preview = std::stol(photos()[0]->param("photo#bytes"));
+  CHECK(previewStats.bytes_saved > 2 * preview);
+  CHECK(logged("Full frame never asked for"));
+}
+
+TEST(failed_preview_is_journaled_and_saves_nothing) {
+  hal::sdSetRoot(hal::makeTempDir());
+  journalBegin();
+  CHECK(bootWithPipeline());
+  journalSetDrainEnabled(false);
+  telegram().failNext("sendPhoto", 502);
+  CHECK(takeAndSendPreview("look"));
+  CHECK(drainPhotoPipeline(60000));
+  CHECK_EQ(photoStats.failed, 1u);
+  CHECK_EQ(previewStats.previews, 0u);
+  CHECK_EQ(journalPending(), 1u);
+  previewRelease();
+  CHECK(logged("Preview never arrived"));
+  CHECK_EQ(previewStats.bytes_saved, 0);
+}
+
+TEST(frame_without_a_smaller_preview_is_sent_as_captured) {
+  // A link this weak puts the ladder on QVGA, already narrower than a preview.
+  hal::radio().rssi = -92;
+  telegram().model().uplink_kbps = 16;
+  CHECK(bootWithPipeline());
+  const uint32_t captured = hal::framesCaptured();
+  CHECK(takeAndSendPhoto("plain"));
+  const uint32_t per_photo = hal::framesCaptured() - captured;
+  CHECK(drainPhotoPipeline(60000));
+
+  const uint32_t before = hal::framesCaptured();
+  CHECK(takeAndSendPreview("look"));
+  CHECK(logged("sending it as is"));
+  // No second capture: the frame in hand went out.
+  CHECK_EQ(hal::framesCaptured() - before, per_photo);
+  CHECK(drainPhotoPipeline(60000));
+  CHECK_EQ(photos().size(), 2u);
+  CHECK_EQ(std::string(photos()[1]->param("reply_markup")), std::string(""));
+  CHECK_EQ(previewStats.previews, 0u);
+  CHECK(traceSummary().find("image n2 ") != std::string::npos);
+}
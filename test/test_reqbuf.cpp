@@ -0,0 +1,94 @@
+// Fixed-buffer request building: URL encoding, integer formatting and sticky overflow.
+#include "check.h"
+#include "cat_feeder.h"
+
+#include <limits.h>
+
+namespace {
+
+// RFC 3986 by the letter, to check the bit table against.
+std::string referenceEncode(const std::string& s) {
+  std::string out;
+  for (unsigned char c : s) {
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+      out += (char)c;
+    } else {
+      char hex[4];
+      snprintf(hex, sizeof(hex), "%%%02X", c);
+      out += hex;
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+TEST(url_encoding_matches_rfc3986_for_every_byte) {
+  for (int c = 1; c < 256; ++c) {
+    const char s[2] = { (char)c, '\0' };
+    char buf[8];
+    ReqBuf req(buf, sizeof(buf));
+    req.addUrlEncoded(s);
+    const std::string want = referenceEncode(s);
+    CHECK_EQ(std::string(req.c_str()), want);
+    CHECK_EQ(urlEncodedLength(s), want.size());
+  }
+}
+
+TEST(url_encoding_of_a_caption) {
+  char buf[128];
+  ReqBuf req(buf, sizeof(buf));
+  req.add("text=").addUrlEncoded("Cat at the bowl 🐱 (wake #3) & more");
+  CHECK_STREQ(req.c_str(),
+              "text=Cat%20at%20the%20bowl%20%F0%9F%90%B1%20%28wake%20%233%29%20%26%20more");
+  CHECK_EQ(req.length(), strlen(req.c_str()));
+  CHECK(!req.overflow());
+}
+
+TEST(integers_format_at_their_limits) {
+  char buf[64];
+  ReqBuf req(buf, sizeof(buf));
+  req.addUInt(0).add(" ").addUInt(ULONG_MAX).add(" ").addInt(-1).add(" ").addInt(LONG_MIN);
+  char want[64];
+  snprintf(want, sizeof(want), "0 %lu -1 %ld", ULONG_MAX, LONG_MIN);
+  CHECK_STREQ(req.c_str(), want);
+}
+
+TEST(last_byte_is_kept_for_the_terminator) {
+  char buf[8];
+  ReqBuf req(buf, sizeof(buf));
+  req.add("1234567");
+  CHECK(!req.overflow());
+  CHECK_EQ(req.length(), (size_t)7);
+  req.add("8");
+  CHECK(req.overflow());
+  CHECK_STREQ(req.c_str(), "1234567");
+}
+
+TEST(overflow_is_sticky_and_leaves_the_prefix_intact) {
+  char buf[16];
+  ReqBuf req(buf, sizeof(buf));
+  req.add("GET /x?t=").addUrlEncoded("a b c d");  // needs 13 more bytes: does not fit
+  CHECK(req.overflow());
+  CHECK_STREQ(req.c_str(), "GET /x?t=");
+  req.add("y");  // would fit, but the request is already broken
+  CHECK(req.overflow());
+  CHECK_STREQ(req.c_str(), "GET /x?t=");
+  req.clear();
+  CHECK(!req.overflow());
+  CHECK_EQ(req.length(), (size_t)0);
+}
+
+TEST(building_a_request_stays_off_the_heap) {
+  char buf[TG_REQ_BUF_SIZE];
+  const uint64_t before = check::allocations();
+  ReqBuf req(buf, sizeof(buf));
+  req.add("GET /bot" BOT_TOKEN "/sendMessage?chat_id=").addUrlEncoded(CHAT_ID)
+     .add("&text=").addUrlEncoded("Feeding done ✅ (2 portions)")
+     .add("&reply_markup=").addUrlEncoded("{\"inline_keyboard\":[[{\"text\":\"Snap\","
+                                          "\"callback_data\":\"/snap\"}]]}")
+     .add(" HTTP/1.1\r\nHost: " TELEGRAM_HOST "\r\nContent-Length: ").addUInt(0)
+     .add("\r\n\r\n");
+  CHECK_EQ(check::allocations() - before, (uint64_t)0);
+  CHECK(!req.overflow());
+}
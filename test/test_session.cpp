@@ -0,0 +1,135 @@
+// Keep-alive TLS session against the stand-in server: reuse, resumption, reconnects.
+#include "fixtures.h"
+
+using hal::telegram;
+
+TEST(keepalive_sends_many_requests_over_one_handshake) {
+  CHECK(bootOnline());
+  for (int i = 0; i < 5; ++i) CHECK(telegramSendMessage("hello"));
+  CHECK_EQ(telegram().connections(), 1u);
+  CHECK_EQ(telegram().fullHandshakes(), 1u);
+  CHECK_EQ(telegram().count("sendMessage"), 5);
+  CHECK_EQ(tgSession.handshakes(), 1u);
+  CHECK_EQ(tgSession.requests(), 5u);
+  CHECK(tgSession.reuseRatio() > 0.79f && tgSession.reuseRatio() < 0.81f);
+  CHECK_STREQ(telegram().requests()[4].param("text"), "hello");
+  CHECK_STREQ(telegram().requests()[4].param("chat_id"), CHAT_ID);
+}
+
+TEST(reused_request_costs_one_round_trip) {
+  CHECK(bootOnline());
+  CHECK(telegramSendMessage("first"));
+  const int64_t t0 = hal::nowUs();
+  CHECK(telegramSendMessage("second"));
+  const int64_t took_ms = (hal::nowUs() - t0) / 1000;
+  const hal::TgServerModel& m = telegram().model();
+  // RTT + server time + airtime of ~250 bytes each way; no connect, no handshake.
+  CHECK(took_ms >= (int64_t)(m.rtt_ms + m.process_ms));
+  CHECK(took_ms < (int64_t)(m.rtt_ms + m.process_ms + 20));
+}
+
+TEST(idle_close_reconnects_with_a_resumed_handshake) {
+  telegram().model().idle_close_ms = 2000;
+  CHECK(bootOnline());
+  CHECK(telegramSendMessage("before"));
+  delay(5000);
+  CHECK_EQ(telegram().openConnections(), 0);
+  CHECK(telegramSendMessage("after"));
+  CHECK_EQ(telegram().connections(), 2u);
+  CHECK_EQ(telegram().fullHandshakes(), 1u);
+  CHECK_EQ(telegram().resumedHandshakes(), 1u);
+  CHECK_EQ(tgSession.handshakes(), 2u);
+  // TlsClient times TCP connect plus handshake.
+  CHECK_EQ(tgSession.lastHandshakeMs(),
+           telegram().model().rtt_ms + telegram().model().resumed_handshake_ms);
+  CHECK(logged("(resumed)"));
+}
+
+TEST(reset_on_a_reused_connection_is_retried_once) {
+  CHECK(bootOnline());
+  CHECK(telegramSendMessage("one"));
+  telegram().resetNext("sendMessage");
+  CHECK(telegramSendMessage("two"));
+  CHECK(logged("Kept-alive connection dropped, reconnecting"));
+  CHECK_EQ(telegram().connections(), 2u);
+  CHECK_EQ(telegram().count("sendMessage"), 3);
+  CHECK_EQ(telegram().requests()[1].status, 0);    // the reset one
+  CHECK_EQ(telegram().requests()[2].status, 200);  // the retry
+  CHECK_EQ(telegram().resumedHandshakes(), 1u);
+}
+
+TEST(reset_on_a_fresh_connection_is_not_retried) {
+  CHECK(bootOnline());
+  telegram().resetNext("sendMessage");
+  CHECK(!telegramSendMessage("lost"));
+  CHECK_EQ(telegram().connections(), 1u);
+  CHECK_EQ(telegram().count("sendMessage"), 1);
+}
+
+TEST(drop_between_requests_is_noticed_before_sending) {
+  CHECK(bootOnline());
+  CHECK(telegramSendMessage("one"));
+  telegram().dropConnections();
+  CHECK(telegramSendMessage("two"));
+  // connected() saw the close, so nothing was sent into the dead socket.
+  CHECK(!logged("Kept-alive connection dropped"));
+  CHECK_EQ(telegram().count("sendMessage"), 2);
+  CHECK_EQ(telegram().connections(), 2u);
+}
+
+TEST(second_session_resumes_the_first_sessions_ticket) {
+  CHECK(bootOnline());
+  CHECK(telegramSendMessage("loop"));
+  char buf[256];
+  ReqBuf req(buf, sizeof(buf));
+  req.add("GET /bot" BOT_TOKEN "/getMe HTTP/1.1\r\nHost: " TELEGRAM_HOST "\r\n\r\n");
+  tgUploadSession.request(req);
+  CHECK_EQ(telegram().connections(), 2u);
+  CHECK_EQ(telegram().fullHandshakes(), 1u);
+  CHECK_EQ(telegram().resumedHandshakes(), 1u);
+}
+
+TEST(server_refusing_resumption_costs_full_handshakes) {
+  telegram().model().resumption = false;
+  CHECK(bootOnline());
+  CHECK(telegramSendMessage("one"));
+  telegram().dropConnections();
+  CHECK(telegramSendMessage("two"));
+  CHECK_EQ(telegram().fullHandshakes(), 2u);
+  CHECK_EQ(telegram().resumedHandshakes(), 0u);
+  CHECK_EQ(tgSession.lastHandshakeMs(),
+           telegram().model().rtt_ms + telegram().model().full_handshake_ms);
+}
+
+TEST(unreachable_server_fails_without_hanging) {
+  telegram().model().up = false;
+  CHECK(bootOnline());
+  const int64_t t0 = hal::nowUs();
+  CHECK(!telegramSendMessage("void"));
+  CHECK(hal::nowUs() - t0 < 15 * 1000000LL);
+  CHECK_EQ(telegram().connections(), 0u);
+}
+
+TEST(server_state_survives_save_and_restore) {
+  CHECK(bootOnline());
+  CHECK(telegramSendMessage("before the sleep"));
+  telegram().pushUpdate("/status");
+  telegram().pushUpdate("cf:full:1", -1, true);
+  telegram().failNext("sendMessage", 502);
+  const hal::TgServerState before = telegram().state();
+  const std::string saved = telegram().save();
+
+  telegram().restore(hal::TelegramServer().save());
+  CHECK_EQ(telegram().pendingUpdates(), 0);
+  CHECK(telegram().state().sessions.empty());
+
+  telegram().restore(saved);
+  CHECK_EQ(telegram().pendingUpdates(), 2);
+  CHECK_EQ(telegram().state().next_update_id, before.next_update_id);
+  CHECK_EQ(telegram().state().next_message_id, before.next_message_id);
+  CHECK(telegram().state().sessions == before.sessions);
+  CHECK(!telegramSendMessage("armed fault"));
+  CHECK(pollTelegram(millis() + 5000));
+  CHECK(logged("Update 700000: /status"));
+  CHECK(logged("Update 700001: cf:full:1"));
+}
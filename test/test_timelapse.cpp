@@ -0,0 +1,148 @@
+// Timelapse batches: albums from the SD journal, what happens to frames Telegram or the
+// card cannot deliver, and the journal lock while an album is on the wire.
+#include "fixtures.h"
+
+#include <stdio.h>
+#include <string>
+
+using hal::TgRequest;
+using hal::telegram;
+
+namespace {
+
+std::string s_dir;
+
+// Card, camera and lock ready; `frames` timelapse frames waiting.
+bool captured(int frames) {
+  s_dir = hal::makeTempDir();
+  hal::sdSetRoot(s_dir);
+  journalBegin();
+  if (!initCamera()) return false;
+  for (int i = 0; i < frames; ++i) {
+    if (timelapseCapture() != i + 1) return false;
+  }
+  return true;
+}
+
+// Flip a data byte of the k-th record on the card, found through the index.
+bool corrupt(uint32_t k) {
+  FILE* idx = fopen((s_dir + TIMELAPSE_BASE_PATH ".idx").c_str(), "rb");
+  uint32_t offset = 0;
+  const bool found = idx && fseek(idx, (long)k * 8, SEEK_SET) == 0 &&
+                     fread(&offset, sizeof(offset), 1, idx) == 1;
+  if (idx) fclose(idx);
+  FILE* dat = fopen((s_dir + TIMELAPSE_BASE_PATH ".dat").c_str(), "r+b");
+  if (!found || !dat) {
+    if (dat) fclose(dat);
+    return false;
+  }
+  fseek(dat, (long)(offset + sizeof(JournalRecord) + 100), SEEK_SET);
+  const int c = fgetc(dat);
+  fseek(dat, -1, SEEK_CUR);
+  fputc(0x5A ^ c, dat);
+  fclose(dat);
+  return true;
+}
+
+bool cardEmpty() {
+  FILE* f = fopen((s_dir + TIMELAPSE_BASE_PATH ".idx").c_str(), "rb");
+  if (f) fclose(f);
+  return f == nullptr;
+}
+
+int64_t s_savedAt = -1;
+
+void saveDuringAlbum(void*) {
+  hal::waitUntil([] { return telegram().count("sendMediaGroup") > 0; }, hal::kForever);
+  static const uint8_t jpg[600] = { 0xFF, 0xD8 };
+  if (journalFrame(jpg, sizeof(jpg), "during the album")) s_savedAt = hal::nowUs();
+  vTaskDelete(nullptr);
+}
+
+}  // namespace
+
+TEST(batch_goes_out_as_albums_of_ten) {
+  CHECK(captured(12));
+  CHECK(bootOnline());
+  CHECK(timelapseUpload(tgSession));
+  CHECK_EQ(telegram().count("sendMediaGroup"), 2);
+  CHECK_EQ(telegram().count("sendPhoto"), 0);
+  const TgRequest& first = telegram().requests()[telegram().requests().size() - 2];
+  CHECK(first.params.count("p9#bytes") == 1 && first.params.count("p10#bytes") == 0);
+  CHECK(strstr(first.param("media"), "Timelapse, 10 frames") != nullptr);
+  CHECK(telegram().requests().back().params.count("p1#bytes") == 1);
+  CHECK(logged("12 frames in 2 album(s), 0 dropped"));
+  CHECK(cardEmpty());
+}
+
+TEST(unreadable_frames_are_skipped) {
+  CHECK(captured(5));
+  CHECK(corrupt(0) && corrupt(2));
+  CHECK(bootOnline());
+  CHECK(timelapseUpload(tgSession));
+  // 0 is dropped up front; 2 ends the first album, which leaves 1 on its own.
+  CHECK_EQ(telegram().count("sendPhoto"), 1);
+  CHECK_EQ(telegram().count("sendMediaGroup"), 1);
+  CHECK_EQ(telegram().requests().back().params.count("p1#bytes"), 1u);
+  CHECK_EQ(telegram().requests().back().params.count("p2#bytes"), 0u);
+  CHECK(logged("Skipped a corrupt frame"));
+  CHECK(logged("3 frames in 1 album(s), 2 dropped"));
+  CHECK(cardEmpty());
+}
+
+TEST(rejected_album_is_split_into_photos) {
+  CHECK(captured(3));
+  CHECK(bootOnline());
+  telegram().failNext("sendMediaGroup", 400, 0, "Bad Request: IMAGE_PROCESS_FAILED");
+  telegram().failNext("sendPhoto", 400, 0, "Bad Request: IMAGE_PROCESS_FAILED");
+  CHECK(timelapseUpload(tgSession));
+  CHECK_EQ(telegram().count("sendMediaGroup"), 1);
+  CHECK_EQ(telegram().count("sendPhoto"), 3);
+  int delivered = 0;
+  for (const TgRequest& r : telegram().requests()) {
+    if (r.api == "sendPhoto" && r.status == 200) delivered++;
+  }
+  CHECK_EQ(delivered, 2);
+  CHECK(logged("Album rejected (HTTP 400)"));
+  CHECK(logged("Frame rejected, dropped"));
+  CHECK(cardEmpty());
+}
+
+TEST(transient_failure_keeps_every_frame) {
+  CHECK(captured(3));
+  CHECK(bootOnline());
+  telegram().failNext("sendMediaGroup", 502);
+  CHECK(!timelapseUpload(tgSession));
+  CHECK_EQ(telegram().count("sendPhoto"), 0);
+  CHECK(logged("stopped on error"));
+  CHECK(!cardEmpty());
+  CHECK(timelapseUpload(tgSession));
+  CHECK_EQ(telegram().count("sendMediaGroup"), 2);
+  CHECK_EQ(telegram().requests().back().status, 200);
+  CHECK(telegram().requests().back().params.count("p2#bytes") == 1);
+  CHECK(cardEmpty());
+}
+
+TEST(backlog_stops_growing_at_the_cap) {
+  CHECK(captured(TIMELAPSE_MAX_PENDING));
+  // Still reports what is waiting, so the wake goes on to upload instead of sleeping.
+  CHECK_EQ(timelapseCapture(), TIMELAPSE_MAX_PENDING);
+  CHECK(logged("not stored, backlog full"));
+  CHECK(bootOnline());
+  CHECK(timelapseUpload(tgSession));
+  CHECK_EQ(telegram().count("sendMediaGroup"), (TIMELAPSE_MAX_PENDING + 9) / 10);
+  CHECK_EQ(timelapseCapture(), 1);
+}
+
+TEST(journal_stays_usable_during_an_album) {
+  CHECK(captured(6));
+  CHECK(bootOnline());
+  CHECK(xTaskCreatePinnedToCore(saveDuringAlbum, "saver", 4096, nullptr, 1, nullptr, 0) == pdPASS);
+  CHECK(timelapseUpload(tgSession));
+  const TgRequest& album = telegram().requests().back();
+  CHECK_EQ(album.api, std::string("sendMediaGroup"));
+  // The other frame went on the card while the album was still being answered.
+  CHECK(s_savedAt > 0);
+  CHECK(s_savedAt < album.t_answered);
+  CHECK_EQ(journalPending(), 1u);
+}